@@ -20,7 +20,9 @@ public class AstroEngineer : ModuleRules
 		});
 
 		PrivateDependencyModuleNames.AddRange(new string[] { 
-			"AIModule"
+			"AIModule",
+			"PhysicsCore",
+			"RenderCore"
 		});
 	}
 }
@@ -0,0 +1,288 @@
+// Copyright Astro Engineer Team. All Rights Reserved.
+
+#include "AstroConnectionSnapIndex.h"
+#include "AstroEngineer.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+#include "Math/RandomStream.h"
+
+DECLARE_CYCLE_STAT(TEXT("Connection Snap Query"), STAT_AstroConnectionSnapQuery, STATGROUP_AstroEngineer);
+
+namespace AstroConnectionSnapIndex
+{
+	/** The lookup before the index existed: every free point of every module */
+	static bool FindNearestByScan(TArrayView<AAstroShipModule* const> Modules, TArrayView<const FTransform> ModuleTransforms,
+		const FVector& Location, EShipModuleType ModuleType, float MaxDistance, const AAstroShipModule*& OutModule, int32& OutConnectionIndex)
+	{
+		OutModule = nullptr;
+		OutConnectionIndex = INDEX_NONE;
+		double BestDistanceSquared = FMath::Square(static_cast<double>(MaxDistance));
+		for (int32 ModuleIndex = 0; ModuleIndex < Modules.Num(); ++ModuleIndex)
+		{
+			const FTransform& ModuleTransform = ModuleTransforms[ModuleIndex];
+			Modules[ModuleIndex]->ForEachFreeConnectionPoint([&](int32 ConnectionIndex, const FModuleConnectionPoint& ConnectionPoint)
+			{
+				if (ConnectionPoint.AcceptedModuleType != ModuleType && ConnectionPoint.AcceptedModuleType != EShipModuleType::Hull)
+					return;
+
+				const double DistanceSquared = FVector::DistSquared(Location, ModuleTransform.TransformPosition(ConnectionPoint.RelativeLocation));
+				if (DistanceSquared <= BestDistanceSquared)
+				{
+					BestDistanceSquared = DistanceSquared;
+					OutModule = Modules[ModuleIndex];
+					OutConnectionIndex = ConnectionIndex;
+				}
+			});
+		}
+		return OutModule != nullptr;
+	}
+
+	static void RunBenchmark(const TArray<FString>& Args, UWorld* World)
+	{
+		if (!World)
+			return;
+
+		const int32 NumModules = Args.Num() > 0 ? FMath::Max(1, FCString::Atoi(*Args[0])) : 5000;
+		const int32 NumQueries = Args.Num() > 1 ? FMath::Max(1, FCString::Atoi(*Args[1])) : 10000;
+		constexpr float CellSize = 200.0f;
+		constexpr double ModuleSpacing = 400.0;
+
+		// A cubic station of modules 4 m apart, each with a port on every face
+		FRandomStream Random(0x0A57);
+		const int32 Side = FMath::CeilToInt32(FMath::Pow(double(NumModules), 1.0 / 3.0));
+		const FVector Faces[] = { FVector::ForwardVector, FVector::BackwardVector, FVector::RightVector, FVector::LeftVector, FVector::UpVector, FVector::DownVector };
+		TArray<AAstroShipModule*> Modules;
+		TArray<FTransform> ModuleTransforms;
+		Modules.Reserve(NumModules);
+		ModuleTransforms.Reserve(NumModules);
+		for (int32 Index = 0; Index < NumModules; ++Index)
+		{
+			AAstroShipModule* Module = World->SpawnActorDeferred<AAstroShipModule>(AAstroShipModule::StaticClass(), FTransform::Identity);
+			if (!Module)
+				continue;
+
+			for (const FVector& Face : Faces)
+			{
+				FModuleConnectionPoint& ConnectionPoint = Module->ConnectionPoints.AddDefaulted_GetRef();
+				ConnectionPoint.RelativeLocation = Face * (ModuleSpacing * 0.5);
+				ConnectionPoint.AcceptedModuleType = static_cast<EShipModuleType>(Random.RandHelper(int32(EShipModuleType::Hull) + 1));
+				ConnectionPoint.bIsOccupied = Random.GetFraction() < 0.5f;
+			}
+			Module->FinishSpawning(FTransform::Identity);
+			Modules.Add(Module);
+			ModuleTransforms.Add(FTransform(FVector(double(Index % Side), double((Index / Side) % Side), double(Index / (Side * Side))) * ModuleSpacing));
+		}
+
+		FAstroConnectionSnapIndex SnapIndex;
+		SnapIndex.Reset(CellSize);
+		double StartTime = FPlatformTime::Seconds();
+		for (int32 ModuleIndex = 0; ModuleIndex < Modules.Num(); ++ModuleIndex)
+		{
+			SnapIndex.UpdateModule(Modules[ModuleIndex], ModuleTransforms[ModuleIndex]);
+		}
+		const double BuildSeconds = FPlatformTime::Seconds() - StartTime;
+
+		TArray<FVector> Locations;
+		TArray<EShipModuleType> Types;
+		for (int32 Query = 0; Query < NumQueries; ++Query)
+		{
+			Locations.Add(FVector(Random.GetFraction(), Random.GetFraction(), Random.GetFraction()) * (Side * ModuleSpacing));
+			Types.Add(static_cast<EShipModuleType>(Random.RandHelper(int32(EShipModuleType::Hull))));
+		}
+
+		UE_LOG(LogAstroEngineer, Display, TEXT("Snap benchmark: %d modules, %d free points, index built in %.3f ms"),
+			Modules.Num(), SnapIndex.NumPoints(), BuildSeconds * 1000.0);
+
+		// Hand-placement range, a wide drag, and a radius covering far more cells than the station occupies
+		for (const float MaxDistance : { 300.0f, 2000.0f, 1.0e7f })
+		{
+			const AAstroShipModule* FoundModule = nullptr;
+			int32 FoundConnection = INDEX_NONE;
+			int32 NumMismatches = 0;
+
+			StartTime = FPlatformTime::Seconds();
+			for (int32 Query = 0; Query < NumQueries; ++Query)
+			{
+				SnapIndex.FindNearest(Locations[Query], Types[Query], MaxDistance, FoundModule, FoundConnection);
+			}
+			const double IndexSeconds = FPlatformTime::Seconds() - StartTime;
+
+			// Fewer scan queries; a full scan per query is the slow path being compared against
+			const int32 NumScanQueries = FMath::Max(1, NumQueries / 10);
+			StartTime = FPlatformTime::Seconds();
+			for (int32 Query = 0; Query < NumScanQueries; ++Query)
+			{
+				FindNearestByScan(Modules, ModuleTransforms, Locations[Query], Types[Query], MaxDistance, FoundModule, FoundConnection);
+			}
+			const double ScanSeconds = FPlatformTime::Seconds() - StartTime;
+
+			for (int32 Query = 0; Query < NumScanQueries; ++Query)
+			{
+				const AAstroShipModule* IndexModule = nullptr;
+				const AAstroShipModule* ScanModule = nullptr;
+				int32 IndexConnection = INDEX_NONE;
+				int32 ScanConnection = INDEX_NONE;
+				SnapIndex.FindNearest(Locations[Query], Types[Query], MaxDistance, IndexModule, IndexConnection);
+				FindNearestByScan(Modules, ModuleTransforms, Locations[Query], Types[Query], MaxDistance, ScanModule, ScanConnection);
+				NumMismatches += (IndexModule != ScanModule || IndexConnection != ScanConnection) ? 1 : 0;
+			}
+
+			UE_LOG(LogAstroEngineer, Display, TEXT("Snap benchmark radius %.0f: index %.3f us per query, scan %.3f us per query, %d of %d answers differ (ties may pick a different point)"),
+				MaxDistance, IndexSeconds * 1.0e6 / NumQueries, ScanSeconds * 1.0e6 / NumScanQueries, NumMismatches, NumScanQueries);
+		}
+
+		for (AAstroShipModule* Module : Modules)
+		{
+			Module->Destroy();
+		}
+	}
+
+	static FAutoConsoleCommandWithWorldAndArgs BenchmarkCommand(
+		TEXT("astro.Ship.SnapBenchmark"),
+		TEXT("Time snap queries on a generated station against scanning every connection point. Usage: astro.Ship.SnapBenchmark [NumModules=5000] [NumQueries=10000]"),
+		FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&RunBenchmark));
+}
+
+void FAstroConnectionSnapIndex::Reset(float InCellSize)
+{
+	CellSize = FMath::Max(InCellSize, 1.0f);
+	Points.Reset();
+	Cells.Reset();
+	ModulePoints.Reset();
+}
+
+void FAstroConnectionSnapIndex::UpdateModule(const AAstroShipModule* Module, const FTransform& ModuleToAssembly)
+{
+	RemoveModule(Module);
+
+	TArray<int32, TInlineAllocator<4>> NewPoints;
+	Module->ForEachFreeConnectionPoint([this, Module, &ModuleToAssembly, &NewPoints](int32 ConnectionIndex, const FModuleConnectionPoint& ConnectionPoint)
+	{
+		FSnapPoint Point;
+		Point.Module = Module;
+		Point.ConnectionIndex = ConnectionIndex;
+		Point.Location = ModuleToAssembly.TransformPosition(ConnectionPoint.RelativeLocation);
+		Point.AcceptedModuleType = ConnectionPoint.AcceptedModuleType;
+		Point.Cell = GetCell(Point.Location);
+
+		const int32 PointIndex = Points.Add(Point);
+		Cells.FindOrAdd(Point.Cell).Add(PointIndex);
+		NewPoints.Add(PointIndex);
+	});
+
+	if (NewPoints.Num() > 0)
+	{
+		ModulePoints.Add(Module, MoveTemp(NewPoints));
+	}
+}
+
+void FAstroConnectionSnapIndex::RemoveModule(const AAstroShipModule* Module)
+{
+	TArray<int32, TInlineAllocator<4>> Removed;
+	if (!ModulePoints.RemoveAndCopyValue(Module, Removed))
+		return;
+
+	// Highest first, so swap-removal never moves a point that is still queued for removal
+	Removed.Sort(TGreater<int32>());
+	for (int32 PointIndex : Removed)
+	{
+		RemovePoint(PointIndex);
+	}
+}
+
+void FAstroConnectionSnapIndex::RemovePoint(int32 PointIndex)
+{
+	const FSnapPoint& Point = Points[PointIndex];
+	TArray<int32, TInlineAllocator<4>>& CellPoints = Cells.FindChecked(Point.Cell);
+	CellPoints.RemoveSingleSwap(PointIndex, EAllowShrinking::No);
+	if (CellPoints.Num() == 0)
+	{
+		Cells.Remove(Point.Cell);
+	}
+
+	// Move the last point into the hole and repoint its references
+	const int32 LastIndex = Points.Num() - 1;
+	if (PointIndex != LastIndex)
+	{
+		const FSnapPoint& Moved = Points[LastIndex];
+		TArray<int32, TInlineAllocator<4>>& MovedCell = Cells.FindChecked(Moved.Cell);
+		MovedCell[MovedCell.Find(LastIndex)] = PointIndex;
+		if (TArray<int32, TInlineAllocator<4>>* Owned = ModulePoints.Find(Moved.Module))
+		{
+			(*Owned)[Owned->Find(LastIndex)] = PointIndex;
+		}
+	}
+	Points.RemoveAtSwap(PointIndex, EAllowShrinking::No);
+}
+
+bool FAstroConnectionSnapIndex::FindNearest(const FVector& Location, EShipModuleType ModuleType, float MaxDistance,
+	const AAstroShipModule*& OutModule, int32& OutConnectionIndex) const
+{
+	SCOPE_CYCLE_COUNTER(STAT_AstroConnectionSnapQuery);
+
+	OutModule = nullptr;
+	OutConnectionIndex = INDEX_NONE;
+
+	double BestDistanceSquared = FMath::Square(static_cast<double>(MaxDistance));
+	const FIntVector MinCell = GetCell(Location - FVector(MaxDistance));
+	const FIntVector MaxCell = GetCell(Location + FVector(MaxDistance));
+
+	auto VisitCell = [this, &Location, ModuleType, &BestDistanceSquared, &OutModule, &OutConnectionIndex](const TArray<int32, TInlineAllocator<4>>& CellPoints)
+	{
+		for (int32 PointIndex : CellPoints)
+		{
+			const FSnapPoint& Point = Points[PointIndex];
+			if (Point.AcceptedModuleType != ModuleType && Point.AcceptedModuleType != EShipModuleType::Hull)
+				continue;
+
+			const double DistanceSquared = FVector::DistSquared(Location, Point.Location);
+			if (DistanceSquared <= BestDistanceSquared)
+			{
+				BestDistanceSquared = DistanceSquared;
+				OutModule = Point.Module;
+				OutConnectionIndex = Point.ConnectionIndex;
+			}
+		}
+	};
+
+	// A radius spanning more cells than are occupied walks the occupied cells instead, so the cost never exceeds one pass over the ship
+	const double NumCellsInRange = (double(MaxCell.X) - MinCell.X + 1.0) * (double(MaxCell.Y) - MinCell.Y + 1.0) * (double(MaxCell.Z) - MinCell.Z + 1.0);
+	if (NumCellsInRange > Cells.Num())
+	{
+		for (const TPair<FIntVector, TArray<int32, TInlineAllocator<4>>>& Cell : Cells)
+		{
+			if (Cell.Key.X >= MinCell.X && Cell.Key.X <= MaxCell.X && Cell.Key.Y >= MinCell.Y && Cell.Key.Y <= MaxCell.Y
+				&& Cell.Key.Z >= MinCell.Z && Cell.Key.Z <= MaxCell.Z)
+			{
+				VisitCell(Cell.Value);
+			}
+		}
+		return OutModule != nullptr;
+	}
+
+	for (int32 X = MinCell.X; X <= MaxCell.X; ++X)
+	{
+		for (int32 Y = MinCell.Y; Y <= MaxCell.Y; ++Y)
+		{
+			for (int32 Z = MinCell.Z; Z <= MaxCell.Z; ++Z)
+			{
+				if (const TArray<int32, TInlineAllocator<4>>* CellPoints = Cells.Find(FIntVector(X, Y, Z)))
+				{
+					VisitCell(*CellPoints);
+				}
+			}
+		}
+	}
+
+	return OutModule != nullptr;
+}
+
+FIntVector FAstroConnectionSnapIndex::GetCell(const FVector& Location) const
+{
+	// Clamped so a huge query radius cannot overflow the cell coordinates
+	auto ToCell = [this](double Coordinate)
+	{
+		return static_cast<int32>(FMath::Clamp(FMath::FloorToDouble(Coordinate / CellSize), double(MIN_int32 / 2), double(MAX_int32 / 2)));
+	};
+	return FIntVector(ToCell(Location.X), ToCell(Location.Y), ToCell(Location.Z));
+}
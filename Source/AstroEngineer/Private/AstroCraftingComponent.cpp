@@ -2,179 +2,858 @@
 
 #include "AstroCraftingComponent.h"
 #include "AstroInventoryComponent.h"
+#include "AstroEngineer.h"
+#include "AstroJobScheduler.h"
+#include "AstroProgressionSaveGame.h"
+#include "HAL/IConsoleManager.h"
+#include "Math/RandomStream.h"
+
+namespace AstroCraftingComponent
+{
+	/** Heap blocks a by-value copy of Recipes makes: the array, plus the storage of each non-empty ingredient map. Copied FText shares its string. */
+	static int32 CountCopyAllocations(const TArray<FCraftingRecipe>& Recipes)
+	{
+		int32 NumAllocations = Recipes.Num() > 0 ? 1 : 0;
+		for (const FCraftingRecipe& Recipe : Recipes)
+		{
+			NumAllocations += Recipe.RequiredItems.Num() > 0 ? 1 : 0;
+		}
+		return NumAllocations;
+	}
+
+	/** Poll the available recipe list once per frame the way a widget does, through each accessor, and log time and allocations per poll */
+	static void RunViewBenchmark(const TArray<FString>& Args)
+	{
+		const int32 NumRecipes = Args.Num() > 0 ? FMath::Max(1, FCString::Atoi(*Args[0])) : 1000;
+		const int32 NumFrames = Args.Num() > 1 ? FMath::Max(1, FCString::Atoi(*Args[1])) : 600;
+
+		// Half the recipes unlocked, each taking three of 200 items
+		UAstroCraftingComponent* Crafting = NewObject<UAstroCraftingComponent>();
+		FRandomStream Random(0x0A57);
+		Crafting->CraftingRecipes.SetNum(NumRecipes);
+		for (int32 Index = 0; Index < NumRecipes; ++Index)
+		{
+			FCraftingRecipe& Recipe = Crafting->CraftingRecipes[Index];
+			Recipe.RecipeID = FName(*FString::Printf(TEXT("BenchmarkRecipe_%d"), Index));
+			Recipe.RecipeName = FText::FromName(Recipe.RecipeID);
+			Recipe.ResultItemID = FName(*FString::Printf(TEXT("BenchmarkItem_%d"), Random.RandHelper(200)));
+			Recipe.bUnlockedAtStart = Index % 2 == 0;
+			for (int32 Ingredient = 0; Ingredient < 3; ++Ingredient)
+			{
+				Recipe.RequiredItems.Add(FName(*FString::Printf(TEXT("BenchmarkItem_%d"), Random.RandHelper(200))), 1 + Random.RandHelper(5));
+			}
+		}
+		Crafting->NotifyRecipesChanged();
+
+		// Before the cache, every poll filtered the recipe list into a new array
+		int64 NumFilterAllocations = 0;
+		double Start = FPlatformTime::Seconds();
+		for (int32 Frame = 0; Frame < NumFrames; ++Frame)
+		{
+			TArray<FCraftingRecipe> Filtered;
+			for (const FCraftingRecipe& Recipe : Crafting->CraftingRecipes)
+			{
+				if (Crafting->IsRecipeUnlocked(Recipe.RecipeID))
+				{
+					Filtered.Add(Recipe);
+				}
+			}
+			NumFilterAllocations += CountCopyAllocations(Filtered);
+		}
+		const double FilterSeconds = FPlatformTime::Seconds() - Start;
+
+		int64 NumCopyAllocations = 0;
+		Start = FPlatformTime::Seconds();
+		for (int32 Frame = 0; Frame < NumFrames; ++Frame)
+		{
+			const TArray<FCraftingRecipe> Copy = Crafting->GetAvailableRecipes();
+			NumCopyAllocations += CountCopyAllocations(Copy);
+		}
+		const double CopySeconds = FPlatformTime::Seconds() - Start;
+
+		int64 NumVisible = 0;
+		Start = FPlatformTime::Seconds();
+		for (int32 Frame = 0; Frame < NumFrames; ++Frame)
+		{
+			NumVisible += Crafting->GetAvailableRecipesRef().Num();
+		}
+		const double RefSeconds = FPlatformTime::Seconds() - Start;
+
+		UE_LOG(LogAstroEngineer, Display, TEXT("Recipe view benchmark: %d of %d recipes available, per poll: filtering %.3f ms and %lld+ allocations, cached copy (Blueprint) %.3f ms and %lld allocations, const ref (C++) %.4f ms and none"),
+			NumVisible / NumFrames, NumRecipes, FilterSeconds * 1000.0 / NumFrames, NumFilterAllocations / NumFrames, CopySeconds * 1000.0 / NumFrames,
+			NumCopyAllocations / NumFrames, RefSeconds * 1000.0 / NumFrames);
+
+		Crafting->MarkAsGarbage();
+	}
+
+	/**
+	 * Change one item at a time in a full inventory and time the incremental craftability update each change triggers,
+	 * against rechecking every recipe the way a crafting menu refresh did before the cache
+	 */
+	static void RunCraftabilityBenchmark(const TArray<FString>& Args)
+	{
+		const int32 NumRecipes = Args.Num() > 0 ? FMath::Max(1, FCString::Atoi(*Args[0])) : 5000;
+		const int32 NumSlots = Args.Num() > 1 ? FMath::Max(1, FCString::Atoi(*Args[1])) : 400;
+		const int32 NumChanges = Args.Num() > 2 ? FMath::Max(2, FCString::Atoi(*Args[2])) : 2000;
+
+		// One stack per item, half full, so single-unit changes never need a new slot
+		UAstroInventoryComponent* Inventory = NewObject<UAstroInventoryComponent>();
+		Inventory->MaxInventorySlots = NumSlots;
+		TArray<FName> ItemIDs;
+		TMap<FName, int32> Contents;
+		for (int32 Index = 0; Index < NumSlots; ++Index)
+		{
+			ItemIDs.Add(FName(*FString::Printf(TEXT("BenchmarkItem_%d"), Index)));
+			Contents.Add(ItemIDs.Last(), FInventoryItem().MaxStackSize / 2);
+		}
+		Inventory->ApplyInventoryDelta(Contents);
+
+		UAstroCraftingComponent* Crafting = NewObject<UAstroCraftingComponent>();
+		FRandomStream Random(0x0A57);
+		Crafting->CraftingRecipes.SetNum(NumRecipes);
+		for (int32 Index = 0; Index < NumRecipes; ++Index)
+		{
+			FCraftingRecipe& Recipe = Crafting->CraftingRecipes[Index];
+			Recipe.RecipeID = FName(*FString::Printf(TEXT("BenchmarkRecipe_%d"), Index));
+			Recipe.ResultItemID = ItemIDs[Random.RandHelper(ItemIDs.Num())];
+			Recipe.bUnlockedAtStart = true;
+			const int32 NumIngredients = 2 + Random.RandHelper(3);
+			for (int32 Ingredient = 0; Ingredient < NumIngredients; ++Ingredient)
+			{
+				Recipe.RequiredItems.Add(ItemIDs[Random.RandHelper(ItemIDs.Num())], 1 + Random.RandHelper(30));
+			}
+		}
+		Crafting->NotifyRecipesChanged();
+		Crafting->SetInventory(Inventory);
+
+		// Take one unit of an item, then give it back, so the inventory stays the same size throughout
+		double IncrementalSeconds = 0.0;
+		double WorstIncrementalSeconds = 0.0;
+		int64 NumRecipesTouched = 0;
+		for (int32 Change = 0; Change < NumChanges; ++Change)
+		{
+			const FName ItemID = ItemIDs[Random.RandHelper(ItemIDs.Num())];
+			const double Start = FPlatformTime::Seconds();
+			Inventory->RemoveItem(ItemID);
+			const double Seconds = FPlatformTime::Seconds() - Start;
+			Inventory->AddItem(ItemID);
+
+			IncrementalSeconds += Seconds;
+			WorstIncrementalSeconds = FMath::Max(WorstIncrementalSeconds, Seconds);
+			const int32 ItemIndex = Crafting->GetRecipeDatabase().FindItemIndex(ItemID);
+			NumRecipesTouched += ItemIndex != INDEX_NONE ? Crafting->GetRecipeDatabase().GetRecipesUsingItem(ItemIndex).Num() : 0;
+		}
+
+		const int32 NumRescans = FMath::Max(NumChanges / 20, 1);
+		int32 NumCraftable = 0;
+		const double RescanStart = FPlatformTime::Seconds();
+		for (int32 Rescan = 0; Rescan < NumRescans; ++Rescan)
+		{
+			NumCraftable = 0;
+			for (const FCraftingRecipe& Recipe : Crafting->CraftingRecipes)
+			{
+				NumCraftable += Crafting->CanCraftRecipe(Recipe.RecipeID) ? 1 : 0;
+			}
+		}
+		const double RescanSeconds = FPlatformTime::Seconds() - RescanStart;
+
+		UE_LOG(LogAstroEngineer, Display, TEXT("Craftability benchmark: %d recipes, %d slots, %d craftable (cache %s). Per change: inventory update with incremental recheck %.2f us (worst %.2f us) covering %.1f recipes, full recheck %.2f us"),
+			NumRecipes, Inventory->GetInventoryItemsView().Num(), NumCraftable, Crafting->GetCraftableRecipeIDs().Num() == NumCraftable ? TEXT("agrees") : TEXT("DISAGREES"),
+			IncrementalSeconds * 1.0e6 / NumChanges, WorstIncrementalSeconds * 1.0e6, double(NumRecipesTouched) / NumChanges, RescanSeconds * 1.0e6 / NumRescans);
+
+		Crafting->SetInventory(nullptr);
+		Crafting->MarkAsGarbage();
+		Inventory->MarkAsGarbage();
+	}
+
+	static FAutoConsoleCommand CraftabilityBenchmarkCommand(
+		TEXT("astro.Crafting.CraftabilityBenchmark"),
+		TEXT("Time incremental craftability updates per inventory change. Usage: astro.Crafting.CraftabilityBenchmark [NumRecipes=5000] [NumSlots=400] [NumChanges=2000]"),
+		FConsoleCommandWithArgsDelegate::CreateStatic(&RunCraftabilityBenchmark));
+
+	static FAutoConsoleCommand ViewBenchmarkCommand(
+		TEXT("astro.Crafting.ViewBenchmark"),
+		TEXT("Compare per-frame polling of available recipes by filtering, cached copy and const ref. Usage: astro.Crafting.ViewBenchmark [NumRecipes=1000] [NumFrames=600]"),
+		FConsoleCommandWithArgsDelegate::CreateStatic(&RunViewBenchmark));
+}
 
 UAstroCraftingComponent::UAstroCraftingComponent()
 {
-	PrimaryComponentTick.bCanEverTick = true;
+	// Crafting is driven by a completion timer, so the component never ticks
+	PrimaryComponentTick.bCanEverTick = false;
+	NumFabricators = 1;
 	bIsCrafting = false;
-	CraftingProgress = 0.0f;
-	CraftingTimer = 0.0f;
-	CurrentCraftingTime = 0.0f;
+	NextJobID = 0;
+	bAvailableRecipesDirty = true;
 }
 
 void UAstroCraftingComponent::BeginPlay()
 {
 	Super::BeginPlay();
-	
+
+	RebuildRecipeDatabase();
+
 	// Get reference to player inventory
 	AActor* Owner = GetOwner();
-	if (Owner)
+	SetInventory(Owner ? Owner->FindComponentByClass<UAstroInventoryComponent>() : nullptr);
+}
+
+void UAstroCraftingComponent::SetInventory(UAstroInventoryComponent* NewInventory)
+{
+	if (PlayerInventory)
+	{
+		PlayerInventory->OnInventorySlotsChanged.RemoveDynamic(this, &UAstroCraftingComponent::HandleInventorySlotsChanged);
+	}
+
+	PlayerInventory = NewInventory;
+	if (PlayerInventory)
 	{
-		PlayerInventory = Owner->FindComponentByClass<UAstroInventoryComponent>();
+		PlayerInventory->OnInventorySlotsChanged.AddDynamic(this, &UAstroCraftingComponent::HandleInventorySlotsChanged);
 	}
+	RefreshCraftability();
 }
 
-void UAstroCraftingComponent::TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
+bool UAstroCraftingComponent::CanCraftRecipe(FName RecipeID) const
 {
-	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
+	if (RecipeID.IsNone())
+		return false;
+
+	return CanCraftRecipeIndex(RecipeDatabase.FindRecipeIndex(RecipeID));
+}
 
-	if (bIsCrafting && CurrentCraftingTime > 0.0f)
+bool UAstroCraftingComponent::CanCraftRecipeIndex(int32 RecipeIndex) const
+{
+	if (!PlayerInventory || !UnlockedRecipes.IsValidIndex(RecipeIndex))
+		return false;
+
+	if (!UnlockedRecipes[RecipeIndex])
+		return false;
+
+	// Check if player has all required items
+	const TArrayView<const int32> Items = RecipeDatabase.GetIngredientItems(RecipeIndex);
+	const TArrayView<const int32> Counts = RecipeDatabase.GetIngredientCounts(RecipeIndex);
+	for (int32 i = 0; i < Items.Num(); ++i)
 	{
-		CraftingTimer += DeltaTime;
-		CraftingProgress = FMath::Clamp(CraftingTimer / CurrentCraftingTime, 0.0f, 1.0f);
+		if (!PlayerInventory->HasItem(RecipeDatabase.GetItemName(Items[i]), Counts[i]))
+			return false;
+	}
+
+	return true;
+}
 
-		if (CraftingTimer >= CurrentCraftingTime)
+void UAstroCraftingComponent::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	if (UAstroJobScheduler* Scheduler = GetJobScheduler())
+	{
+		for (FCraftingJob& Job : CraftingJobs)
 		{
-			CompleteCrafting();
+			Scheduler->CancelJob(Job.CompletionHandle);
 		}
 	}
+
+	Super::EndPlay(EndPlayReason);
 }
 
-bool UAstroCraftingComponent::CanCraftRecipe(FName RecipeID) const
+int32 UAstroCraftingComponent::ComputeMaxCraftableCount(int32 RecipeIndex) const
 {
-	if (!PlayerInventory || RecipeID.IsNone())
-		return false;
+	if (!PlayerInventory || !UnlockedRecipes[RecipeIndex])
+		return 0;
 
-	// Find the recipe
-	const FCraftingRecipe* Recipe = nullptr;
-	for (const FCraftingRecipe& R : CraftingRecipes)
+	int32 MaxCount = MAX_int32;
+	const TArrayView<const int32> Items = RecipeDatabase.GetIngredientItems(RecipeIndex);
+	const TArrayView<const int32> Counts = RecipeDatabase.GetIngredientCounts(RecipeIndex);
+	for (int32 i = 0; i < Items.Num() && MaxCount > 0; ++i)
 	{
-		if (R.RecipeID == RecipeID)
+		if (Counts[i] > 0)
 		{
-			Recipe = &R;
-			break;
+			MaxCount = FMath::Min(MaxCount, PlayerInventory->GetItemQuantity(RecipeDatabase.GetItemName(Items[i])) / Counts[i]);
 		}
 	}
+	return MaxCount;
+}
 
-	if (!Recipe || !Recipe->bIsUnlocked)
-		return false;
+void UAstroCraftingComponent::RefreshCraftability()
+{
+	const int32 RecipeCount = RecipeDatabase.NumRecipes();
+	MaxCraftableCounts.SetNumUninitialized(RecipeCount);
+	CraftableRecipes.Init(false, RecipeCount);
 
-	// Check if player has all required items
-	for (const TPair<FName, int32>& RequiredItem : Recipe->RequiredItems)
+	for (int32 RecipeIndex = 0; RecipeIndex < RecipeCount; ++RecipeIndex)
 	{
-		if (!PlayerInventory->HasItem(RequiredItem.Key, RequiredItem.Value))
-			return false;
+		MaxCraftableCounts[RecipeIndex] = ComputeMaxCraftableCount(RecipeIndex);
+		CraftableRecipes[RecipeIndex] = MaxCraftableCounts[RecipeIndex] > 0;
 	}
+}
 
-	return true;
+void UAstroCraftingComponent::UpdateCraftability(TArrayView<const int32> RecipeIndices)
+{
+	TArray<FName> NowCraftable;
+	TArray<FName> NoLongerCraftable;
+
+	for (int32 RecipeIndex : RecipeIndices)
+	{
+		const int32 MaxCount = ComputeMaxCraftableCount(RecipeIndex);
+		const bool bWasCraftable = CraftableRecipes[RecipeIndex];
+		const bool bIsCraftable = MaxCount > 0;
+
+		MaxCraftableCounts[RecipeIndex] = MaxCount;
+		if (bIsCraftable != bWasCraftable)
+		{
+			CraftableRecipes[RecipeIndex] = bIsCraftable;
+			(bIsCraftable ? NowCraftable : NoLongerCraftable).Add(RecipeDatabase.GetRecipeID(RecipeIndex));
+		}
+	}
+
+	if (NowCraftable.Num() > 0 || NoLongerCraftable.Num() > 0)
+	{
+		OnCraftableSetChanged.Broadcast(NowCraftable, NoLongerCraftable);
+	}
+}
+
+void UAstroCraftingComponent::HandleInventorySlotsChanged(const TArray<int32>& ChangedSlots, const TArray<FName>& ChangedItems)
+{
+	// Only recipes consuming a changed item can change craftability
+	TArray<int32> AffectedRecipes;
+	RecipeDatabase.GatherRecipesUsingItems(ChangedItems, AffectedRecipes);
+	UpdateCraftability(AffectedRecipes);
+
+	if (BlockedOutputs.Num() > 0)
+	{
+		DeliverBlockedOutputs();
+	}
+}
+
+void UAstroCraftingComponent::DeliverBlockedOutputs()
+{
+	// Taken out first because a successful delivery re-enters through HandleInventorySlotsChanged
+	TMap<FName, int32> Outputs = MoveTemp(BlockedOutputs);
+	BlockedOutputs.Reset();
+	if (!PlayerInventory || !PlayerInventory->ApplyInventoryDelta(Outputs))
+	{
+		for (const TPair<FName, int32>& Output : Outputs)
+		{
+			BlockedOutputs.FindOrAdd(Output.Key) += Output.Value;
+		}
+	}
+}
+
+bool UAstroCraftingComponent::IsRecipeCraftable(FName RecipeID) const
+{
+	const int32 RecipeIndex = RecipeDatabase.FindRecipeIndex(RecipeID);
+	return CraftableRecipes.IsValidIndex(RecipeIndex) && CraftableRecipes[RecipeIndex];
+}
+
+int32 UAstroCraftingComponent::GetMaxCraftableCount(FName RecipeID) const
+{
+	const int32 RecipeIndex = RecipeDatabase.FindRecipeIndex(RecipeID);
+	return MaxCraftableCounts.IsValidIndex(RecipeIndex) ? MaxCraftableCounts[RecipeIndex] : 0;
+}
+
+TArray<FName> UAstroCraftingComponent::GetCraftableRecipeIDs() const
+{
+	TArray<FName> RecipeIDs;
+	for (TConstSetBitIterator<> It(CraftableRecipes); It; ++It)
+	{
+		RecipeIDs.Add(RecipeDatabase.GetRecipeID(It.GetIndex()));
+	}
+	return RecipeIDs;
 }
 
 bool UAstroCraftingComponent::StartCrafting(FName RecipeID)
 {
-	if (bIsCrafting || !CanCraftRecipe(RecipeID))
+	return QueueCrafting(RecipeID) != INDEX_NONE;
+}
+
+int32 UAstroCraftingComponent::QueueCrafting(FName RecipeID, int32 Count, int32 Priority)
+{
+	// The cached count bounds every ingredient total by a live inventory quantity, so the delta below cannot overflow
+	const int32 RecipeIndex = RecipeDatabase.FindRecipeIndex(RecipeID);
+	if (Count <= 0 || !CanCraftRecipeIndex(RecipeIndex) || Count > MaxCraftableCounts[RecipeIndex])
+		return INDEX_NONE;
+
+	// Take ingredients for every unit in one transaction
+	if (!PlayerInventory->ApplyInventoryDelta(MakeIngredientDelta(RecipeIndex, -Count)))
+		return INDEX_NONE;
+
+	FCraftingJob NewJob;
+	NewJob.JobID = NextJobID++;
+	NewJob.RecipeID = RecipeID;
+	NewJob.Priority = Priority;
+	NewJob.RemainingCount = Count;
+
+	// Keep dispatch order: higher priority first, FIFO within a priority
+	int32 InsertIndex = CraftingJobs.IndexOfByPredicate([Priority](const FCraftingJob& Job)
+	{
+		return Job.Priority < Priority;
+	});
+	if (InsertIndex == INDEX_NONE)
+	{
+		InsertIndex = CraftingJobs.Num();
+	}
+	CraftingJobs.Insert(NewJob, InsertIndex);
+
+	DispatchWaitingJobs(GetSimulationTime());
+	UpdateCraftingState();
+
+	OnCraftingQueueChanged.Broadcast();
+	return NewJob.JobID;
+}
+
+bool UAstroCraftingComponent::CancelCraftingJob(int32 JobID)
+{
+	const int32 JobIndex = FindJobIndex(JobID);
+	if (JobIndex == INDEX_NONE)
 		return false;
 
-	FCraftingRecipe* Recipe = FindRecipe(RecipeID);
-	if (!Recipe)
+	// Return the ingredients of every unfinished unit; a job whose refund has no room keeps running
+	const FCraftingJob Job = CraftingJobs[JobIndex];
+	const int32 RecipeIndex = RecipeDatabase.FindRecipeIndex(Job.RecipeID);
+	if (RecipeIndex != INDEX_NONE && PlayerInventory && !PlayerInventory->ApplyInventoryDelta(MakeIngredientDelta(RecipeIndex, Job.RemainingCount)))
+	{
+		UE_LOG(LogAstroEngineer, Warning, TEXT("Cannot cancel crafting job %d: no inventory space for its refund"), JobID);
 		return false;
+	}
 
-	// Remove required items from inventory
-	for (const TPair<FName, int32>& RequiredItem : Recipe->RequiredItems)
+	CraftingJobs.RemoveAt(JobIndex);
+	if (UAstroJobScheduler* Scheduler = GetJobScheduler())
 	{
-		PlayerInventory->RemoveItem(RequiredItem.Key, RequiredItem.Value);
+		Scheduler->CancelJob(Job.CompletionHandle);
 	}
 
-	// Start crafting
-	CurrentCraftingRecipe = RecipeID;
-	CurrentCraftingTime = Recipe->CraftingTime;
-	CraftingTimer = 0.0f;
-	CraftingProgress = 0.0f;
-	bIsCrafting = true;
+	DispatchWaitingJobs(GetSimulationTime());
+	UpdateCraftingState();
 
-	OnCraftingStarted.Broadcast(RecipeID);
+	OnCraftingQueueChanged.Broadcast();
 	return true;
 }
 
-void UAstroCraftingComponent::CancelCrafting()
+bool UAstroCraftingComponent::CancelCrafting()
 {
-	if (!bIsCrafting)
-		return;
+	if (CraftingJobs.Num() == 0)
+		return true;
 
-	// Optionally return items to player
-	FCraftingRecipe* Recipe = FindRecipe(CurrentCraftingRecipe);
-	if (Recipe && PlayerInventory)
+	// Cancelling one job at a time would start each waiting job just before cancelling it too
+	TMap<FName, int32> Refund;
+	for (const FCraftingJob& Job : CraftingJobs)
 	{
-		for (const TPair<FName, int32>& RequiredItem : Recipe->RequiredItems)
+		const int32 RecipeIndex = RecipeDatabase.FindRecipeIndex(Job.RecipeID);
+		if (RecipeIndex != INDEX_NONE)
 		{
-			PlayerInventory->AddItem(RequiredItem.Key, RequiredItem.Value);
+			for (const TPair<FName, int32>& Ingredient : MakeIngredientDelta(RecipeIndex, Job.RemainingCount))
+			{
+				int32& Total = Refund.FindOrAdd(Ingredient.Key);
+				Total = int32(FMath::Min<int64>(int64(Total) + Ingredient.Value, MAX_int32));
+			}
 		}
 	}
 
-	CurrentCraftingRecipe = NAME_None;
-	CraftingTimer = 0.0f;
-	CraftingProgress = 0.0f;
-	CurrentCraftingTime = 0.0f;
-	bIsCrafting = false;
+	if (PlayerInventory && Refund.Num() > 0 && !PlayerInventory->ApplyInventoryDelta(Refund))
+	{
+		UE_LOG(LogAstroEngineer, Warning, TEXT("Cannot cancel %d crafting jobs: no inventory space for their refund"), CraftingJobs.Num());
+		return false;
+	}
+
+	if (UAstroJobScheduler* Scheduler = GetJobScheduler())
+	{
+		for (FCraftingJob& Job : CraftingJobs)
+		{
+			Scheduler->CancelJob(Job.CompletionHandle);
+		}
+	}
+	CraftingJobs.Reset();
+
+	DispatchWaitingJobs(GetSimulationTime());
+	UpdateCraftingState();
+
+	OnCraftingQueueChanged.Broadcast();
+	return true;
 }
 
-void UAstroCraftingComponent::CompleteCrafting()
+float UAstroCraftingComponent::GetJobProgress(int32 JobID) const
 {
-	if (!bIsCrafting)
+	const int32 JobIndex = FindJobIndex(JobID);
+	if (JobIndex == INDEX_NONE || !CraftingJobs[JobIndex].IsRunning())
+		return 0.0f;
+
+	const FCraftingJob& Job = CraftingJobs[JobIndex];
+	const double Duration = Job.UnitEndTime - Job.UnitStartTime;
+	if (Duration <= 0.0)
+		return 1.0f;
+
+	return FMath::Clamp(static_cast<float>((GetSimulationTime() - Job.UnitStartTime) / Duration), 0.0f, 1.0f);
+}
+
+float UAstroCraftingComponent::GetCraftingProgress() const
+{
+	const FCraftingJob* Job = CraftingJobs.FindByPredicate([](const FCraftingJob& Candidate)
+	{
+		return Candidate.IsRunning();
+	});
+	return Job ? GetJobProgress(Job->JobID) : 0.0f;
+}
+
+void UAstroCraftingComponent::HandleUnitCompleted(double CompletionTime, int32 JobID)
+{
+	const int32 JobIndex = FindJobIndex(JobID);
+	if (JobIndex == INDEX_NONE)
 		return;
 
-	FCraftingRecipe* Recipe = FindRecipe(CurrentCraftingRecipe);
-	if (Recipe && PlayerInventory)
+	FCraftingJob& Job = CraftingJobs[JobIndex];
+	const FName RecipeID = Job.RecipeID;
+	Job.CompletionHandle.Invalidate();
+	--Job.RemainingCount;
+
+	if (Job.RemainingCount > 0)
+	{
+		// The next unit starts exactly when this one ended, so catch-up loses no time
+		Job.UnitStartTime = CompletionTime;
+		Job.UnitEndTime = CompletionTime + GetRecipeCraftingTime(RecipeID);
+		ScheduleUnitCompletion(Job);
+	}
+	else
 	{
-		// Add result item to inventory
-		PlayerInventory->AddItem(Recipe->ResultItemID, Recipe->ResultQuantity);
-		OnCraftingCompleted.Broadcast(CurrentCraftingRecipe);
+		CraftingJobs.RemoveAt(JobIndex);
+		DispatchWaitingJobs(CompletionTime);
 	}
+	UpdateCraftingState();
 
-	CurrentCraftingRecipe = NAME_None;
-	CraftingTimer = 0.0f;
-	CraftingProgress = 0.0f;
-	CurrentCraftingTime = 0.0f;
-	bIsCrafting = false;
+	// Hand out results only once the job list is consistent, since handlers may queue more work
+	const int32 RecipeIndex = RecipeDatabase.FindRecipeIndex(RecipeID);
+	if (RecipeIndex != INDEX_NONE && RecipeDatabase.GetResultItem(RecipeIndex) != INDEX_NONE && PlayerInventory)
+	{
+		const FName ResultItem = RecipeDatabase.GetItemName(RecipeDatabase.GetResultItem(RecipeIndex));
+		const int32 ResultQuantity = RecipeDatabase.GetResultQuantity(RecipeIndex);
+		if (!PlayerInventory->AddItem(ResultItem, ResultQuantity))
+		{
+			BlockedOutputs.FindOrAdd(ResultItem) += ResultQuantity;
+			UE_LOG(LogAstroEngineer, Warning, TEXT("No inventory space for %d %s from %s; holding it until there is"), ResultQuantity, *ResultItem.ToString(), *RecipeID.ToString());
+			OnCraftingOutputBlocked.Broadcast(RecipeID);
+		}
+	}
+	OnCraftingCompleted.Broadcast(RecipeID);
+	OnCraftingQueueChanged.Broadcast();
 }
 
-TArray<FCraftingRecipe> UAstroCraftingComponent::GetAvailableRecipes() const
+void UAstroCraftingComponent::DispatchWaitingJobs(double Now)
 {
-	TArray<FCraftingRecipe> UnlockedRecipes;
-	for (const FCraftingRecipe& Recipe : CraftingRecipes)
+	TBitArray<> BusyFabricators(false, FMath::Max(NumFabricators, 1));
+	int32 FreeCount = BusyFabricators.Num();
+	for (const FCraftingJob& Job : CraftingJobs)
 	{
-		if (Recipe.bIsUnlocked)
+		if (Job.IsRunning() && BusyFabricators.IsValidIndex(Job.FabricatorIndex))
 		{
-			UnlockedRecipes.Add(Recipe);
+			BusyFabricators[Job.FabricatorIndex] = true;
+			--FreeCount;
 		}
 	}
-	return UnlockedRecipes;
+
+	TArray<FName> StartedRecipes;
+	for (FCraftingJob& Job : CraftingJobs)
+	{
+		if (FreeCount <= 0)
+			break;
+		if (Job.IsRunning())
+			continue;
+
+		Job.FabricatorIndex = BusyFabricators.Find(false);
+		BusyFabricators[Job.FabricatorIndex] = true;
+		--FreeCount;
+
+		Job.UnitStartTime = Now;
+		Job.UnitEndTime = Now + GetRecipeCraftingTime(Job.RecipeID);
+		ScheduleUnitCompletion(Job);
+		StartedRecipes.Add(Job.RecipeID);
+	}
+
+	for (FName RecipeID : StartedRecipes)
+	{
+		OnCraftingStarted.Broadcast(RecipeID);
+	}
+}
+
+void UAstroCraftingComponent::ScheduleUnitCompletion(FCraftingJob& Job)
+{
+	if (UAstroJobScheduler* Scheduler = GetJobScheduler())
+	{
+		Job.CompletionHandle = Scheduler->ScheduleJob(Job.UnitEndTime,
+			FAstroJobCompleted::CreateUObject(this, &UAstroCraftingComponent::HandleUnitCompleted, Job.JobID));
+	}
+}
+
+int32 UAstroCraftingComponent::FindJobIndex(int32 JobID) const
+{
+	return CraftingJobs.IndexOfByPredicate([JobID](const FCraftingJob& Job)
+	{
+		return Job.JobID == JobID;
+	});
+}
+
+UAstroJobScheduler* UAstroCraftingComponent::GetJobScheduler() const
+{
+	UWorld* World = GetWorld();
+	return World ? World->GetSubsystem<UAstroJobScheduler>() : nullptr;
+}
+
+double UAstroCraftingComponent::GetSimulationTime() const
+{
+	if (const UAstroJobScheduler* Scheduler = GetJobScheduler())
+		return Scheduler->GetSimulationTime();
+
+	const UWorld* World = GetWorld();
+	return World ? World->GetTimeSeconds() : 0.0;
+}
+
+void UAstroCraftingComponent::UpdateCraftingState()
+{
+	const FCraftingJob* Job = CraftingJobs.FindByPredicate([](const FCraftingJob& Candidate)
+	{
+		return Candidate.IsRunning();
+	});
+	bIsCrafting = Job != nullptr;
+	CurrentCraftingRecipe = Job ? Job->RecipeID : NAME_None;
+}
+
+float UAstroCraftingComponent::GetRecipeCraftingTime(FName RecipeID) const
+{
+	const int32 RecipeIndex = RecipeDatabase.FindRecipeIndex(RecipeID);
+	return RecipeIndex != INDEX_NONE ? FMath::Max(RecipeDatabase.GetCraftingTime(RecipeIndex), 0.0f) : 0.0f;
+}
+
+TMap<FName, int32> UAstroCraftingComponent::MakeIngredientDelta(int32 RecipeIndex, int32 Units) const
+{
+	const TArrayView<const int32> Items = RecipeDatabase.GetIngredientItems(RecipeIndex);
+	const TArrayView<const int32> Counts = RecipeDatabase.GetIngredientCounts(RecipeIndex);
+
+	TMap<FName, int32> Delta;
+	Delta.Reserve(Items.Num());
+	for (int32 i = 0; i < Items.Num(); ++i)
+	{
+		// Saturate rather than wrap, so a corrupt or oversized count can never flip a removal into an addition
+		int32& Total = Delta.FindOrAdd(RecipeDatabase.GetItemName(Items[i]));
+		Total = int32(FMath::Clamp<int64>(int64(Total) + int64(Counts[i]) * Units, MIN_int32 + 1, MAX_int32));
+	}
+	return Delta;
+}
+
+TArray<FCraftingRecipe> UAstroCraftingComponent::GetAvailableRecipes() const
+{
+	return GetAvailableRecipesRef();
+}
+
+const TArray<FCraftingRecipe>& UAstroCraftingComponent::GetAvailableRecipesRef() const
+{
+	if (bAvailableRecipesDirty)
+	{
+		AvailableRecipesCache.Reset();
+		ForEachAvailableRecipe([this](const FCraftingRecipe& Recipe)
+		{
+			AvailableRecipesCache.Add(Recipe);
+		});
+		bAvailableRecipesDirty = false;
+	}
+	return AvailableRecipesCache;
+}
+
+void UAstroCraftingComponent::ForEachAvailableRecipe(TFunctionRef<void(const FCraftingRecipe&)> Visitor) const
+{
+	for (TConstSetBitIterator<> It(UnlockedRecipes); It; ++It)
+	{
+		Visitor(CraftingRecipes[It.GetIndex()]);
+	}
+}
+
+void UAstroCraftingComponent::NotifyRecipesChanged()
+{
+	RebuildRecipeDatabase();
+}
+
+void UAstroCraftingComponent::RebuildRecipeDatabase()
+{
+	// Carry unlocks over by ID, since indices may shift when recipes are edited
+	TSet<FName> PreviouslyUnlocked;
+	for (TConstSetBitIterator<> It(UnlockedRecipes); It; ++It)
+	{
+		PreviouslyUnlocked.Add(RecipeDatabase.GetRecipeID(It.GetIndex()));
+	}
+
+	RecipeDatabase.Build(CraftingRecipes);
+
+	UnlockedRecipes.Init(false, RecipeDatabase.NumRecipes());
+	for (int32 RecipeIndex = 0; RecipeIndex < RecipeDatabase.NumRecipes(); ++RecipeIndex)
+	{
+		UnlockedRecipes[RecipeIndex] = CraftingRecipes[RecipeIndex].bUnlockedAtStart || PreviouslyUnlocked.Contains(CraftingRecipes[RecipeIndex].RecipeID);
+	}
+
+	RefreshCraftability();
+	bAvailableRecipesDirty = true;
 }
 
 void UAstroCraftingComponent::UnlockRecipe(FName RecipeID)
 {
-	FCraftingRecipe* Recipe = FindRecipe(RecipeID);
-	if (Recipe)
+	const int32 RecipeIndex = RecipeDatabase.FindRecipeIndex(RecipeID);
+	if (RecipeIndex != INDEX_NONE)
 	{
-		Recipe->bIsUnlocked = true;
+		const int32 Recipes[] = { RecipeIndex };
+		UnlockRecipes(Recipes);
 	}
 }
 
-bool UAstroCraftingComponent::IsRecipeUnlocked(FName RecipeID) const
+void UAstroCraftingComponent::UnlockRecipes(TArrayView<const int32> RecipeIndices)
 {
-	for (const FCraftingRecipe& Recipe : CraftingRecipes)
+	TArray<int32> NewlyUnlocked;
+	for (int32 RecipeIndex : RecipeIndices)
 	{
-		if (Recipe.RecipeID == RecipeID)
-			return Recipe.bIsUnlocked;
+		if (UnlockedRecipes.IsValidIndex(RecipeIndex) && !UnlockedRecipes[RecipeIndex])
+		{
+			UnlockedRecipes[RecipeIndex] = true;
+			NewlyUnlocked.Add(RecipeIndex);
+		}
 	}
-	return false;
+
+	if (NewlyUnlocked.Num() == 0)
+		return;
+
+	bAvailableRecipesDirty = true;
+	UpdateCraftability(NewlyUnlocked);
+
+	TArray<FName> RecipeIDs;
+	RecipeIDs.Reserve(NewlyUnlocked.Num());
+	for (int32 RecipeIndex : NewlyUnlocked)
+	{
+		RecipeIDs.Add(RecipeDatabase.GetRecipeID(RecipeIndex));
+	}
+	OnRecipesUnlocked.Broadcast(RecipeIDs);
 }
 
-FCraftingRecipe* UAstroCraftingComponent::FindRecipe(FName RecipeID)
+bool UAstroCraftingComponent::IsRecipeUnlocked(FName RecipeID) const
 {
-	for (FCraftingRecipe& Recipe : CraftingRecipes)
+	const int32 RecipeIndex = RecipeDatabase.FindRecipeIndex(RecipeID);
+	return UnlockedRecipes.IsValidIndex(RecipeIndex) && UnlockedRecipes[RecipeIndex];
+}
+
+void UAstroCraftingComponent::SerializeProgress(FArchive& Ar, double ElapsedSeconds)
+{
+	// Unlocks go by recipe ID so they survive recipes being added, removed or reordered
+	TArray<FName> SavedRecipeIDs;
+	if (Ar.IsSaving())
+	{
+		for (TConstSetBitIterator<> It(UnlockedRecipes); It; ++It)
+		{
+			SavedRecipeIDs.Add(RecipeDatabase.GetRecipeID(It.GetIndex()));
+		}
+	}
+	Ar << SavedRecipeIDs;
+	Ar << NextJobID;
+
+	if (Ar.CustomVer(FAstroProgressionVersion::GUID) >= FAstroProgressionVersion::BlockedCraftOutputs)
+	{
+		Ar << BlockedOutputs;
+	}
+
+	int32 JobCount = CraftingJobs.Num();
+	Ar << JobCount;
+	if (JobCount < 0 || JobCount > MAX_uint16)
 	{
-		if (Recipe.RecipeID == RecipeID)
-			return &Recipe;
+		Ar.SetError();
+		return;
 	}
-	return nullptr;
+
+	// Restored jobs resume from when they would have, had they kept running since the save
+	const double Now = GetSimulationTime() - (Ar.IsLoading() ? FMath::Max(ElapsedSeconds, 0.0) : 0.0);
+	if (Ar.IsLoading())
+	{
+		// The saved queue replaces this one; its ingredients were paid for in the saved session
+		if (UAstroJobScheduler* Scheduler = GetJobScheduler())
+		{
+			for (FCraftingJob& Job : CraftingJobs)
+			{
+				Scheduler->CancelJob(Job.CompletionHandle);
+			}
+		}
+		CraftingJobs.Reset();
+		CraftingJobs.SetNum(JobCount);
+	}
+
+	for (FCraftingJob& Job : CraftingJobs)
+	{
+		double UnitStartOffset = Job.UnitStartTime - Now;
+		double UnitEndOffset = Job.UnitEndTime - Now;
+		Ar << Job.JobID;
+		Ar << Job.RecipeID;
+		Ar << Job.Priority;
+		Ar << Job.RemainingCount;
+		Ar << Job.FabricatorIndex;
+		Ar << UnitStartOffset;
+		Ar << UnitEndOffset;
+
+		if (Ar.IsLoading())
+		{
+			Job.UnitStartTime = Now + UnitStartOffset;
+			Job.UnitEndTime = Now + UnitEndOffset;
+		}
+	}
+
+	if (!Ar.IsLoading() || Ar.IsError())
+		return;
+
+	int32 MissingRecipes = 0;
+	for (const FName RecipeID : SavedRecipeIDs)
+	{
+		const int32 RecipeIndex = RecipeDatabase.FindRecipeIndex(RecipeID);
+		if (UnlockedRecipes.IsValidIndex(RecipeIndex))
+		{
+			UnlockedRecipes[RecipeIndex] = true;
+		}
+		else
+		{
+			++MissingRecipes;
+		}
+	}
+	if (MissingRecipes > 0)
+	{
+		UE_LOG(LogAstroEngineer, Warning, TEXT("%d saved recipe unlocks name recipes that no longer exist"), MissingRecipes);
+	}
+
+	const int32 DroppedJobs = CraftingJobs.RemoveAll([this](const FCraftingJob& Job)
+	{
+		return RecipeDatabase.FindRecipeIndex(Job.RecipeID) == INDEX_NONE || Job.RemainingCount <= 0;
+	});
+	if (DroppedJobs > 0)
+	{
+		UE_LOG(LogAstroEngineer, Warning, TEXT("Dropped %d saved crafting jobs for recipes that no longer exist"), DroppedJobs);
+	}
+
+	for (FCraftingJob& Job : CraftingJobs)
+	{
+		if (Job.IsRunning() && Job.FabricatorIndex < NumFabricators)
+		{
+			ScheduleUnitCompletion(Job);
+		}
+		else
+		{
+			Job.FabricatorIndex = INDEX_NONE;
+		}
+	}
+	DispatchWaitingJobs(Now);
+	UpdateCraftingState();
+
+	bAvailableRecipesDirty = true;
+	RefreshCraftability();
+	if (BlockedOutputs.Num() > 0)
+	{
+		DeliverBlockedOutputs();
+	}
+	OnCraftingQueueChanged.Broadcast();
+}
+
+FCraftingRecipe* UAstroCraftingComponent::FindRecipe(FName RecipeID)
+{
+	const int32 RecipeIndex = RecipeDatabase.FindRecipeIndex(RecipeID);
+	return CraftingRecipes.IsValidIndex(RecipeIndex) ? &CraftingRecipes[RecipeIndex] : nullptr;
+}
+
+const FCraftingRecipe* UAstroCraftingComponent::FindRecipe(FName RecipeID) const
+{
+	const int32 RecipeIndex = RecipeDatabase.FindRecipeIndex(RecipeID);
+	return CraftingRecipes.IsValidIndex(RecipeIndex) ? &CraftingRecipes[RecipeIndex] : nullptr;
 }
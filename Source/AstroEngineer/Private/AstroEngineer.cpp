@@ -3,6 +3,8 @@
 #include "AstroEngineer.h"
 #include "Modules/ModuleManager.h"
 
+DEFINE_LOG_CATEGORY(LogAstroEngineer);
+
 void FAstroEngineerModule::StartupModule()
 {
 	// This code will execute after your module is loaded into memory
@@ -0,0 +1,481 @@
+// Copyright Astro Engineer Team. All Rights Reserved.
+
+#include "AstroFloatingOrigin.h"
+#include "AstroOrbitalSubsystem.h"
+#include "AstroShipAssembly.h"
+#include "AstroShipBodyComponent.h"
+#include "AstroEngineer.h"
+#include "Components/PrimitiveComponent.h"
+#include "Engine/Level.h"
+#include "Engine/StaticMesh.h"
+#include "Engine/StaticMeshActor.h"
+#include "Engine/World.h"
+#include "GameFramework/Controller.h"
+#include "GameFramework/Pawn.h"
+#include "GameFramework/PlayerController.h"
+#include "HAL/IConsoleManager.h"
+#include "Math/RandomStream.h"
+
+DECLARE_CYCLE_STAT(TEXT("Place Orbiting Ships"), STAT_AstroPlaceOrbitingShips, STATGROUP_AstroEngineer);
+DECLARE_CYCLE_STAT(TEXT("Rebase Floating Origin"), STAT_AstroRebaseOrigin, STATGROUP_AstroEngineer);
+DECLARE_CYCLE_STAT(TEXT("Update Local Bubble"), STAT_AstroUpdateBubble, STATGROUP_AstroEngineer);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Origin Rebases"), STAT_AstroOriginRebases, STATGROUP_AstroEngineer);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Rebased Actors"), STAT_AstroRebasedActors, STATGROUP_AstroEngineer);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Local Actors"), STAT_AstroLocalActors, STATGROUP_AstroEngineer);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Parked Actors"), STAT_AstroParkedActors, STATGROUP_AstroEngineer);
+
+namespace AstroFloatingOrigin
+{
+	/** Parked actors come back a little inside the radius they were parked at */
+	static constexpr double UnparkFraction = 0.9;
+
+	static constexpr int32 ParkedSweepPerFrame = 64;
+
+	/** Actors the floating origin moves: placed in the world, and not controllers, which follow what they control */
+	static bool IsTrackable(const AActor& Actor)
+	{
+		return Actor.GetRootComponent() && !Actor.IsA<AController>();
+	}
+
+	/** Ships in orbit are placed from their orbits every frame instead */
+	static bool IsOnRails(const AActor& Actor)
+	{
+		const AAstroShipAssembly* Ship = Cast<AAstroShipAssembly>(&Actor);
+		return Ship && Ship->IsInOrbit();
+	}
+
+	/** Bounding sphere radius in metres */
+	static double GetBoundsRadius(const AActor& Actor)
+	{
+		FVector BoundsOrigin, BoundsExtent;
+		Actor.GetActorBounds(false, BoundsOrigin, BoundsExtent);
+		return (BoundsExtent.Size() + FVector::Dist(BoundsOrigin, Actor.GetActorLocation())) / FAstroFloatingOrigin::WorldUnitsPerMetre;
+	}
+
+	static int32 CountLevelActors(const UWorld& World)
+	{
+		int32 NumActors = 0;
+		for (const ULevel* Level : World.GetLevels())
+		{
+			NumActors += Level ? Level->Actors.Num() : 0;
+		}
+		return NumActors;
+	}
+
+	/** Time rebases with a fixed crowd around the vessel as the rest of the world fills up, ten times more at each step */
+	static void RunRebaseBenchmark(const TArray<FString>& Args, UWorld* World)
+	{
+		UAstroOrbitalSubsystem* OrbitalSubsystem = World ? World->GetSubsystem<UAstroOrbitalSubsystem>() : nullptr;
+		if (!OrbitalSubsystem)
+			return;
+
+		const int32 MaxActors = Args.Num() > 0 ? FMath::Max(1, FCString::Atoi(*Args[0])) : 100000;
+		const int32 NumRebases = Args.Num() > 1 ? FMath::Max(1, FCString::Atoi(*Args[1])) : 10;
+		const int32 NumLocal = Args.Num() > 2 ? FMath::Max(0, FCString::Atoi(*Args[2])) : 500;
+		UStaticMesh* Cube = LoadObject<UStaticMesh>(nullptr, TEXT("/Engine/BasicShapes/Cube.Cube"));
+
+		FAstroFloatingOrigin& FloatingOrigin = OrbitalSubsystem->GetFloatingOrigin();
+		const FVector BubbleCenter = FloatingOrigin.GetOrigin();
+		const double BubbleRadius = FloatingOrigin.LocalBubbleRadius * FAstroFloatingOrigin::WorldUnitsPerMetre;
+		FloatingOrigin.UpdateBubble(*World, BubbleCenter);
+
+		FRandomStream Random(0x0A57);
+		FActorSpawnParameters SpawnParams;
+		SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+		TArray<AActor*> Spawned;
+		auto SpawnCube = [&](double MinDistance, double MaxDistance)
+		{
+			const FVector Location = Random.GetUnitVector() * FMath::Lerp(MinDistance, MaxDistance, double(Random.GetFraction()));
+			AStaticMeshActor* Actor = World->SpawnActor<AStaticMeshActor>(Location, FRotator::ZeroRotator, SpawnParams);
+			if (Actor)
+			{
+				Actor->SetMobility(EComponentMobility::Movable);
+				Actor->GetStaticMeshComponent()->SetStaticMesh(Cube);
+				Spawned.Add(Actor);
+			}
+			return Actor != nullptr;
+		};
+
+		// The crowd around the vessel stays the same; everything added afterwards is far away and gets parked
+		for (int32 Index = 0; Index < NumLocal; ++Index)
+		{
+			if (!SpawnCube(0.0, 0.5 * BubbleRadius))
+				break;
+		}
+
+		double FirstRebaseSeconds = 0.0;
+		for (int32 TargetCount = FMath::Min(1000, MaxActors); ; TargetCount = FMath::Min(TargetCount * 10, MaxActors))
+		{
+			while (Spawned.Num() < NumLocal + TargetCount)
+			{
+				if (!SpawnCube(2.0 * BubbleRadius, 20.0 * BubbleRadius))
+					break;
+			}
+			FloatingOrigin.UpdateBubble(*World, BubbleCenter);
+
+			// Out and back in pairs, so the world ends where it started
+			const double StartTime = FPlatformTime::Seconds();
+			for (int32 Rebase = 0; Rebase < NumRebases; ++Rebase)
+			{
+				FloatingOrigin.Rebase(Rebase % 2 == 0 ? BubbleCenter + FVector(FloatingOrigin.RebaseDistance, 0.0, 0.0) : BubbleCenter);
+			}
+			const double RebaseSeconds = (FPlatformTime::Seconds() - StartTime) / NumRebases;
+			if (NumRebases % 2 != 0)
+			{
+				FloatingOrigin.Rebase(BubbleCenter);
+			}
+			if (FirstRebaseSeconds <= 0.0)
+			{
+				FirstRebaseSeconds = RebaseSeconds;
+			}
+
+			UE_LOG(LogAstroEngineer, Display, TEXT("Rebase benchmark: %d actors in the world, %d local, %d parked, %.3f ms per rebase (%.2fx the first step)"),
+				CountLevelActors(*World), FloatingOrigin.GetNumLocalActors(), FloatingOrigin.GetNumParkedActors(), RebaseSeconds * 1000.0,
+				RebaseSeconds / FMath::Max(FirstRebaseSeconds, UE_DOUBLE_SMALL_NUMBER));
+
+			if (TargetCount >= MaxActors || Spawned.Num() < NumLocal + TargetCount)
+				break;
+		}
+
+		for (AActor* Actor : Spawned)
+		{
+			Actor->Destroy();
+		}
+	}
+
+	static FAutoConsoleCommandWithWorldAndArgs RebaseBenchmarkCommand(
+		TEXT("astro.Orbit.RebaseBenchmark"),
+		TEXT("Time floating origin rebases with a fixed local crowd and 1,000, 10,000 and 100,000 far actors. Usage: astro.Orbit.RebaseBenchmark [MaxActors=100000] [NumRebases=10] [LocalActors=500]"),
+		FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&RunRebaseBenchmark));
+}
+
+void FAstroFloatingOrigin::RegisterShip(AAstroShipAssembly* Ship)
+{
+	Ships.AddUnique(Ship);
+}
+
+void FAstroFloatingOrigin::UnregisterShip(AAstroShipAssembly* Ship)
+{
+	Ships.RemoveSwap(Ship, EAllowShrinking::No);
+}
+
+void FAstroFloatingOrigin::Update(UWorld& World, const FAstroOrbitPropagator& Propagator)
+{
+	if (Propagator.IsValid(ActiveCraft))
+	{
+		const FVector ActivePosition = Propagator.GetCraftRootPosition(ActiveCraft);
+		UpdateBubble(World, ActivePosition);
+		if (FVector::DistSquared(ActivePosition, Origin) > FMath::Square(RebaseDistance))
+		{
+			Rebase(ActivePosition);
+		}
+	}
+	else if (ParkedActors.Num() > 0)
+	{
+		UnparkAll();
+	}
+
+	SCOPE_CYCLE_COUNTER(STAT_AstroPlaceOrbitingShips);
+
+	// Positions are subtracted in double before narrowing to world space, so ships far from the origin only lose precision far away
+	for (int32 Index = Ships.Num() - 1; Index >= 0; --Index)
+	{
+		AAstroShipAssembly* Ship = Ships[Index].Get();
+		if (!Ship || !Propagator.IsValid(Ship->GetOrbitHandle()))
+		{
+			Ships.RemoveAtSwap(Index, EAllowShrinking::No);
+			continue;
+		}
+
+		const FVector NewLocation = RootToWorld(Propagator.GetCraftRootPosition(Ship->GetOrbitHandle()));
+		if (Ship->GetOrbitHandle() == ActiveCraft)
+		{
+			CarryPassengers(World, *Ship, NewLocation - Ship->GetActorLocation());
+		}
+		Ship->SetActorLocation(NewLocation, false, nullptr, ETeleportType::TeleportPhysics);
+	}
+}
+
+void FAstroFloatingOrigin::CarryPassengers(UWorld& World, const AAstroShipAssembly& Ship, const FVector& Delta)
+{
+	if (Delta.IsZero())
+		return;
+
+	// Pawns attached to the ship already follow it; free ones inside the hull would otherwise be left behind every frame
+	const FBox ShipBox = Ship.ShipBody->Bounds.GetBox();
+	for (FConstPlayerControllerIterator It = World.GetPlayerControllerIterator(); It; ++It)
+	{
+		APawn* Pawn = It->IsValid() ? (*It)->GetPawn() : nullptr;
+		if (Pawn && !Pawn->GetAttachParentActor() && ShipBox.IsInside(Pawn->GetActorLocation()))
+		{
+			Pawn->AddActorWorldOffset(Delta, false, nullptr, ETeleportType::TeleportPhysics);
+		}
+	}
+}
+
+void FAstroFloatingOrigin::Rebase(const FVector& NewOrigin)
+{
+	SCOPE_CYCLE_COUNTER(STAT_AstroRebaseOrigin);
+
+	const FVector WorldShift = (Origin - NewOrigin) * WorldUnitsPerMetre;
+	Origin = NewOrigin;
+	TotalWorldShift += WorldShift;
+	++NumRebases;
+	INC_DWORD_STAT(STAT_AstroOriginRebases);
+
+	// Only the bubble moves; parked actors keep their old coordinates and are owed the difference when they come back.
+	// Attached actors follow their parent, and ships in orbit are placed from their orbits right after.
+	int32 NumShifted = 0;
+	for (const FLocalActor& Local : LocalActors)
+	{
+		AActor* Actor = Local.Actor.Get();
+		if (!Actor || Actor->GetAttachParentActor() || AstroFloatingOrigin::IsOnRails(*Actor))
+			continue;
+
+		Actor->ApplyWorldOffset(WorldShift, false);
+		++NumShifted;
+	}
+	SET_DWORD_STAT(STAT_AstroRebasedActors, NumShifted);
+
+	UE_LOG(LogAstroEngineer, Verbose, TEXT("Floating origin moved to %s, %d local actors shifted, %d parked"), *Origin.ToString(), NumShifted, ParkedActors.Num());
+}
+
+void FAstroFloatingOrigin::UpdateBubble(UWorld& World, const FVector& NewBubbleCenter)
+{
+	SCOPE_CYCLE_COUNTER(STAT_AstroUpdateBubble);
+
+	BubbleCenter = NewBubbleCenter;
+	if (!bTrackingWorld)
+	{
+		TrackWorld(World);
+	}
+
+	// Local actors are few, so each is checked every frame
+	for (int32 Index = LocalActors.Num() - 1; Index >= 0; --Index)
+	{
+		const FLocalActor& Local = LocalActors[Index];
+		const AActor* Actor = Local.Actor.Get();
+		if (!Actor)
+		{
+			LocalActors.RemoveAtSwap(Index, EAllowShrinking::No);
+			continue;
+		}
+
+		if (Local.bAlwaysLocal || Actor->GetAttachParentActor() || AstroFloatingOrigin::IsOnRails(*Actor))
+			continue;
+
+		if (FVector::Dist(WorldToRoot(Actor->GetActorLocation()), BubbleCenter) - Local.BoundsRadius > LocalBubbleRadius)
+		{
+			Park(Local, TotalWorldShift);
+			LocalActors.RemoveAtSwap(Index, EAllowShrinking::No);
+		}
+	}
+
+	// Parked actors are found through the grid cells around the bubble; the margin keeps actors on the edge from flickering
+	const double UnparkRadius = LocalBubbleRadius * AstroFloatingOrigin::UnparkFraction;
+	const FIntVector CenterCell = GetParkingCell(BubbleCenter);
+	TArray<int32, TInlineAllocator<64>> ToUnpark;
+	for (int32 Z = -1; Z <= 1; ++Z)
+	{
+		for (int32 Y = -1; Y <= 1; ++Y)
+		{
+			for (int32 X = -1; X <= 1; ++X)
+			{
+				const TArray<int32>* Cell = ParkingCells.Find(CenterCell + FIntVector(X, Y, Z));
+				if (!Cell)
+					continue;
+
+				for (const int32 ParkedIndex : *Cell)
+				{
+					const FParkedActor& Parked = ParkedActors[ParkedIndex];
+					if (!Parked.Actor.IsValid() || FVector::Dist(Parked.RootPosition, BubbleCenter) - Parked.BoundsRadius < UnparkRadius)
+					{
+						ToUnpark.Add(ParkedIndex);
+					}
+				}
+			}
+		}
+	}
+	for (const int32 ParkedIndex : ToUnpark)
+	{
+		Unpark(ParkedIndex);
+	}
+
+	// Destroyed actors parked far away are swept a few at a time
+	for (int32 Checked = 0; Checked < AstroFloatingOrigin::ParkedSweepPerFrame && ParkedActors.Num() > 0; ++Checked)
+	{
+		ParkedSweepCursor = (ParkedSweepCursor + 1) % ParkedActors.GetMaxIndex();
+		if (ParkedActors.IsAllocated(ParkedSweepCursor) && !ParkedActors[ParkedSweepCursor].Actor.IsValid())
+		{
+			Unpark(ParkedSweepCursor);
+		}
+	}
+
+	SET_DWORD_STAT(STAT_AstroLocalActors, LocalActors.Num());
+	SET_DWORD_STAT(STAT_AstroParkedActors, ParkedActors.Num());
+}
+
+void FAstroFloatingOrigin::TrackActor(AActor& Actor)
+{
+	if (bTrackingWorld && AstroFloatingOrigin::IsTrackable(Actor))
+	{
+		// Spawned in current world coordinates; UpdateBubble parks it if it is out of range
+		FLocalActor& Local = LocalActors.AddDefaulted_GetRef();
+		Local.Actor = &Actor;
+		Local.BoundsRadius = AstroFloatingOrigin::GetBoundsRadius(Actor);
+		Local.bAlwaysLocal = IsAlwaysLocal(Actor, Local.BoundsRadius);
+	}
+}
+
+void FAstroFloatingOrigin::TrackAddedLevel(ULevel& Level)
+{
+	if (!bTrackingWorld)
+		return;
+
+	// The level's actors are still where they were authored, before any rebase
+	for (AActor* Actor : Level.Actors)
+	{
+		if (Actor && AstroFloatingOrigin::IsTrackable(*Actor))
+		{
+			SortActor(*Actor, FVector::ZeroVector);
+		}
+	}
+}
+
+void FAstroFloatingOrigin::TrackWorld(UWorld& World)
+{
+	bTrackingWorld = true;
+	for (ULevel* Level : World.GetLevels())
+	{
+		if (!Level)
+			continue;
+
+		for (AActor* Actor : Level->Actors)
+		{
+			if (Actor && AstroFloatingOrigin::IsTrackable(*Actor))
+			{
+				SortActor(*Actor, TotalWorldShift);
+			}
+		}
+	}
+}
+
+void FAstroFloatingOrigin::SortActor(AActor& Actor, const FVector& AppliedShift)
+{
+	FLocalActor Local;
+	Local.Actor = &Actor;
+	Local.BoundsRadius = AstroFloatingOrigin::GetBoundsRadius(Actor);
+	Local.bAlwaysLocal = IsAlwaysLocal(Actor, Local.BoundsRadius);
+
+	const FVector OwedShift = TotalWorldShift - AppliedShift;
+	const FVector RootPosition = WorldToRoot(Actor.GetActorLocation() + OwedShift);
+	if (!Local.bAlwaysLocal && !Actor.GetAttachParentActor() && FVector::Dist(RootPosition, BubbleCenter) - Local.BoundsRadius > LocalBubbleRadius)
+	{
+		Park(Local, AppliedShift);
+		return;
+	}
+
+	if (!OwedShift.IsZero() && !Actor.GetAttachParentActor())
+	{
+		Actor.ApplyWorldOffset(OwedShift, false);
+	}
+	LocalActors.Add(Local);
+}
+
+bool FAstroFloatingOrigin::IsAlwaysLocal(const AActor& Actor, double BoundsRadius) const
+{
+	// Pawns are never hidden from their players, and actors wider than a grid cell could not be found again once parked
+	return Actor.IsA<APawn>() || BoundsRadius > 0.5 * LocalBubbleRadius;
+}
+
+void FAstroFloatingOrigin::Park(const FLocalActor& Local, const FVector& AppliedShift)
+{
+	AActor* Actor = Local.Actor.Get();
+	check(Actor);
+
+	FParkedActor Parked;
+	Parked.Actor = Local.Actor;
+	Parked.BoundsRadius = Local.BoundsRadius;
+	Parked.AppliedShift = AppliedShift;
+	Parked.RootPosition = WorldToRoot(Actor->GetActorLocation() + (TotalWorldShift - AppliedShift));
+	Parked.Cell = GetParkingCell(Parked.RootPosition);
+	Parked.bWasHidden = Actor->IsHidden();
+	Parked.bHadCollision = Actor->GetActorEnableCollision();
+
+	// A simulating body without collision would drift or fall while nothing can see it
+	if (UPrimitiveComponent* RootPrimitive = Cast<UPrimitiveComponent>(Actor->GetRootComponent()))
+	{
+		Parked.bWasSimulating = RootPrimitive->IsSimulatingPhysics();
+		if (Parked.bWasSimulating)
+		{
+			RootPrimitive->SetSimulatePhysics(false);
+		}
+	}
+	Actor->SetActorHiddenInGame(true);
+	Actor->SetActorEnableCollision(false);
+
+	const FIntVector Cell = Parked.Cell;
+	ParkingCells.FindOrAdd(Cell).Add(ParkedActors.Add(MoveTemp(Parked)));
+}
+
+void FAstroFloatingOrigin::Unpark(int32 ParkedIndex)
+{
+	FParkedActor& Parked = ParkedActors[ParkedIndex];
+	if (TArray<int32>* Cell = ParkingCells.Find(Parked.Cell))
+	{
+		Cell->RemoveSwap(ParkedIndex, EAllowShrinking::No);
+		if (Cell->Num() == 0)
+		{
+			ParkingCells.Remove(Parked.Cell);
+		}
+	}
+
+	if (AActor* Actor = Parked.Actor.Get())
+	{
+		// One step for every rebase it missed
+		const FVector OwedShift = TotalWorldShift - Parked.AppliedShift;
+		if (!OwedShift.IsZero())
+		{
+			Actor->ApplyWorldOffset(OwedShift, false);
+		}
+
+		Actor->SetActorEnableCollision(Parked.bHadCollision);
+		Actor->SetActorHiddenInGame(Parked.bWasHidden);
+		if (Parked.bWasSimulating)
+		{
+			if (UPrimitiveComponent* RootPrimitive = Cast<UPrimitiveComponent>(Actor->GetRootComponent()))
+			{
+				RootPrimitive->SetSimulatePhysics(true);
+			}
+		}
+
+		FLocalActor& Local = LocalActors.AddDefaulted_GetRef();
+		Local.Actor = Actor;
+		Local.BoundsRadius = Parked.BoundsRadius;
+	}
+
+	ParkedActors.RemoveAt(ParkedIndex);
+}
+
+void FAstroFloatingOrigin::UnparkAll()
+{
+	TArray<int32> ParkedIndices;
+	ParkedIndices.Reserve(ParkedActors.Num());
+	for (auto It = ParkedActors.CreateConstIterator(); It; ++It)
+	{
+		ParkedIndices.Add(It.GetIndex());
+	}
+	for (const int32 ParkedIndex : ParkedIndices)
+	{
+		Unpark(ParkedIndex);
+	}
+}
+
+FIntVector FAstroFloatingOrigin::GetParkingCell(const FVector& RootPosition) const
+{
+	auto ToCell = [this](double Coordinate)
+	{
+		return static_cast<int32>(FMath::Clamp(FMath::FloorToDouble(Coordinate / LocalBubbleRadius), double(MIN_int32 / 2), double(MAX_int32 / 2)));
+	};
+	return FIntVector(ToCell(RootPosition.X), ToCell(RootPosition.Y), ToCell(RootPosition.Z));
+}
@@ -1,81 +1,268 @@
 // Copyright Astro Engineer Team. All Rights Reserved.
 
 #include "AstroInventoryComponent.h"
+#include "AstroEngineer.h"
+#include "HAL/IConsoleManager.h"
+#include "Math/RandomStream.h"
+
+namespace AstroInventoryComponent
+{
+	/** Quantity of an item by walking every slot, as lookups worked before the ItemID index */
+	static int32 GetItemQuantityByScan(TArrayView<const FInventoryItem> Items, FName ItemID)
+	{
+		int32 Quantity = 0;
+		for (const FInventoryItem& Item : Items)
+		{
+			if (Item.ItemID == ItemID)
+			{
+				Quantity += Item.Quantity;
+			}
+		}
+		return Quantity;
+	}
+
+	/** Time indexed quantity lookups against a slot scan on full inventories of 40, 400 and 4000 slots */
+	static void RunBenchmark(const TArray<FString>& Args)
+	{
+		const int32 NumQueries = Args.Num() > 0 ? FMath::Max(1, FCString::Atoi(*Args[0])) : 100000;
+
+		for (const int32 NumSlots : { 40, 400, 4000 })
+		{
+			// Two stacks per item, so lookups have to sum across slots
+			UAstroInventoryComponent* Inventory = NewObject<UAstroInventoryComponent>();
+			Inventory->MaxInventorySlots = NumSlots;
+			TArray<FName> ItemIDs;
+			TMap<FName, int32> Delta;
+			for (int32 Index = 0; Index < NumSlots / 2; ++Index)
+			{
+				const FName ItemID(*FString::Printf(TEXT("BenchmarkItem_%d"), Index));
+				ItemIDs.Add(ItemID);
+				Delta.Add(ItemID, FInventoryItem().MaxStackSize * 2);
+			}
+			Inventory->ApplyInventoryDelta(Delta);
+
+			FRandomStream Random(0x0A57);
+			TArray<FName> Queries;
+			Queries.SetNumUninitialized(NumQueries);
+			for (FName& Query : Queries)
+			{
+				Query = ItemIDs[Random.RandHelper(ItemIDs.Num())];
+			}
+
+			int64 IndexedTotal = 0;
+			double Start = FPlatformTime::Seconds();
+			for (const FName& Query : Queries)
+			{
+				IndexedTotal += Inventory->GetItemQuantity(Query);
+			}
+			const double IndexedSeconds = FPlatformTime::Seconds() - Start;
+
+			int64 ScanTotal = 0;
+			Start = FPlatformTime::Seconds();
+			for (const FName& Query : Queries)
+			{
+				ScanTotal += GetItemQuantityByScan(Inventory->GetInventoryItemsView(), Query);
+			}
+			const double ScanSeconds = FPlatformTime::Seconds() - Start;
+
+			UE_LOG(LogAstroEngineer, Display, TEXT("Inventory benchmark: %d slots, %d lookups, indexed %.1f ns, scan %.1f ns per lookup (%.1fx)%s"),
+				Inventory->GetInventoryItemsView().Num(), NumQueries, IndexedSeconds * 1.0e9 / NumQueries, ScanSeconds * 1.0e9 / NumQueries,
+				ScanSeconds / FMath::Max(IndexedSeconds, UE_DOUBLE_SMALL_NUMBER), IndexedTotal == ScanTotal ? TEXT("") : TEXT(", RESULTS DIFFER"));
+
+			Inventory->MarkAsGarbage();
+		}
+	}
+
+	static FAutoConsoleCommand BenchmarkCommand(
+		TEXT("astro.Inventory.Benchmark"),
+		TEXT("Time ItemID-indexed quantity lookups against a slot scan at 40, 400 and 4000 slots. Usage: astro.Inventory.Benchmark [NumQueries=100000]"),
+		FConsoleCommandWithArgsDelegate::CreateStatic(&RunBenchmark));
+}
 
 UAstroInventoryComponent::UAstroInventoryComponent()
 {
-	PrimaryComponentTick.bCanEverTick = true;
+	PrimaryComponentTick.bCanEverTick = false;
 	MaxInventorySlots = 40; // 8x5 grid default
 }
 
 void UAstroInventoryComponent::BeginPlay()
 {
 	Super::BeginPlay();
+
+	RebuildItemIndex();
+
+	// Components that began play first, such as the crafting cache, saw an empty index; report the authored contents now it exists
+	if (InventoryItems.Num() > 0)
+	{
+		TArray<int32> ChangedSlots;
+		ChangedSlots.Reserve(InventoryItems.Num());
+		for (int32 SlotIndex = 0; SlotIndex < InventoryItems.Num(); ++SlotIndex)
+		{
+			ChangedSlots.Add(SlotIndex);
+		}
+
+		TArray<FName> ChangedItems;
+		ItemIndex.GetKeys(ChangedItems);
+
+		OnInventorySlotsChanged.Broadcast(ChangedSlots, ChangedItems);
+		OnInventoryChanged.Broadcast();
+	}
 }
 
-void UAstroInventoryComponent::TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
+bool UAstroInventoryComponent::AddItem(FName ItemID, int32 Quantity)
 {
-	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
+	if (ItemID.IsNone() || Quantity <= 0)
+		return false;
+
+	TMap<FName, int32> Delta;
+	Delta.Add(ItemID, Quantity);
+	return ApplyInventoryDelta(Delta);
 }
 
-bool UAstroInventoryComponent::AddItem(FName ItemID, int32 Quantity)
+bool UAstroInventoryComponent::RemoveItem(FName ItemID, int32 Quantity)
 {
 	if (ItemID.IsNone() || Quantity <= 0)
 		return false;
 
-	// Try to find existing item and stack
-	FInventoryItem* ExistingItem = FindItem(ItemID);
-	if (ExistingItem)
+	TMap<FName, int32> Delta;
+	Delta.Add(ItemID, -Quantity);
+	return ApplyInventoryDelta(Delta);
+}
+
+bool UAstroInventoryComponent::ApplyInventoryDelta(const TMap<FName, int32>& Delta)
+{
+	// Validate the whole delta and work out the net slot change before touching anything
+	int32 NetNewSlots = 0;
+	for (const TPair<FName, int32>& Change : Delta)
 	{
-		if (ExistingItem->Quantity + Quantity <= ExistingItem->MaxStackSize)
+		// MIN_int32 has no positive counterpart to remove
+		if (Change.Key.IsNone() || Change.Value == MIN_int32)
+			return false;
+
+		const FItemSlotIndex* Index = ItemIndex.Find(Change.Key);
+		if (Change.Value < 0)
 		{
-			ExistingItem->Quantity += Quantity;
-			OnInventoryChanged.Broadcast();
-			return true;
+			int32 ToRemove = -Change.Value;
+			if (!Index || Index->TotalQuantity < ToRemove)
+				return false;
+
+			// Removals drain the newest stacks first
+			for (int32 i = Index->Slots.Num() - 1; i >= 0 && ToRemove > 0; --i)
+			{
+				const int32 StackQuantity = InventoryItems[Index->Slots[i]].Quantity;
+				if (StackQuantity <= ToRemove)
+				{
+					--NetNewSlots;
+				}
+				ToRemove -= StackQuantity;
+			}
 		}
-		else
+		else if (Change.Value > 0)
 		{
-			// TODO: Handle overflow to new stack
-			int32 RemainingSpace = ExistingItem->MaxStackSize - ExistingItem->Quantity;
-			ExistingItem->Quantity = ExistingItem->MaxStackSize;
-			Quantity -= RemainingSpace;
+			if (Index && Index->TotalQuantity > MAX_int32 - Change.Value)
+				return false;
+
+			int32 Remaining = Change.Value;
+			if (Index)
+			{
+				for (int32 SlotIndex : Index->Slots)
+				{
+					const FInventoryItem& Item = InventoryItems[SlotIndex];
+					Remaining -= FMath::Max(Item.MaxStackSize - Item.Quantity, 0);
+				}
+			}
+			if (Remaining > 0)
+			{
+				NetNewSlots += FMath::DivideAndRoundUp(Remaining, GetStackSizeFor(Change.Key));
+			}
 		}
 	}
 
-	// Check if we have space for new item
-	if (InventoryItems.Num() >= MaxInventorySlots)
+	if (InventoryItems.Num() + NetNewSlots > MaxInventorySlots)
 		return false;
 
-	// Add new item
-	FInventoryItem NewItem;
-	NewItem.ItemID = ItemID;
-	NewItem.Quantity = Quantity;
-	// TODO: Load item data from data table
-	InventoryItems.Add(NewItem);
+	TSet<int32> TouchedSlots;
+	TArray<FName> ChangedItems;
+	TArray<int32> EmptiedSlots;
 
-	OnInventoryChanged.Broadcast();
-	return true;
-}
+	// Adjust quantities in place; emptied slots are compacted afterwards so indices stay stable here
+	for (const TPair<FName, int32>& Change : Delta)
+	{
+		if (Change.Value == 0)
+			continue;
 
-bool UAstroInventoryComponent::RemoveItem(FName ItemID, int32 Quantity)
-{
-	if (ItemID.IsNone() || Quantity <= 0)
-		return false;
+		ChangedItems.Add(Change.Key);
 
-	FInventoryItem* Item = FindItem(ItemID);
-	if (!Item || Item->Quantity < Quantity)
-		return false;
+		if (Change.Value < 0)
+		{
+			FItemSlotIndex& Index = ItemIndex.FindChecked(Change.Key);
+			int32 ToRemove = -Change.Value;
+			for (int32 i = Index.Slots.Num() - 1; i >= 0 && ToRemove > 0; --i)
+			{
+				FInventoryItem& Item = InventoryItems[Index.Slots[i]];
+				const int32 Taken = FMath::Min(Item.Quantity, ToRemove);
+				Item.Quantity -= Taken;
+				Index.TotalQuantity -= Taken;
+				ToRemove -= Taken;
+				TouchedSlots.Add(Index.Slots[i]);
+
+				if (Item.Quantity <= 0)
+				{
+					EmptiedSlots.Add(Index.Slots[i]);
+				}
+			}
+		}
+		else
+		{
+			int32 Remaining = Change.Value;
+			if (FItemSlotIndex* Index = ItemIndex.Find(Change.Key))
+			{
+				for (int32 SlotIndex : Index->Slots)
+				{
+					FInventoryItem& Item = InventoryItems[SlotIndex];
+					const int32 Added = FMath::Min(FMath::Max(Item.MaxStackSize - Item.Quantity, 0), Remaining);
+					if (Added > 0)
+					{
+						Item.Quantity += Added;
+						Index->TotalQuantity += Added;
+						Remaining -= Added;
+						TouchedSlots.Add(SlotIndex);
+					}
+					if (Remaining == 0)
+						break;
+				}
+			}
+
+			// Overflow into new stacks
+			const int32 StackSize = GetStackSizeFor(Change.Key);
+			while (Remaining > 0)
+			{
+				FInventoryItem NewItem;
+				NewItem.ItemID = Change.Key;
+				NewItem.Quantity = FMath::Min(Remaining, StackSize);
+				NewItem.MaxStackSize = StackSize;
+				// TODO: Load item data from data table
+				TouchedSlots.Add(AddSlot(NewItem));
+				Remaining -= NewItem.Quantity;
+			}
+		}
+	}
 
-	Item->Quantity -= Quantity;
-	
-	// Remove item if quantity is 0
-	if (Item->Quantity <= 0)
+	if (ChangedItems.Num() == 0)
+		return true;
+
+	// Compact from the highest index down so every swapped-in slot is still live
+	EmptiedSlots.Sort(TGreater<int32>());
+	for (int32 SlotIndex : EmptiedSlots)
 	{
-		InventoryItems.RemoveAll([ItemID](const FInventoryItem& Item) {
-			return Item.ItemID == ItemID;
-		});
+		TouchedSlots.Add(InventoryItems.Num() - 1);
+		RemoveSlot(SlotIndex);
 	}
 
+	TArray<int32> ChangedSlots = TouchedSlots.Array();
+	ChangedSlots.Sort();
+
+	OnInventorySlotsChanged.Broadcast(ChangedSlots, ChangedItems);
 	OnInventoryChanged.Broadcast();
 	return true;
 }
@@ -87,26 +274,133 @@ bool UAstroInventoryComponent::HasItem(FName ItemID, int32 Quantity) const
 
 int32 UAstroInventoryComponent::GetItemQuantity(FName ItemID) const
 {
-	for (const FInventoryItem& Item : InventoryItems)
-	{
-		if (Item.ItemID == ItemID)
-			return Item.Quantity;
-	}
-	return 0;
+	const FItemSlotIndex* Index = ItemIndex.Find(ItemID);
+	return Index ? Index->TotalQuantity : 0;
 }
 
 void UAstroInventoryComponent::ClearInventory()
 {
+	TArray<int32> ChangedSlots;
+	ChangedSlots.Reserve(InventoryItems.Num());
+	for (int32 SlotIndex = 0; SlotIndex < InventoryItems.Num(); ++SlotIndex)
+	{
+		ChangedSlots.Add(SlotIndex);
+	}
+
+	TArray<FName> ChangedItems;
+	ItemIndex.GetKeys(ChangedItems);
+
 	InventoryItems.Empty();
+	ItemIndex.Empty();
+
+	OnInventorySlotsChanged.Broadcast(ChangedSlots, ChangedItems);
 	OnInventoryChanged.Broadcast();
 }
 
+void UAstroInventoryComponent::SerializeProgress(FArchive& Ar)
+{
+	// Only the total per item is stored: an item table, then one packed quantity per table index. Stacks are rebuilt on load.
+	TArray<FName> ItemIDs;
+	TArray<int32> Quantities;
+	if (Ar.IsSaving())
+	{
+		ItemIDs.Reserve(ItemIndex.Num());
+		Quantities.Reserve(ItemIndex.Num());
+		for (const TPair<FName, FItemSlotIndex>& Entry : ItemIndex)
+		{
+			if (Entry.Value.TotalQuantity > 0)
+			{
+				ItemIDs.Add(Entry.Key);
+				Quantities.Add(Entry.Value.TotalQuantity);
+			}
+		}
+	}
+
+	Ar << ItemIDs;
+	Quantities.SetNumZeroed(ItemIDs.Num());
+	for (int32& Quantity : Quantities)
+	{
+		uint32 Packed = static_cast<uint32>(Quantity);
+		Ar.SerializeIntPacked(Packed);
+		Quantity = static_cast<int32>(Packed);
+	}
+
+	if (!Ar.IsLoading() || Ar.IsError())
+		return;
+
+	// Move from the current contents to the saved ones as a single delta
+	TMap<FName, int32> Delta;
+	for (const TPair<FName, FItemSlotIndex>& Entry : ItemIndex)
+	{
+		Delta.Add(Entry.Key, -Entry.Value.TotalQuantity);
+	}
+	for (int32 Index = 0; Index < ItemIDs.Num(); ++Index)
+	{
+		if (!ItemIDs[Index].IsNone() && Quantities[Index] > 0)
+		{
+			Delta.FindOrAdd(ItemIDs[Index]) += Quantities[Index];
+		}
+	}
+
+	if (!ApplyInventoryDelta(Delta))
+	{
+		UE_LOG(LogAstroEngineer, Warning, TEXT("Saved inventory of %d items does not fit in %d slots"), ItemIDs.Num(), MaxInventorySlots);
+	}
+}
+
 FInventoryItem* UAstroInventoryComponent::FindItem(FName ItemID)
 {
-	for (FInventoryItem& Item : InventoryItems)
+	const FItemSlotIndex* Index = ItemIndex.Find(ItemID);
+	return Index ? &InventoryItems[Index->Slots[0]] : nullptr;
+}
+
+int32 UAstroInventoryComponent::GetStackSizeFor(FName ItemID) const
+{
+	const FItemSlotIndex* Index = ItemIndex.Find(ItemID);
+	const int32 StackSize = Index ? InventoryItems[Index->Slots[0]].MaxStackSize : FInventoryItem().MaxStackSize;
+	return FMath::Max(StackSize, 1);
+}
+
+void UAstroInventoryComponent::RebuildItemIndex()
+{
+	ItemIndex.Reset();
+	for (int32 SlotIndex = 0; SlotIndex < InventoryItems.Num(); ++SlotIndex)
+	{
+		const FInventoryItem& Item = InventoryItems[SlotIndex];
+		FItemSlotIndex& Index = ItemIndex.FindOrAdd(Item.ItemID);
+		Index.Slots.Add(SlotIndex);
+		Index.TotalQuantity += Item.Quantity;
+	}
+}
+
+int32 UAstroInventoryComponent::AddSlot(const FInventoryItem& NewItem)
+{
+	const int32 SlotIndex = InventoryItems.Add(NewItem);
+
+	FItemSlotIndex& Index = ItemIndex.FindOrAdd(NewItem.ItemID);
+	Index.Slots.Add(SlotIndex);
+	Index.TotalQuantity += NewItem.Quantity;
+
+	return SlotIndex;
+}
+
+void UAstroInventoryComponent::RemoveSlot(int32 SlotIndex)
+{
+	const FInventoryItem& Removed = InventoryItems[SlotIndex];
+	FItemSlotIndex& Index = ItemIndex.FindChecked(Removed.ItemID);
+	Index.TotalQuantity -= Removed.Quantity;
+	Index.Slots.RemoveSingleSwap(SlotIndex);
+	if (Index.Slots.Num() == 0)
+	{
+		ItemIndex.Remove(Removed.ItemID);
+	}
+
+	// Swap the last slot into the hole so no other indices shift
+	const int32 LastIndex = InventoryItems.Num() - 1;
+	if (SlotIndex != LastIndex)
 	{
-		if (Item.ItemID == ItemID)
-			return &Item;
+		FItemSlotIndex& MovedIndex = ItemIndex.FindChecked(InventoryItems[LastIndex].ItemID);
+		MovedIndex.Slots[MovedIndex.Slots.IndexOfByKey(LastIndex)] = SlotIndex;
 	}
-	return nullptr;
+	InventoryItems.RemoveAtSwap(SlotIndex);
 }
@@ -0,0 +1,216 @@
+// Copyright Astro Engineer Team. All Rights Reserved.
+
+#include "AstroJobScheduler.h"
+#include "AstroEngineer.h"
+#include "Engine/World.h"
+
+DECLARE_CYCLE_STAT(TEXT("Process Due Jobs"), STAT_AstroProcessDueJobs, STATGROUP_AstroEngineer);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Pending Jobs"), STAT_AstroPendingJobs, STATGROUP_AstroEngineer);
+
+void UAstroJobScheduler::Tick(float DeltaTime)
+{
+	Super::Tick(DeltaTime);
+
+	ProcessDueJobs(GetSimulationTime());
+	SET_DWORD_STAT(STAT_AstroPendingJobs, Heap.Num());
+}
+
+TStatId UAstroJobScheduler::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UAstroJobScheduler, STATGROUP_AstroEngineer);
+}
+
+FAstroJobHandle UAstroJobScheduler::ScheduleJob(double CompletionTime, FAstroJobCompleted OnCompleted)
+{
+	int32 JobIndex;
+	if (FreeJobs.Num() > 0)
+	{
+		JobIndex = FreeJobs.Pop(EAllowShrinking::No);
+	}
+	else
+	{
+		JobIndex = Jobs.AddDefaulted();
+	}
+
+	FJob& Job = Jobs[JobIndex];
+	Job.CompletionTime = CompletionTime;
+	Job.Sequence = NextSequence++;
+	Job.Serial = NextSerial++;
+	Job.OnCompleted = MoveTemp(OnCompleted);
+	Job.HeapIndex = Heap.Add(JobIndex);
+	SiftUp(Job.HeapIndex);
+
+	FAstroJobHandle Handle;
+	Handle.Index = JobIndex;
+	Handle.Serial = Job.Serial;
+	return Handle;
+}
+
+bool UAstroJobScheduler::CancelJob(FAstroJobHandle& Handle)
+{
+	if (!FindJob(Handle))
+	{
+		Handle.Invalidate();
+		return false;
+	}
+
+	ReleaseJob(Handle.Index);
+	Handle.Invalidate();
+	return true;
+}
+
+bool UAstroJobScheduler::RescheduleJob(const FAstroJobHandle& Handle, double NewCompletionTime)
+{
+	FJob* Job = FindJob(Handle);
+	if (!Job)
+		return false;
+
+	const double OldCompletionTime = Job->CompletionTime;
+	Job->CompletionTime = NewCompletionTime;
+	if (NewCompletionTime < OldCompletionTime)
+	{
+		SiftUp(Job->HeapIndex);
+	}
+	else
+	{
+		SiftDown(Job->HeapIndex);
+	}
+	return true;
+}
+
+bool UAstroJobScheduler::IsJobPending(const FAstroJobHandle& Handle) const
+{
+	return FindJob(Handle) != nullptr;
+}
+
+double UAstroJobScheduler::GetJobCompletionTime(const FAstroJobHandle& Handle) const
+{
+	const FJob* Job = FindJob(Handle);
+	return Job ? Job->CompletionTime : 0.0;
+}
+
+double UAstroJobScheduler::GetSimulationTime() const
+{
+	return GetWorld()->GetTimeSeconds() + SimulationTimeOffset;
+}
+
+void UAstroJobScheduler::AdvanceSimulationTime(double Seconds)
+{
+	if (Seconds <= 0.0)
+		return;
+
+	SimulationTimeOffset += Seconds;
+	ProcessDueJobs(GetSimulationTime());
+}
+
+void UAstroJobScheduler::RunDueJobs()
+{
+	ProcessDueJobs(GetSimulationTime());
+}
+
+void UAstroJobScheduler::ProcessDueJobs(double Now)
+{
+	SCOPE_CYCLE_COUNTER(STAT_AstroProcessDueJobs);
+
+	while (Heap.Num() > 0 && Jobs[Heap[0]].CompletionTime <= Now)
+	{
+		const int32 JobIndex = Heap[0];
+		const double CompletionTime = Jobs[JobIndex].CompletionTime;
+		FAstroJobCompleted OnCompleted = MoveTemp(Jobs[JobIndex].OnCompleted);
+
+		// Release before the callback so it can schedule follow-up work into the freed slot
+		ReleaseJob(JobIndex);
+		OnCompleted.ExecuteIfBound(CompletionTime);
+	}
+}
+
+UAstroJobScheduler::FJob* UAstroJobScheduler::FindJob(const FAstroJobHandle& Handle)
+{
+	if (!Jobs.IsValidIndex(Handle.Index))
+		return nullptr;
+
+	FJob& Job = Jobs[Handle.Index];
+	return (Job.Serial == Handle.Serial && Job.HeapIndex != INDEX_NONE) ? &Job : nullptr;
+}
+
+const UAstroJobScheduler::FJob* UAstroJobScheduler::FindJob(const FAstroJobHandle& Handle) const
+{
+	return const_cast<UAstroJobScheduler*>(this)->FindJob(Handle);
+}
+
+void UAstroJobScheduler::ReleaseJob(int32 JobIndex)
+{
+	FJob& Job = Jobs[JobIndex];
+	HeapRemoveAt(Job.HeapIndex);
+
+	Job.HeapIndex = INDEX_NONE;
+	Job.Serial = 0;
+	Job.OnCompleted.Unbind();
+	FreeJobs.Add(JobIndex);
+}
+
+bool UAstroJobScheduler::HeapLess(int32 A, int32 B) const
+{
+	const FJob& JobA = Jobs[Heap[A]];
+	const FJob& JobB = Jobs[Heap[B]];
+	if (JobA.CompletionTime != JobB.CompletionTime)
+		return JobA.CompletionTime < JobB.CompletionTime;
+	return JobA.Sequence < JobB.Sequence;
+}
+
+void UAstroJobScheduler::HeapSwap(int32 A, int32 B)
+{
+	Heap.Swap(A, B);
+	Jobs[Heap[A]].HeapIndex = A;
+	Jobs[Heap[B]].HeapIndex = B;
+}
+
+void UAstroJobScheduler::SiftUp(int32 HeapIndex)
+{
+	while (HeapIndex > 0)
+	{
+		const int32 Parent = (HeapIndex - 1) / 2;
+		if (!HeapLess(HeapIndex, Parent))
+			break;
+
+		HeapSwap(HeapIndex, Parent);
+		HeapIndex = Parent;
+	}
+}
+
+void UAstroJobScheduler::SiftDown(int32 HeapIndex)
+{
+	const int32 Count = Heap.Num();
+	for (;;)
+	{
+		const int32 Left = HeapIndex * 2 + 1;
+		if (Left >= Count)
+			break;
+
+		const int32 Right = Left + 1;
+		const int32 Smallest = (Right < Count && HeapLess(Right, Left)) ? Right : Left;
+		if (!HeapLess(Smallest, HeapIndex))
+			break;
+
+		HeapSwap(HeapIndex, Smallest);
+		HeapIndex = Smallest;
+	}
+}
+
+void UAstroJobScheduler::HeapRemoveAt(int32 HeapIndex)
+{
+	const int32 LastIndex = Heap.Num() - 1;
+	if (HeapIndex != LastIndex)
+	{
+		HeapSwap(HeapIndex, LastIndex);
+		Heap.Pop(EAllowShrinking::No);
+
+		// The moved entry may belong either above or below its new position
+		SiftUp(HeapIndex);
+		SiftDown(HeapIndex);
+	}
+	else
+	{
+		Heap.Pop(EAllowShrinking::No);
+	}
+}
@@ -0,0 +1,256 @@
+// Copyright Astro Engineer Team. All Rights Reserved.
+
+#include "AstroModuleStatStore.h"
+#include "AstroShipModule.h"
+#include "AstroEngineer.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+#include "Math/RandomStream.h"
+
+DECLARE_CYCLE_STAT(TEXT("Sum Module Stats"), STAT_AstroSumModuleStats, STATGROUP_AstroEngineer);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Module Stat Rows"), STAT_AstroModuleStatRows, STATGROUP_AstroEngineer);
+
+namespace AstroModuleStatStore
+{
+	/**
+	 * Sum a float column in four float lanes, folding each block of lanes into a double.
+	 * A plain float-to-double loop stays scalar because strict floating point forbids reordering the adds;
+	 * short float blocks keep the SIMD adds exact enough while the double total keeps long columns precise.
+	 */
+	static double SumColumn(TArrayView<const float> Values)
+	{
+		constexpr int32 BlockSize = 1024;
+		const int32 NumVectorized = Values.Num() & ~3;
+
+		double Total = 0.0;
+		int32 Index = 0;
+		while (Index < NumVectorized)
+		{
+			const int32 BlockEnd = FMath::Min(Index + BlockSize, NumVectorized);
+			VectorRegister4Float Lanes = VectorZeroFloat();
+			for (; Index < BlockEnd; Index += 4)
+			{
+				Lanes = VectorAdd(Lanes, VectorLoad(Values.GetData() + Index));
+			}
+
+			alignas(16) float LaneSums[4];
+			VectorStoreAligned(Lanes, LaneSums);
+			Total += double(LaneSums[0]) + double(LaneSums[1]) + double(LaneSums[2]) + double(LaneSums[3]);
+		}
+		for (; Index < Values.Num(); ++Index)
+		{
+			Total += Values[Index];
+		}
+		return Total;
+	}
+
+	static void RunBenchmark(const TArray<FString>& Args, UWorld* World)
+	{
+		UAstroModuleStatStore* Store = World ? World->GetSubsystem<UAstroModuleStatStore>() : nullptr;
+		if (!Store || !World->HasBegunPlay())
+		{
+			UE_LOG(LogAstroEngineer, Warning, TEXT("Module stat benchmark needs a world that has begun play"));
+			return;
+		}
+
+		const int32 NumModules = Args.Num() > 0 ? FMath::Max(1, FCString::Atoi(*Args[0])) : 100000;
+		const int32 NumIterations = Args.Num() > 1 ? FMath::Max(1, FCString::Atoi(*Args[1])) : 20;
+
+		// Stats go in through the setters before BeginPlay, the same way design overrides do
+		FRandomStream Random(0x0A57);
+		TArray<AAstroShipModule*> Modules;
+		TArray<FAstroModuleStatHandle> Handles;
+		Modules.Reserve(NumModules);
+		Handles.Reserve(NumModules);
+		for (int32 Index = 0; Index < NumModules; ++Index)
+		{
+			AAstroShipModule* Module = World->SpawnActorDeferred<AAstroShipModule>(AAstroShipModule::StaticClass(), FTransform::Identity);
+			if (!Module)
+				continue;
+
+			Module->SetMass(FMath::Lerp(100.0f, 20000.0f, Random.GetFraction()));
+			Module->SetPowerConsumption(FMath::Lerp(0.0f, 50.0f, Random.GetFraction()));
+			Module->SetPowerGeneration(FMath::Lerp(0.0f, 50.0f, Random.GetFraction()));
+			Module->SetCrewCapacity(Random.RandHelper(4));
+			Module->SetThrust(FMath::Lerp(0.0f, 500000.0f, Random.GetFraction()));
+			Module->FinishSpawning(FTransform::Identity);
+			Modules.Add(Module);
+			Handles.Add(Module->GetStatHandle());
+		}
+
+		// Actor fields: one pointer chase per module, the layout before the store existed
+		FAstroModuleStatTotals FieldTotals;
+		double StartTime = FPlatformTime::Seconds();
+		for (int32 Iteration = 0; Iteration < NumIterations; ++Iteration)
+		{
+			FieldTotals = FAstroModuleStatTotals();
+			for (const AAstroShipModule* Module : Modules)
+			{
+				FieldTotals.Mass += Module->Mass;
+				FieldTotals.PowerConsumption += Module->PowerConsumption;
+				FieldTotals.PowerGeneration += Module->PowerGeneration;
+				FieldTotals.CrewCapacity += Module->CrewCapacity;
+				FieldTotals.Thrust += Module->Thrust;
+				++FieldTotals.ModuleCount;
+			}
+		}
+		const double FieldSeconds = (FPlatformTime::Seconds() - StartTime) / NumIterations;
+
+		// Actor getters: the pointer chase plus a handle lookup into the store
+		FAstroModuleStatTotals GetterTotals;
+		StartTime = FPlatformTime::Seconds();
+		for (int32 Iteration = 0; Iteration < NumIterations; ++Iteration)
+		{
+			GetterTotals = FAstroModuleStatTotals();
+			for (const AAstroShipModule* Module : Modules)
+			{
+				GetterTotals.Mass += Module->GetMass();
+				GetterTotals.PowerConsumption += Module->GetPowerConsumption();
+				GetterTotals.PowerGeneration += Module->GetPowerGeneration();
+				GetterTotals.CrewCapacity += Module->GetCrewCapacity();
+				GetterTotals.Thrust += Module->GetThrust();
+				++GetterTotals.ModuleCount;
+			}
+		}
+		const double GetterSeconds = (FPlatformTime::Seconds() - StartTime) / NumIterations;
+
+		FAstroModuleStatTotals HandleTotals;
+		StartTime = FPlatformTime::Seconds();
+		for (int32 Iteration = 0; Iteration < NumIterations; ++Iteration)
+		{
+			HandleTotals = Store->SumModules(Handles);
+		}
+		const double HandleSeconds = (FPlatformTime::Seconds() - StartTime) / NumIterations;
+
+		FAstroModuleStatTotals ColumnTotals;
+		StartTime = FPlatformTime::Seconds();
+		for (int32 Iteration = 0; Iteration < NumIterations; ++Iteration)
+		{
+			ColumnTotals = Store->SumAllModules();
+		}
+		const double ColumnSeconds = (FPlatformTime::Seconds() - StartTime) / NumIterations;
+
+		UE_LOG(LogAstroEngineer, Display, TEXT("Module stat benchmark, %d modules (%d rows in store): actor fields %.3f ms, actor getters %.3f ms, store by handle %.3f ms, store columns %.3f ms; mass %.0f / %.0f / %.0f / %.0f kg"),
+			Modules.Num(), ColumnTotals.ModuleCount, FieldSeconds * 1000.0, GetterSeconds * 1000.0, HandleSeconds * 1000.0, ColumnSeconds * 1000.0,
+			FieldTotals.Mass, GetterTotals.Mass, HandleTotals.Mass, ColumnTotals.Mass);
+
+		for (AAstroShipModule* Module : Modules)
+		{
+			Module->Destroy();
+		}
+	}
+
+	static FAutoConsoleCommandWithWorldAndArgs BenchmarkCommand(
+		TEXT("astro.Ship.StatBenchmark"),
+		TEXT("Spawn modules and time whole-fleet stat sums through the actors and through the stat store. Usage: astro.Ship.StatBenchmark [NumModules=100000] [NumIterations=20]"),
+		FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&RunBenchmark));
+}
+
+FAstroModuleStatHandle UAstroModuleStatStore::Register(const AAstroShipModule& Module)
+{
+	int32 Slot;
+	if (FreeSlots.Num() > 0)
+	{
+		Slot = FreeSlots.Pop(EAllowShrinking::No);
+	}
+	else
+	{
+		Slot = SlotRows.Add(INDEX_NONE);
+		SlotSerials.Add(0);
+	}
+
+	const int32 Row = Masses.Add(Module.Mass);
+	PowerConsumptions.Add(Module.PowerConsumption);
+	PowerGenerations.Add(Module.PowerGeneration);
+	CrewCapacities.Add(Module.CrewCapacity);
+	Thrusts.Add(Module.Thrust);
+	ModuleTypes.Add(Module.ModuleType);
+	RowSlots.Add(Slot);
+	SlotRows[Slot] = Row;
+
+	SET_DWORD_STAT(STAT_AstroModuleStatRows, Masses.Num());
+
+	FAstroModuleStatHandle Handle;
+	Handle.Index = Slot;
+	Handle.Serial = ++SlotSerials[Slot];
+	return Handle;
+}
+
+void UAstroModuleStatStore::Release(FAstroModuleStatHandle& Handle)
+{
+	if (!IsValid(Handle))
+	{
+		Handle.Invalidate();
+		return;
+	}
+
+	// Move the last row into the hole so the columns stay packed
+	const int32 Row = SlotRows[Handle.Index];
+	const int32 LastRow = Masses.Num() - 1;
+	SlotRows[RowSlots[LastRow]] = Row;
+
+	Masses.RemoveAtSwap(Row, EAllowShrinking::No);
+	PowerConsumptions.RemoveAtSwap(Row, EAllowShrinking::No);
+	PowerGenerations.RemoveAtSwap(Row, EAllowShrinking::No);
+	CrewCapacities.RemoveAtSwap(Row, EAllowShrinking::No);
+	Thrusts.RemoveAtSwap(Row, EAllowShrinking::No);
+	ModuleTypes.RemoveAtSwap(Row, EAllowShrinking::No);
+	RowSlots.RemoveAtSwap(Row, EAllowShrinking::No);
+
+	SlotRows[Handle.Index] = INDEX_NONE;
+	++SlotSerials[Handle.Index];
+	FreeSlots.Add(Handle.Index);
+	Handle.Invalidate();
+
+	SET_DWORD_STAT(STAT_AstroModuleStatRows, Masses.Num());
+}
+
+bool UAstroModuleStatStore::IsValid(const FAstroModuleStatHandle& Handle) const
+{
+	return SlotRows.IsValidIndex(Handle.Index) && SlotRows[Handle.Index] != INDEX_NONE && SlotSerials[Handle.Index] == Handle.Serial;
+}
+
+int32 UAstroModuleStatStore::GetRow(const FAstroModuleStatHandle& Handle) const
+{
+	check(IsValid(Handle));
+	return SlotRows[Handle.Index];
+}
+
+FAstroModuleStatTotals UAstroModuleStatStore::SumAllModules() const
+{
+	SCOPE_CYCLE_COUNTER(STAT_AstroSumModuleStats);
+
+	// One pass per packed column; the float columns are summed in explicit SIMD lanes
+	FAstroModuleStatTotals Totals;
+	Totals.ModuleCount = Masses.Num();
+	Totals.Mass = AstroModuleStatStore::SumColumn(Masses);
+	Totals.PowerConsumption = AstroModuleStatStore::SumColumn(PowerConsumptions);
+	Totals.PowerGeneration = AstroModuleStatStore::SumColumn(PowerGenerations);
+	for (int32 Value : CrewCapacities)
+	{
+		Totals.CrewCapacity += Value;
+	}
+	Totals.Thrust = AstroModuleStatStore::SumColumn(Thrusts);
+	return Totals;
+}
+
+FAstroModuleStatTotals UAstroModuleStatStore::SumModules(TArrayView<const FAstroModuleStatHandle> Handles) const
+{
+	SCOPE_CYCLE_COUNTER(STAT_AstroSumModuleStats);
+
+	FAstroModuleStatTotals Totals;
+	for (const FAstroModuleStatHandle& Handle : Handles)
+	{
+		if (!IsValid(Handle))
+			continue;
+
+		const int32 Row = SlotRows[Handle.Index];
+		Totals.Mass += Masses[Row];
+		Totals.PowerConsumption += PowerConsumptions[Row];
+		Totals.PowerGeneration += PowerGenerations[Row];
+		Totals.CrewCapacity += CrewCapacities[Row];
+		Totals.Thrust += Thrusts[Row];
+		++Totals.ModuleCount;
+	}
+	return Totals;
+}
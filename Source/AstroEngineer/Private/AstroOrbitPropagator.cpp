@@ -0,0 +1,562 @@
+// Copyright Astro Engineer Team. All Rights Reserved.
+
+#include "AstroOrbitPropagator.h"
+#include "AstroEngineer.h"
+#include "HAL/IConsoleManager.h"
+
+DECLARE_CYCLE_STAT(TEXT("Propagate On Rails"), STAT_AstroPropagateOnRails, STATGROUP_AstroEngineer);
+DECLARE_CYCLE_STAT(TEXT("Integrate Thrusting Craft"), STAT_AstroIntegrateThrusting, STATGROUP_AstroEngineer);
+DECLARE_CYCLE_STAT(TEXT("Patch Conics"), STAT_AstroPatchConics, STATGROUP_AstroEngineer);
+DECLARE_CYCLE_STAT(TEXT("Resolve Orbit Events"), STAT_AstroResolveOrbitEvents, STATGROUP_AstroEngineer);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Orbit Events Resolved"), STAT_AstroOrbitEventsResolved, STATGROUP_AstroEngineer);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Orbiting Craft"), STAT_AstroOrbitingCraft, STATGROUP_AstroEngineer);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Thrusting Craft"), STAT_AstroThrustingCraft, STATGROUP_AstroEngineer);
+
+namespace AstroOrbitPropagator
+{
+	/** Slack on radius tests at an event time, which the analytic crossing only hits to rounding */
+	static constexpr double EventRadiusTolerance = 1.0;
+
+	/** Fastest a conic can go: its periapsis speed, or infinity when that is undefined */
+	static double GetTopSpeed(const FAstroOrbitalElements& Elements, double GravitationalParameter)
+	{
+		const double PeriapsisRadius = Elements.GetPeriapsisRadius();
+		return PeriapsisRadius > 0.0
+			? FMath::Sqrt(GravitationalParameter * (1.0 + Elements.Eccentricity) / PeriapsisRadius)
+			: TNumericLimits<double>::Max();
+	}
+}
+
+static TAutoConsoleVariable<int32> CVarAstroOrbitBatchKepler(
+	TEXT("astro.Orbit.BatchKepler"),
+	1,
+	TEXT("Solve Kepler's equation for coasting craft with the SIMD batch solver (1) or one craft at a time with the scalar reference (0)"),
+	ECVF_Default);
+
+int32 FAstroOrbitPropagator::AddBody(FName Name, double GravitationalParameter, double Radius, int32 ParentIndex, const FAstroOrbitalElements& Orbit)
+{
+	check(ParentIndex == INDEX_NONE ? Bodies.Num() == 0 : Bodies.IsValidIndex(ParentIndex));
+
+	FAstroCelestialBody& Body = Bodies.AddDefaulted_GetRef();
+	Body.Name = Name;
+	Body.GravitationalParameter = GravitationalParameter;
+	Body.Radius = Radius;
+	Body.ParentIndex = ParentIndex;
+	Body.Orbit = Orbit;
+	if (ParentIndex != INDEX_NONE)
+	{
+		Body.SphereOfInfluence = FAstroOrbitalMath::SphereOfInfluence(Orbit.SemiMajorAxis, GravitationalParameter, Bodies[ParentIndex].GravitationalParameter);
+	}
+
+	// Bodies are few and added once, so the child lists are simply rebuilt
+	ChildOffsets.Init(0, Bodies.Num() + 1);
+	for (const FAstroCelestialBody& Child : Bodies)
+	{
+		if (Child.ParentIndex != INDEX_NONE)
+		{
+			++ChildOffsets[Child.ParentIndex + 1];
+		}
+	}
+	for (int32 BodyIndex = 0; BodyIndex < Bodies.Num(); ++BodyIndex)
+	{
+		ChildOffsets[BodyIndex + 1] += ChildOffsets[BodyIndex];
+	}
+
+	ChildBodies.SetNumUninitialized(ChildOffsets.Last());
+	TArray<int32> Cursors(ChildOffsets.GetData(), Bodies.Num());
+	for (int32 BodyIndex = 0; BodyIndex < Bodies.Num(); ++BodyIndex)
+	{
+		if (Bodies[BodyIndex].ParentIndex != INDEX_NONE)
+		{
+			ChildBodies[Cursors[Bodies[BodyIndex].ParentIndex]++] = BodyIndex;
+		}
+	}
+
+	UpdateBodies();
+	return Bodies.Num() - 1;
+}
+
+int32 FAstroOrbitPropagator::FindBody(FName Name) const
+{
+	return Bodies.IndexOfByPredicate([Name](const FAstroCelestialBody& Body) { return Body.Name == Name; });
+}
+
+FAstroOrbitHandle FAstroOrbitPropagator::AddCraft(int32 BodyIndex, const FVector& Position, const FVector& Velocity)
+{
+	check(Bodies.IsValidIndex(BodyIndex));
+
+	int32 Slot;
+	if (FreeSlots.Num() > 0)
+	{
+		Slot = FreeSlots.Pop(EAllowShrinking::No);
+	}
+	else
+	{
+		Slot = SlotRows.Add(INDEX_NONE);
+		SlotSerials.Add(0);
+	}
+
+	const int32 Row = Positions.Add(Position);
+	Velocities.Add(Velocity);
+	CraftBodies.Add(BodyIndex);
+	GravitationalParameters.Add(Bodies[BodyIndex].GravitationalParameter);
+	SemiMajorAxes.AddUninitialized();
+	Eccentricities.AddUninitialized();
+	MeanMotions.AddUninitialized();
+	MeanAnomaliesAtEpoch.AddUninitialized();
+	Epochs.AddUninitialized();
+	PerifocalPs.AddUninitialized();
+	PerifocalQs.AddUninitialized();
+	CraftElements.AddUninitialized();
+	NextEventTimes.AddUninitialized();
+	ThrustAccelerations.Add(FVector::ZeroVector);
+	ThrustingCraft.Add(false);
+	LandedCraft.Add(false);
+	RowSlots.Add(Slot);
+	SlotRows[Slot] = Row;
+
+	PutOnRails(Row, Time);
+
+	FAstroOrbitHandle Handle;
+	Handle.Index = Slot;
+	Handle.Serial = ++SlotSerials[Slot];
+	return Handle;
+}
+
+void FAstroOrbitPropagator::RemoveCraft(FAstroOrbitHandle& Handle)
+{
+	if (!IsValid(Handle))
+	{
+		Handle.Invalidate();
+		return;
+	}
+
+	// Move the last row into the hole so the columns stay packed
+	const int32 Row = SlotRows[Handle.Index];
+	const int32 LastRow = Positions.Num() - 1;
+	SlotRows[RowSlots[LastRow]] = Row;
+
+	if (ThrustingCraft[Row])
+	{
+		--NumThrusting;
+	}
+	ThrustingCraft[Row] = ThrustingCraft[LastRow];
+	ThrustingCraft.RemoveAt(LastRow);
+	LandedCraft[Row] = LandedCraft[LastRow];
+	LandedCraft.RemoveAt(LastRow);
+
+	SemiMajorAxes.RemoveAtSwap(Row, EAllowShrinking::No);
+	Eccentricities.RemoveAtSwap(Row, EAllowShrinking::No);
+	MeanMotions.RemoveAtSwap(Row, EAllowShrinking::No);
+	MeanAnomaliesAtEpoch.RemoveAtSwap(Row, EAllowShrinking::No);
+	Epochs.RemoveAtSwap(Row, EAllowShrinking::No);
+	GravitationalParameters.RemoveAtSwap(Row, EAllowShrinking::No);
+	PerifocalPs.RemoveAtSwap(Row, EAllowShrinking::No);
+	PerifocalQs.RemoveAtSwap(Row, EAllowShrinking::No);
+	CraftElements.RemoveAtSwap(Row, EAllowShrinking::No);
+	NextEventTimes.RemoveAtSwap(Row, EAllowShrinking::No);
+	Positions.RemoveAtSwap(Row, EAllowShrinking::No);
+	Velocities.RemoveAtSwap(Row, EAllowShrinking::No);
+	CraftBodies.RemoveAtSwap(Row, EAllowShrinking::No);
+	ThrustAccelerations.RemoveAtSwap(Row, EAllowShrinking::No);
+	RowSlots.RemoveAtSwap(Row, EAllowShrinking::No);
+
+	SlotRows[Handle.Index] = INDEX_NONE;
+	++SlotSerials[Handle.Index];
+	FreeSlots.Add(Handle.Index);
+	Handle.Invalidate();
+}
+
+bool FAstroOrbitPropagator::IsValid(const FAstroOrbitHandle& Handle) const
+{
+	return SlotRows.IsValidIndex(Handle.Index) && SlotRows[Handle.Index] != INDEX_NONE && SlotSerials[Handle.Index] == Handle.Serial;
+}
+
+int32 FAstroOrbitPropagator::GetRow(const FAstroOrbitHandle& Handle) const
+{
+	check(IsValid(Handle));
+	return SlotRows[Handle.Index];
+}
+
+void FAstroOrbitPropagator::SetCraftThrust(const FAstroOrbitHandle& Handle, const FVector& Acceleration)
+{
+	const int32 Row = GetRow(Handle);
+	const bool bThrusting = !Acceleration.IsNearlyZero(UE_DOUBLE_SMALL_NUMBER);
+	ThrustAccelerations[Row] = bThrusting ? Acceleration : FVector::ZeroVector;
+	if (bThrusting == ThrustingCraft[Row])
+		return;
+
+	ThrustingCraft[Row] = bThrusting;
+	if (bThrusting)
+	{
+		// Thrust lifts a landed craft off; PatchConics checks craft under thrust every frame instead
+		++NumThrusting;
+		LandedCraft[Row] = false;
+		NextEventTimes[Row] = TNumericLimits<double>::Max();
+	}
+	else
+	{
+		// The integrated state lags the clock by the unfinished step
+		--NumThrusting;
+		PutOnRails(Row, Time - ThrustStepRemainder);
+	}
+}
+
+void FAstroOrbitPropagator::CutAllThrust()
+{
+	for (TConstSetBitIterator<> It(ThrustingCraft); It; ++It)
+	{
+		ThrustAccelerations[It.GetIndex()] = FVector::ZeroVector;
+		PutOnRails(It.GetIndex(), Time - ThrustStepRemainder);
+	}
+	ThrustingCraft.Init(false, ThrustingCraft.Num());
+	NumThrusting = 0;
+}
+
+void FAstroOrbitPropagator::SetCraftState(const FAstroOrbitHandle& Handle, int32 BodyIndex, const FVector& Position, const FVector& Velocity)
+{
+	check(Bodies.IsValidIndex(BodyIndex));
+
+	const int32 Row = GetRow(Handle);
+	Positions[Row] = Position;
+	Velocities[Row] = Velocity;
+	CraftBodies[Row] = BodyIndex;
+	GravitationalParameters[Row] = Bodies[BodyIndex].GravitationalParameter;
+	LandedCraft[Row] = false;
+	if (!ThrustingCraft[Row])
+	{
+		PutOnRails(Row, Time);
+	}
+}
+
+FVector FAstroOrbitPropagator::GetCraftRootPosition(const FAstroOrbitHandle& Handle) const
+{
+	const int32 Row = GetRow(Handle);
+	return Bodies[CraftBodies[Row]].RootPosition + Positions[Row];
+}
+
+FAstroOrbitalElements FAstroOrbitPropagator::GetCraftElements(const FAstroOrbitHandle& Handle) const
+{
+	const int32 Row = GetRow(Handle);
+	return ThrustingCraft[Row]
+		? FAstroOrbitalMath::ElementsFromState(Positions[Row], Velocities[Row], GravitationalParameters[Row], Time)
+		: CraftElements[Row];
+}
+
+void FAstroOrbitPropagator::Advance(double DeltaSeconds)
+{
+	Impacts.Reset();
+	ResolveEvents(Time + DeltaSeconds);
+	Time += DeltaSeconds;
+
+	UpdateBodies();
+	PropagateOnRails();
+	IntegrateThrusting(DeltaSeconds);
+	PatchConics();
+
+	SET_DWORD_STAT(STAT_AstroOrbitingCraft, Positions.Num());
+	SET_DWORD_STAT(STAT_AstroThrustingCraft, NumThrusting);
+}
+
+void FAstroOrbitPropagator::UpdateBodies()
+{
+	// Parents precede children, so one forward pass resolves the whole hierarchy
+	for (FAstroCelestialBody& Body : Bodies)
+	{
+		if (Body.ParentIndex == INDEX_NONE)
+			continue;
+
+		const FAstroCelestialBody& Parent = Bodies[Body.ParentIndex];
+		FAstroOrbitalMath::StateAtTime(Body.Orbit, Parent.GravitationalParameter, Time, Body.PositionInParent, Body.VelocityInParent);
+		Body.RootPosition = Parent.RootPosition + Body.PositionInParent;
+		Body.RootVelocity = Parent.RootVelocity + Body.VelocityInParent;
+	}
+}
+
+void FAstroOrbitPropagator::PropagateOnRails()
+{
+	SCOPE_CYCLE_COUNTER(STAT_AstroPropagateOnRails);
+
+	const int32 NumRows = Positions.Num();
+	MeanAnomalyScratch.SetNumUninitialized(NumRows, EAllowShrinking::No);
+	AnomalyScratch.SetNumUninitialized(NumRows, EAllowShrinking::No);
+	SineScratch.SetNumUninitialized(NumRows, EAllowShrinking::No);
+	CosineScratch.SetNumUninitialized(NumRows, EAllowShrinking::No);
+
+	// Solve every row as an ellipse in one pass; thrusting and landed rows are ignored and hyperbolic ones re-solved below
+	for (int32 Row = 0; Row < NumRows; ++Row)
+	{
+		MeanAnomalyScratch[Row] = MeanAnomaliesAtEpoch[Row] + MeanMotions[Row] * (Time - Epochs[Row]);
+	}
+	if (CVarAstroOrbitBatchKepler.GetValueOnGameThread() != 0)
+	{
+		FAstroOrbitalMath::SolveKeplerEllipticBatch(MeanAnomalyScratch, Eccentricities, AnomalyScratch, SineScratch, CosineScratch);
+	}
+	else
+	{
+		FAstroOrbitalMath::SolveKeplerEllipticBatchReference(MeanAnomalyScratch, Eccentricities, AnomalyScratch, SineScratch, CosineScratch);
+	}
+
+	for (int32 Row = 0; Row < NumRows; ++Row)
+	{
+		if (ThrustingCraft[Row] || LandedCraft[Row])
+			continue;
+
+		const double Eccentricity = Eccentricities[Row];
+		if (Eccentricity < 1.0)
+		{
+			FAstroOrbitalMath::StateFromEllipticAnomaly(SineScratch[Row], CosineScratch[Row], SemiMajorAxes[Row], Eccentricity, GravitationalParameters[Row],
+				PerifocalPs[Row], PerifocalQs[Row], Positions[Row], Velocities[Row]);
+		}
+		else
+		{
+			const double Anomaly = FAstroOrbitalMath::SolveKeplerHyperbolic(MeanAnomalyScratch[Row], Eccentricity);
+			FAstroOrbitalMath::StateFromAnomaly(Anomaly, SemiMajorAxes[Row], Eccentricity, GravitationalParameters[Row],
+				PerifocalPs[Row], PerifocalQs[Row], Positions[Row], Velocities[Row]);
+		}
+	}
+}
+
+void FAstroOrbitPropagator::IntegrateThrusting(double DeltaSeconds)
+{
+	if (NumThrusting == 0)
+	{
+		ThrustStepRemainder = 0.0;
+		return;
+	}
+
+	SCOPE_CYCLE_COUNTER(STAT_AstroIntegrateThrusting);
+
+	// Fixed steps keep burns independent of frame rate; the leftover fraction carries to the next frame
+	const double Available = ThrustStepRemainder + DeltaSeconds;
+	const int32 NumSteps = FMath::Min(FMath::FloorToInt32(Available / ThrustStepSeconds), MaxThrustStepsPerAdvance);
+	ThrustStepRemainder = FMath::Min(Available - NumSteps * ThrustStepSeconds, ThrustStepSeconds);
+
+	const double HalfStep = 0.5 * ThrustStepSeconds;
+	for (TConstSetBitIterator<> It(ThrustingCraft); It; ++It)
+	{
+		const int32 Row = It.GetIndex();
+		const double GravitationalParameter = GravitationalParameters[Row];
+		const FVector Thrust = ThrustAccelerations[Row];
+		FVector Position = Positions[Row];
+		FVector Velocity = Velocities[Row];
+
+		auto Acceleration = [GravitationalParameter, &Thrust](const FVector& At)
+		{
+			const double RadiusSquared = At.SizeSquared();
+			return Thrust - At * (GravitationalParameter / (RadiusSquared * FMath::Sqrt(RadiusSquared)));
+		};
+
+		// Kick-drift-kick leapfrog: symplectic, so coasting phases of a long burn do not gain or lose energy
+		FVector CurrentAcceleration = Acceleration(Position);
+		for (int32 Step = 0; Step < NumSteps; ++Step)
+		{
+			Velocity += CurrentAcceleration * HalfStep;
+			Position += Velocity * ThrustStepSeconds;
+			CurrentAcceleration = Acceleration(Position);
+			Velocity += CurrentAcceleration * HalfStep;
+		}
+
+		Positions[Row] = Position;
+		Velocities[Row] = Velocity;
+	}
+}
+
+void FAstroOrbitPropagator::ResolveEvents(double EndTime)
+{
+	SCOPE_CYCLE_COUNTER(STAT_AstroResolveOrbitEvents);
+
+	// Thrusting and landed craft have no event time, so at real-time rates this is one compare per craft
+	int32 NumResolved = 0;
+	const int32 NumRows = Positions.Num();
+	for (int32 Row = 0; Row < NumRows; ++Row)
+	{
+		for (int32 Step = 0; Step < MaxEventStepsPerAdvance && NextEventTimes[Row] < EndTime; ++Step)
+		{
+			const double EventTime = FMath::Max(NextEventTimes[Row], Time);
+			ResolveEvent(Row, EventTime);
+			++NumResolved;
+
+			// A craft sitting right on a boundary must still make progress
+			if (NextEventTimes[Row] <= EventTime)
+			{
+				NextEventTimes[Row] = EventTime + MinEventCheckSeconds;
+			}
+		}
+	}
+	INC_DWORD_STAT_BY(STAT_AstroOrbitEventsResolved, NumResolved);
+}
+
+void FAstroOrbitPropagator::ResolveEvent(int32 Row, double EventTime)
+{
+	const int32 BodyIndex = CraftBodies[Row];
+	const FAstroCelestialBody& Body = Bodies[BodyIndex];
+	FAstroOrbitalMath::StateAtTime(CraftElements[Row], GravitationalParameters[Row], EventTime, Positions[Row], Velocities[Row]);
+	const double Radius = Positions[Row].Size();
+
+	if (Radius <= Body.Radius + AstroOrbitPropagator::EventRadiusTolerance)
+	{
+		LandCraft(Row);
+		return;
+	}
+
+	// Bodies are evaluated at the event time rather than at the end of the frame, which may be hours later under warp
+	int32 NewBodyIndex = INDEX_NONE;
+	if (Body.ParentIndex != INDEX_NONE && Radius >= Body.SphereOfInfluence - AstroOrbitPropagator::EventRadiusTolerance)
+	{
+		FVector BodyPosition, BodyVelocity;
+		FAstroOrbitalMath::StateAtTime(Body.Orbit, Bodies[Body.ParentIndex].GravitationalParameter, EventTime, BodyPosition, BodyVelocity);
+		Positions[Row] += BodyPosition;
+		Velocities[Row] += BodyVelocity;
+		NewBodyIndex = Body.ParentIndex;
+	}
+	else
+	{
+		for (int32 ChildCursor = ChildOffsets[BodyIndex]; ChildCursor < ChildOffsets[BodyIndex + 1]; ++ChildCursor)
+		{
+			const FAstroCelestialBody& Child = Bodies[ChildBodies[ChildCursor]];
+			FVector ChildPosition, ChildVelocity;
+			FAstroOrbitalMath::StateAtTime(Child.Orbit, Body.GravitationalParameter, EventTime, ChildPosition, ChildVelocity);
+			if (FVector::DistSquared(Positions[Row], ChildPosition) < FMath::Square(Child.SphereOfInfluence))
+			{
+				Positions[Row] -= ChildPosition;
+				Velocities[Row] -= ChildVelocity;
+				NewBodyIndex = ChildBodies[ChildCursor];
+				break;
+			}
+		}
+	}
+
+	if (NewBodyIndex == INDEX_NONE)
+	{
+		UpdateNextEventTime(Row, EventTime);
+		return;
+	}
+
+	CraftBodies[Row] = NewBodyIndex;
+	GravitationalParameters[Row] = Bodies[NewBodyIndex].GravitationalParameter;
+	PutOnRails(Row, EventTime);
+
+	UE_LOG(LogAstroEngineer, Verbose, TEXT("Craft in slot %d moved from %s to %s at t=%.1f"), RowSlots[Row], *Body.Name.ToString(), *Bodies[NewBodyIndex].Name.ToString(), EventTime);
+}
+
+void FAstroOrbitPropagator::PatchConics()
+{
+	SCOPE_CYCLE_COUNTER(STAT_AstroPatchConics);
+
+	const int32 NumRows = Positions.Num();
+	for (int32 Row = 0; Row < NumRows; ++Row)
+	{
+		if (LandedCraft[Row])
+			continue;
+
+		const int32 BodyIndex = CraftBodies[Row];
+		const FAstroCelestialBody& Body = Bodies[BodyIndex];
+		const FVector& Position = Positions[Row];
+
+		if (Position.SizeSquared() < FMath::Square(Body.Radius))
+		{
+			LandCraft(Row);
+			continue;
+		}
+
+		if (Body.ParentIndex != INDEX_NONE && Position.SizeSquared() > FMath::Square(Body.SphereOfInfluence))
+		{
+			ChangeBody(Row, Body.ParentIndex);
+			continue;
+		}
+
+		for (int32 ChildCursor = ChildOffsets[BodyIndex]; ChildCursor < ChildOffsets[BodyIndex + 1]; ++ChildCursor)
+		{
+			const FAstroCelestialBody& Child = Bodies[ChildBodies[ChildCursor]];
+			if (FVector::DistSquared(Position, Child.PositionInParent) < FMath::Square(Child.SphereOfInfluence))
+			{
+				ChangeBody(Row, ChildBodies[ChildCursor]);
+				break;
+			}
+		}
+	}
+}
+
+void FAstroOrbitPropagator::PutOnRails(int32 Row, double StateTime)
+{
+	const FAstroOrbitalElements Elements = FAstroOrbitalMath::ElementsFromState(Positions[Row], Velocities[Row], GravitationalParameters[Row], StateTime);
+
+	CraftElements[Row] = Elements;
+	SemiMajorAxes[Row] = Elements.SemiMajorAxis;
+	Eccentricities[Row] = Elements.Eccentricity;
+	MeanMotions[Row] = Elements.GetMeanMotion(GravitationalParameters[Row]);
+	MeanAnomaliesAtEpoch[Row] = Elements.MeanAnomalyAtEpoch;
+	Epochs[Row] = Elements.Epoch;
+	Elements.GetPerifocalBasis(PerifocalPs[Row], PerifocalQs[Row]);
+
+	UpdateNextEventTime(Row, StateTime);
+}
+
+void FAstroOrbitPropagator::UpdateNextEventTime(int32 Row, double StateTime)
+{
+	const FAstroOrbitalElements& Elements = CraftElements[Row];
+	const double GravitationalParameter = GravitationalParameters[Row];
+	const int32 BodyIndex = CraftBodies[Row];
+	const FAstroCelestialBody& Body = Bodies[BodyIndex];
+
+	// Hitting the surface and leaving the sphere of influence follow from the conic alone
+	double NextEventTime = FAstroOrbitalMath::FindRadiusCrossing(Elements, GravitationalParameter, Body.Radius, StateTime, false);
+	if (Body.ParentIndex != INDEX_NONE)
+	{
+		NextEventTime = FMath::Min(NextEventTime, FAstroOrbitalMath::FindRadiusCrossing(Elements, GravitationalParameter, Body.SphereOfInfluence, StateTime, true));
+	}
+
+	// Children move, so entering one of their spheres is bounded conservatively: the gap cannot close faster than both top speeds
+	const double CraftTopSpeed = AstroOrbitPropagator::GetTopSpeed(Elements, GravitationalParameter);
+	for (int32 ChildCursor = ChildOffsets[BodyIndex]; ChildCursor < ChildOffsets[BodyIndex + 1]; ++ChildCursor)
+	{
+		const FAstroCelestialBody& Child = Bodies[ChildBodies[ChildCursor]];
+		FVector ChildPosition, ChildVelocity;
+		FAstroOrbitalMath::StateAtTime(Child.Orbit, Body.GravitationalParameter, StateTime, ChildPosition, ChildVelocity);
+		const double Gap = FVector::Dist(Positions[Row], ChildPosition) - Child.SphereOfInfluence;
+		const double ClosingSpeed = CraftTopSpeed + AstroOrbitPropagator::GetTopSpeed(Child.Orbit, Body.GravitationalParameter);
+		NextEventTime = FMath::Min(NextEventTime, StateTime + FMath::Max(Gap / ClosingSpeed, MinEventCheckSeconds));
+	}
+	NextEventTimes[Row] = NextEventTime;
+}
+
+void FAstroOrbitPropagator::LandCraft(int32 Row)
+{
+	if (ThrustingCraft[Row])
+	{
+		ThrustingCraft[Row] = false;
+		ThrustAccelerations[Row] = FVector::ZeroVector;
+		--NumThrusting;
+	}
+
+	const FAstroCelestialBody& Body = Bodies[CraftBodies[Row]];
+	Positions[Row] = Positions[Row].GetSafeNormal(UE_DOUBLE_SMALL_NUMBER, FVector::UpVector) * Body.Radius;
+	Velocities[Row] = FVector::ZeroVector;
+	LandedCraft[Row] = true;
+	NextEventTimes[Row] = TNumericLimits<double>::Max();
+
+	FAstroOrbitHandle& Impact = Impacts.AddDefaulted_GetRef();
+	Impact.Index = RowSlots[Row];
+	Impact.Serial = SlotSerials[Impact.Index];
+
+	UE_LOG(LogAstroEngineer, Verbose, TEXT("Craft in slot %d hit %s"), RowSlots[Row], *Body.Name.ToString());
+}
+
+void FAstroOrbitPropagator::ChangeBody(int32 Row, int32 NewBodyIndex)
+{
+	const FAstroCelestialBody& OldBody = Bodies[CraftBodies[Row]];
+	const FAstroCelestialBody& NewBody = Bodies[NewBodyIndex];
+
+	Positions[Row] += OldBody.RootPosition - NewBody.RootPosition;
+	Velocities[Row] += OldBody.RootVelocity - NewBody.RootVelocity;
+	CraftBodies[Row] = NewBodyIndex;
+	GravitationalParameters[Row] = NewBody.GravitationalParameter;
+
+	if (!ThrustingCraft[Row])
+	{
+		PutOnRails(Row, Time);
+	}
+
+	UE_LOG(LogAstroEngineer, Verbose, TEXT("Craft in slot %d moved from %s to %s"), RowSlots[Row], *OldBody.Name.ToString(), *NewBody.Name.ToString());
+}
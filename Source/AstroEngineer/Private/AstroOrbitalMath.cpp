@@ -0,0 +1,357 @@
+// Copyright Astro Engineer Team. All Rights Reserved.
+
+#include "AstroOrbitalMath.h"
+
+namespace AstroOrbitalMath
+{
+	static constexpr int32 MaxKeplerIterations = 32;
+	static constexpr double KeplerTolerance = 1.0e-12;
+
+	/** Exactly parabolic orbits have no finite semi-major axis, so they are nudged to a barely hyperbolic one */
+	static constexpr double NearParabolicTolerance = 1.0e-9;
+
+	/** Below this eccentricity or inclination the periapsis or node direction is undefined, and a reference axis stands in */
+	static constexpr double DegenerateTolerance = 1.0e-11;
+
+	/** Batch lanes are clamped below this so a hyperbolic orbit in the batch cannot stall the shared iteration loop */
+	static constexpr double MaxBatchEccentricity = 1.0 - 1.0e-9;
+
+	/** PI/2 split in two for exact range reduction, and minimax coefficients for sine and cosine on [-PI/4, PI/4] */
+	static constexpr double HalfPiHigh = 1.57079632679489655800e+00;
+	static constexpr double HalfPiLow = 6.12323399573676603587e-17;
+	static constexpr double SineCoefficients[] = { 1.58962301576546568060e-10, -2.50507477628578072866e-8, 2.75573136213857245213e-6,
+		-1.98412698295895385996e-4, 8.33333333332211858878e-3, -1.66666666666666307295e-1 };
+	static constexpr double CosineCoefficients[] = { -1.13585365213876817300e-11, 2.08757008419747316778e-9, -2.75573141792967388112e-7,
+		2.48015872888517045348e-5, -1.38888888888730564116e-3, 4.16666666666665929218e-2 };
+
+	/** Sine and cosine of four angles at full double precision, for the angles Newton visits (a few turns either way) */
+	static FORCEINLINE void VectorSinCos(const VectorRegister4Double& Angle, VectorRegister4Double& OutSin, VectorRegister4Double& OutCos)
+	{
+		// Angle = Quadrant * PI/2 + Reduced, with |Reduced| <= PI/4
+		const VectorRegister4Double Quadrant = VectorFloor(VectorMultiplyAdd(Angle, VectorSetFloat1(2.0 / UE_DOUBLE_PI), VectorSetFloat1(0.5)));
+		const VectorRegister4Double Reduced = VectorNegateMultiplyAdd(Quadrant, VectorSetFloat1(HalfPiLow),
+			VectorNegateMultiplyAdd(Quadrant, VectorSetFloat1(HalfPiHigh), Angle));
+		const VectorRegister4Double Squared = VectorMultiply(Reduced, Reduced);
+
+		VectorRegister4Double SinePolynomial = VectorSetFloat1(SineCoefficients[0]);
+		VectorRegister4Double CosinePolynomial = VectorSetFloat1(CosineCoefficients[0]);
+		constexpr int32 NumTerms = UE_ARRAY_COUNT(SineCoefficients);
+		for (int32 Term = 1; Term < NumTerms; ++Term)
+		{
+			SinePolynomial = VectorMultiplyAdd(SinePolynomial, Squared, VectorSetFloat1(SineCoefficients[Term]));
+			CosinePolynomial = VectorMultiplyAdd(CosinePolynomial, Squared, VectorSetFloat1(CosineCoefficients[Term]));
+		}
+		const VectorRegister4Double Sine = VectorMultiplyAdd(VectorMultiply(Reduced, Squared), SinePolynomial, Reduced);
+		const VectorRegister4Double Cosine = VectorMultiplyAdd(VectorMultiply(Squared, Squared), CosinePolynomial,
+			VectorNegateMultiplyAdd(Squared, VectorSetFloat1(0.5), VectorSetFloat1(1.0)));
+
+		// Quadrant mod 4: odd quadrants swap sine and cosine, sine is negated in 2 and 3, cosine in 1 and 2
+		const VectorRegister4Double Turn = VectorNegateMultiplyAdd(VectorFloor(VectorMultiply(Quadrant, VectorSetFloat1(0.25))), VectorSetFloat1(4.0), Quadrant);
+		const VectorRegister4Double Odd = VectorBitwiseOr(VectorCompareEQ(Turn, VectorSetFloat1(1.0)), VectorCompareEQ(Turn, VectorSetFloat1(3.0)));
+		const VectorRegister4Double SineNegative = VectorCompareGT(Turn, VectorSetFloat1(1.5));
+		const VectorRegister4Double CosineNegative = VectorBitwiseAnd(VectorCompareGT(Turn, VectorSetFloat1(0.5)), VectorCompareLT(Turn, VectorSetFloat1(2.5)));
+
+		const VectorRegister4Double SwappedSine = VectorSelect(Odd, Cosine, Sine);
+		const VectorRegister4Double SwappedCosine = VectorSelect(Odd, Sine, Cosine);
+		OutSin = VectorSelect(SineNegative, VectorNegate(SwappedSine), SwappedSine);
+		OutCos = VectorSelect(CosineNegative, VectorNegate(SwappedCosine), SwappedCosine);
+	}
+}
+
+double FAstroOrbitalElements::GetApoapsisRadius() const
+{
+	return IsHyperbolic() ? TNumericLimits<double>::Max() : SemiMajorAxis * (1.0 + Eccentricity);
+}
+
+double FAstroOrbitalElements::GetMeanMotion(double GravitationalParameter) const
+{
+	const double A = FMath::Abs(SemiMajorAxis);
+	return A > 0.0 ? FMath::Sqrt(GravitationalParameter / (A * A * A)) : 0.0;
+}
+
+double FAstroOrbitalElements::GetPeriod(double GravitationalParameter) const
+{
+	const double MeanMotion = GetMeanMotion(GravitationalParameter);
+	return IsHyperbolic() || MeanMotion <= 0.0 ? TNumericLimits<double>::Max() : 2.0 * UE_DOUBLE_PI / MeanMotion;
+}
+
+void FAstroOrbitalElements::GetPerifocalBasis(FVector& OutP, FVector& OutQ) const
+{
+	double SinNode, CosNode, SinInclination, CosInclination, SinPeriapsis, CosPeriapsis;
+	FMath::SinCos(&SinNode, &CosNode, LongitudeOfAscendingNode);
+	FMath::SinCos(&SinInclination, &CosInclination, Inclination);
+	FMath::SinCos(&SinPeriapsis, &CosPeriapsis, ArgumentOfPeriapsis);
+
+	// Rotate from the ascending node by the argument of periapsis within the orbital plane
+	const FVector NodeDirection(CosNode, SinNode, 0.0);
+	const FVector Normal(SinNode * SinInclination, -CosNode * SinInclination, CosInclination);
+	const FVector InPlane = Normal ^ NodeDirection;
+
+	OutP = NodeDirection * CosPeriapsis + InPlane * SinPeriapsis;
+	OutQ = Normal ^ OutP;
+}
+
+double FAstroOrbitalMath::SolveKeplerElliptic(double MeanAnomaly, double Eccentricity)
+{
+	MeanAnomaly = WrapAngle(MeanAnomaly);
+
+	// Second-order starter for moderate eccentricity, PI for high where iterating from M can overshoot
+	double Anomaly = Eccentricity < 0.8 ? MeanAnomaly + Eccentricity * FMath::Sin(MeanAnomaly) : (MeanAnomaly < 0.0 ? -UE_DOUBLE_PI : UE_DOUBLE_PI);
+	for (int32 Iteration = 0; Iteration < AstroOrbitalMath::MaxKeplerIterations; ++Iteration)
+	{
+		// Halley's method: the second derivative is free once sine and cosine are known, and saves about one iteration in four
+		double SinE, CosE;
+		FMath::SinCos(&SinE, &CosE, Anomaly);
+		const double Residual = Anomaly - Eccentricity * SinE - MeanAnomaly;
+		const double Slope = 1.0 - Eccentricity * CosE;
+		const double Step = Residual * Slope / (Slope * Slope - 0.5 * Residual * Eccentricity * SinE);
+		Anomaly -= Step;
+		if (FMath::Abs(Step) < AstroOrbitalMath::KeplerTolerance)
+			break;
+	}
+	return Anomaly;
+}
+
+void FAstroOrbitalMath::SolveKeplerEllipticBatch(TArrayView<const double> MeanAnomalies, TArrayView<const double> Eccentricities,
+	TArrayView<double> OutAnomalies, TArrayView<double> OutSines, TArrayView<double> OutCosines)
+{
+	const int32 Count = MeanAnomalies.Num();
+	check(Eccentricities.Num() == Count && OutAnomalies.Num() == Count && OutSines.Num() == Count && OutCosines.Num() == Count);
+
+	const VectorRegister4Double Zero = VectorZeroDouble();
+	const VectorRegister4Double One = VectorSetFloat1(1.0);
+	const VectorRegister4Double Half = VectorSetFloat1(0.5);
+	const VectorRegister4Double Pi = VectorSetFloat1(UE_DOUBLE_PI);
+	const VectorRegister4Double TwoPi = VectorSetFloat1(UE_DOUBLE_TWO_PI);
+	const VectorRegister4Double InverseTwoPi = VectorSetFloat1(1.0 / UE_DOUBLE_TWO_PI);
+	const VectorRegister4Double HighEccentricity = VectorSetFloat1(0.8);
+	const VectorRegister4Double MaxEccentricity = VectorSetFloat1(AstroOrbitalMath::MaxBatchEccentricity);
+	const VectorRegister4Double Tolerance = VectorSetFloat1(AstroOrbitalMath::KeplerTolerance);
+
+	// Same starter and iteration as SolveKeplerElliptic; a group of four stops once its slowest lane converges
+	const int32 VectorCount = Count & ~3;
+	for (int32 Index = 0; Index < VectorCount; Index += 4)
+	{
+		const VectorRegister4Double Eccentricity = VectorMin(VectorLoad(&Eccentricities[Index]), MaxEccentricity);
+		VectorRegister4Double MeanAnomaly = VectorLoad(&MeanAnomalies[Index]);
+		MeanAnomaly = VectorNegateMultiplyAdd(VectorFloor(VectorMultiplyAdd(MeanAnomaly, InverseTwoPi, Half)), TwoPi, MeanAnomaly);
+
+		VectorRegister4Double SinE, CosE;
+		VectorSinCos(MeanAnomaly, SinE, CosE);
+		const VectorRegister4Double LowStart = VectorMultiplyAdd(Eccentricity, SinE, MeanAnomaly);
+		const VectorRegister4Double HighStart = VectorSelect(VectorCompareLT(MeanAnomaly, Zero), VectorNegate(Pi), Pi);
+		VectorRegister4Double Anomaly = VectorSelect(VectorCompareLT(Eccentricity, HighEccentricity), LowStart, HighStart);
+
+		for (int32 Iteration = 0; Iteration < AstroOrbitalMath::MaxKeplerIterations; ++Iteration)
+		{
+			VectorSinCos(Anomaly, SinE, CosE);
+			const VectorRegister4Double Residual = VectorSubtract(VectorNegateMultiplyAdd(Eccentricity, SinE, Anomaly), MeanAnomaly);
+			const VectorRegister4Double Slope = VectorNegateMultiplyAdd(Eccentricity, CosE, One);
+			const VectorRegister4Double Curvature = VectorMultiply(VectorMultiply(Residual, Half), VectorMultiply(Eccentricity, SinE));
+			const VectorRegister4Double Step = VectorDivide(VectorMultiply(Residual, Slope), VectorMultiplyAdd(Slope, Slope, VectorNegate(Curvature)));
+			Anomaly = VectorSubtract(Anomaly, Step);
+			if (VectorMaskBits(VectorCompareGE(VectorAbs(Step), Tolerance)) == 0)
+				break;
+		}
+
+		VectorSinCos(Anomaly, SinE, CosE);
+		VectorStore(Anomaly, &OutAnomalies[Index]);
+		VectorStore(SinE, &OutSines[Index]);
+		VectorStore(CosE, &OutCosines[Index]);
+	}
+
+	const int32 TailCount = Count - VectorCount;
+	SolveKeplerEllipticBatchReference(MeanAnomalies.Slice(VectorCount, TailCount), Eccentricities.Slice(VectorCount, TailCount),
+		OutAnomalies.Slice(VectorCount, TailCount), OutSines.Slice(VectorCount, TailCount), OutCosines.Slice(VectorCount, TailCount));
+}
+
+void FAstroOrbitalMath::SolveKeplerEllipticBatchReference(TArrayView<const double> MeanAnomalies, TArrayView<const double> Eccentricities,
+	TArrayView<double> OutAnomalies, TArrayView<double> OutSines, TArrayView<double> OutCosines)
+{
+	const int32 Count = MeanAnomalies.Num();
+	check(Eccentricities.Num() == Count && OutAnomalies.Num() == Count && OutSines.Num() == Count && OutCosines.Num() == Count);
+
+	for (int32 Index = 0; Index < Count; ++Index)
+	{
+		const double Eccentricity = FMath::Min(Eccentricities[Index], AstroOrbitalMath::MaxBatchEccentricity);
+		OutAnomalies[Index] = SolveKeplerElliptic(MeanAnomalies[Index], Eccentricity);
+		FMath::SinCos(&OutSines[Index], &OutCosines[Index], OutAnomalies[Index]);
+	}
+}
+
+double FAstroOrbitalMath::SolveKeplerHyperbolic(double MeanAnomaly, double Eccentricity)
+{
+	// Logarithmic starter, good for both small and very large mean anomalies
+	double Anomaly = FMath::Sign(MeanAnomaly) * FMath::Loge(2.0 * FMath::Abs(MeanAnomaly) / Eccentricity + 1.8);
+	for (int32 Iteration = 0; Iteration < AstroOrbitalMath::MaxKeplerIterations; ++Iteration)
+	{
+		const double Step = (Eccentricity * sinh(Anomaly) - Anomaly - MeanAnomaly) / (Eccentricity * cosh(Anomaly) - 1.0);
+		Anomaly -= Step;
+		if (FMath::Abs(Step) < AstroOrbitalMath::KeplerTolerance * FMath::Max(1.0, FMath::Abs(Anomaly)))
+			break;
+	}
+	return Anomaly;
+}
+
+FAstroOrbitalElements FAstroOrbitalMath::ElementsFromState(const FVector& Position, const FVector& Velocity, double GravitationalParameter, double Time)
+{
+	FAstroOrbitalElements Elements;
+	Elements.Epoch = Time;
+
+	const double Radius = Position.Size();
+	if (Radius <= 0.0 || GravitationalParameter <= 0.0)
+		return Elements;
+
+	FVector AdjustedVelocity = Velocity;
+	FVector AngularMomentum = Position ^ AdjustedVelocity;
+	if (AngularMomentum.SizeSquared() <= AstroOrbitalMath::DegenerateTolerance * Radius * Radius * FMath::Max(AdjustedVelocity.SizeSquared(), 1.0))
+	{
+		// Purely radial motion has no orbital plane; a negligible sideways component gives it one
+		const FVector Side = FMath::Abs(Position.Z) < 0.9 * Radius ? FVector::UnitZ() : FVector::UnitX();
+		AdjustedVelocity += (Side ^ Position).GetSafeNormal() * FMath::Max(AdjustedVelocity.Size() * 1.0e-6, 1.0e-6);
+		AngularMomentum = Position ^ AdjustedVelocity;
+	}
+
+	const double AngularMomentumSize = AngularMomentum.Size();
+	const FVector Normal = AngularMomentum / AngularMomentumSize;
+	const FVector EccentricityVector = (AdjustedVelocity ^ AngularMomentum) / GravitationalParameter - Position / Radius;
+
+	double Eccentricity = EccentricityVector.Size();
+	if (FMath::Abs(Eccentricity - 1.0) < AstroOrbitalMath::NearParabolicTolerance)
+	{
+		Eccentricity = 1.0 + AstroOrbitalMath::NearParabolicTolerance;
+	}
+	const double SemiLatusRectum = AngularMomentumSize * AngularMomentumSize / GravitationalParameter;
+
+	Elements.Eccentricity = Eccentricity;
+	Elements.SemiMajorAxis = SemiLatusRectum / (1.0 - Eccentricity * Eccentricity);
+	Elements.Inclination = FMath::Acos(FMath::Clamp(Normal.Z, -1.0, 1.0));
+
+	// Ascending node, falling back to +X for equatorial orbits
+	const FVector Node(-AngularMomentum.Y, AngularMomentum.X, 0.0);
+	const bool bEquatorial = Node.Size() <= AstroOrbitalMath::DegenerateTolerance * AngularMomentumSize;
+	const FVector NodeDirection = bEquatorial ? FVector::UnitX() : Node.GetUnsafeNormal();
+	Elements.LongitudeOfAscendingNode = bEquatorial ? 0.0 : FMath::Atan2(NodeDirection.Y, NodeDirection.X);
+
+	// Periapsis angle from the node, or zero for circular orbits so the anomaly counts from the node
+	const FVector InPlane = Normal ^ NodeDirection;
+	Elements.ArgumentOfPeriapsis = Eccentricity > AstroOrbitalMath::DegenerateTolerance
+		? FMath::Atan2(EccentricityVector | InPlane, EccentricityVector | NodeDirection)
+		: 0.0;
+
+	FVector P, Q;
+	Elements.GetPerifocalBasis(P, Q);
+	const double TrueAnomaly = FMath::Atan2(Position | Q, Position | P);
+
+	double SinTrue, CosTrue;
+	FMath::SinCos(&SinTrue, &CosTrue, TrueAnomaly);
+	if (Eccentricity < 1.0)
+	{
+		const double EccentricAnomaly = FMath::Atan2(FMath::Sqrt(1.0 - Eccentricity * Eccentricity) * SinTrue, Eccentricity + CosTrue);
+		Elements.MeanAnomalyAtEpoch = EccentricAnomaly - Eccentricity * FMath::Sin(EccentricAnomaly);
+	}
+	else
+	{
+		const double HyperbolicAnomaly = asinh(FMath::Sqrt(Eccentricity * Eccentricity - 1.0) * SinTrue / (1.0 + Eccentricity * CosTrue));
+		Elements.MeanAnomalyAtEpoch = Eccentricity * sinh(HyperbolicAnomaly) - HyperbolicAnomaly;
+	}
+
+	return Elements;
+}
+
+void FAstroOrbitalMath::StateAtTime(const FAstroOrbitalElements& Elements, double GravitationalParameter, double Time, FVector& OutPosition, FVector& OutVelocity)
+{
+	FVector P, Q;
+	Elements.GetPerifocalBasis(P, Q);
+
+	const double MeanAnomaly = Elements.MeanAnomalyAtEpoch + Elements.GetMeanMotion(GravitationalParameter) * (Time - Elements.Epoch);
+	const double Anomaly = Elements.IsHyperbolic()
+		? SolveKeplerHyperbolic(MeanAnomaly, Elements.Eccentricity)
+		: SolveKeplerElliptic(MeanAnomaly, Elements.Eccentricity);
+
+	StateFromAnomaly(Anomaly, Elements.SemiMajorAxis, Elements.Eccentricity, GravitationalParameter, P, Q, OutPosition, OutVelocity);
+}
+
+void FAstroOrbitalMath::StateFromAnomaly(double Anomaly, double SemiMajorAxis, double Eccentricity, double GravitationalParameter,
+	const FVector& P, const FVector& Q, FVector& OutPosition, FVector& OutVelocity)
+{
+	if (Eccentricity < 1.0)
+	{
+		double SinE, CosE;
+		FMath::SinCos(&SinE, &CosE, Anomaly);
+		StateFromEllipticAnomaly(SinE, CosE, SemiMajorAxis, Eccentricity, GravitationalParameter, P, Q, OutPosition, OutVelocity);
+	}
+	else
+	{
+		const double SinhH = sinh(Anomaly);
+		const double CoshH = cosh(Anomaly);
+		const double A = -SemiMajorAxis;
+		const double MinorFactor = FMath::Sqrt(Eccentricity * Eccentricity - 1.0);
+		const double Radius = A * (Eccentricity * CoshH - 1.0);
+		const double SpeedFactor = FMath::Sqrt(GravitationalParameter * A) / Radius;
+
+		OutPosition = P * (A * (Eccentricity - CoshH)) + Q * (A * MinorFactor * SinhH);
+		OutVelocity = P * (-SpeedFactor * SinhH) + Q * (SpeedFactor * MinorFactor * CoshH);
+	}
+}
+
+void FAstroOrbitalMath::StateFromEllipticAnomaly(double SinE, double CosE, double SemiMajorAxis, double Eccentricity, double GravitationalParameter,
+	const FVector& P, const FVector& Q, FVector& OutPosition, FVector& OutVelocity)
+{
+	const double MinorFactor = FMath::Sqrt(1.0 - Eccentricity * Eccentricity);
+	const double Radius = SemiMajorAxis * (1.0 - Eccentricity * CosE);
+	const double SpeedFactor = FMath::Sqrt(GravitationalParameter * SemiMajorAxis) / Radius;
+
+	OutPosition = P * (SemiMajorAxis * (CosE - Eccentricity)) + Q * (SemiMajorAxis * MinorFactor * SinE);
+	OutVelocity = P * (-SpeedFactor * SinE) + Q * (SpeedFactor * MinorFactor * CosE);
+}
+
+void FAstroOrbitalMath::HohmannTransfer(double FromRadius, double ToRadius, double GravitationalParameter, double& OutDepartureDeltaV, double& OutArrivalDeltaV, double& OutTransferTime)
+{
+	const double TransferAxis = 0.5 * (FromRadius + ToRadius);
+
+	// Positive values are prograde burns; a transfer inwards gives two retrograde ones
+	const double DepartureSpeed = FMath::Sqrt(GravitationalParameter * (2.0 / FromRadius - 1.0 / TransferAxis));
+	const double ArrivalSpeed = FMath::Sqrt(GravitationalParameter * (2.0 / ToRadius - 1.0 / TransferAxis));
+	OutDepartureDeltaV = DepartureSpeed - FMath::Sqrt(GravitationalParameter / FromRadius);
+	OutArrivalDeltaV = FMath::Sqrt(GravitationalParameter / ToRadius) - ArrivalSpeed;
+	OutTransferTime = UE_DOUBLE_PI * FMath::Sqrt(TransferAxis * TransferAxis * TransferAxis / GravitationalParameter);
+}
+
+double FAstroOrbitalMath::FindRadiusCrossing(const FAstroOrbitalElements& Elements, double GravitationalParameter, double Radius, double After, bool bOutward)
+{
+	const double MeanMotion = Elements.GetMeanMotion(GravitationalParameter);
+	if (MeanMotion <= 0.0 || Elements.Eccentricity <= 0.0)
+		return TNumericLimits<double>::Max();
+
+	// r = a (1 - e cos E) on an ellipse and r = a (1 - e cosh H) on a hyperbola; outward crossings have positive anomaly
+	const double CosAnomaly = (1.0 - Radius / Elements.SemiMajorAxis) / Elements.Eccentricity;
+	if (!Elements.IsHyperbolic())
+	{
+		if (FMath::Abs(CosAnomaly) > 1.0)
+			return TNumericLimits<double>::Max();
+
+		const double Anomaly = bOutward ? FMath::Acos(CosAnomaly) : -FMath::Acos(CosAnomaly);
+		const double CrossingMeanAnomaly = Anomaly - Elements.Eccentricity * FMath::Sin(Anomaly);
+		const double MeanAnomalyAfter = Elements.MeanAnomalyAtEpoch + MeanMotion * (After - Elements.Epoch);
+		const double Ahead = CrossingMeanAnomaly - MeanAnomalyAfter;
+		return After + (Ahead - UE_DOUBLE_TWO_PI * FMath::FloorToDouble(Ahead / UE_DOUBLE_TWO_PI)) / MeanMotion;
+	}
+
+	if (CosAnomaly < 1.0)
+		return TNumericLimits<double>::Max();
+
+	const double Anomaly = bOutward ? acosh(CosAnomaly) : -acosh(CosAnomaly);
+	const double CrossingTime = Elements.Epoch + (Elements.Eccentricity * sinh(Anomaly) - Anomaly - Elements.MeanAnomalyAtEpoch) / MeanMotion;
+	return CrossingTime > After ? CrossingTime : TNumericLimits<double>::Max();
+}
+
+double FAstroOrbitalMath::SphereOfInfluence(double SemiMajorAxis, double GravitationalParameter, double ParentGravitationalParameter)
+{
+	return FMath::Abs(SemiMajorAxis) * FMath::Pow(GravitationalParameter / ParentGravitationalParameter, 0.4);
+}
+
+double FAstroOrbitalMath::WrapAngle(double Angle)
+{
+	return Angle - UE_DOUBLE_TWO_PI * FMath::FloorToDouble((Angle + UE_DOUBLE_PI) / UE_DOUBLE_TWO_PI);
+}
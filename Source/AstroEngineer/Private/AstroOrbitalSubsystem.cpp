@@ -0,0 +1,200 @@
+// Copyright Astro Engineer Team. All Rights Reserved.
+
+#include "AstroOrbitalSubsystem.h"
+#include "AstroTimeWarpSubsystem.h"
+#include "AstroEngineer.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+#include "Math/RandomStream.h"
+
+namespace AstroOrbitalSubsystem
+{
+	/** Propagate a synthetic fleet around an Earth-sized body with a Moon-sized satellite and log per-frame cost */
+	static void RunBenchmark(const TArray<FString>& Args)
+	{
+		const int32 NumCraft = Args.Num() > 0 ? FMath::Max(1, FCString::Atoi(*Args[0])) : 10000;
+		const int32 NumFrames = Args.Num() > 1 ? FMath::Max(1, FCString::Atoi(*Args[1])) : 300;
+
+		FAstroOrbitPropagator Propagator;
+		const int32 Planet = Propagator.AddBody(TEXT("BenchmarkPlanet"), 3.986004418e14, 6.371e6, INDEX_NONE, FAstroOrbitalElements());
+		FAstroOrbitalElements MoonOrbit;
+		MoonOrbit.SemiMajorAxis = 3.844e8;
+		MoonOrbit.Eccentricity = 0.0549;
+		MoonOrbit.Inclination = FMath::DegreesToRadians(5.1);
+		Propagator.AddBody(TEXT("BenchmarkMoon"), 4.9048695e12, 1.737e6, Planet, MoonOrbit);
+
+		// Low orbits to highly eccentric ones, with a few escape trajectories mixed in
+		FRandomStream Random(0x0A57);
+		const double GravitationalParameter = Propagator.GetBody(Planet).GravitationalParameter;
+		for (int32 Index = 0; Index < NumCraft; ++Index)
+		{
+			const double Radius = FMath::Lerp(6.6e6, 4.2e7, double(Random.GetFraction()));
+			const double CircularSpeed = FMath::Sqrt(GravitationalParameter / Radius);
+			const double SpeedFactor = Random.GetFraction() < 0.05f ? FMath::Lerp(1.45, 2.0, double(Random.GetFraction())) : FMath::Lerp(0.8, 1.3, double(Random.GetFraction()));
+			const FVector Direction = Random.GetUnitVector();
+			const FVector Tangent = (Direction ^ Random.GetUnitVector()).GetSafeNormal();
+			Propagator.AddCraft(Planet, Direction * Radius, Tangent * CircularSpeed * SpeedFactor);
+		}
+
+		double RailsSeconds = 0.0;
+		double AdvanceSeconds = 0.0;
+		double WorstFrameSeconds = 0.0;
+		for (int32 Frame = 0; Frame < NumFrames; ++Frame)
+		{
+			const double FrameStart = FPlatformTime::Seconds();
+			Propagator.Advance(1.0 / 60.0);
+			const double FrameSeconds = FPlatformTime::Seconds() - FrameStart;
+			AdvanceSeconds += FrameSeconds;
+			WorstFrameSeconds = FMath::Max(WorstFrameSeconds, FrameSeconds);
+
+			const double RailsStart = FPlatformTime::Seconds();
+			Propagator.PropagateOnRails();
+			RailsSeconds += FPlatformTime::Seconds() - RailsStart;
+		}
+
+		UE_LOG(LogAstroEngineer, Display, TEXT("Orbit benchmark: %d craft over %d frames, %.3f ms per frame (worst %.3f ms), rails alone %.3f ms, %.1f ns per craft"),
+			NumCraft, NumFrames, AdvanceSeconds * 1000.0 / NumFrames, WorstFrameSeconds * 1000.0, RailsSeconds * 1000.0 / NumFrames,
+			RailsSeconds * 1.0e9 / (double(NumFrames) * NumCraft));
+	}
+
+	/** Time the SIMD Kepler solver against the scalar reference on random orbits and report the largest disagreement */
+	static void RunKeplerBenchmark(const TArray<FString>& Args)
+	{
+		const int32 Count = Args.Num() > 0 ? FMath::Max(1, FCString::Atoi(*Args[0])) : 1000000;
+		const int32 NumRepeats = Args.Num() > 1 ? FMath::Max(1, FCString::Atoi(*Args[1])) : 10;
+
+		FRandomStream Random(0x0A57);
+		TArray<double> MeanAnomalies, Eccentricities;
+		MeanAnomalies.SetNumUninitialized(Count);
+		Eccentricities.SetNumUninitialized(Count);
+		for (int32 Index = 0; Index < Count; ++Index)
+		{
+			MeanAnomalies[Index] = FMath::Lerp(-1.0e4, 1.0e4, double(Random.GetFraction()));
+			Eccentricities[Index] = FMath::Lerp(0.0, 0.99, double(Random.GetFraction()));
+		}
+
+		TArray<double> BatchAnomalies, BatchSines, BatchCosines, ReferenceAnomalies, ReferenceSines, ReferenceCosines;
+		for (TArray<double>* Output : { &BatchAnomalies, &BatchSines, &BatchCosines, &ReferenceAnomalies, &ReferenceSines, &ReferenceCosines })
+		{
+			Output->SetNumUninitialized(Count);
+		}
+
+		double BatchSeconds = TNumericLimits<double>::Max();
+		double ReferenceSeconds = TNumericLimits<double>::Max();
+		for (int32 Repeat = 0; Repeat < NumRepeats; ++Repeat)
+		{
+			double Start = FPlatformTime::Seconds();
+			FAstroOrbitalMath::SolveKeplerEllipticBatch(MeanAnomalies, Eccentricities, BatchAnomalies, BatchSines, BatchCosines);
+			BatchSeconds = FMath::Min(BatchSeconds, FPlatformTime::Seconds() - Start);
+
+			Start = FPlatformTime::Seconds();
+			FAstroOrbitalMath::SolveKeplerEllipticBatchReference(MeanAnomalies, Eccentricities, ReferenceAnomalies, ReferenceSines, ReferenceCosines);
+			ReferenceSeconds = FMath::Min(ReferenceSeconds, FPlatformTime::Seconds() - Start);
+		}
+
+		double MaxAnomalyError = 0.0;
+		double MaxTrigError = 0.0;
+		for (int32 Index = 0; Index < Count; ++Index)
+		{
+			MaxAnomalyError = FMath::Max(MaxAnomalyError, FMath::Abs(BatchAnomalies[Index] - ReferenceAnomalies[Index]));
+			MaxTrigError = FMath::Max3(MaxTrigError, FMath::Abs(BatchSines[Index] - ReferenceSines[Index]), FMath::Abs(BatchCosines[Index] - ReferenceCosines[Index]));
+		}
+
+		UE_LOG(LogAstroEngineer, Display, TEXT("Kepler benchmark: %d solves, batch %.3f ms, scalar %.3f ms (%.2fx), max anomaly difference %.3g rad, max sin/cos difference %.3g"),
+			Count, BatchSeconds * 1000.0, ReferenceSeconds * 1000.0, ReferenceSeconds / FMath::Max(BatchSeconds, UE_DOUBLE_SMALL_NUMBER), MaxAnomalyError, MaxTrigError);
+	}
+
+	static FAutoConsoleCommand KeplerBenchmarkCommand(
+		TEXT("astro.Orbit.KeplerBenchmark"),
+		TEXT("Compare the SIMD Kepler solver with the scalar reference. Usage: astro.Orbit.KeplerBenchmark [NumSolves=1000000] [NumRepeats=10]"),
+		FConsoleCommandWithArgsDelegate::CreateStatic(&RunKeplerBenchmark));
+
+	static FAutoConsoleCommand BenchmarkCommand(
+		TEXT("astro.Orbit.Benchmark"),
+		TEXT("Time patched-conic propagation of a synthetic fleet. Usage: astro.Orbit.Benchmark [NumCraft=10000] [NumFrames=300]"),
+		FConsoleCommandWithArgsDelegate::CreateStatic(&RunBenchmark));
+}
+
+void UAstroOrbitalSubsystem::Initialize(FSubsystemCollectionBase& Collection)
+{
+	Super::Initialize(Collection);
+
+	FWorldDelegates::LevelAddedToWorld.AddUObject(this, &UAstroOrbitalSubsystem::HandleLevelAddedToWorld);
+	ActorSpawnedHandle = GetWorld()->AddOnActorSpawnedHandler(FOnActorSpawned::FDelegate::CreateUObject(this, &UAstroOrbitalSubsystem::HandleActorSpawned));
+}
+
+void UAstroOrbitalSubsystem::Deinitialize()
+{
+	FWorldDelegates::LevelAddedToWorld.RemoveAll(this);
+	GetWorld()->RemoveOnActorSpawnedHandler(ActorSpawnedHandle);
+
+	Super::Deinitialize();
+}
+
+void UAstroOrbitalSubsystem::HandleLevelAddedToWorld(ULevel* Level, UWorld* World)
+{
+	if (Level && World == GetWorld())
+	{
+		FloatingOrigin.TrackAddedLevel(*Level);
+	}
+}
+
+void UAstroOrbitalSubsystem::HandleActorSpawned(AActor* Actor)
+{
+	if (Actor)
+	{
+		FloatingOrigin.TrackActor(*Actor);
+	}
+}
+
+void UAstroOrbitalSubsystem::Tick(float DeltaTime)
+{
+	Super::Tick(DeltaTime);
+
+	// Coasting craft are analytic, so a warped step costs the same as a real-time one
+	UAstroTimeWarpSubsystem* TimeWarp = GetWorld()->GetSubsystem<UAstroTimeWarpSubsystem>();
+	const double StartTime = FPlatformTime::Seconds();
+	Propagator.Advance(DeltaTime * (TimeWarp ? TimeWarp->GetWarpRate() : 1.0));
+	LastAdvanceSeconds = FPlatformTime::Seconds() - StartTime;
+
+	// The propagator stops an impacting craft at the moment it hits, but the player should not be warped past it
+	if (TimeWarp && TimeWarp->IsWarping() && Propagator.GetImpacts().Num() > 0)
+	{
+		UE_LOG(LogAstroEngineer, Log, TEXT("Time warp stopped: %d craft hit a surface"), Propagator.GetImpacts().Num());
+		TimeWarp->StopWarp();
+	}
+
+	FloatingOrigin.Update(*GetWorld(), Propagator);
+	TrajectoryCache.Update(Propagator);
+}
+
+TStatId UAstroOrbitalSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UAstroOrbitalSubsystem, STATGROUP_AstroEngineer);
+}
+
+int32 UAstroOrbitalSubsystem::AddBody(FName Name, double GravitationalParameter, double Radius, FName ParentName, double SemiMajorAxis, double Eccentricity,
+	double Inclination, double LongitudeOfAscendingNode, double ArgumentOfPeriapsis, double MeanAnomalyAtEpoch)
+{
+	const int32 ParentIndex = ParentName.IsNone() ? INDEX_NONE : Propagator.FindBody(ParentName);
+	if (ParentName.IsNone() ? Propagator.NumBodies() > 0 : ParentIndex == INDEX_NONE)
+	{
+		UE_LOG(LogAstroEngineer, Warning, TEXT("Cannot add body %s: %s"), *Name.ToString(),
+			ParentName.IsNone() ? TEXT("the world already has a root body") : TEXT("its parent has not been added"));
+		return INDEX_NONE;
+	}
+
+	FAstroOrbitalElements Orbit;
+	Orbit.SemiMajorAxis = SemiMajorAxis;
+	Orbit.Eccentricity = Eccentricity;
+	Orbit.Inclination = Inclination;
+	Orbit.LongitudeOfAscendingNode = LongitudeOfAscendingNode;
+	Orbit.ArgumentOfPeriapsis = ArgumentOfPeriapsis;
+	Orbit.MeanAnomalyAtEpoch = MeanAnomalyAtEpoch;
+	return Propagator.AddBody(Name, GravitationalParameter, Radius, ParentIndex, Orbit);
+}
+
+FVector UAstroOrbitalSubsystem::GetBodyWorldLocation(int32 BodyIndex) const
+{
+	return Propagator.GetBodies().IsValidIndex(BodyIndex) ? FloatingOrigin.RootToWorld(Propagator.GetBody(BodyIndex).RootPosition) : FVector::ZeroVector;
+}
@@ -6,11 +6,13 @@
 #include "EnhancedInputComponent.h"
 #include "EnhancedInputSubsystems.h"
 #include "AstroInventoryComponent.h"
+#include "AstroShipAssembly.h"
 #include "DrawDebugHelpers.h"
+#include "AstroEngineer.h"
 
 AAstroPlayerCharacter::AAstroPlayerCharacter()
 {
-	PrimaryActorTick.bCanEverTick = true;
+	PrimaryActorTick.bCanEverTick = false;
 
 	// Set size for collision capsule
 	GetCapsuleComponent()->InitCapsuleSize(42.f, 96.0f);
@@ -43,11 +45,6 @@ void AAstroPlayerCharacter::BeginPlay()
 	}
 }
 
-void AAstroPlayerCharacter::Tick(float DeltaTime)
-{
-	Super::Tick(DeltaTime);
-}
-
 void AAstroPlayerCharacter::SetupPlayerInputComponent(UInputComponent* PlayerInputComponent)
 {
 	Super::SetupPlayerInputComponent(PlayerInputComponent);
@@ -116,6 +113,16 @@ void AAstroPlayerCharacter::Interact()
 	{
 		// Check if hit actor is interactable
 		AActor* HitActor = HitResult.GetActor();
+
+		// Finalized ships draw modules as instances; wake the module that was hit
+		if (AAstroShipAssembly* Assembly = Cast<AAstroShipAssembly>(HitActor))
+		{
+			if (AAstroShipModule* Module = Assembly->ExpandModuleFromHit(HitResult))
+			{
+				HitActor = Module;
+			}
+		}
+
 		if (HitActor)
 		{
 			// Blueprint implementable interaction event
@@ -0,0 +1,262 @@
+// Copyright Astro Engineer Team. All Rights Reserved.
+
+#include "AstroProgressionSaveGame.h"
+#include "AstroInventoryComponent.h"
+#include "AstroCraftingComponent.h"
+#include "AstroResearchComponent.h"
+#include "AstroJobScheduler.h"
+#include "AstroEngineer.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+#include "Kismet/GameplayStatics.h"
+#include "Math/RandomStream.h"
+#include "Serialization/CustomVersion.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+
+DECLARE_CYCLE_STAT(TEXT("Capture Progression"), STAT_AstroCaptureProgression, STATGROUP_AstroEngineer);
+DECLARE_CYCLE_STAT(TEXT("Apply Progression"), STAT_AstroApplyProgression, STATGROUP_AstroEngineer);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Progression Save Bytes"), STAT_AstroProgressionSaveBytes, STATGROUP_AstroEngineer);
+
+const FGuid FAstroProgressionVersion::GUID(0x6A1F3C52, 0x4E0B49D7, 0x9C2A8E15, 0xB3D47F60);
+static FCustomVersionRegistration GRegisterAstroProgressionVersion(FAstroProgressionVersion::GUID, FAstroProgressionVersion::Latest, TEXT("AstroProgression"));
+
+namespace AstroProgressionSave
+{
+	static TAutoConsoleVariable<float> CVarMaxOfflineHours(
+		TEXT("astro.Progression.MaxOfflineHours"),
+		168.0f,
+		TEXT("Longest time away, in hours, that production is caught up for when a save is loaded. 0 disables offline progress."));
+
+	/** Write one component into its own length-prefixed section, so a missing component on load just skips its bytes */
+	template <typename ComponentType>
+	static void WriteSection(FArchive& Ar, ComponentType* Component)
+	{
+		TArray<uint8> Section;
+		if (Component)
+		{
+			FMemoryWriter Writer(Section);
+			Writer.SetCustomVersion(FAstroProgressionVersion::GUID, FAstroProgressionVersion::Latest, TEXT("AstroProgression"));
+			Component->SerializeProgress(Writer);
+		}
+		Ar << Section;
+	}
+
+	/** Inventory has no jobs to catch up */
+	static void SerializeLoadedSection(FArchive& Ar, UAstroInventoryComponent& Component, double ElapsedSeconds)
+	{
+		Component.SerializeProgress(Ar);
+	}
+
+	template <typename ComponentType>
+	static void SerializeLoadedSection(FArchive& Ar, ComponentType& Component, double ElapsedSeconds)
+	{
+		Component.SerializeProgress(Ar, ElapsedSeconds);
+	}
+
+	template <typename ComponentType>
+	static bool ReadSection(FArchive& Ar, int32 Version, ComponentType* Component, double ElapsedSeconds)
+	{
+		TArray<uint8> Section;
+		Ar << Section;
+		if (Ar.IsError())
+			return false;
+		if (!Component || Section.Num() == 0)
+			return true;
+
+		FMemoryReaderView Reader(Section);
+		Reader.SetCustomVersion(FAstroProgressionVersion::GUID, Version, TEXT("AstroProgression"));
+		SerializeLoadedSection(Reader, *Component, ElapsedSeconds);
+		return !Reader.IsError();
+	}
+
+	/**
+	 * Fill an actor with a late-game profile: a full inventory, most recipes and research unlocked.
+	 * Then time capturing it into a payload and applying the payload back.
+	 */
+	static void RunSaveBenchmark(const TArray<FString>& Args, UWorld* World)
+	{
+		if (!World)
+			return;
+
+		const int32 NumRecipes = Args.Num() > 0 ? FMath::Max(1, FCString::Atoi(*Args[0])) : 3000;
+		const int32 NumNodes = Args.Num() > 1 ? FMath::Max(1, FCString::Atoi(*Args[1])) : 1500;
+		const int32 NumSlots = Args.Num() > 2 ? FMath::Max(1, FCString::Atoi(*Args[2])) : 400;
+		const int32 NumIterations = Args.Num() > 3 ? FMath::Max(1, FCString::Atoi(*Args[3])) : 50;
+
+		FActorSpawnParameters SpawnParams;
+		SpawnParams.ObjectFlags |= RF_Transient;
+		AActor* Player = World->SpawnActor<AActor>(SpawnParams);
+		if (!Player)
+			return;
+
+		// One stack per item, unregistered components owned by the actor so CaptureProgress finds them
+		UAstroInventoryComponent* Inventory = NewObject<UAstroInventoryComponent>(Player);
+		Inventory->MaxInventorySlots = NumSlots;
+		TMap<FName, int32> Contents;
+		for (int32 Index = 0; Index < NumSlots; ++Index)
+		{
+			Contents.Add(FName(*FString::Printf(TEXT("BenchmarkItem_%d"), Index)), FInventoryItem().MaxStackSize);
+		}
+		Inventory->ApplyInventoryDelta(Contents);
+
+		// Nine in ten recipes and nodes unlocked, with IDs as long as authored content uses
+		FRandomStream Random(0x0A57);
+		UAstroCraftingComponent* Crafting = NewObject<UAstroCraftingComponent>(Player);
+		Crafting->CraftingRecipes.SetNum(NumRecipes);
+		for (int32 Index = 0; Index < NumRecipes; ++Index)
+		{
+			FCraftingRecipe& Recipe = Crafting->CraftingRecipes[Index];
+			Recipe.RecipeID = FName(*FString::Printf(TEXT("Recipe_Fabrication_Component_%d"), Index));
+			Recipe.ResultItemID = FName(*FString::Printf(TEXT("BenchmarkItem_%d"), Random.RandHelper(NumSlots)));
+			Recipe.bUnlockedAtStart = Random.GetFraction() < 0.9f;
+		}
+		Crafting->NotifyRecipesChanged();
+		Crafting->SetInventory(Inventory);
+
+		UAstroResearchComponent* Research = NewObject<UAstroResearchComponent>(Player);
+		Research->ResearchNodes.SetNum(NumNodes);
+		for (int32 Index = 0; Index < NumNodes; ++Index)
+		{
+			FResearchNode& Node = Research->ResearchNodes[Index];
+			Node.NodeID = FName(*FString::Printf(TEXT("Research_Propulsion_Tier_%d"), Index));
+			Node.bUnlockedAtStart = Random.GetFraction() < 0.9f;
+		}
+		Research->NotifyResearchNodesChanged();
+
+		UAstroProgressionSaveGame* SaveGame = NewObject<UAstroProgressionSaveGame>();
+		double StartTime = FPlatformTime::Seconds();
+		for (int32 Iteration = 0; Iteration < NumIterations; ++Iteration)
+		{
+			SaveGame->CaptureProgress(Player);
+		}
+		const double CaptureSeconds = (FPlatformTime::Seconds() - StartTime) / NumIterations;
+
+		int32 NumRecipesUnlocked = 0;
+		int32 NumNodesUnlocked = 0;
+		for (const FCraftingRecipe& Recipe : Crafting->CraftingRecipes)
+		{
+			NumRecipesUnlocked += Crafting->IsRecipeUnlocked(Recipe.RecipeID) ? 1 : 0;
+		}
+		for (const FResearchNode& Node : Research->ResearchNodes)
+		{
+			NumNodesUnlocked += Research->IsNodeUnlocked(Node.NodeID) ? 1 : 0;
+		}
+
+		bool bApplied = true;
+		StartTime = FPlatformTime::Seconds();
+		for (int32 Iteration = 0; Iteration < NumIterations; ++Iteration)
+		{
+			bApplied &= SaveGame->ApplyProgress(Player);
+		}
+		const double ApplySeconds = (FPlatformTime::Seconds() - StartTime) / NumIterations;
+
+		UE_LOG(LogAstroEngineer, Display, TEXT("Progression save benchmark: %d of %d recipes and %d of %d nodes unlocked, %d slots; %d byte payload, capture %.3f ms, apply %.3f ms%s"),
+			NumRecipesUnlocked, NumRecipes, NumNodesUnlocked, NumNodes, NumSlots, SaveGame->Payload.Num(),
+			CaptureSeconds * 1000.0, ApplySeconds * 1000.0, bApplied ? TEXT("") : TEXT(" (APPLY FAILED)"));
+
+		Crafting->SetInventory(nullptr);
+		Player->Destroy();
+	}
+
+	static FAutoConsoleCommandWithWorldAndArgs SaveBenchmarkCommand(
+		TEXT("astro.Progression.SaveBenchmark"),
+		TEXT("Fill a late-game profile and log the progression payload size and the time to capture and apply it. Usage: astro.Progression.SaveBenchmark [NumRecipes=3000] [NumNodes=1500] [NumSlots=400] [NumIterations=50]"),
+		FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&RunSaveBenchmark));
+}
+
+bool UAstroProgressionSaveGame::CaptureProgress(AActor* Player)
+{
+	SCOPE_CYCLE_COUNTER(STAT_AstroCaptureProgression);
+
+	if (!Player)
+		return false;
+
+	Payload.Reset();
+	PayloadVersion = FAstroProgressionVersion::Latest;
+	SaveTimestamp = FDateTime::UtcNow();
+
+	FMemoryWriter Writer(Payload);
+	AstroProgressionSave::WriteSection(Writer, Player->FindComponentByClass<UAstroInventoryComponent>());
+	AstroProgressionSave::WriteSection(Writer, Player->FindComponentByClass<UAstroCraftingComponent>());
+	AstroProgressionSave::WriteSection(Writer, Player->FindComponentByClass<UAstroResearchComponent>());
+
+	SET_DWORD_STAT(STAT_AstroProgressionSaveBytes, Payload.Num());
+	return !Writer.IsError();
+}
+
+bool UAstroProgressionSaveGame::ApplyProgress(AActor* Player, double OfflineSeconds) const
+{
+	SCOPE_CYCLE_COUNTER(STAT_AstroApplyProgression);
+
+	if (!Player)
+		return false;
+
+	if (PayloadVersion < FAstroProgressionVersion::Oldest || PayloadVersion > FAstroProgressionVersion::Latest)
+	{
+		UE_LOG(LogAstroEngineer, Warning, TEXT("Progression save has unsupported version %d"), PayloadVersion);
+		return false;
+	}
+
+	// Inventory first so crafting sees the restored stock, and crafting before research so research can re-grant its recipes
+	FMemoryReaderView Reader(Payload);
+	return AstroProgressionSave::ReadSection(Reader, PayloadVersion, Player->FindComponentByClass<UAstroInventoryComponent>(), OfflineSeconds)
+		&& AstroProgressionSave::ReadSection(Reader, PayloadVersion, Player->FindComponentByClass<UAstroCraftingComponent>(), OfflineSeconds)
+		&& AstroProgressionSave::ReadSection(Reader, PayloadVersion, Player->FindComponentByClass<UAstroResearchComponent>(), OfflineSeconds);
+}
+
+bool UAstroProgressionSaveGame::AsyncSaveProgress(AActor* Player, const FString& SlotName, int32 UserIndex)
+{
+	const double StartTime = FPlatformTime::Seconds();
+
+	UAstroProgressionSaveGame* SaveGame = Cast<UAstroProgressionSaveGame>(UGameplayStatics::CreateSaveGameObject(UAstroProgressionSaveGame::StaticClass()));
+	if (!SaveGame || !SaveGame->CaptureProgress(Player))
+		return false;
+
+	// Serializing the save object is all that happens on the game thread; the write runs on a worker
+	const double CaptureTime = FPlatformTime::Seconds();
+	const int32 PayloadBytes = SaveGame->Payload.Num();
+	UGameplayStatics::AsyncSaveGameToSlot(SaveGame, SlotName, UserIndex,
+		FAsyncSaveGameToSlotDelegate::CreateLambda([StartTime, CaptureTime, PayloadBytes](const FString& SavedSlot, const int32, bool bSuccess)
+		{
+			UE_LOG(LogAstroEngineer, Log, TEXT("Progression save to '%s' %s: %d byte payload, captured in %.2f ms, written after %.2f ms"),
+				*SavedSlot, bSuccess ? TEXT("finished") : TEXT("failed"), PayloadBytes,
+				(CaptureTime - StartTime) * 1000.0, (FPlatformTime::Seconds() - StartTime) * 1000.0);
+		}));
+
+	UE_LOG(LogAstroEngineer, Verbose, TEXT("Progression save queued, game thread cost %.2f ms"), (FPlatformTime::Seconds() - StartTime) * 1000.0);
+	return true;
+}
+
+bool UAstroProgressionSaveGame::LoadProgress(AActor* Player, const FString& SlotName, int32 UserIndex)
+{
+	const double StartTime = FPlatformTime::Seconds();
+
+	const UAstroProgressionSaveGame* SaveGame = Cast<UAstroProgressionSaveGame>(UGameplayStatics::LoadGameFromSlot(SlotName, UserIndex));
+
+	// Only the jobs restored from this save are moved back by the time away; the production clock and every other
+	// job in the world keep their place
+	double OfflineSeconds = 0.0;
+	UAstroJobScheduler* Scheduler = Player && Player->GetWorld() ? Player->GetWorld()->GetSubsystem<UAstroJobScheduler>() : nullptr;
+	if (SaveGame && Scheduler && SaveGame->SaveTimestamp.GetTicks() > 0)
+	{
+		const double MaxOfflineSeconds = FMath::Max(AstroProgressionSave::CVarMaxOfflineHours.GetValueOnGameThread(), 0.0f) * 3600.0;
+		OfflineSeconds = FMath::Clamp((FDateTime::UtcNow() - SaveGame->SaveTimestamp).GetTotalSeconds(), 0.0, MaxOfflineSeconds);
+	}
+
+	if (!SaveGame || !SaveGame->ApplyProgress(Player, OfflineSeconds))
+	{
+		UE_LOG(LogAstroEngineer, Warning, TEXT("Could not load progression from '%s'"), *SlotName);
+		return false;
+	}
+
+	// Everything that finished while away completes now, in order, in one batch
+	if (Scheduler)
+	{
+		Scheduler->RunDueJobs();
+	}
+
+	UE_LOG(LogAstroEngineer, Log, TEXT("Loaded progression from '%s': %d byte payload, %.0f s of offline production, in %.2f ms"),
+		*SlotName, SaveGame->Payload.Num(), OfflineSeconds, (FPlatformTime::Seconds() - StartTime) * 1000.0);
+	return true;
+}
@@ -0,0 +1,137 @@
+// Copyright Astro Engineer Team. All Rights Reserved.
+
+#include "AstroRecipeDatabase.h"
+#include "AstroCraftingComponent.h"
+#include "Algo/Sort.h"
+#include "Algo/Unique.h"
+
+void FAstroRecipeDatabase::Build(TArrayView<const FCraftingRecipe> Recipes)
+{
+	Reset();
+	++BuildSerial;
+
+	const int32 RecipeCount = Recipes.Num();
+	RecipeIDs.Reserve(RecipeCount);
+	ResultItems.Reserve(RecipeCount);
+	ResultQuantities.Reserve(RecipeCount);
+	CraftingTimes.Reserve(RecipeCount);
+	IngredientOffsets.Reserve(RecipeCount + 1);
+
+	for (int32 RecipeIndex = 0; RecipeIndex < RecipeCount; ++RecipeIndex)
+	{
+		const FCraftingRecipe& Recipe = Recipes[RecipeIndex];
+
+		RecipeIndexByID.FindOrAdd(Recipe.RecipeID, RecipeIndex);
+		RecipeIDs.Add(Recipe.RecipeID);
+		ResultItems.Add(Recipe.ResultItemID.IsNone() ? INDEX_NONE : AddItem(Recipe.ResultItemID));
+		ResultQuantities.Add(Recipe.ResultQuantity);
+		CraftingTimes.Add(Recipe.CraftingTime);
+
+		IngredientOffsets.Add(IngredientItems.Num());
+		for (const TPair<FName, int32>& RequiredItem : Recipe.RequiredItems)
+		{
+			IngredientItems.Add(AddItem(RequiredItem.Key));
+			IngredientCounts.Add(RequiredItem.Value);
+		}
+	}
+	IngredientOffsets.Add(IngredientItems.Num());
+
+	// Build the item -> consuming recipes index with a counting pass, then a fill pass
+	ConsumerOffsets.SetNumZeroed(ItemNames.Num() + 1);
+	for (int32 ItemIndex : IngredientItems)
+	{
+		++ConsumerOffsets[ItemIndex + 1];
+	}
+	for (int32 ItemIndex = 0; ItemIndex < ItemNames.Num(); ++ItemIndex)
+	{
+		ConsumerOffsets[ItemIndex + 1] += ConsumerOffsets[ItemIndex];
+	}
+
+	TArray<int32> FillCursor(ConsumerOffsets.GetData(), ItemNames.Num());
+	ConsumerRecipes.SetNumUninitialized(IngredientItems.Num());
+	for (int32 RecipeIndex = 0; RecipeIndex < RecipeCount; ++RecipeIndex)
+	{
+		for (int32 Ingredient = IngredientOffsets[RecipeIndex]; Ingredient < IngredientOffsets[RecipeIndex + 1]; ++Ingredient)
+		{
+			ConsumerRecipes[FillCursor[IngredientItems[Ingredient]]++] = RecipeIndex;
+		}
+	}
+}
+
+void FAstroRecipeDatabase::Reset()
+{
+	RecipeIndexByID.Reset();
+	ItemIndexByName.Reset();
+	ItemNames.Reset();
+	RecipeIDs.Reset();
+	ResultItems.Reset();
+	ResultQuantities.Reset();
+	CraftingTimes.Reset();
+	IngredientOffsets.Reset();
+	IngredientItems.Reset();
+	IngredientCounts.Reset();
+	ConsumerOffsets.Reset();
+	ConsumerRecipes.Reset();
+}
+
+int32 FAstroRecipeDatabase::FindRecipeIndex(FName RecipeID) const
+{
+	const int32* Index = RecipeIndexByID.Find(RecipeID);
+	return Index ? *Index : INDEX_NONE;
+}
+
+int32 FAstroRecipeDatabase::FindItemIndex(FName ItemID) const
+{
+	const int32* Index = ItemIndexByName.Find(ItemID);
+	return Index ? *Index : INDEX_NONE;
+}
+
+TArrayView<const int32> FAstroRecipeDatabase::GetIngredientItems(int32 RecipeIndex) const
+{
+	const int32 Start = IngredientOffsets[RecipeIndex];
+	return TArrayView<const int32>(IngredientItems.GetData() + Start, IngredientOffsets[RecipeIndex + 1] - Start);
+}
+
+TArrayView<const int32> FAstroRecipeDatabase::GetIngredientCounts(int32 RecipeIndex) const
+{
+	const int32 Start = IngredientOffsets[RecipeIndex];
+	return TArrayView<const int32>(IngredientCounts.GetData() + Start, IngredientOffsets[RecipeIndex + 1] - Start);
+}
+
+TArrayView<const int32> FAstroRecipeDatabase::GetRecipesUsingItem(int32 ItemIndex) const
+{
+	const int32 Start = ConsumerOffsets[ItemIndex];
+	return TArrayView<const int32>(ConsumerRecipes.GetData() + Start, ConsumerOffsets[ItemIndex + 1] - Start);
+}
+
+void FAstroRecipeDatabase::GatherRecipesUsingItems(TArrayView<const FName> ItemIDs, TArray<int32>& OutRecipes) const
+{
+	const int32 FirstAdded = OutRecipes.Num();
+	for (FName ItemID : ItemIDs)
+	{
+		const int32 ItemIndex = FindItemIndex(ItemID);
+		if (ItemIndex != INDEX_NONE)
+		{
+			OutRecipes.Append(GetRecipesUsingItem(ItemIndex));
+		}
+	}
+
+	// One item's consumer list has no repeats; several can share recipes. Sorting what was added keeps the cost
+	// proportional to the consumers touched rather than to the whole recipe list.
+	if (ItemIDs.Num() > 1)
+	{
+		const TArrayView<int32> Added = MakeArrayView(OutRecipes).RightChop(FirstAdded);
+		Algo::Sort(Added);
+		OutRecipes.SetNum(FirstAdded + Algo::Unique(Added), EAllowShrinking::No);
+	}
+}
+
+int32 FAstroRecipeDatabase::AddItem(FName ItemID)
+{
+	if (const int32* Existing = ItemIndexByName.Find(ItemID))
+		return *Existing;
+
+	const int32 ItemIndex = ItemNames.Add(ItemID);
+	ItemIndexByName.Add(ItemID, ItemIndex);
+	return ItemIndex;
+}
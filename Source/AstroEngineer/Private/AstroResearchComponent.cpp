@@ -3,35 +3,223 @@
 #include "AstroResearchComponent.h"
 #include "AstroInventoryComponent.h"
 #include "AstroCraftingComponent.h"
+#include "AstroEngineer.h"
+#include "HAL/IConsoleManager.h"
+#include "Math/RandomStream.h"
+
+namespace AstroResearchComponent
+{
+	/** Heap blocks a by-value copy of Nodes makes: the array, plus each non-empty prerequisite, resource and unlock container */
+	static int32 CountCopyAllocations(const TArray<FResearchNode>& Nodes)
+	{
+		int32 NumAllocations = Nodes.Num() > 0 ? 1 : 0;
+		for (const FResearchNode& Node : Nodes)
+		{
+			NumAllocations += (Node.Prerequisites.Num() > 0 ? 1 : 0) + (Node.RequiredResources.Num() > 0 ? 1 : 0)
+				+ (Node.UnlocksRecipes.Num() > 0 ? 1 : 0) + (Node.UnlocksItems.Num() > 0 ? 1 : 0);
+		}
+		return NumAllocations;
+	}
+
+	/** Poll the available research list once per frame the way a widget does, through each accessor, and log time and allocations per poll */
+	static void RunViewBenchmark(const TArray<FString>& Args)
+	{
+		const int32 NumNodes = Args.Num() > 0 ? FMath::Max(1, FCString::Atoi(*Args[0])) : 1000;
+		const int32 NumFrames = Args.Num() > 1 ? FMath::Max(1, FCString::Atoi(*Args[1])) : 600;
+
+		// A layered tree: the first layer is unlocked, so the second layer is available
+		UAstroResearchComponent* Research = NewObject<UAstroResearchComponent>();
+		const int32 LayerSize = FMath::Max(NumNodes / 10, 1);
+		Research->ResearchNodes.SetNum(NumNodes);
+		for (int32 Index = 0; Index < NumNodes; ++Index)
+		{
+			FResearchNode& Node = Research->ResearchNodes[Index];
+			Node.NodeID = FName(*FString::Printf(TEXT("BenchmarkNode_%d"), Index));
+			Node.NodeName = FText::FromName(Node.NodeID);
+			Node.bUnlockedAtStart = Index < LayerSize;
+			Node.RequiredResources.Add(TEXT("BenchmarkItem"), 10);
+			Node.UnlocksRecipes.Add(FName(*FString::Printf(TEXT("BenchmarkRecipe_%d"), Index)));
+			if (Index >= LayerSize)
+			{
+				Node.Prerequisites.Add(Research->ResearchNodes[Index - LayerSize].NodeID);
+			}
+		}
+		Research->NotifyResearchNodesChanged();
+
+		// Before the cache, every poll checked each node and filtered the tree into a new array
+		int64 NumFilterAllocations = 0;
+		double Start = FPlatformTime::Seconds();
+		for (int32 Frame = 0; Frame < NumFrames; ++Frame)
+		{
+			TArray<FResearchNode> Filtered;
+			for (const FResearchNode& Node : Research->ResearchNodes)
+			{
+				bool bAvailable = !Research->IsNodeUnlocked(Node.NodeID);
+				for (FName Prerequisite : Node.Prerequisites)
+				{
+					bAvailable &= Research->IsNodeUnlocked(Prerequisite);
+				}
+				if (bAvailable)
+				{
+					Filtered.Add(Node);
+				}
+			}
+			NumFilterAllocations += CountCopyAllocations(Filtered);
+		}
+		const double FilterSeconds = FPlatformTime::Seconds() - Start;
+
+		int64 NumCopyAllocations = 0;
+		Start = FPlatformTime::Seconds();
+		for (int32 Frame = 0; Frame < NumFrames; ++Frame)
+		{
+			const TArray<FResearchNode> Copy = Research->GetAvailableResearchNodes();
+			NumCopyAllocations += CountCopyAllocations(Copy);
+		}
+		const double CopySeconds = FPlatformTime::Seconds() - Start;
+
+		int64 NumVisible = 0;
+		Start = FPlatformTime::Seconds();
+		for (int32 Frame = 0; Frame < NumFrames; ++Frame)
+		{
+			NumVisible += Research->GetAvailableResearchNodesRef().Num();
+		}
+		const double RefSeconds = FPlatformTime::Seconds() - Start;
+
+		UE_LOG(LogAstroEngineer, Display, TEXT("Research view benchmark: %d of %d nodes available, per poll: filtering %.3f ms and %lld+ allocations, cached copy (Blueprint) %.3f ms and %lld allocations, const ref (C++) %.4f ms and none"),
+			NumVisible / NumFrames, NumNodes, FilterSeconds * 1000.0 / NumFrames, NumFilterAllocations / NumFrames, CopySeconds * 1000.0 / NumFrames,
+			NumCopyAllocations / NumFrames, RefSeconds * 1000.0 / NumFrames);
+
+		Research->MarkAsGarbage();
+	}
+
+	/**
+	 * Compile a random research DAG, then unlock it in topological order and time each incremental availability update
+	 * against the prerequisite scans availability took before the graph
+	 */
+	static void RunGraphBenchmark(const TArray<FString>& Args)
+	{
+		const int32 NumNodes = Args.Num() > 0 ? FMath::Max(2, FCString::Atoi(*Args[0])) : 10000;
+
+		// Up to three prerequisites per node, drawn from the few hundred nodes before it
+		UAstroResearchComponent* Research = NewObject<UAstroResearchComponent>();
+		FRandomStream Random(0x0A57);
+		Research->ResearchNodes.SetNum(NumNodes);
+		for (int32 Index = 0; Index < NumNodes; ++Index)
+		{
+			FResearchNode& Node = Research->ResearchNodes[Index];
+			Node.NodeID = FName(*FString::Printf(TEXT("BenchmarkNode_%d"), Index));
+			const int32 NumPrerequisites = Index == 0 ? 0 : 1 + Random.RandHelper(3);
+			for (int32 Prerequisite = 0; Prerequisite < NumPrerequisites; ++Prerequisite)
+			{
+				Node.Prerequisites.AddUnique(Research->ResearchNodes[FMath::Max(0, Index - 1 - Random.RandHelper(300))].NodeID);
+			}
+		}
+
+		double Start = FPlatformTime::Seconds();
+		Research->NotifyResearchNodesChanged();
+		const double BuildSeconds = FPlatformTime::Seconds() - Start;
+
+		// Availability of every node by linear search, as GetAvailableResearchNodes worked before the graph
+		const TArray<FResearchNode>& Nodes = Research->ResearchNodes;
+		TSet<FName> Unlocked;
+		Start = FPlatformTime::Seconds();
+		int32 NumScannedAvailable = 0;
+		for (const FResearchNode& Node : Nodes)
+		{
+			const FResearchNode* Found = Nodes.FindByPredicate([&Node](const FResearchNode& Candidate) { return Candidate.NodeID == Node.NodeID; });
+			bool bAvailable = Found && !Unlocked.Contains(Node.NodeID);
+			for (FName Prerequisite : Node.Prerequisites)
+			{
+				const FResearchNode* PrerequisiteNode = Nodes.FindByPredicate([Prerequisite](const FResearchNode& Candidate) { return Candidate.NodeID == Prerequisite; });
+				bAvailable &= PrerequisiteNode && Unlocked.Contains(Prerequisite);
+			}
+			NumScannedAvailable += bAvailable ? 1 : 0;
+		}
+		const double ScanSeconds = FPlatformTime::Seconds() - Start;
+		const int32 NumGraphAvailable = Research->GetAvailableResearchNodesRef().Num();
+
+		double UnlockSeconds = 0.0;
+		double WorstUnlockSeconds = 0.0;
+		for (const int32 NodeIndex : Research->GetResearchGraph().GetTopologicalOrder())
+		{
+			const double UnlockStart = FPlatformTime::Seconds();
+			Research->UnlockNode(Research->GetResearchGraph().GetNodeID(NodeIndex));
+			const double Seconds = FPlatformTime::Seconds() - UnlockStart;
+			UnlockSeconds += Seconds;
+			WorstUnlockSeconds = FMath::Max(WorstUnlockSeconds, Seconds);
+		}
+
+		int32 NumUnlocked = 0;
+		for (const FResearchNode& Node : Nodes)
+		{
+			NumUnlocked += Research->IsNodeUnlocked(Node.NodeID) ? 1 : 0;
+		}
+
+		UE_LOG(LogAstroEngineer, Display, TEXT("Research graph benchmark: %d nodes, build with cycle check %.2f ms; availability by scan %.2f ms (%d available, graph says %d); incremental unlock %.2f us per node (worst %.2f us), %d of %d unlocked"),
+			NumNodes, BuildSeconds * 1000.0, ScanSeconds * 1000.0, NumScannedAvailable, NumGraphAvailable,
+			UnlockSeconds * 1.0e6 / NumNodes, WorstUnlockSeconds * 1.0e6, NumUnlocked, NumNodes);
+
+		Research->MarkAsGarbage();
+	}
+
+	static FAutoConsoleCommand GraphBenchmarkCommand(
+		TEXT("astro.Research.GraphBenchmark"),
+		TEXT("Time research DAG compilation and incremental unlocks against prerequisite scans. Usage: astro.Research.GraphBenchmark [NumNodes=10000]"),
+		FConsoleCommandWithArgsDelegate::CreateStatic(&RunGraphBenchmark));
+
+	static FAutoConsoleCommand ViewBenchmarkCommand(
+		TEXT("astro.Research.ViewBenchmark"),
+		TEXT("Compare per-frame polling of available research by filtering, cached copy and const ref. Usage: astro.Research.ViewBenchmark [NumNodes=1000] [NumFrames=600]"),
+		FConsoleCommandWithArgsDelegate::CreateStatic(&RunViewBenchmark));
+}
 
 UAstroResearchComponent::UAstroResearchComponent()
 {
-	PrimaryComponentTick.bCanEverTick = true;
+	// Research completes from a scheduled timer, so the component never ticks
+	PrimaryComponentTick.bCanEverTick = false;
 	bIsResearching = false;
-	ResearchProgress = 0.0f;
-	ResearchTimer = 0.0f;
-	CurrentResearchTime = 0.0f;
+	MaxConcurrentResearch = 1;
+	LabCount = 1;
+	SpeedBonusPerExtraLab = 0.5f;
+	ResearchStartTime = 0.0;
+	ResearchEndTime = 0.0;
+	bAvailableNodesDirty = true;
+	PlayerInventory = nullptr;
+	CraftingComponent = nullptr;
+	ResolvedRecipeSerial = 0;
 }
 
 void UAstroResearchComponent::BeginPlay()
 {
 	Super::BeginPlay();
-}
 
-void UAstroResearchComponent::TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
-{
-	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
+	if (AActor* Owner = GetOwner())
+	{
+		PlayerInventory = Owner->FindComponentByClass<UAstroInventoryComponent>();
+		CraftingComponent = Owner->FindComponentByClass<UAstroCraftingComponent>();
+	}
 
-	if (bIsResearching && CurrentResearchTime > 0.0f)
+	// The crafting component may begin play after this one; compile its recipes now so nodes unlocked at start can grant
+	// them. Its own BeginPlay recompiles and keeps the unlocks.
+	if (CraftingComponent && CraftingComponent->GetRecipeDatabase().GetBuildSerial() == 0)
 	{
-		ResearchTimer += DeltaTime;
-		ResearchProgress = FMath::Clamp(ResearchTimer / CurrentResearchTime, 0.0f, 1.0f);
+		CraftingComponent->NotifyRecipesChanged();
+	}
+
+	RebuildResearchGraph();
+}
 
-		if (ResearchTimer >= CurrentResearchTime)
+void UAstroResearchComponent::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	if (UAstroJobScheduler* Scheduler = GetJobScheduler())
+	{
+		for (FResearchJob& Job : ResearchJobs)
 		{
-			CompleteResearch();
+			Scheduler->CancelJob(Job.CompletionHandle);
 		}
 	}
+
+	Super::EndPlay(EndPlayReason);
 }
 
 bool UAstroResearchComponent::CanResearchNode(FName NodeID) const
@@ -39,114 +227,507 @@ bool UAstroResearchComponent::CanResearchNode(FName NodeID) const
 	if (NodeID.IsNone())
 		return false;
 
-	const FResearchNode* Node = nullptr;
-	for (const FResearchNode& N : ResearchNodes)
-	{
-		if (N.NodeID == NodeID)
-		{
-			Node = &N;
-			break;
-		}
-	}
+	// Prerequisites are tracked incrementally, so availability is a single bit
+	const int32 NodeIndex = ResearchGraph.FindNodeIndex(NodeID);
+	if (!AvailableNodes.IsValidIndex(NodeIndex) || !AvailableNodes[NodeIndex])
+		return false;
 
-	if (!Node || Node->bIsUnlocked)
+	if (ResearchJobs.Num() >= FMath::Max(MaxConcurrentResearch, 1) || FindResearchJobIndex(NodeID) != INDEX_NONE)
 		return false;
 
-	// Check prerequisites
-	for (const FName& PrereqID : Node->Prerequisites)
+	// Check resources
+	const FResearchNode& Node = ResearchNodes[NodeIndex];
+	if (Node.RequiredResources.Num() > 0 && !PlayerInventory)
+		return false;
+
+	for (const TPair<FName, int32>& Resource : Node.RequiredResources)
 	{
-		if (!IsNodeUnlocked(PrereqID))
+		if (!PlayerInventory->HasItem(Resource.Key, Resource.Value))
 			return false;
 	}
 
-	// Check resources - would need inventory reference
-	// Simplified for now
 	return true;
 }
 
 bool UAstroResearchComponent::StartResearch(FName NodeID)
 {
-	if (bIsResearching || !CanResearchNode(NodeID))
+	if (!CanResearchNode(NodeID))
 		return false;
 
 	FResearchNode* Node = FindNode(NodeID);
 	if (!Node)
 		return false;
 
-	// Start research
-	CurrentResearchNode = NodeID;
-	CurrentResearchTime = Node->ResearchTime;
-	ResearchTimer = 0.0f;
-	ResearchProgress = 0.0f;
-	bIsResearching = true;
+	// Take the resources in one transaction
+	if (Node->RequiredResources.Num() > 0)
+	{
+		TMap<FName, int32> Cost;
+		for (const TPair<FName, int32>& Resource : Node->RequiredResources)
+		{
+			Cost.Add(Resource.Key, -Resource.Value);
+		}
+		if (!PlayerInventory->ApplyInventoryDelta(Cost))
+			return false;
+	}
+
+	const double Now = GetSimulationTime();
+
+	FResearchJob& Job = ResearchJobs.AddDefaulted_GetRef();
+	Job.NodeID = NodeID;
+	Job.StartTime = Now;
+	Job.TotalWork = FMath::Max(Node->ResearchTime, 0.0f);
+	Job.RemainingWork = Job.TotalWork;
+	Job.RateChangeTime = Now;
+	Job.EndTime = Now + Job.RemainingWork / GetResearchRate();
+
+	if (UAstroJobScheduler* Scheduler = GetJobScheduler())
+	{
+		Job.CompletionHandle = Scheduler->ScheduleJob(Job.EndTime,
+			FAstroJobCompleted::CreateUObject(this, &UAstroResearchComponent::CompleteResearch, NodeID));
+	}
 
+	UpdateResearchState();
 	return true;
 }
 
 void UAstroResearchComponent::CancelResearch()
 {
-	if (!bIsResearching)
-		return;
+	while (ResearchJobs.Num() > 0)
+	{
+		CancelResearchNode(ResearchJobs.Last().NodeID);
+	}
+}
 
-	CurrentResearchNode = NAME_None;
-	ResearchTimer = 0.0f;
-	ResearchProgress = 0.0f;
-	CurrentResearchTime = 0.0f;
-	bIsResearching = false;
+bool UAstroResearchComponent::CancelResearchNode(FName NodeID)
+{
+	const int32 JobIndex = FindResearchJobIndex(NodeID);
+	if (JobIndex == INDEX_NONE)
+		return false;
+
+	FResearchJob Job = ResearchJobs[JobIndex];
+	ResearchJobs.RemoveAt(JobIndex);
+
+	if (UAstroJobScheduler* Scheduler = GetJobScheduler())
+	{
+		Scheduler->CancelJob(Job.CompletionHandle);
+	}
+
+	const FResearchNode* Node = FindNode(NodeID);
+	if (Node && PlayerInventory && Node->RequiredResources.Num() > 0)
+	{
+		PlayerInventory->ApplyInventoryDelta(Node->RequiredResources);
+	}
+
+	UpdateResearchState();
+	return true;
+}
+
+float UAstroResearchComponent::GetResearchProgress() const
+{
+	return ResearchJobs.Num() > 0 ? GetNodeResearchProgress(ResearchJobs[0].NodeID) : 0.0f;
+}
+
+float UAstroResearchComponent::GetNodeResearchProgress(FName NodeID) const
+{
+	const int32 JobIndex = FindResearchJobIndex(NodeID);
+	if (JobIndex == INDEX_NONE)
+		return 0.0f;
+
+	const FResearchJob& Job = ResearchJobs[JobIndex];
+	if (Job.TotalWork <= 0.0)
+		return 1.0f;
+
+	const double RemainingWork = Job.RemainingWork - (GetSimulationTime() - Job.RateChangeTime) * GetResearchRate();
+	return FMath::Clamp(static_cast<float>(1.0 - RemainingWork / Job.TotalWork), 0.0f, 1.0f);
 }
 
-void UAstroResearchComponent::CompleteResearch()
+void UAstroResearchComponent::SetLabCount(int32 NewLabCount)
 {
-	if (!bIsResearching)
+	NewLabCount = FMath::Max(NewLabCount, 1);
+	if (NewLabCount == LabCount)
 		return;
 
-	FResearchNode* Node = FindNode(CurrentResearchNode);
-	if (Node)
+	// Bank the work done at the old rate, then retime what is left at the new one
+	const double Now = GetSimulationTime();
+	const double OldRate = GetResearchRate();
+	LabCount = NewLabCount;
+	const double NewRate = GetResearchRate();
+
+	UAstroJobScheduler* Scheduler = GetJobScheduler();
+	for (FResearchJob& Job : ResearchJobs)
 	{
-		Node->bIsUnlocked = true;
+		Job.RemainingWork = FMath::Max(Job.RemainingWork - (Now - Job.RateChangeTime) * OldRate, 0.0);
+		Job.RateChangeTime = Now;
+		Job.EndTime = Now + Job.RemainingWork / NewRate;
+
+		if (Scheduler)
+		{
+			Scheduler->RescheduleJob(Job.CompletionHandle, Job.EndTime);
+		}
+	}
+
+	UpdateResearchState();
+}
+
+float UAstroResearchComponent::GetResearchRate() const
+{
+	return 1.0f + FMath::Max(SpeedBonusPerExtraLab, 0.0f) * (LabCount - 1);
+}
+
+UAstroJobScheduler* UAstroResearchComponent::GetJobScheduler() const
+{
+	UWorld* World = GetWorld();
+	return World ? World->GetSubsystem<UAstroJobScheduler>() : nullptr;
+}
+
+double UAstroResearchComponent::GetSimulationTime() const
+{
+	if (const UAstroJobScheduler* Scheduler = GetJobScheduler())
+		return Scheduler->GetSimulationTime();
 
-		// Unlock recipes - would need crafting component reference
-		// This would be handled through events in Blueprint
+	const UWorld* World = GetWorld();
+	return World ? World->GetTimeSeconds() : 0.0;
+}
 
-		OnResearchCompleted.Broadcast(CurrentResearchNode);
+void UAstroResearchComponent::CompleteResearch(double CompletionTime, FName NodeID)
+{
+	const int32 JobIndex = FindResearchJobIndex(NodeID);
+	if (JobIndex == INDEX_NONE)
+		return;
+
+	ResearchJobs.RemoveAt(JobIndex);
+	UpdateResearchState();
+
+	UnlockNode(NodeID);
+}
+
+bool UAstroResearchComponent::UnlockNode(FName NodeID)
+{
+	const int32 NodeIndex = ResearchGraph.FindNodeIndex(NodeID);
+	if (NodeIndex == INDEX_NONE || UnlockedNodes[NodeIndex])
+		return false;
+
+	// Research already running on the node is finished by this, its resources stay spent
+	const int32 JobIndex = FindResearchJobIndex(NodeID);
+	if (JobIndex != INDEX_NONE)
+	{
+		if (UAstroJobScheduler* Scheduler = GetJobScheduler())
+		{
+			Scheduler->CancelJob(ResearchJobs[JobIndex].CompletionHandle);
+		}
+		ResearchJobs.RemoveAt(JobIndex);
+		UpdateResearchState();
 	}
 
-	CurrentResearchNode = NAME_None;
-	ResearchTimer = 0.0f;
-	ResearchProgress = 0.0f;
-	CurrentResearchTime = 0.0f;
-	bIsResearching = false;
+	UnlockNodeIndex(NodeIndex);
+
+	const int32 Unlocked[] = { NodeIndex };
+	GrantNodeUnlocks(Unlocked);
+
+	OnResearchCompleted.Broadcast(NodeID);
+	return true;
+}
+
+void UAstroResearchComponent::UpdateResearchState()
+{
+	const FResearchJob* Job = ResearchJobs.Num() > 0 ? &ResearchJobs[0] : nullptr;
+	bIsResearching = Job != nullptr;
+	CurrentResearchNode = Job ? Job->NodeID : NAME_None;
+	ResearchStartTime = Job ? Job->StartTime : 0.0;
+	ResearchEndTime = Job ? Job->EndTime : 0.0;
+}
+
+int32 UAstroResearchComponent::FindResearchJobIndex(FName NodeID) const
+{
+	return ResearchJobs.IndexOfByPredicate([NodeID](const FResearchJob& Job)
+	{
+		return Job.NodeID == NodeID;
+	});
 }
 
 TArray<FResearchNode> UAstroResearchComponent::GetAvailableResearchNodes() const
 {
-	TArray<FResearchNode> AvailableNodes;
-	for (const FResearchNode& Node : ResearchNodes)
+	return GetAvailableResearchNodesRef();
+}
+
+const TArray<FResearchNode>& UAstroResearchComponent::GetAvailableResearchNodesRef() const
+{
+	if (bAvailableNodesDirty)
 	{
-		if (!Node.bIsUnlocked && CanResearchNode(Node.NodeID))
+		AvailableNodesCache.Reset();
+		ForEachAvailableResearchNode([this](const FResearchNode& Node)
 		{
-			AvailableNodes.Add(Node);
-		}
+			AvailableNodesCache.Add(Node);
+		});
+		bAvailableNodesDirty = false;
 	}
-	return AvailableNodes;
+	return AvailableNodesCache;
 }
 
-bool UAstroResearchComponent::IsNodeUnlocked(FName NodeID) const
+void UAstroResearchComponent::ForEachAvailableResearchNode(TFunctionRef<void(const FResearchNode&)> Visitor) const
 {
-	for (const FResearchNode& Node : ResearchNodes)
+	for (TConstSetBitIterator<> It(AvailableNodes); It; ++It)
 	{
-		if (Node.NodeID == NodeID)
-			return Node.bIsUnlocked;
+		Visitor(ResearchNodes[It.GetIndex()]);
 	}
-	return false;
+}
+
+void UAstroResearchComponent::NotifyResearchNodesChanged()
+{
+	RebuildResearchGraph();
+}
+
+bool UAstroResearchComponent::IsNodeUnlocked(FName NodeID) const
+{
+	const int32 NodeIndex = ResearchGraph.FindNodeIndex(NodeID);
+	return UnlockedNodes.IsValidIndex(NodeIndex) && UnlockedNodes[NodeIndex];
 }
 
 FResearchNode* UAstroResearchComponent::FindNode(FName NodeID)
 {
-	for (FResearchNode& Node : ResearchNodes)
+	const int32 NodeIndex = ResearchGraph.FindNodeIndex(NodeID);
+	return ResearchNodes.IsValidIndex(NodeIndex) ? &ResearchNodes[NodeIndex] : nullptr;
+}
+
+void UAstroResearchComponent::RebuildResearchGraph()
+{
+	// Carry unlocks over by ID, since indices may shift when nodes are edited
+	TSet<FName> PreviouslyUnlocked;
+	for (TConstSetBitIterator<> It(UnlockedNodes); It; ++It)
+	{
+		PreviouslyUnlocked.Add(ResearchGraph.GetNodeID(It.GetIndex()));
+	}
+
+	ResearchGraph.Build(ResearchNodes);
+
+	const int32 NodeCount = ResearchGraph.NumNodes();
+	UnlockedNodes.Init(false, NodeCount);
+	for (int32 NodeIndex = 0; NodeIndex < NodeCount; ++NodeIndex)
+	{
+		UnlockedNodes[NodeIndex] = ResearchNodes[NodeIndex].bUnlockedAtStart || PreviouslyUnlocked.Contains(ResearchNodes[NodeIndex].NodeID);
+	}
+
+	RecountAvailableNodes();
+
+	// Node indices changed, so force the recipe unlocks to be resolved again
+	RecipeUnlockOffsets.Reset();
+	ResolveRecipeUnlocks();
+
+	// Nodes unlocked at start (and any added to the unlocked set by the edit) grant their recipes and items here
+	GrantAllNodeUnlocks();
+}
+
+void UAstroResearchComponent::RecountAvailableNodes()
+{
+	const int32 NodeCount = ResearchGraph.NumNodes();
+	AvailableNodes.Init(false, NodeCount);
+	LockedPrerequisiteCounts.SetNumUninitialized(NodeCount);
+	for (int32 NodeIndex = 0; NodeIndex < NodeCount; ++NodeIndex)
+	{
+		int32 LockedCount = 0;
+		for (int32 PrereqIndex : ResearchGraph.GetPrerequisites(NodeIndex))
+		{
+			LockedCount += UnlockedNodes[PrereqIndex] ? 0 : 1;
+		}
+		LockedPrerequisiteCounts[NodeIndex] = LockedCount;
+		AvailableNodes[NodeIndex] = LockedCount == 0 && !UnlockedNodes[NodeIndex] && !ResearchGraph.IsBlocked(NodeIndex);
+	}
+
+	bAvailableNodesDirty = true;
+}
+
+void UAstroResearchComponent::SerializeProgress(FArchive& Ar, double ElapsedSeconds)
+{
+	// Unlocks go by node ID so they survive the tree being edited
+	TArray<FName> SavedNodeIDs;
+	if (Ar.IsSaving())
+	{
+		for (TConstSetBitIterator<> It(UnlockedNodes); It; ++It)
+		{
+			SavedNodeIDs.Add(ResearchGraph.GetNodeID(It.GetIndex()));
+		}
+	}
+	Ar << SavedNodeIDs;
+
+	int32 JobCount = ResearchJobs.Num();
+	Ar << JobCount;
+	if (JobCount < 0 || JobCount > MAX_uint16)
+	{
+		Ar.SetError();
+		return;
+	}
+
+	// Restored jobs resume from when they would have, had they kept running since the save
+	const double Now = GetSimulationTime() - (Ar.IsLoading() ? FMath::Max(ElapsedSeconds, 0.0) : 0.0);
+	const double Rate = GetResearchRate();
+	if (Ar.IsLoading())
+	{
+		if (UAstroJobScheduler* Scheduler = GetJobScheduler())
+		{
+			for (FResearchJob& Job : ResearchJobs)
+			{
+				Scheduler->CancelJob(Job.CompletionHandle);
+			}
+		}
+		ResearchJobs.Reset();
+		ResearchJobs.SetNum(JobCount);
+	}
+
+	for (FResearchJob& Job : ResearchJobs)
+	{
+		// Work left as of now, so the lab count at load time sets the new completion time
+		double StartOffset = Job.StartTime - Now;
+		double RemainingWork = FMath::Max(Job.RemainingWork - (Now - Job.RateChangeTime) * Rate, 0.0);
+		Ar << Job.NodeID;
+		Ar << StartOffset;
+		Ar << Job.TotalWork;
+		Ar << RemainingWork;
+
+		if (Ar.IsLoading())
+		{
+			Job.StartTime = Now + StartOffset;
+			Job.RemainingWork = RemainingWork;
+			Job.RateChangeTime = Now;
+			Job.EndTime = Now + RemainingWork / Rate;
+		}
+	}
+
+	if (!Ar.IsLoading() || Ar.IsError())
+		return;
+
+	int32 MissingNodes = 0;
+	for (const FName NodeID : SavedNodeIDs)
+	{
+		const int32 NodeIndex = ResearchGraph.FindNodeIndex(NodeID);
+		if (UnlockedNodes.IsValidIndex(NodeIndex))
+		{
+			UnlockedNodes[NodeIndex] = true;
+		}
+		else
+		{
+			++MissingNodes;
+		}
+	}
+	if (MissingNodes > 0)
+	{
+		UE_LOG(LogAstroEngineer, Warning, TEXT("%d saved research unlocks name nodes that no longer exist"), MissingNodes);
+	}
+	RecountAvailableNodes();
+
+	// Re-grant the recipes of every unlocked node, which also repairs recipe unlocks lost to a changed recipe list
+	GrantAllNodeUnlocks();
+
+	UAstroJobScheduler* Scheduler = GetJobScheduler();
+	ResearchJobs.RemoveAll([this](const FResearchJob& Job)
+	{
+		const int32 NodeIndex = ResearchGraph.FindNodeIndex(Job.NodeID);
+		return NodeIndex == INDEX_NONE || UnlockedNodes[NodeIndex];
+	});
+	for (FResearchJob& Job : ResearchJobs)
+	{
+		if (Scheduler)
+		{
+			Job.CompletionHandle = Scheduler->ScheduleJob(Job.EndTime,
+				FAstroJobCompleted::CreateUObject(this, &UAstroResearchComponent::CompleteResearch, Job.NodeID));
+		}
+	}
+	UpdateResearchState();
+}
+
+void UAstroResearchComponent::UnlockNodeIndex(int32 NodeIndex)
+{
+	if (UnlockedNodes[NodeIndex])
+		return;
+
+	UnlockedNodes[NodeIndex] = true;
+	AvailableNodes[NodeIndex] = false;
+
+	// Only dependents of the new node can become available
+	for (int32 Dependent : ResearchGraph.GetDependents(NodeIndex))
 	{
-		if (Node.NodeID == NodeID)
-			return &Node;
+		if (--LockedPrerequisiteCounts[Dependent] == 0 && !UnlockedNodes[Dependent] && !ResearchGraph.IsBlocked(Dependent))
+		{
+			AvailableNodes[Dependent] = true;
+		}
+	}
+
+	bAvailableNodesDirty = true;
+}
+
+void UAstroResearchComponent::GrantNodeUnlocks(TArrayView<const int32> NodeIndices)
+{
+	ResolveRecipeUnlocks();
+
+	TArray<int32> Recipes;
+	TArray<FName> NewItems;
+	for (int32 NodeIndex : NodeIndices)
+	{
+		if (RecipeUnlockOffsets.IsValidIndex(NodeIndex + 1))
+		{
+			const int32 Start = RecipeUnlockOffsets[NodeIndex];
+			Recipes.Append(RecipeUnlockIndices.GetData() + Start, RecipeUnlockOffsets[NodeIndex + 1] - Start);
+		}
+
+		for (FName ItemID : ResearchNodes[NodeIndex].UnlocksItems)
+		{
+			bool bAlreadyUnlocked = false;
+			UnlockedItems.Add(ItemID, &bAlreadyUnlocked);
+			if (!bAlreadyUnlocked)
+			{
+				NewItems.Add(ItemID);
+			}
+		}
+	}
+
+	if (CraftingComponent && Recipes.Num() > 0)
+	{
+		CraftingComponent->UnlockRecipes(Recipes);
+	}
+	if (NewItems.Num() > 0)
+	{
+		OnItemsUnlocked.Broadcast(NewItems);
+	}
+}
+
+void UAstroResearchComponent::GrantAllNodeUnlocks()
+{
+	TArray<int32> NodeIndices;
+	for (TConstSetBitIterator<> It(UnlockedNodes); It; ++It)
+	{
+		NodeIndices.Add(It.GetIndex());
+	}
+	GrantNodeUnlocks(NodeIndices);
+}
+
+void UAstroResearchComponent::ResolveRecipeUnlocks()
+{
+	if (!CraftingComponent)
+		return;
+
+	// The crafting component compiles its database in its own BeginPlay, which may not have run yet
+	const FAstroRecipeDatabase& RecipeDatabase = CraftingComponent->GetRecipeDatabase();
+	if (RecipeDatabase.GetBuildSerial() == 0)
+		return;
+
+	if (RecipeUnlockOffsets.Num() == ResearchNodes.Num() + 1 && ResolvedRecipeSerial == RecipeDatabase.GetBuildSerial())
+		return;
+
+	RecipeUnlockOffsets.Reset(ResearchNodes.Num() + 1);
+	RecipeUnlockIndices.Reset();
+	for (const FResearchNode& Node : ResearchNodes)
+	{
+		RecipeUnlockOffsets.Add(RecipeUnlockIndices.Num());
+		for (FName RecipeID : Node.UnlocksRecipes)
+		{
+			const int32 RecipeIndex = RecipeDatabase.FindRecipeIndex(RecipeID);
+			if (RecipeIndex == INDEX_NONE)
+			{
+				UE_LOG(LogAstroEngineer, Warning, TEXT("Research node '%s' unlocks missing recipe '%s'"), *Node.NodeID.ToString(), *RecipeID.ToString());
+				continue;
+			}
+			RecipeUnlockIndices.Add(RecipeIndex);
+		}
 	}
-	return nullptr;
+	RecipeUnlockOffsets.Add(RecipeUnlockIndices.Num());
+	ResolvedRecipeSerial = RecipeDatabase.GetBuildSerial();
 }
@@ -0,0 +1,142 @@
+// Copyright Astro Engineer Team. All Rights Reserved.
+
+#include "AstroResearchGraph.h"
+#include "AstroResearchComponent.h"
+#include "AstroEngineer.h"
+
+bool FAstroResearchGraph::Build(TArrayView<const FResearchNode> Nodes)
+{
+	Reset();
+
+	const int32 NodeCount = Nodes.Num();
+	NodeIDs.Reserve(NodeCount);
+	for (int32 NodeIndex = 0; NodeIndex < NodeCount; ++NodeIndex)
+	{
+		const FName NodeID = Nodes[NodeIndex].NodeID;
+		NodeIDs.Add(NodeID);
+		if (NodeIndexByID.Contains(NodeID))
+		{
+			UE_LOG(LogAstroEngineer, Warning, TEXT("Research node '%s' is defined more than once; only the first entry is reachable by ID"), *NodeID.ToString());
+			continue;
+		}
+		NodeIndexByID.Add(NodeID, NodeIndex);
+	}
+
+	BlockedNodes.Init(false, NodeCount);
+
+	// Prerequisite adjacency, skipping duplicates and unknown IDs
+	PrerequisiteOffsets.Reserve(NodeCount + 1);
+	for (int32 NodeIndex = 0; NodeIndex < NodeCount; ++NodeIndex)
+	{
+		const int32 Start = PrerequisiteNodes.Num();
+		PrerequisiteOffsets.Add(Start);
+
+		for (FName PrereqID : Nodes[NodeIndex].Prerequisites)
+		{
+			const int32 PrereqIndex = FindNodeIndex(PrereqID);
+			if (PrereqIndex == INDEX_NONE)
+			{
+				UE_LOG(LogAstroEngineer, Warning, TEXT("Research node '%s' requires missing node '%s'"), *NodeIDs[NodeIndex].ToString(), *PrereqID.ToString());
+				BlockedNodes[NodeIndex] = true;
+				continue;
+			}
+
+			const TArrayView<const int32> Existing(PrerequisiteNodes.GetData() + Start, PrerequisiteNodes.Num() - Start);
+			if (!Existing.Contains(PrereqIndex))
+			{
+				PrerequisiteNodes.Add(PrereqIndex);
+			}
+		}
+	}
+	PrerequisiteOffsets.Add(PrerequisiteNodes.Num());
+
+	// Dependent adjacency with a counting pass, then a fill pass
+	DependentOffsets.SetNumZeroed(NodeCount + 1);
+	for (int32 PrereqIndex : PrerequisiteNodes)
+	{
+		++DependentOffsets[PrereqIndex + 1];
+	}
+	for (int32 NodeIndex = 0; NodeIndex < NodeCount; ++NodeIndex)
+	{
+		DependentOffsets[NodeIndex + 1] += DependentOffsets[NodeIndex];
+	}
+
+	TArray<int32> FillCursor(DependentOffsets.GetData(), NodeCount);
+	DependentNodes.SetNumUninitialized(PrerequisiteNodes.Num());
+	for (int32 NodeIndex = 0; NodeIndex < NodeCount; ++NodeIndex)
+	{
+		for (int32 PrereqIndex : GetPrerequisites(NodeIndex))
+		{
+			DependentNodes[FillCursor[PrereqIndex]++] = NodeIndex;
+		}
+	}
+
+	// Kahn's algorithm; whatever never reaches zero in-degree is on or behind a cycle
+	TArray<int32> InDegree;
+	InDegree.SetNumUninitialized(NodeCount);
+	TopologicalOrder.Reserve(NodeCount);
+	for (int32 NodeIndex = 0; NodeIndex < NodeCount; ++NodeIndex)
+	{
+		InDegree[NodeIndex] = PrerequisiteOffsets[NodeIndex + 1] - PrerequisiteOffsets[NodeIndex];
+		if (InDegree[NodeIndex] == 0)
+		{
+			TopologicalOrder.Add(NodeIndex);
+		}
+	}
+	for (int32 Cursor = 0; Cursor < TopologicalOrder.Num(); ++Cursor)
+	{
+		for (int32 Dependent : GetDependents(TopologicalOrder[Cursor]))
+		{
+			if (--InDegree[Dependent] == 0)
+			{
+				TopologicalOrder.Add(Dependent);
+			}
+		}
+	}
+
+	if (TopologicalOrder.Num() < NodeCount)
+	{
+		TArray<FString> CycleNodes;
+		for (int32 NodeIndex = 0; NodeIndex < NodeCount; ++NodeIndex)
+		{
+			if (InDegree[NodeIndex] > 0)
+			{
+				BlockedNodes[NodeIndex] = true;
+				CycleNodes.Add(NodeIDs[NodeIndex].ToString());
+			}
+		}
+		UE_LOG(LogAstroEngineer, Error, TEXT("Research tree has a prerequisite cycle; these nodes can never be researched: %s"), *FString::Join(CycleNodes, TEXT(", ")));
+	}
+
+	return BlockedNodes.Find(true) == INDEX_NONE;
+}
+
+void FAstroResearchGraph::Reset()
+{
+	NodeIndexByID.Reset();
+	NodeIDs.Reset();
+	PrerequisiteOffsets.Reset();
+	PrerequisiteNodes.Reset();
+	DependentOffsets.Reset();
+	DependentNodes.Reset();
+	TopologicalOrder.Reset();
+	BlockedNodes.Reset();
+}
+
+int32 FAstroResearchGraph::FindNodeIndex(FName NodeID) const
+{
+	const int32* Index = NodeIndexByID.Find(NodeID);
+	return Index ? *Index : INDEX_NONE;
+}
+
+TArrayView<const int32> FAstroResearchGraph::GetPrerequisites(int32 NodeIndex) const
+{
+	const int32 Start = PrerequisiteOffsets[NodeIndex];
+	return TArrayView<const int32>(PrerequisiteNodes.GetData() + Start, PrerequisiteOffsets[NodeIndex + 1] - Start);
+}
+
+TArrayView<const int32> FAstroResearchGraph::GetDependents(int32 NodeIndex) const
+{
+	const int32 Start = DependentOffsets[NodeIndex];
+	return TArrayView<const int32>(DependentNodes.GetData() + Start, DependentOffsets[NodeIndex + 1] - Start);
+}
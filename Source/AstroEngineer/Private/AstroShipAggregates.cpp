@@ -0,0 +1,204 @@
+// Copyright Astro Engineer Team. All Rights Reserved.
+
+#include "AstroShipAggregates.h"
+
+FAstroShipModuleContribution FAstroShipModuleContribution::FromModule(const AAstroShipModule& Module, const FVector& ShipSpaceLocation)
+{
+	FAstroShipModuleContribution Contribution;
+	Contribution.ModuleType = Module.GetModuleType();
+	Contribution.Mass = Module.GetMass();
+	Contribution.PowerConsumption = Module.GetPowerConsumption();
+	Contribution.PowerGeneration = Module.GetPowerGeneration();
+	Contribution.CrewCapacity = Module.GetCrewCapacity();
+	Contribution.Thrust = Module.GetThrust();
+	Contribution.Location = ShipSpaceLocation;
+	return Contribution;
+}
+
+void FAstroShipAggregates::Add(const FAstroShipModuleContribution& Contribution)
+{
+	const FVector& P = Contribution.Location;
+	const double M = Contribution.Mass;
+
+	TotalMass += M;
+	PowerGeneration += Contribution.PowerGeneration;
+	PowerConsumption += Contribution.PowerConsumption;
+	CrewCapacity += Contribution.CrewCapacity;
+	TotalThrust += Contribution.Thrust;
+	++ModuleCount;
+	++ModuleTypeCounts[static_cast<int32>(Contribution.ModuleType)];
+
+	MassMoment += M * P;
+	SecondMoment[0] += M * P.X * P.X;
+	SecondMoment[1] += M * P.Y * P.Y;
+	SecondMoment[2] += M * P.Z * P.Z;
+	SecondMoment[3] += M * P.X * P.Y;
+	SecondMoment[4] += M * P.X * P.Z;
+	SecondMoment[5] += M * P.Y * P.Z;
+}
+
+void FAstroShipAggregates::Remove(const FAstroShipModuleContribution& Contribution)
+{
+	const FVector& P = Contribution.Location;
+	const double M = Contribution.Mass;
+
+	TotalMass -= M;
+	PowerGeneration -= Contribution.PowerGeneration;
+	PowerConsumption -= Contribution.PowerConsumption;
+	CrewCapacity -= Contribution.CrewCapacity;
+	TotalThrust -= Contribution.Thrust;
+	--ModuleCount;
+	--ModuleTypeCounts[static_cast<int32>(Contribution.ModuleType)];
+
+	MassMoment -= M * P;
+	SecondMoment[0] -= M * P.X * P.X;
+	SecondMoment[1] -= M * P.Y * P.Y;
+	SecondMoment[2] -= M * P.Z * P.Z;
+	SecondMoment[3] -= M * P.X * P.Y;
+	SecondMoment[4] -= M * P.X * P.Z;
+	SecondMoment[5] -= M * P.Y * P.Z;
+
+	// An empty ship has exactly zero of everything; drop accumulated rounding
+	if (ModuleCount == 0)
+	{
+		Reset();
+	}
+}
+
+void FAstroShipAggregates::Reset()
+{
+	*this = FAstroShipAggregates();
+}
+
+FVector FAstroShipAggregates::GetCenterOfMass() const
+{
+	return TotalMass > UE_SMALL_NUMBER ? MassMoment / TotalMass : FVector::ZeroVector;
+}
+
+FMatrix FAstroShipAggregates::GetInertiaTensor() const
+{
+	// I = sum m (|p|^2 E - p p^T), shifted to the center of mass with the parallel axis theorem
+	const FVector C = GetCenterOfMass();
+	const double XX = SecondMoment[0] - TotalMass * C.X * C.X;
+	const double YY = SecondMoment[1] - TotalMass * C.Y * C.Y;
+	const double ZZ = SecondMoment[2] - TotalMass * C.Z * C.Z;
+	const double XY = SecondMoment[3] - TotalMass * C.X * C.Y;
+	const double XZ = SecondMoment[4] - TotalMass * C.X * C.Z;
+	const double YZ = SecondMoment[5] - TotalMass * C.Y * C.Z;
+
+	return FMatrix(
+		FPlane(YY + ZZ, -XY, -XZ, 0.0),
+		FPlane(-XY, XX + ZZ, -YZ, 0.0),
+		FPlane(-XZ, -YZ, XX + YY, 0.0),
+		FPlane(0.0, 0.0, 0.0, 1.0));
+}
+
+void FAstroShipAggregates::GetPrincipalInertia(FVector& OutMoments, FQuat& OutAxes) const
+{
+	// Cyclic Jacobi rotations on the symmetric tensor; converges in a handful of sweeps for 3x3
+	const FMatrix Tensor = GetInertiaTensor();
+	double A[3][3];
+	double V[3][3] = { { 1.0, 0.0, 0.0 }, { 0.0, 1.0, 0.0 }, { 0.0, 0.0, 1.0 } };
+	for (int32 Row = 0; Row < 3; ++Row)
+	{
+		for (int32 Col = 0; Col < 3; ++Col)
+		{
+			A[Row][Col] = Tensor.M[Row][Col];
+		}
+	}
+
+	for (int32 Sweep = 0; Sweep < 16; ++Sweep)
+	{
+		const double OffDiagonal = FMath::Abs(A[0][1]) + FMath::Abs(A[0][2]) + FMath::Abs(A[1][2]);
+		const double Diagonal = FMath::Abs(A[0][0]) + FMath::Abs(A[1][1]) + FMath::Abs(A[2][2]);
+		if (OffDiagonal <= UE_DOUBLE_KINDA_SMALL_NUMBER * FMath::Max(Diagonal, 1.0))
+			break;
+
+		for (int32 P = 0; P < 2; ++P)
+		{
+			for (int32 Q = P + 1; Q < 3; ++Q)
+			{
+				if (FMath::Abs(A[P][Q]) < UE_DOUBLE_SMALL_NUMBER)
+					continue;
+
+				const double Theta = 0.5 * FMath::Atan2(2.0 * A[P][Q], A[Q][Q] - A[P][P]);
+				const double C = FMath::Cos(Theta);
+				const double S = FMath::Sin(Theta);
+
+				for (int32 K = 0; K < 3; ++K)
+				{
+					const double AKP = A[K][P];
+					const double AKQ = A[K][Q];
+					A[K][P] = C * AKP - S * AKQ;
+					A[K][Q] = S * AKP + C * AKQ;
+				}
+				for (int32 K = 0; K < 3; ++K)
+				{
+					const double APK = A[P][K];
+					const double AQK = A[Q][K];
+					A[P][K] = C * APK - S * AQK;
+					A[Q][K] = S * APK + C * AQK;
+				}
+				for (int32 K = 0; K < 3; ++K)
+				{
+					const double VKP = V[K][P];
+					const double VKQ = V[K][Q];
+					V[K][P] = C * VKP - S * VKQ;
+					V[K][Q] = S * VKP + C * VKQ;
+				}
+			}
+		}
+	}
+
+	OutMoments = FVector(A[0][0], A[1][1], A[2][2]);
+
+	// Columns of V are the principal axes; keep the basis right-handed so it is a rotation
+	FVector AxisX(V[0][0], V[1][0], V[2][0]);
+	FVector AxisY(V[0][1], V[1][1], V[2][1]);
+	FVector AxisZ(V[0][2], V[1][2], V[2][2]);
+	if (FVector::DotProduct(FVector::CrossProduct(AxisX, AxisY), AxisZ) < 0.0)
+	{
+		AxisZ = -AxisZ;
+	}
+	OutAxes = FMatrix(AxisX, AxisY, AxisZ, FVector::ZeroVector).ToQuat();
+}
+
+bool FAstroShipAggregates::Equals(const FAstroShipAggregates& Other, double Tolerance) const
+{
+	if (ModuleCount != Other.ModuleCount || CrewCapacity != Other.CrewCapacity)
+		return false;
+
+	for (int32 TypeIndex = 0; TypeIndex < NumModuleTypes; ++TypeIndex)
+	{
+		if (ModuleTypeCounts[TypeIndex] != Other.ModuleTypeCounts[TypeIndex])
+			return false;
+	}
+
+	// Moments grow with mass and distance, so compare them relative to their magnitude
+	auto NearlyEqual = [Tolerance](double A, double B)
+	{
+		return FMath::Abs(A - B) <= Tolerance * FMath::Max3(1.0, FMath::Abs(A), FMath::Abs(B));
+	};
+
+	if (!NearlyEqual(TotalMass, Other.TotalMass) || !NearlyEqual(PowerGeneration, Other.PowerGeneration) || !NearlyEqual(PowerConsumption, Other.PowerConsumption)
+		|| !NearlyEqual(TotalThrust, Other.TotalThrust))
+		return false;
+
+	if (!NearlyEqual(MassMoment.X, Other.MassMoment.X) || !NearlyEqual(MassMoment.Y, Other.MassMoment.Y) || !NearlyEqual(MassMoment.Z, Other.MassMoment.Z))
+		return false;
+
+	for (int32 Index = 0; Index < UE_ARRAY_COUNT(SecondMoment); ++Index)
+	{
+		if (!NearlyEqual(SecondMoment[Index], Other.SecondMoment[Index]))
+			return false;
+	}
+
+	return true;
+}
+
+FString FAstroShipAggregates::ToString() const
+{
+	const FVector CenterOfMass = GetCenterOfMass();
+	return FString::Printf(TEXT("Modules=%d Mass=%.3f Power=%.3f/%.3f Crew=%d Thrust=%.3f CoM=(%.2f, %.2f, %.2f)"),
+		ModuleCount, TotalMass, PowerGeneration, PowerConsumption, CrewCapacity, TotalThrust, CenterOfMass.X, CenterOfMass.Y, CenterOfMass.Z);
+}
@@ -1,26 +1,341 @@
 // Copyright Astro Engineer Team. All Rights Reserved.
 
 #include "AstroShipAssembly.h"
+#include "AstroShipBodyComponent.h"
+#include "AstroOrbitalSubsystem.h"
+#include "AstroTimeWarpSubsystem.h"
+#include "AstroEngineer.h"
+#include "Components/InstancedStaticMeshComponent.h"
+#include "Containers/Ticker.h"
+#include "CoreGlobals.h"
+#include "Engine/AssetManager.h"
+#include "EngineUtils.h"
+#include "Engine/StreamableManager.h"
+#include "Misc/FileHelper.h"
+#include "HAL/IConsoleManager.h"
+
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Collapsed Ship Modules"), STAT_AstroCollapsedModules, STATGROUP_AstroEngineer);
+DECLARE_CYCLE_STAT(TEXT("Build Ship From Design"), STAT_AstroBuildShipFromDesign, STATGROUP_AstroEngineer);
+DECLARE_CYCLE_STAT(TEXT("Stream Ship Design Step"), STAT_AstroStreamShipDesignStep, STATGROUP_AstroEngineer);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Design Modules Spawned"), STAT_AstroDesignModulesSpawned, STATGROUP_AstroEngineer);
+
+static TAutoConsoleVariable<int32> CVarAstroValidateShipAggregates(
+	TEXT("astro.Ship.ValidateAggregates"),
+	0,
+	TEXT("Cross-check the running ship totals against a full recompute after every module change (0 = off, 1 = on)"),
+	ECVF_Default);
+
+namespace AstroShipAssembly
+{
+	/** Look up every class of a design's class table, loading synchronously if asked; missing classes come back null */
+	static void ResolveDesignClasses(const FAstroShipDesign& Design, bool bLoad, TArray<UClass*>& OutClasses)
+	{
+		OutClasses.Reset(Design.ModuleClasses.Num());
+		for (const FSoftClassPath& ClassPath : Design.ModuleClasses)
+		{
+			UClass* ModuleClass = bLoad ? ClassPath.TryLoadClass<AAstroShipModule>() : ClassPath.ResolveClass();
+			if (!ModuleClass || !ModuleClass->IsChildOf<AAstroShipModule>())
+			{
+				UE_LOG(LogAstroEngineer, Warning, TEXT("Ship design '%s' uses missing module class '%s'; those modules and everything attached to them are skipped"),
+					*Design.ShipName, *ClassPath.ToString());
+				ModuleClass = nullptr;
+			}
+			OutClasses.Add(ModuleClass);
+		}
+	}
+
+	struct FShipFootprint
+	{
+		int32 Actors = 0;
+		int32 Components = 0;
+		int32 RegisteredComponents = 0;
+		int32 RenderStates = 0;
+		int32 PhysicsStates = 0;
+	};
+
+	/** Count the ship actor and its module actors, and what their components cost the scene and physics */
+	static FShipFootprint MeasureShip(const AAstroShipAssembly& Ship)
+	{
+		FShipFootprint Footprint;
+		auto CountActor = [&Footprint](const AActor* Actor)
+		{
+			++Footprint.Actors;
+			Actor->ForEachComponent(false, [&Footprint](const UActorComponent* Component)
+			{
+				++Footprint.Components;
+				Footprint.RegisteredComponents += Component->IsRegistered() ? 1 : 0;
+				Footprint.RenderStates += Component->IsRenderStateCreated() ? 1 : 0;
+				Footprint.PhysicsStates += Component->IsPhysicsStateCreated() ? 1 : 0;
+			});
+		};
+
+		CountActor(&Ship);
+		for (const AAstroShipModule* Module : Ship.GetModulesView())
+		{
+			if (Module)
+			{
+				CountActor(Module);
+			}
+		}
+		return Footprint;
+	}
+
+	static void RunCollapseReport(const TArray<FString>& Args, UWorld* World)
+	{
+		if (!World)
+			return;
+
+		for (TActorIterator<AAstroShipAssembly> It(World); It; ++It)
+		{
+			AAstroShipAssembly* Ship = *It;
+			const TArray<AAstroShipModule*> Modules = Ship->GetAllModules();
+
+			// Measure fully expanded, then fully collapsed, then put back the modules that were live
+			TArray<AAstroShipModule*> WereCollapsed;
+			for (AAstroShipModule* Module : Modules)
+			{
+				if (Ship->ExpandModule(Module))
+				{
+					WereCollapsed.Add(Module);
+				}
+			}
+			const FShipFootprint Expanded = MeasureShip(*Ship);
+
+			const double StartTime = FPlatformTime::Seconds();
+			Ship->CollapseModulesToInstances();
+			const double CollapseSeconds = FPlatformTime::Seconds() - StartTime;
+			const FShipFootprint Collapsed = MeasureShip(*Ship);
+
+			for (AAstroShipModule* Module : Modules)
+			{
+				if (!WereCollapsed.Contains(Module))
+				{
+					Ship->ExpandModule(Module);
+				}
+			}
+
+			UE_LOG(LogAstroEngineer, Display, TEXT("Ship '%s', %d modules, expanded -> collapsed: actors %d -> %d, components %d -> %d, registered %d -> %d, render proxies %d -> %d, physics states %d -> %d; collapse took %.3f ms"),
+				*Ship->GetName(), Modules.Num(), Expanded.Actors, Collapsed.Actors, Expanded.Components, Collapsed.Components,
+				Expanded.RegisteredComponents, Collapsed.RegisteredComponents, Expanded.RenderStates, Collapsed.RenderStates,
+				Expanded.PhysicsStates, Collapsed.PhysicsStates, CollapseSeconds * 1000.0);
+		}
+	}
+
+	static FAutoConsoleCommandWithWorldAndArgs CollapseReportCommand(
+		TEXT("astro.Ship.CollapseReport"),
+		TEXT("Log actor and component counts of every ship with all modules live and with all modules collapsed to instances. Usage: astro.Ship.CollapseReport"),
+		FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&RunCollapseReport));
+
+	/** A design benchmark waiting for its streamed copy to finish */
+	struct FDesignBenchmark
+	{
+		TWeakObjectPtr<AAstroShipAssembly> StreamedShip;
+		FAstroShipDesign Design;
+		FString SourceName;
+		double BuildSeconds = 0.0;
+		double StreamStartTime = 0.0;
+		double WorstFrameSeconds = 0.0;
+		int32 NumFrames = 0;
+		FTSTicker::FDelegateHandle TickerHandle;
+	};
+
+	static TUniquePtr<FDesignBenchmark> DesignBenchmark;
+
+	/** Empty ship for a benchmark copy, high above the source and held still so it does not fall through the level */
+	static AAstroShipAssembly* SpawnBenchmarkShip(UWorld& World, const AAstroShipAssembly& Source)
+	{
+		const FTransform Transform(Source.GetActorRotation(), Source.GetActorLocation() + FVector(0.0, 0.0, 1.0e5));
+		AAstroShipAssembly* Ship = World.SpawnActorDeferred<AAstroShipAssembly>(AAstroShipAssembly::StaticClass(), Transform, nullptr, nullptr,
+			ESpawnActorCollisionHandlingMethod::AlwaysSpawn);
+		if (!Ship)
+			return nullptr;
+
+		Ship->bSimulatePhysicsWhenFinalized = false;
+		Ship->DesignModulesPerFrame = Source.DesignModulesPerFrame;
+		Ship->FinishSpawning(Transform);
+		return Ship;
+	}
+
+	/** Modules outlive their ship, so a benchmark copy destroys them first */
+	static void DestroyBenchmarkShip(AAstroShipAssembly* Ship)
+	{
+		if (!Ship)
+			return;
+
+		for (AAstroShipModule* Module : Ship->GetAllModules())
+		{
+			if (Module)
+			{
+				Module->Destroy();
+			}
+		}
+		Ship->Destroy();
+	}
+
+	/** Whether a ship built from a design captures back to the same design */
+	static bool MatchesDesign(const AAstroShipAssembly& Ship, const FAstroShipDesign& Design)
+	{
+		FAstroShipDesign Rebuilt;
+		return Rebuilt.Capture(Ship) && Rebuilt.IsEquivalent(Design);
+	}
+
+	static bool TickDesignBenchmark(float DeltaTime)
+	{
+		FDesignBenchmark& Run = *DesignBenchmark;
+		AAstroShipAssembly* Ship = Run.StreamedShip.Get();
+		if (!Ship)
+		{
+			DesignBenchmark.Reset();
+			return false;
+		}
+
+		if (Ship->IsStreamingDesign())
+		{
+			++Run.NumFrames;
+			Run.WorstFrameSeconds = FMath::Max(Run.WorstFrameSeconds, FPlatformTime::ToSeconds(GGameThreadTime));
+			return true;
+		}
+
+		const double StreamSeconds = FPlatformTime::Seconds() - Run.StreamStartTime;
+		const bool bStreamMatches = MatchesDesign(*Ship, Run.Design);
+		DestroyBenchmarkShip(Ship);
+
+		UE_LOG(LogAstroEngineer, Display, TEXT("Ship design benchmark, '%s': build %.2f ms in one frame; stream %.2f ms over %d frames, worst game thread frame %.2f ms; streamed ship %s the design"),
+			*Run.SourceName, Run.BuildSeconds * 1000.0, StreamSeconds * 1000.0, Run.NumFrames, Run.WorstFrameSeconds * 1000.0,
+			bStreamMatches ? TEXT("matches") : TEXT("DOES NOT MATCH"));
+
+		DesignBenchmark.Reset();
+		return false;
+	}
+
+	static void RunDesignBenchmark(const TArray<FString>& Args, UWorld* World)
+	{
+		if (DesignBenchmark || !World || !World->HasBegunPlay())
+		{
+			UE_LOG(LogAstroEngineer, Warning, TEXT("Ship design benchmark needs a world that has begun play and no other run in progress"));
+			return;
+		}
+
+		// The named ship, or the one with the most modules
+		AAstroShipAssembly* Source = nullptr;
+		for (TActorIterator<AAstroShipAssembly> It(World); It; ++It)
+		{
+			const bool bNamed = Args.Num() > 0 && It->GetName() == Args[0];
+			if (bNamed || (Args.Num() == 0 && (!Source || It->GetModulesView().Num() > Source->GetModulesView().Num())))
+			{
+				Source = *It;
+			}
+		}
+
+		FAstroShipDesign Design;
+		if (!Source || !Design.Capture(*Source))
+		{
+			UE_LOG(LogAstroEngineer, Warning, TEXT("Ship design benchmark found no ship with modules to capture"));
+			return;
+		}
+
+		double StartTime = FPlatformTime::Seconds();
+		TArray<uint8> Bytes;
+		const bool bSaved = Design.SaveToBytes(Bytes);
+		const double SaveSeconds = FPlatformTime::Seconds() - StartTime;
+
+		FAstroShipDesign Loaded;
+		StartTime = FPlatformTime::Seconds();
+		const bool bLoaded = bSaved && Loaded.LoadFromBytes(Bytes);
+		const double LoadSeconds = FPlatformTime::Seconds() - StartTime;
+
+		UE_LOG(LogAstroEngineer, Display, TEXT("Ship design benchmark, '%s': %d modules, %d classes, %d bytes (%.2f per module), save %.3f ms, load %.3f ms; loaded design %s the saved one"),
+			*Source->GetName(), Design.NumModules(), Design.ModuleClasses.Num(), Bytes.Num(), double(Bytes.Num()) / Design.NumModules(),
+			SaveSeconds * 1000.0, LoadSeconds * 1000.0, bLoaded && Loaded.IsEquivalent(Design) ? TEXT("matches") : TEXT("DOES NOT MATCH"));
+		if (!bLoaded)
+			return;
+
+		AAstroShipAssembly* BuiltShip = SpawnBenchmarkShip(*World, *Source);
+		AAstroShipAssembly* StreamedShip = SpawnBenchmarkShip(*World, *Source);
+		if (!BuiltShip || !StreamedShip)
+		{
+			DestroyBenchmarkShip(BuiltShip);
+			DestroyBenchmarkShip(StreamedShip);
+			return;
+		}
+
+		StartTime = FPlatformTime::Seconds();
+		BuiltShip->BuildFromDesign(Loaded);
+		const double BuildSeconds = FPlatformTime::Seconds() - StartTime;
+		const bool bBuildMatches = MatchesDesign(*BuiltShip, Design);
+		DestroyBenchmarkShip(BuiltShip);
+		if (!bBuildMatches)
+		{
+			UE_LOG(LogAstroEngineer, Warning, TEXT("Ship design benchmark: ship built from the loaded design DOES NOT MATCH the design"));
+		}
+
+		DesignBenchmark = MakeUnique<FDesignBenchmark>();
+		FDesignBenchmark& Run = *DesignBenchmark;
+		Run.StreamedShip = StreamedShip;
+		Run.Design = MoveTemp(Design);
+		Run.SourceName = Source->GetName();
+		Run.BuildSeconds = BuildSeconds;
+		Run.StreamStartTime = FPlatformTime::Seconds();
+		if (!StreamedShip->StreamFromDesign(Loaded))
+		{
+			DestroyBenchmarkShip(StreamedShip);
+			DesignBenchmark.Reset();
+			return;
+		}
+		Run.TickerHandle = FTSTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateStatic(&TickDesignBenchmark));
+	}
+
+	static FAutoConsoleCommandWithWorldAndArgs DesignBenchmarkCommand(
+		TEXT("astro.Ship.DesignBenchmark"),
+		TEXT("Save a ship's design, load it back and check it matches, then time building a copy in one frame against streaming one in. Usage: astro.Ship.DesignBenchmark [ShipActorName=largest ship]"),
+		FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&RunDesignBenchmark));
+}
 
 AAstroShipAssembly::AAstroShipAssembly()
 {
-	PrimaryActorTick.bCanEverTick = true;
+	PrimaryActorTick.bCanEverTick = false;
+
+	ShipBody = CreateDefaultSubobject<UAstroShipBodyComponent>(TEXT("ShipBody"));
+	RootComponent = ShipBody;
 
 	RootModule = nullptr;
 	bIsComplete = false;
 	bRequiresCockpit = true;
 	bRequiresEngine = true;
 	bRequiresFuelTank = true;
+	MinThrustToWeight = 0.0f;
+	ReferenceGravity = 9.81f;
+	SnapCellSize = 200.0f;
+	bSimulatePhysicsWhenFinalized = true;
+	DesignModulesPerFrame = 64;
 }
 
 void AAstroShipAssembly::BeginPlay()
 {
 	Super::BeginPlay();
+
+	SnapIndex.Reset(SnapCellSize);
 }
 
-void AAstroShipAssembly::Tick(float DeltaTime)
+void AAstroShipAssembly::EndPlay(const EEndPlayReason::Type EndPlayReason)
 {
-	Super::Tick(DeltaTime);
+	DEC_DWORD_STAT_BY(STAT_AstroCollapsedModules, CollapsedModuleGroups.Num());
+
+	// Abandon a design still streaming in
+	if (StreamingDesign)
+	{
+		if (DesignClassesHandle)
+		{
+			DesignClassesHandle->CancelHandle();
+		}
+		GetWorldTimerManager().ClearAllTimersForObject(this);
+		StreamingDesign.Reset();
+		DesignClassesHandle.Reset();
+	}
+
+	LeaveOrbit();
+
+	Super::EndPlay(EndPlayReason);
 }
 
 bool AAstroShipAssembly::AddModule(TSubclassOf<AAstroShipModule> ModuleClass, AAstroShipModule* ParentModule, int32 ConnectionIndex)
@@ -36,133 +351,745 @@ bool AAstroShipAssembly::AddModule(TSubclassOf<AAstroShipModule> ModuleClass, AA
 	if (!NewModule)
 		return false;
 
+	return AttachSpawnedModule(NewModule, ParentModule, ConnectionIndex);
+}
+
+bool AAstroShipAssembly::AttachSpawnedModule(AAstroShipModule* NewModule, AAstroShipModule* ParentModule, int32 ConnectionIndex)
+{
 	// If no parent, this is the root module
 	if (!ParentModule)
 	{
 		if (!RootModule)
 		{
 			RootModule = NewModule;
-			ShipModules.Add(NewModule);
+			NewModule->AttachToComponent(ShipBody, FAttachmentTransformRules::KeepWorldTransform);
+			TrackModule(NewModule);
 			return true;
 		}
-		return false; // Root already exists
 	}
-
 	// Attach to parent module
-	if (ParentModule->AttachModule(NewModule, ConnectionIndex))
+	else if (ParentModule->AttachModule(NewModule, ConnectionIndex))
 	{
-		ShipModules.Add(NewModule);
+		TrackModule(NewModule);
 		return true;
 	}
 
-	// Failed to attach, destroy the module
+	// Root already exists or the connection was refused, destroy the module
 	NewModule->Destroy();
 	return false;
 }
 
 void AAstroShipAssembly::RemoveModule(AAstroShipModule* Module)
 {
-	if (!Module || Module == RootModule)
+	if (!Module || Module == RootModule || !ModuleIndices.Contains(Module))
 		return;
 
-	// Detach from parent
-	AActor* ParentActor = Module->GetAttachParentActor();
-	if (AAstroShipModule* ParentModule = Cast<AAstroShipModule>(ParentActor))
+	BeginStructuralEdit();
+
+	TArray<AAstroShipModule*> Subtree;
+	Module->GatherSubtree(Subtree);
+
+	// Cut the single edge into the subtree; everything below goes with it
+	if (AAstroShipModule* ParentModule = Module->GetParentModule())
 	{
 		ParentModule->DetachModule(Module);
+		UpdateSnapPoints(ParentModule);
+	}
+
+	for (AAstroShipModule* Removed : Subtree)
+	{
+		// Drop its instance before the actor goes away
+		ExpandModule(Removed);
+		UntrackModule(Removed);
+		Removed->Destroy();
 	}
 
-	// Remove from list
-	ShipModules.Remove(Module);
+	EndStructuralEdit();
+}
 
-	// Destroy the module
-	Module->Destroy();
+void AAstroShipAssembly::BeginStructuralEdit()
+{
+	++StructuralEditDepth;
+}
+
+void AAstroShipAssembly::EndStructuralEdit()
+{
+	if (StructuralEditDepth == 0)
+		return;
+
+	if (--StructuralEditDepth == 0 && bStructureChangedInEdit)
+	{
+		bStructureChangedInEdit = false;
+		FinishStructuralEdit();
+	}
+}
+
+void AAstroShipAssembly::MarkStructureChanged()
+{
+	if (StructuralEditDepth > 0)
+	{
+		bStructureChangedInEdit = true;
+		return;
+	}
+	FinishStructuralEdit();
+}
+
+void AAstroShipAssembly::FinishStructuralEdit()
+{
+	ConditionalValidateAggregates();
+
+	if (bIsComplete && ShipBody->HasCompoundBody())
+	{
+		RebuildCompoundBody();
+	}
+
+	OnShipStructureChanged.Broadcast();
+}
+
+bool AAstroShipAssembly::IsModuleConnected(const AAstroShipModule* Module) const
+{
+	return Module && RootModule && ModuleIndices.Contains(Module) && Module->GetRootModule() == RootModule;
+}
+
+bool AAstroShipAssembly::AreModulesConnected(const AAstroShipModule* ModuleA, const AAstroShipModule* ModuleB) const
+{
+	return ModuleA && ModuleB && ModuleIndices.Contains(ModuleA) && ModuleIndices.Contains(ModuleB)
+		&& ModuleA->GetRootModule() == ModuleB->GetRootModule();
+}
+
+bool AAstroShipAssembly::FindSnapConnection(FVector WorldLocation, EShipModuleType ModuleType, float MaxDistance, AAstroShipModule*& OutModule, int32& OutConnectionIndex) const
+{
+	const FVector LocalLocation = ShipBody->GetComponentTransform().InverseTransformPosition(WorldLocation);
+
+	const AAstroShipModule* FoundModule = nullptr;
+	const bool bFound = SnapIndex.FindNearest(LocalLocation, ModuleType, MaxDistance, FoundModule, OutConnectionIndex);
+	OutModule = const_cast<AAstroShipModule*>(FoundModule);
+	return bFound;
+}
+
+void AAstroShipAssembly::UpdateSnapPoints(const AAstroShipModule* Module)
+{
+	SnapIndex.UpdateModule(Module, Module->GetActorTransform().GetRelativeTransform(ShipBody->GetComponentTransform()));
+}
+
+TArray<AAstroShipModule*> AAstroShipAssembly::GetSubtreeModules(AAstroShipModule* Module) const
+{
+	TArray<AAstroShipModule*> Subtree;
+	if (Module && ModuleIndices.Contains(Module))
+	{
+		Module->GatherSubtree(Subtree);
+	}
+	return Subtree;
 }
 
 float AAstroShipAssembly::CalculateTotalMass() const
 {
-	float TotalMass = 0.0f;
-	for (AAstroShipModule* Module : ShipModules)
+	return Aggregates.GetTotalMass();
+}
+
+float AAstroShipAssembly::CalculatePowerBalance() const
+{
+	return Aggregates.GetPowerBalance();
+}
+
+bool AAstroShipAssembly::IsShipFlyable() const
+{
+	if (Aggregates.GetModuleCount() == 0)
+		return false;
+
+	return Validator.IsValid(*this);
+}
+
+TArray<FShipValidationFailure> AAstroShipAssembly::ValidateShip() const
+{
+	TArray<FShipValidationFailure> Failures;
+	Validator.GatherFailures(*this, Failures);
+	return Failures;
+}
+
+bool AAstroShipAssembly::EnterOrbit(FName BodyName, FVector Position, FVector Velocity)
+{
+	UAstroOrbitalSubsystem* OrbitalSubsystem = GetWorld() ? GetWorld()->GetSubsystem<UAstroOrbitalSubsystem>() : nullptr;
+	if (!bIsComplete || !OrbitalSubsystem)
+		return false;
+
+	FAstroOrbitPropagator& Propagator = OrbitalSubsystem->GetPropagator();
+	const int32 BodyIndex = Propagator.FindBody(BodyName);
+	if (BodyIndex == INDEX_NONE)
+	{
+		UE_LOG(LogAstroEngineer, Warning, TEXT("%s cannot enter orbit around unknown body %s"), *GetName(), *BodyName.ToString());
+		return false;
+	}
+
+	if (Propagator.IsValid(OrbitHandle))
+	{
+		Propagator.SetCraftState(OrbitHandle, BodyIndex, Position, Velocity);
+	}
+	else
+	{
+		OrbitHandle = Propagator.AddCraft(BodyIndex, Position, Velocity);
+		OrbitalSubsystem->GetFloatingOrigin().RegisterShip(this);
+	}
+
+	// The propagator places ships on rails every frame; a simulating body would fall under gravity and fight it
+	SetPhysicsSuspended(true);
+	return true;
+}
+
+void AAstroShipAssembly::LeaveOrbit()
+{
+	if (!OrbitHandle.IsValid())
+		return;
+
+	if (UAstroOrbitalSubsystem* OrbitalSubsystem = GetWorld() ? GetWorld()->GetSubsystem<UAstroOrbitalSubsystem>() : nullptr)
+	{
+		OrbitalSubsystem->GetFloatingOrigin().UnregisterShip(this);
+		OrbitalSubsystem->GetPropagator().RemoveCraft(OrbitHandle);
+	}
+	OrbitHandle.Invalidate();
+
+	// Ships on rails never simulate, so one leaving orbit gets its physics back
+	SetPhysicsSuspended(false);
+}
+
+bool AAstroShipAssembly::IsInOrbit() const
+{
+	const UAstroOrbitalSubsystem* OrbitalSubsystem = GetWorld() ? GetWorld()->GetSubsystem<UAstroOrbitalSubsystem>() : nullptr;
+	return OrbitalSubsystem && OrbitalSubsystem->GetPropagator().IsValid(OrbitHandle);
+}
+
+void AAstroShipAssembly::SetPhysicsSuspended(bool bSuspended)
+{
+	if (bSuspended && ShipBody->IsSimulatingPhysics())
+	{
+		ShipBody->SetPhysicsLinearVelocity(FVector::ZeroVector);
+		ShipBody->SetPhysicsAngularVelocityInDegrees(FVector::ZeroVector);
+		ShipBody->SetSimulatePhysics(false);
+		bPhysicsSuspended = true;
+	}
+	else if (!bSuspended && bPhysicsSuspended)
+	{
+		ShipBody->SetSimulatePhysics(true);
+		bPhysicsSuspended = false;
+	}
+}
+
+void AAstroShipAssembly::MakeActiveVessel()
+{
+	if (IsInOrbit())
+	{
+		GetWorld()->GetSubsystem<UAstroOrbitalSubsystem>()->GetFloatingOrigin().SetActiveCraft(OrbitHandle);
+	}
+}
+
+void AAstroShipAssembly::SetThrottle(float Throttle)
+{
+	// Engines stay off under time warp, where every ship is on rails
+	const UAstroTimeWarpSubsystem* TimeWarp = GetWorld()->GetSubsystem<UAstroTimeWarpSubsystem>();
+	if (!IsInOrbit() || Aggregates.GetTotalMass() <= 0.0 || (TimeWarp && TimeWarp->IsWarping()))
+		return;
+
+	const double Acceleration = FMath::Clamp(Throttle, 0.0f, 1.0f) * Aggregates.GetTotalThrust() / Aggregates.GetTotalMass();
+	GetWorld()->GetSubsystem<UAstroOrbitalSubsystem>()->GetPropagator().SetCraftThrust(OrbitHandle, GetActorForwardVector() * Acceleration);
+}
+
+void AAstroShipAssembly::RefreshModuleStats(AAstroShipModule* Module)
+{
+	const int32* ModuleIndex = ModuleIndices.Find(Module);
+	if (!ModuleIndex)
+		return;
+
+	FAstroShipModuleContribution& Contribution = ModuleContributions[*ModuleIndex];
+	const FAstroShipModuleContribution Previous = Contribution;
+	Aggregates.Remove(Contribution);
+	Contribution = FAstroShipModuleContribution::FromModule(*Module, GetShipSpaceLocation(Module));
+	Aggregates.Add(Contribution);
+
+	// Only the rules reading a stat that actually moved need re-evaluating
+	if (Contribution.Mass != Previous.Mass || Contribution.Thrust != Previous.Thrust)
+	{
+		Validator.Invalidate(FAstroShipValidator::MassRules);
+	}
+	if (Contribution.PowerGeneration != Previous.PowerGeneration || Contribution.PowerConsumption != Previous.PowerConsumption)
+	{
+		Validator.Invalidate(FAstroShipValidator::PowerRules);
+	}
+
+	ConditionalValidateAggregates();
+}
+
+bool AAstroShipAssembly::ValidateAggregates() const
+{
+	FAstroShipAggregates Recomputed;
+	for (const AAstroShipModule* Module : ShipModules)
 	{
 		if (Module)
 		{
-			TotalMass += Module->Mass;
+			Recomputed.Add(FAstroShipModuleContribution::FromModule(*Module, GetShipSpaceLocation(Module)));
 		}
 	}
-	return TotalMass;
+
+	if (!Aggregates.Equals(Recomputed, 1.0e-6))
+	{
+		UE_LOG(LogAstroEngineer, Error, TEXT("Ship '%s' running totals drifted from its modules. Running: %s Recomputed: %s"),
+			*GetName(), *Aggregates.ToString(), *Recomputed.ToString());
+		return false;
+	}
+	return true;
 }
 
-float AAstroShipAssembly::CalculatePowerBalance() const
+void AAstroShipAssembly::TrackModule(AAstroShipModule* Module)
 {
-	float TotalGeneration = 0.0f;
-	float TotalConsumption = 0.0f;
+	ModuleIndices.Add(Module, ShipModules.Add(Module));
+	Aggregates.Add(ModuleContributions.Add_GetRef(FAstroShipModuleContribution::FromModule(*Module, GetShipSpaceLocation(Module))));
+
+	// The new module brings free points, and takes one from its parent
+	UpdateSnapPoints(Module);
+	if (const AAstroShipModule* ParentModule = Module->GetParentModule())
+	{
+		UpdateSnapPoints(ParentModule);
+	}
+
+	Validator.Invalidate(FAstroShipValidator::StructureRules);
+	MarkStructureChanged();
+}
+
+void AAstroShipAssembly::UntrackModule(AAstroShipModule* Module)
+{
+	int32 ModuleIndex = INDEX_NONE;
+	if (!ModuleIndices.RemoveAndCopyValue(Module, ModuleIndex))
+		return;
+
+	Aggregates.Remove(ModuleContributions[ModuleIndex]);
+	SnapIndex.RemoveModule(Module);
 
+	// Swap-remove and patch the module that moved into the hole
+	ShipModules.RemoveAtSwap(ModuleIndex, EAllowShrinking::No);
+	ModuleContributions.RemoveAtSwap(ModuleIndex, EAllowShrinking::No);
+	if (ShipModules.IsValidIndex(ModuleIndex))
+	{
+		ModuleIndices[ShipModules[ModuleIndex]] = ModuleIndex;
+	}
+
+	Validator.Invalidate(FAstroShipValidator::StructureRules);
+	MarkStructureChanged();
+}
+
+FVector AAstroShipAssembly::GetShipSpaceLocation(const AAstroShipModule* Module) const
+{
+	if (!RootModule || Module == RootModule)
+		return FVector::ZeroVector;
+
+	return RootModule->GetActorTransform().InverseTransformPosition(Module->GetActorLocation());
+}
+
+void AAstroShipAssembly::ConditionalValidateAggregates() const
+{
+	if (CVarAstroValidateShipAggregates.GetValueOnGameThread() != 0)
+	{
+		ValidateAggregates();
+	}
+}
+
+void AAstroShipAssembly::FinalizeShip()
+{
+	if (!IsShipFlyable())
+		return;
+
+	bIsComplete = true;
+	
+	// Bake one rigid body and instanced rendering; controls are still up to the pawn setup
+	BakeFinalizedShip();
+	
+	OnShipFinalized.Broadcast();
+}
+
+void AAstroShipAssembly::CollapseModulesToInstances()
+{
+	const int32 CollapsedBefore = CollapsedModuleGroups.Num();
 	for (AAstroShipModule* Module : ShipModules)
 	{
-		if (Module)
+		CollapseModule(Module);
+	}
+
+	UE_LOG(LogAstroEngineer, Log, TEXT("Ship '%s': %d of %d modules drawn through %d instanced groups (%d newly collapsed)"),
+		*GetName(), CollapsedModuleGroups.Num(), ShipModules.Num(), InstancedModuleGroups.Num(), CollapsedModuleGroups.Num() - CollapsedBefore);
+}
+
+bool AAstroShipAssembly::CollapseModule(AAstroShipModule* Module)
+{
+	if (!Module || CollapsedModuleGroups.Contains(Module) || !ModuleIndices.Contains(Module))
+		return false;
+
+	const UStaticMeshComponent* ModuleMesh = Module->GetModuleMesh();
+	if (!ModuleMesh || !ModuleMesh->GetStaticMesh())
+		return false;
+
+	const int32 GroupIndex = FindOrAddInstanceGroup(ModuleMesh);
+	InstancedModuleGroups[GroupIndex]->AddInstance(GetModuleInstanceTransform(Module));
+	InstanceModules[GroupIndex].Add(Module);
+	CollapsedModuleGroups.Add(Module, GroupIndex);
+
+	SetModuleDormant(Module, true);
+	INC_DWORD_STAT(STAT_AstroCollapsedModules);
+	return true;
+}
+
+bool AAstroShipAssembly::ExpandModule(AAstroShipModule* Module)
+{
+	int32 GroupIndex = INDEX_NONE;
+	if (!CollapsedModuleGroups.RemoveAndCopyValue(Module, GroupIndex))
+		return false;
+
+	// Groups remove with swap semantics, so mirror that in the instance -> module table
+	const int32 InstanceIndex = InstanceModules[GroupIndex].IndexOfByKey(Module);
+	InstancedModuleGroups[GroupIndex]->RemoveInstance(InstanceIndex);
+	InstanceModules[GroupIndex].RemoveAtSwap(InstanceIndex);
+
+	SetModuleDormant(Module, false);
+	DEC_DWORD_STAT(STAT_AstroCollapsedModules);
+	return true;
+}
+
+AAstroShipModule* AAstroShipAssembly::ExpandModuleFromHit(const FHitResult& Hit)
+{
+	// Finalized ships are traced against the compound body rather than the instances
+	if (Hit.GetComponent() == ShipBody)
+	{
+		AAstroShipModule* Module = ShipBody->FindModuleAt(Hit.ImpactPoint);
+		ExpandModule(Module);
+		return Module;
+	}
+
+	const int32 GroupIndex = InstancedModuleGroups.IndexOfByKey(Hit.GetComponent());
+	if (GroupIndex == INDEX_NONE || !InstanceModules[GroupIndex].IsValidIndex(Hit.Item))
+		return nullptr;
+
+	AAstroShipModule* Module = InstanceModules[GroupIndex][Hit.Item];
+	ExpandModule(Module);
+	return Module;
+}
+
+bool AAstroShipAssembly::IsModuleCollapsed(const AAstroShipModule* Module) const
+{
+	return CollapsedModuleGroups.Contains(Module);
+}
+
+int32 AAstroShipAssembly::FindOrAddInstanceGroup(const UStaticMeshComponent* SourceMesh)
+{
+	const int32 NumMaterials = SourceMesh->GetNumMaterials();
+	const int32 ExistingIndex = InstancedModuleGroups.IndexOfByPredicate([SourceMesh, NumMaterials](const UInstancedStaticMeshComponent* Group)
+	{
+		if (Group->GetStaticMesh() != SourceMesh->GetStaticMesh() || Group->GetNumMaterials() != NumMaterials)
+			return false;
+
+		for (int32 MaterialIndex = 0; MaterialIndex < NumMaterials; ++MaterialIndex)
 		{
-			TotalGeneration += Module->PowerGeneration;
-			TotalConsumption += Module->PowerConsumption;
+			if (Group->GetMaterial(MaterialIndex) != SourceMesh->GetMaterial(MaterialIndex))
+				return false;
 		}
+		return true;
+	});
+	if (ExistingIndex != INDEX_NONE)
+		return ExistingIndex;
+
+	UInstancedStaticMeshComponent* Group = NewObject<UInstancedStaticMeshComponent>(this);
+	Group->bSupportRemoveAtSwap = true;
+	Group->SetMobility(EComponentMobility::Movable);
+	Group->SetStaticMesh(SourceMesh->GetStaticMesh());
+	for (int32 MaterialIndex = 0; MaterialIndex < NumMaterials; ++MaterialIndex)
+	{
+		Group->SetMaterial(MaterialIndex, SourceMesh->GetMaterial(MaterialIndex));
+	}
+	if (ShipBody->HasCompoundBody())
+	{
+		Group->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+	}
+	else
+	{
+		Group->SetCollisionProfileName(SourceMesh->GetCollisionProfileName());
 	}
+	Group->SetupAttachment(ShipBody);
+	Group->RegisterComponent();
+	AddInstanceComponent(Group);
 
-	return TotalGeneration - TotalConsumption;
+	InstanceModules.AddDefaulted();
+	return InstancedModuleGroups.Add(Group);
 }
 
-bool AAstroShipAssembly::IsShipFlyable() const
+FTransform AAstroShipAssembly::GetModuleInstanceTransform(const AAstroShipModule* Module) const
 {
-	if (ShipModules.Num() == 0)
-		return false;
+	return Module->GetModuleMesh()->GetComponentTransform().GetRelativeTransform(ShipBody->GetComponentTransform());
+}
+
+void AAstroShipAssembly::SetModuleDormant(AAstroShipModule* Module, bool bDormant)
+{
+	// Unregistered components have no render proxy or physics state; the actor itself stays as the module's data
+	if (bDormant)
+	{
+		Module->UnregisterAllComponents();
+	}
+	else
+	{
+		Module->RegisterAllComponents();
+	}
+}
+
+AAstroShipAssembly* AAstroShipAssembly::SplitOffModule(AAstroShipModule* Module)
+{
+	if (!Module || Module == RootModule || !ModuleIndices.Contains(Module))
+		return nullptr;
 
-	bool bHasCockpit = false;
-	bool bHasEngine = false;
-	bool bHasFuelTank = false;
+	FActorSpawnParameters SpawnParams;
+	SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+	AAstroShipAssembly* NewShip = GetWorld()->SpawnActor<AAstroShipAssembly>(GetClass(), Module->GetActorTransform(), SpawnParams);
+	if (!NewShip)
+		return nullptr;
+
+	NewShip->ShipName = ShipName;
+	NewShip->bRequiresCockpit = bRequiresCockpit;
+	NewShip->bRequiresEngine = bRequiresEngine;
+	NewShip->bRequiresFuelTank = bRequiresFuelTank;
+	NewShip->MinThrustToWeight = MinThrustToWeight;
+	NewShip->ReferenceGravity = ReferenceGravity;
+	NewShip->bSimulatePhysicsWhenFinalized = bSimulatePhysicsWhenFinalized;
+
+	TArray<AAstroShipModule*> Subtree;
+	Module->GatherSubtree(Subtree);
+
+	BeginStructuralEdit();
+	NewShip->BeginStructuralEdit();
+
+	AAstroShipModule* ParentModule = Module->GetParentModule();
+	ParentModule->DetachModule(Module);
+	UpdateSnapPoints(ParentModule);
+
+	for (AAstroShipModule* Moved : Subtree)
+	{
+		ExpandModule(Moved);
+		UntrackModule(Moved);
+		Moved->SetOwner(NewShip);
+	}
+
+	Module->AttachToComponent(NewShip->ShipBody, FAttachmentTransformRules::KeepWorldTransform);
+	NewShip->RootModule = Module;
+	for (AAstroShipModule* Moved : Subtree)
+	{
+		NewShip->TrackModule(Moved);
+	}
+
+	NewShip->EndStructuralEdit();
+
+	if (bIsComplete)
+	{
+		NewShip->bIsComplete = true;
+		NewShip->BakeFinalizedShip();
 
+		// Both halves leave with the velocity the parent body had at the split point
+		if (ShipBody->IsSimulatingPhysics() && NewShip->ShipBody->IsSimulatingPhysics())
+		{
+			NewShip->ShipBody->SetPhysicsLinearVelocity(ShipBody->GetPhysicsLinearVelocityAtPoint(NewShip->GetActorLocation()));
+			NewShip->ShipBody->SetPhysicsAngularVelocityInDegrees(ShipBody->GetPhysicsAngularVelocityInDegrees());
+		}
+	}
+
+	EndStructuralEdit();
+	return NewShip;
+}
+
+void AAstroShipAssembly::RebuildCompoundBody()
+{
+	if (!RootModule)
+	{
+		ShipBody->ClearCompoundBody();
+		return;
+	}
+
+	// Module meshes stay traceable but must not push against the body they are part of
 	for (AAstroShipModule* Module : ShipModules)
 	{
-		if (Module)
+		Module->GetModuleMesh()->SetCollisionEnabled(ECollisionEnabled::QueryOnly);
+	}
+
+	const FTransform ShipSpaceToBody = RootModule->GetActorTransform().GetRelativeTransform(ShipBody->GetComponentTransform());
+	ShipBody->BuildCompoundBody(ShipModules, ShipSpaceToBody, Aggregates);
+
+	if (bSimulatePhysicsWhenFinalized && !bPhysicsSuspended && !ShipBody->IsSimulatingPhysics())
+	{
+		// A ship finalized on rails starts simulating when it leaves orbit
+		if (IsInOrbit())
 		{
-			switch (Module->ModuleType)
-			{
-			case EShipModuleType::Cockpit:
-				bHasCockpit = true;
-				break;
-			case EShipModuleType::Engine:
-				bHasEngine = true;
-				break;
-			case EShipModuleType::FuelTank:
-				bHasFuelTank = true;
-				break;
-			default:
-				break;
-			}
+			bPhysicsSuspended = true;
+		}
+		else
+		{
+			ShipBody->SetSimulatePhysics(true);
 		}
 	}
+}
+
+void AAstroShipAssembly::BakeFinalizedShip()
+{
+	RebuildCompoundBody();
+	CollapseModulesToInstances();
+}
+
+bool AAstroShipAssembly::SaveDesignToFile(const FString& FilePath) const
+{
+	const double StartTime = FPlatformTime::Seconds();
 
-	// Check required modules
-	if (bRequiresCockpit && !bHasCockpit)
+	FAstroShipDesign Design;
+	TArray<uint8> Bytes;
+	if (!Design.Capture(*this) || !Design.SaveToBytes(Bytes))
 		return false;
-	if (bRequiresEngine && !bHasEngine)
+
+	UE_LOG(LogAstroEngineer, Log, TEXT("Saved design of ship '%s': %d modules, %d classes, %d bytes in %.2f ms"),
+		*GetName(), Design.NumModules(), Design.ModuleClasses.Num(), Bytes.Num(), (FPlatformTime::Seconds() - StartTime) * 1000.0);
+
+	return FFileHelper::SaveArrayToFile(Bytes, *FilePath);
+}
+
+bool AAstroShipAssembly::LoadDesignFromFile(const FString& FilePath, bool bStreamAsync)
+{
+	FAstroShipDesign Design;
+	if (!Design.LoadFromFile(FilePath))
+	{
+		UE_LOG(LogAstroEngineer, Warning, TEXT("Could not load ship design '%s'"), *FilePath);
 		return false;
-	if (bRequiresFuelTank && !bHasFuelTank)
+	}
+
+	return bStreamAsync ? StreamFromDesign(Design) : BuildFromDesign(Design);
+}
+
+bool AAstroShipAssembly::BuildFromDesign(const FAstroShipDesign& Design)
+{
+	SCOPE_CYCLE_COUNTER(STAT_AstroBuildShipFromDesign);
+
+	if (RootModule || IsStreamingDesign() || Design.IsEmpty())
 		return false;
 
-	// Check power balance
-	if (CalculatePowerBalance() < 0.0f)
+	const double StartTime = FPlatformTime::Seconds();
+
+	// Resolve each class once rather than once per module
+	TArray<UClass*> Classes;
+	AstroShipAssembly::ResolveDesignClasses(Design, true, Classes);
+
+	ShipName = FText::FromString(Design.ShipName);
+	ShipModules.Reserve(Design.NumModules());
+	ModuleContributions.Reserve(Design.NumModules());
+	ModuleIndices.Reserve(Design.NumModules());
+
+	TArray<AAstroShipModule*> SpawnedModules;
+	SpawnedModules.Reserve(Design.NumModules());
+
+	BeginStructuralEdit();
+	for (int32 DesignIndex = 0; DesignIndex < Design.NumModules(); ++DesignIndex)
+	{
+		SpawnDesignModule(Design, DesignIndex, Classes, SpawnedModules);
+	}
+	EndStructuralEdit();
+
+	UE_LOG(LogAstroEngineer, Log, TEXT("Built ship '%s' from design: %d of %d modules in %.2f ms"),
+		*GetName(), ShipModules.Num(), Design.NumModules(), (FPlatformTime::Seconds() - StartTime) * 1000.0);
+
+	return RootModule != nullptr;
+}
+
+bool AAstroShipAssembly::StreamFromDesign(const FAstroShipDesign& Design)
+{
+	if (RootModule || IsStreamingDesign() || Design.IsEmpty())
 		return false;
 
+	StreamStartTime = FPlatformTime::Seconds();
+	StreamingDesign = MakeUnique<FAstroShipDesign>(Design);
+	StreamedModules.Reset(Design.NumModules());
+	ShipName = FText::FromString(Design.ShipName);
+
+	// Held open until the last batch, so derived ship data is rebuilt once
+	BeginStructuralEdit();
+
+	TArray<FSoftObjectPath> ClassPaths;
+	ClassPaths.Reserve(Design.ModuleClasses.Num());
+	for (const FSoftClassPath& ClassPath : Design.ModuleClasses)
+	{
+		ClassPaths.Add(ClassPath);
+	}
+
+	DesignClassesHandle = UAssetManager::GetStreamableManager().RequestAsyncLoad(MoveTemp(ClassPaths),
+		FStreamableDelegate::CreateUObject(this, &AAstroShipAssembly::OnDesignClassesLoaded));
+	if (!DesignClassesHandle)
+	{
+		OnDesignClassesLoaded();
+	}
 	return true;
 }
 
-void AAstroShipAssembly::FinalizeShip()
+void AAstroShipAssembly::OnDesignClassesLoaded()
 {
-	if (!IsShipFlyable())
+	if (!StreamingDesign)
 		return;
 
-	bIsComplete = true;
-	
-	// Here you would convert the assembly into a flyable ship pawn
-	// This would involve creating physics constraints, setting up controls, etc.
-	
-	OnShipFinalized.Broadcast();
+	AstroShipAssembly::ResolveDesignClasses(*StreamingDesign, false, StreamingClasses);
+	StreamDesignStep();
+}
+
+void AAstroShipAssembly::StreamDesignStep()
+{
+	SCOPE_CYCLE_COUNTER(STAT_AstroStreamShipDesignStep);
+
+	if (!StreamingDesign)
+		return;
+
+	const int32 BatchEnd = FMath::Min(StreamedModules.Num() + FMath::Max(DesignModulesPerFrame, 1), StreamingDesign->NumModules());
+	while (StreamedModules.Num() < BatchEnd)
+	{
+		SpawnDesignModule(*StreamingDesign, StreamedModules.Num(), StreamingClasses, StreamedModules);
+	}
+
+	if (StreamedModules.Num() < StreamingDesign->NumModules())
+	{
+		GetWorldTimerManager().SetTimerForNextTick(this, &AAstroShipAssembly::StreamDesignStep);
+		return;
+	}
+
+	FinishStreamingDesign();
+}
+
+void AAstroShipAssembly::FinishStreamingDesign()
+{
+	UE_LOG(LogAstroEngineer, Log, TEXT("Streamed ship '%s' from design: %d of %d modules in %.2f ms"),
+		*GetName(), ShipModules.Num(), StreamingDesign->NumModules(), (FPlatformTime::Seconds() - StreamStartTime) * 1000.0);
+
+	StreamingDesign.Reset();
+	DesignClassesHandle.Reset();
+	StreamingClasses.Reset();
+	StreamedModules.Reset();
+
+	EndStructuralEdit();
+	OnShipDesignLoaded.Broadcast(RootModule != nullptr);
+}
+
+void AAstroShipAssembly::SpawnDesignModule(const FAstroShipDesign& Design, int32 DesignIndex, TArrayView<UClass* const> Classes, TArray<AAstroShipModule*>& SpawnedModules)
+{
+	const FAstroShipDesignModule& Entry = Design.Modules[DesignIndex];
+	AAstroShipModule*& Spawned = SpawnedModules.Add_GetRef(nullptr);
+
+	UClass* ModuleClass = Classes[Entry.ClassIndex];
+	AAstroShipModule* ParentModule = Entry.ParentIndex == INDEX_NONE ? nullptr : SpawnedModules[Entry.ParentIndex];
+	if (!ModuleClass || (Entry.ParentIndex != INDEX_NONE && !ParentModule))
+		return;
+
+	// Overrides go into the authored values before BeginPlay copies them into the stat store
+	AAstroShipModule* NewModule = GetWorld()->SpawnActorDeferred<AAstroShipModule>(ModuleClass, GetActorTransform(), this);
+	if (!NewModule)
+		return;
+
+	Entry.ApplyOverrides(*NewModule);
+	NewModule->FinishSpawning(GetActorTransform());
+
+	if (AttachSpawnedModule(NewModule, ParentModule, Entry.ParentConnectionIndex))
+	{
+		Spawned = NewModule;
+		INC_DWORD_STAT(STAT_AstroDesignModulesSpawned);
+	}
 }
@@ -0,0 +1,364 @@
+// Copyright Astro Engineer Team. All Rights Reserved.
+
+#include "AstroShipBodyComponent.h"
+#include "AstroShipModule.h"
+#include "AstroShipAggregates.h"
+#include "AstroShipAssembly.h"
+#include "AstroEngineer.h"
+#include "Containers/Ticker.h"
+#include "CoreGlobals.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+#include "Components/StaticMeshComponent.h"
+#include "Engine/StaticMesh.h"
+#include "Engine/CollisionProfile.h"
+#include "PhysicsEngine/BodySetup.h"
+#include "Physics/PhysicsInterfaceCore.h"
+
+DECLARE_CYCLE_STAT(TEXT("Build Ship Compound Body"), STAT_AstroBuildShipBody, STATGROUP_AstroEngineer);
+
+namespace AstroShipBodyComponent
+{
+	/** Frames of one benchmark stage; the frame a stage is spawned on is skipped */
+	struct FPhysicsBenchmarkStage
+	{
+		const TCHAR* Name = TEXT("");
+		int32 NumBodies = 0;
+		int32 NumFrames = 0;
+		double FrameSeconds = 0.0;
+		double GameThreadSeconds = 0.0;
+	};
+
+	struct FPhysicsBenchmark
+	{
+		TWeakObjectPtr<UWorld> World;
+		int32 NumModules = 0;
+		int32 FramesPerStage = 0;
+		int32 StageIndex = 0;
+		int32 WarmUpFrames = 1;
+		FPhysicsBenchmarkStage Stages[3];
+		TArray<TWeakObjectPtr<AActor>> SpawnedActors;
+		FTSTicker::FDelegateHandle TickerHandle;
+	};
+
+	static TUniquePtr<FPhysicsBenchmark> PhysicsBenchmark;
+
+	static void DestroyStageActors(FPhysicsBenchmark& Run)
+	{
+		for (const TWeakObjectPtr<AActor>& Actor : Run.SpawnedActors)
+		{
+			if (Actor.IsValid())
+			{
+				Actor->Destroy();
+			}
+		}
+		Run.SpawnedActors.Reset();
+	}
+
+	/**
+	 * Spawn a cube of 1 m modules far above the level, gravity off and spinning so the solver has work every step.
+	 * Compound stages bake them into one ship body; the others simulate each module mesh as its own body,
+	 * with neighbours in contact but no constraints, so they are a lower bound for a constrained module stack.
+	 */
+	static int32 SpawnStage(FPhysicsBenchmark& Run, bool bCompound)
+	{
+		UWorld* World = Run.World.Get();
+		UStaticMesh* Cube = LoadObject<UStaticMesh>(nullptr, TEXT("/Engine/BasicShapes/Cube.Cube"));
+		if (!World || !Cube)
+			return 0;
+
+		const FVector Origin(0.0, 0.0, 1.0e5);
+		const int32 Side = FMath::CeilToInt32(FMath::Pow(double(Run.NumModules), 1.0 / 3.0));
+
+		AAstroShipAssembly* Ship = nullptr;
+		if (bCompound)
+		{
+			FActorSpawnParameters SpawnParams;
+			SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+			Ship = World->SpawnActor<AAstroShipAssembly>(Origin, FRotator::ZeroRotator, SpawnParams);
+			if (!Ship)
+				return 0;
+			Run.SpawnedActors.Add(Ship);
+		}
+
+		TArray<AAstroShipModule*> Modules;
+		FAstroShipAggregates Aggregates;
+		for (int32 Index = 0; Index < Run.NumModules; ++Index)
+		{
+			const FVector Offset = FVector(double(Index % Side), double((Index / Side) % Side), double(Index / (Side * Side))) * 100.0;
+			FActorSpawnParameters SpawnParams;
+			SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+			AAstroShipModule* Module = World->SpawnActor<AAstroShipModule>(Origin + Offset, FRotator::ZeroRotator, SpawnParams);
+			if (!Module)
+				continue;
+
+			Run.SpawnedActors.Add(Module);
+			UStaticMeshComponent* ModuleMesh = Module->GetModuleMesh();
+			ModuleMesh->SetMobility(EComponentMobility::Movable);
+			ModuleMesh->SetStaticMesh(Cube);
+			if (bCompound)
+			{
+				ModuleMesh->SetCollisionEnabled(ECollisionEnabled::QueryOnly);
+				Module->AttachToComponent(Ship->ShipBody, FAttachmentTransformRules::KeepWorldTransform);
+				Aggregates.Add(FAstroShipModuleContribution::FromModule(*Module, Offset));
+				Modules.Add(Module);
+			}
+			else
+			{
+				ModuleMesh->SetEnableGravity(false);
+				ModuleMesh->SetSimulatePhysics(true);
+				ModuleMesh->SetPhysicsAngularVelocityInDegrees(FVector(5.0, 10.0, 0.0));
+			}
+		}
+
+		if (bCompound)
+		{
+			Ship->ShipBody->BuildCompoundBody(Modules, FTransform::Identity, Aggregates);
+			Ship->ShipBody->SetEnableGravity(false);
+			Ship->ShipBody->SetSimulatePhysics(true);
+			Ship->ShipBody->SetPhysicsAngularVelocityInDegrees(FVector(5.0, 10.0, 0.0));
+			return 1;
+		}
+		return Run.SpawnedActors.Num();
+	}
+
+	static void FinishPhysicsBenchmark()
+	{
+		FPhysicsBenchmark& Run = *PhysicsBenchmark;
+		DestroyStageActors(Run);
+
+		const FPhysicsBenchmarkStage& Baseline = Run.Stages[0];
+		for (const FPhysicsBenchmarkStage& Stage : Run.Stages)
+		{
+			if (Stage.NumFrames == 0)
+				continue;
+
+			const double FrameMs = Stage.FrameSeconds * 1000.0 / Stage.NumFrames;
+			const double GameThreadMs = Stage.GameThreadSeconds * 1000.0 / Stage.NumFrames;
+			const double BaselineMs = Baseline.NumFrames > 0 ? Baseline.GameThreadSeconds * 1000.0 / Baseline.NumFrames : 0.0;
+			UE_LOG(LogAstroEngineer, Display, TEXT("Ship physics benchmark, %s: %d modules in %d simulated bodies, %d frames, %.3f ms per frame, game thread %.3f ms (%+.3f ms over the empty scene)"),
+				Stage.Name, Run.NumModules, Stage.NumBodies, Stage.NumFrames, FrameMs, GameThreadMs, GameThreadMs - BaselineMs);
+		}
+
+		PhysicsBenchmark.Reset();
+	}
+
+	static bool TickPhysicsBenchmark(float DeltaTime)
+	{
+		FPhysicsBenchmark& Run = *PhysicsBenchmark;
+		if (!Run.World.IsValid())
+		{
+			PhysicsBenchmark.Reset();
+			return false;
+		}
+
+		if (Run.WarmUpFrames > 0)
+		{
+			--Run.WarmUpFrames;
+			return true;
+		}
+
+		FPhysicsBenchmarkStage& Stage = Run.Stages[Run.StageIndex];
+		++Stage.NumFrames;
+		Stage.FrameSeconds += DeltaTime;
+		Stage.GameThreadSeconds += FPlatformTime::ToSeconds(GGameThreadTime);
+		if (Stage.NumFrames < Run.FramesPerStage)
+			return true;
+
+		DestroyStageActors(Run);
+		if (++Run.StageIndex == UE_ARRAY_COUNT(Run.Stages))
+		{
+			FinishPhysicsBenchmark();
+			return false;
+		}
+
+		Run.Stages[Run.StageIndex].NumBodies = SpawnStage(Run, Run.StageIndex == 1);
+		Run.WarmUpFrames = 1;
+		return true;
+	}
+
+	static void RunPhysicsBenchmark(const TArray<FString>& Args, UWorld* World)
+	{
+		if (PhysicsBenchmark || !World || !World->HasBegunPlay())
+		{
+			UE_LOG(LogAstroEngineer, Warning, TEXT("Ship physics benchmark needs a world that has begun play and no other run in progress"));
+			return;
+		}
+
+		PhysicsBenchmark = MakeUnique<FPhysicsBenchmark>();
+		FPhysicsBenchmark& Run = *PhysicsBenchmark;
+		Run.World = World;
+		Run.NumModules = Args.Num() > 0 ? FMath::Max(1, FCString::Atoi(*Args[0])) : 500;
+		Run.FramesPerStage = Args.Num() > 1 ? FMath::Max(1, FCString::Atoi(*Args[1])) : 300;
+		Run.Stages[0].Name = TEXT("empty scene");
+		Run.Stages[1].Name = TEXT("compound body");
+		Run.Stages[2].Name = TEXT("body per module");
+		Run.TickerHandle = FTSTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateStatic(&TickPhysicsBenchmark));
+	}
+
+	static FAutoConsoleCommandWithWorldAndArgs PhysicsBenchmarkCommand(
+		TEXT("astro.Ship.PhysicsBenchmark"),
+		TEXT("Log frame and game thread time with no ship, a compound-body ship and the same modules as separate bodies. Usage: astro.Ship.PhysicsBenchmark [NumModules=500] [FramesPerStage=300]"),
+		FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&RunPhysicsBenchmark));
+}
+
+UAstroShipBodyComponent::UAstroShipBodyComponent(const FObjectInitializer& ObjectInitializer)
+	: Super(ObjectInitializer)
+{
+	PrimaryComponentTick.bCanEverTick = false;
+	SetMobility(EComponentMobility::Movable);
+	SetCollisionProfileName(UCollisionProfile::PhysicsActor_ProfileName);
+	ShipBodySetup = nullptr;
+	CenterOfMass = FVector::ZeroVector;
+	PrincipalInertia = FVector::OneVector;
+	PrincipalAxes = FQuat::Identity;
+}
+
+void UAstroShipBodyComponent::BuildCompoundBody(TArrayView<AAstroShipModule* const> Modules, const FTransform& ShipSpaceToComponent, const FAstroShipAggregates& Aggregates)
+{
+	SCOPE_CYCLE_COUNTER(STAT_AstroBuildShipBody);
+
+	UBodySetup* NewBodySetup = NewObject<UBodySetup>(this, NAME_None, RF_Transient);
+	NewBodySetup->BodySetupGuid = FGuid::NewGuid();
+	NewBodySetup->CollisionTraceFlag = CTF_UseSimpleAsComplex;
+	NewBodySetup->bGenerateMirroredCollision = false;
+	FKAggregateGeom& Geom = NewBodySetup->AggGeom;
+
+	PieceModules.Reset();
+	PieceBounds.Reset();
+
+	const FTransform ComponentToWorld = GetComponentTransform();
+	for (AAstroShipModule* Module : Modules)
+	{
+		const UStaticMeshComponent* ModuleMesh = Module ? Module->GetModuleMesh() : nullptr;
+		const UStaticMesh* StaticMesh = ModuleMesh ? ModuleMesh->GetStaticMesh() : nullptr;
+		if (!StaticMesh)
+			continue;
+
+		const FTransform MeshToShip = ModuleMesh->GetComponentTransform().GetRelativeTransform(ComponentToWorld);
+		const FVector Scale = MeshToShip.GetScale3D();
+		FTransform MeshToShipUnscaled = MeshToShip;
+		MeshToShipUnscaled.RemoveScaling();
+
+		const UBodySetup* SourceBodySetup = StaticMesh->GetBodySetup();
+		if (SourceBodySetup && SourceBodySetup->AggGeom.GetElementCount() > 0)
+		{
+			const FKAggregateGeom& SourceGeom = SourceBodySetup->AggGeom;
+			for (const FKBoxElem& Box : SourceGeom.BoxElems)
+			{
+				Geom.BoxElems.Add(Box.GetFinalScaled(Scale, MeshToShipUnscaled));
+			}
+			for (const FKSphereElem& Sphere : SourceGeom.SphereElems)
+			{
+				Geom.SphereElems.Add(Sphere.GetFinalScaled(Scale, MeshToShipUnscaled));
+			}
+			for (const FKSphylElem& Sphyl : SourceGeom.SphylElems)
+			{
+				Geom.SphylElems.Add(Sphyl.GetFinalScaled(Scale, MeshToShipUnscaled));
+			}
+			for (const FKConvexElem& Convex : SourceGeom.ConvexElems)
+			{
+				// Bake the full transform, including non-uniform scale, into the hull vertices
+				const FTransform ElemToShip = Convex.GetTransform() * MeshToShip;
+				FKConvexElem& Baked = Geom.ConvexElems.AddDefaulted_GetRef();
+				Baked.VertexData.Reserve(Convex.VertexData.Num());
+				for (const FVector& Vertex : Convex.VertexData)
+				{
+					Baked.VertexData.Add(ElemToShip.TransformPosition(Vertex));
+				}
+				Baked.UpdateElemBox();
+			}
+		}
+		else
+		{
+			// No simple collision authored for this mesh; fall back to its bounds
+			const FBox LocalBox = StaticMesh->GetBoundingBox();
+			FKBoxElem Box(LocalBox.GetSize().X, LocalBox.GetSize().Y, LocalBox.GetSize().Z);
+			Box.Center = LocalBox.GetCenter();
+			Geom.BoxElems.Add(Box.GetFinalScaled(Scale, MeshToShipUnscaled));
+		}
+
+		PieceModules.Add(Module);
+		PieceBounds.Add(StaticMesh->GetBoundingBox().TransformBy(MeshToShip));
+	}
+
+	NewBodySetup->CreatePhysicsMeshes();
+	ShipBodySetup = NewBodySetup;
+
+	// Mass properties come from the module stats, not from the collision volume
+	const double TotalMass = Aggregates.GetTotalMass();
+	FVector Moments;
+	FQuat Axes;
+	Aggregates.GetPrincipalInertia(Moments, Axes);
+
+	// Point masses give a single module zero inertia; keep at least a 10 cm radius of gyration so the solver stays stable
+	const double MinMoment = FMath::Max(TotalMass, 1.0) * 100.0;
+	CenterOfMass = ShipSpaceToComponent.TransformPosition(Aggregates.GetCenterOfMass());
+	PrincipalAxes = ShipSpaceToComponent.GetRotation() * Axes;
+	PrincipalInertia = FVector(FMath::Max(Moments.X, MinMoment), FMath::Max(Moments.Y, MinMoment), FMath::Max(Moments.Z, MinMoment));
+	BodyInstance.SetMassOverride(FMath::Max(TotalMass, 1.0), true);
+
+	RecreatePhysicsState();
+	UpdateBounds();
+
+	UE_LOG(LogAstroEngineer, Log, TEXT("Ship body '%s': %d modules merged into %d collision elements, mass %.1f"),
+		*GetOwner()->GetName(), PieceModules.Num(), Geom.GetElementCount(), TotalMass);
+}
+
+void UAstroShipBodyComponent::ClearCompoundBody()
+{
+	if (!ShipBodySetup)
+		return;
+
+	ShipBodySetup = nullptr;
+	PieceModules.Reset();
+	PieceBounds.Reset();
+	RecreatePhysicsState();
+	UpdateBounds();
+}
+
+AAstroShipModule* UAstroShipBodyComponent::FindModuleAt(FVector WorldLocation) const
+{
+	const FVector LocalLocation = GetComponentTransform().InverseTransformPosition(WorldLocation);
+
+	AAstroShipModule* BestModule = nullptr;
+	double BestDistanceSquared = TNumericLimits<double>::Max();
+	for (int32 PieceIndex = 0; PieceIndex < PieceBounds.Num(); ++PieceIndex)
+	{
+		const double DistanceSquared = PieceBounds[PieceIndex].ComputeSquaredDistanceToPoint(LocalLocation);
+		if (DistanceSquared < BestDistanceSquared)
+		{
+			BestDistanceSquared = DistanceSquared;
+			BestModule = PieceModules[PieceIndex];
+		}
+	}
+	return BestModule;
+}
+
+FBoxSphereBounds UAstroShipBodyComponent::CalcBounds(const FTransform& LocalToWorld) const
+{
+	if (ShipBodySetup)
+	{
+		return FBoxSphereBounds(ShipBodySetup->AggGeom.CalcAABB(LocalToWorld));
+	}
+	return FBoxSphereBounds(LocalToWorld.GetLocation(), FVector::ZeroVector, 0.0);
+}
+
+void UAstroShipBodyComponent::OnCreatePhysicsState()
+{
+	Super::OnCreatePhysicsState();
+
+	ApplyMassProperties();
+}
+
+void UAstroShipBodyComponent::ApplyMassProperties()
+{
+	if (!ShipBodySetup || !BodyInstance.IsValidBodyInstance())
+		return;
+
+	FPhysicsCommand::ExecuteWrite(BodyInstance.ActorHandle, [this](const FPhysicsActorHandle& Actor)
+	{
+		FPhysicsInterface::SetComLocalPose_AssumesLocked(Actor, FTransform(PrincipalAxes, CenterOfMass));
+		FPhysicsInterface::SetMassSpaceInertiaTensor_AssumesLocked(Actor, PrincipalInertia);
+	});
+}
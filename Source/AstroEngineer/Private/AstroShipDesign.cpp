@@ -0,0 +1,303 @@
+// Copyright Astro Engineer Team. All Rights Reserved.
+
+#include "AstroShipDesign.h"
+#include "AstroShipAssembly.h"
+#include "AstroShipModule.h"
+#include "AstroEngineer.h"
+#include "Misc/FileHelper.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+
+DECLARE_CYCLE_STAT(TEXT("Capture Ship Design"), STAT_AstroCaptureShipDesign, STATGROUP_AstroEngineer);
+DECLARE_CYCLE_STAT(TEXT("Serialize Ship Design"), STAT_AstroSerializeShipDesign, STATGROUP_AstroEngineer);
+
+namespace AstroShipDesign
+{
+	/** "ASHD" */
+	static constexpr uint32 FileMagic = 0x44485341;
+
+	/** Smallest possible encoding of one module: class index, parent delta, connection index and override mask */
+	static constexpr int64 MinBytesPerModule = 4;
+
+	static void SerializePackedInt(FArchive& Ar, int32& Value)
+	{
+		uint32 Packed = static_cast<uint32>(Value);
+		Ar.SerializeIntPacked(Packed);
+		Value = static_cast<int32>(Packed);
+	}
+
+	/** Count read from the archive that cannot possibly fit in the bytes remaining */
+	static bool IsImplausibleCount(FArchive& Ar, uint32 Count, int64 MinBytesPerEntry)
+	{
+		return Ar.IsLoading() && Ar.TotalSize() >= 0 && static_cast<int64>(Count) * MinBytesPerEntry > Ar.TotalSize() - Ar.Tell();
+	}
+}
+
+void FAstroShipDesignModule::CaptureOverrides(const AAstroShipModule& Module, const AAstroShipModule& Defaults)
+{
+	OverrideMask = 0;
+	Mass = Module.GetMass();
+	PowerConsumption = Module.GetPowerConsumption();
+	PowerGeneration = Module.GetPowerGeneration();
+	CrewCapacity = Module.GetCrewCapacity();
+	Thrust = Module.GetThrust();
+
+	OverrideMask |= Mass != Defaults.Mass ? Override_Mass : 0;
+	OverrideMask |= PowerConsumption != Defaults.PowerConsumption ? Override_PowerConsumption : 0;
+	OverrideMask |= PowerGeneration != Defaults.PowerGeneration ? Override_PowerGeneration : 0;
+	OverrideMask |= CrewCapacity != Defaults.CrewCapacity ? Override_CrewCapacity : 0;
+	OverrideMask |= Thrust != Defaults.Thrust ? Override_Thrust : 0;
+}
+
+void FAstroShipDesignModule::ApplyOverrides(AAstroShipModule& Module) const
+{
+	if (OverrideMask & Override_Mass)
+	{
+		Module.SetMass(Mass);
+	}
+	if (OverrideMask & Override_PowerConsumption)
+	{
+		Module.SetPowerConsumption(PowerConsumption);
+	}
+	if (OverrideMask & Override_PowerGeneration)
+	{
+		Module.SetPowerGeneration(PowerGeneration);
+	}
+	if (OverrideMask & Override_CrewCapacity)
+	{
+		Module.SetCrewCapacity(CrewCapacity);
+	}
+	if (OverrideMask & Override_Thrust)
+	{
+		Module.SetThrust(Thrust);
+	}
+}
+
+bool FAstroShipDesign::Capture(const AAstroShipAssembly& Ship)
+{
+	SCOPE_CYCLE_COUNTER(STAT_AstroCaptureShipDesign);
+
+	Reset();
+	if (!Ship.RootModule)
+		return false;
+
+	ShipName = Ship.ShipName.ToString();
+
+	// Parent-first order falls out of the subtree walk
+	TArray<AAstroShipModule*> Ordered;
+	Ordered.Reserve(Ship.GetModulesView().Num());
+	Ship.RootModule->GatherSubtree(Ordered);
+	if (Ordered.Num() != Ship.GetModulesView().Num())
+	{
+		UE_LOG(LogAstroEngineer, Warning, TEXT("Ship '%s' has %d modules not connected to its root; they are left out of the design"),
+			*Ship.GetName(), Ship.GetModulesView().Num() - Ordered.Num());
+	}
+
+	TMap<const AAstroShipModule*, int32> DesignIndices;
+	TMap<UClass*, int32> ClassIndices;
+	DesignIndices.Reserve(Ordered.Num());
+	Modules.Reserve(Ordered.Num());
+
+	for (const AAstroShipModule* Module : Ordered)
+	{
+		UClass* ModuleClass = Module->GetClass();
+		int32* ClassIndex = ClassIndices.Find(ModuleClass);
+		if (!ClassIndex)
+		{
+			ClassIndex = &ClassIndices.Add(ModuleClass, ModuleClasses.Add(FSoftClassPath(ModuleClass)));
+		}
+
+		FAstroShipDesignModule& Entry = Modules.AddDefaulted_GetRef();
+		Entry.ClassIndex = *ClassIndex;
+		if (const AAstroShipModule* Parent = Module->GetParentModule())
+		{
+			Entry.ParentIndex = DesignIndices.FindChecked(Parent);
+			Entry.ParentConnectionIndex = Module->GetParentConnectionIndex();
+		}
+		Entry.CaptureOverrides(*Module, *ModuleClass->GetDefaultObject<AAstroShipModule>());
+
+		DesignIndices.Add(Module, DesignIndices.Num());
+	}
+
+	return true;
+}
+
+bool FAstroShipDesign::Serialize(FArchive& Ar)
+{
+	SCOPE_CYCLE_COUNTER(STAT_AstroSerializeShipDesign);
+
+	uint32 Magic = AstroShipDesign::FileMagic;
+	int32 Version = Version_Latest;
+	Ar << Magic;
+	Ar << Version;
+	if (Magic != AstroShipDesign::FileMagic || Version < Version_Initial || Version > Version_Latest)
+	{
+		UE_LOG(LogAstroEngineer, Warning, TEXT("Not a ship design, or saved by a newer version (%d)"), Version);
+		Ar.SetError();
+		return false;
+	}
+
+	Ar << ShipName;
+
+	uint32 ClassCount = ModuleClasses.Num();
+	Ar.SerializeIntPacked(ClassCount);
+	if (AstroShipDesign::IsImplausibleCount(Ar, ClassCount, sizeof(int32)))
+	{
+		Ar.SetError();
+		return false;
+	}
+	if (Ar.IsLoading())
+	{
+		ModuleClasses.SetNum(ClassCount);
+	}
+	for (FSoftClassPath& ClassPath : ModuleClasses)
+	{
+		FString PathString = ClassPath.ToString();
+		Ar << PathString;
+		if (Ar.IsLoading())
+		{
+			ClassPath.SetPath(PathString);
+		}
+	}
+
+	uint32 ModuleCount = Modules.Num();
+	Ar.SerializeIntPacked(ModuleCount);
+	if (AstroShipDesign::IsImplausibleCount(Ar, ModuleCount, AstroShipDesign::MinBytesPerModule))
+	{
+		Ar.SetError();
+		return false;
+	}
+	if (Ar.IsLoading())
+	{
+		Modules.SetNum(ModuleCount);
+	}
+
+	// Column by column, so similar values sit together
+	for (FAstroShipDesignModule& Module : Modules)
+	{
+		AstroShipDesign::SerializePackedInt(Ar, Module.ClassIndex);
+	}
+	for (int32 Index = 0; Index < Modules.Num(); ++Index)
+	{
+		// Parents precede children, so the distance back to the parent is small and positive; 0 marks the root
+		int32 ParentDelta = Modules[Index].ParentIndex == INDEX_NONE ? 0 : Index - Modules[Index].ParentIndex;
+		AstroShipDesign::SerializePackedInt(Ar, ParentDelta);
+		Modules[Index].ParentIndex = ParentDelta == 0 ? INDEX_NONE : Index - ParentDelta;
+	}
+	for (FAstroShipDesignModule& Module : Modules)
+	{
+		AstroShipDesign::SerializePackedInt(Ar, Module.ParentConnectionIndex);
+	}
+	for (FAstroShipDesignModule& Module : Modules)
+	{
+		Ar << Module.OverrideMask;
+	}
+	for (FAstroShipDesignModule& Module : Modules)
+	{
+		if (Module.OverrideMask & FAstroShipDesignModule::Override_Mass)
+		{
+			Ar << Module.Mass;
+		}
+		if (Module.OverrideMask & FAstroShipDesignModule::Override_PowerConsumption)
+		{
+			Ar << Module.PowerConsumption;
+		}
+		if (Module.OverrideMask & FAstroShipDesignModule::Override_PowerGeneration)
+		{
+			Ar << Module.PowerGeneration;
+		}
+		if (Module.OverrideMask & FAstroShipDesignModule::Override_CrewCapacity)
+		{
+			AstroShipDesign::SerializePackedInt(Ar, Module.CrewCapacity);
+		}
+		if (Module.OverrideMask & FAstroShipDesignModule::Override_Thrust)
+		{
+			Ar << Module.Thrust;
+		}
+	}
+
+	if (Ar.IsLoading() && (Ar.IsError() || !IsWellFormed()))
+	{
+		UE_LOG(LogAstroEngineer, Warning, TEXT("Ship design '%s' is corrupt"), *ShipName);
+		Ar.SetError();
+		Reset();
+		return false;
+	}
+	return !Ar.IsError();
+}
+
+bool FAstroShipDesign::SaveToBytes(TArray<uint8>& OutBytes)
+{
+	FMemoryWriter Writer(OutBytes);
+	return Serialize(Writer);
+}
+
+bool FAstroShipDesign::LoadFromBytes(TArrayView<const uint8> Bytes)
+{
+	FMemoryReaderView Reader(Bytes);
+	return Serialize(Reader);
+}
+
+bool FAstroShipDesign::SaveToFile(const FString& FilePath)
+{
+	TArray<uint8> Bytes;
+	return SaveToBytes(Bytes) && FFileHelper::SaveArrayToFile(Bytes, *FilePath);
+}
+
+bool FAstroShipDesign::LoadFromFile(const FString& FilePath)
+{
+	TArray<uint8> Bytes;
+	if (!FFileHelper::LoadFileToArray(Bytes, *FilePath))
+		return false;
+
+	return LoadFromBytes(Bytes);
+}
+
+void FAstroShipDesign::Reset()
+{
+	ShipName.Reset();
+	ModuleClasses.Reset();
+	Modules.Reset();
+}
+
+bool FAstroShipDesign::IsEquivalent(const FAstroShipDesign& Other) const
+{
+	if (ShipName != Other.ShipName || ModuleClasses != Other.ModuleClasses || Modules.Num() != Other.Modules.Num())
+		return false;
+
+	for (int32 Index = 0; Index < Modules.Num(); ++Index)
+	{
+		const FAstroShipDesignModule& Module = Modules[Index];
+		const FAstroShipDesignModule& OtherModule = Other.Modules[Index];
+		if (Module.ClassIndex != OtherModule.ClassIndex || Module.ParentIndex != OtherModule.ParentIndex
+			|| Module.ParentConnectionIndex != OtherModule.ParentConnectionIndex || Module.OverrideMask != OtherModule.OverrideMask)
+			return false;
+
+		const uint8 Mask = Module.OverrideMask;
+		if (((Mask & FAstroShipDesignModule::Override_Mass) && Module.Mass != OtherModule.Mass)
+			|| ((Mask & FAstroShipDesignModule::Override_PowerConsumption) && Module.PowerConsumption != OtherModule.PowerConsumption)
+			|| ((Mask & FAstroShipDesignModule::Override_PowerGeneration) && Module.PowerGeneration != OtherModule.PowerGeneration)
+			|| ((Mask & FAstroShipDesignModule::Override_CrewCapacity) && Module.CrewCapacity != OtherModule.CrewCapacity)
+			|| ((Mask & FAstroShipDesignModule::Override_Thrust) && Module.Thrust != OtherModule.Thrust))
+			return false;
+	}
+	return true;
+}
+
+bool FAstroShipDesign::IsWellFormed() const
+{
+	for (int32 Index = 0; Index < Modules.Num(); ++Index)
+	{
+		const FAstroShipDesignModule& Module = Modules[Index];
+		if (!ModuleClasses.IsValidIndex(Module.ClassIndex) || Module.ParentConnectionIndex < 0)
+			return false;
+
+		// Exactly one root, at the front
+		const bool bIsRoot = Module.ParentIndex == INDEX_NONE;
+		if (bIsRoot != (Index == 0))
+			return false;
+		if (!bIsRoot && (Module.ParentIndex < 0 || Module.ParentIndex >= Index))
+			return false;
+	}
+	return true;
+}
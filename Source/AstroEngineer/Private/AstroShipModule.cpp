@@ -2,10 +2,12 @@
 
 #include "AstroShipModule.h"
 #include "Components/StaticMeshComponent.h"
+#include "AstroShipAssembly.h"
+#include "AstroEngineer.h"
 
 AAstroShipModule::AAstroShipModule()
 {
-	PrimaryActorTick.bCanEverTick = true;
+	PrimaryActorTick.bCanEverTick = false;
 
 	// Create module mesh
 	ModuleMesh = CreateDefaultSubobject<UStaticMeshComponent>(TEXT("ModuleMesh"));
@@ -17,21 +19,41 @@ AAstroShipModule::AAstroShipModule()
 	PowerConsumption = 0.0f;
 	PowerGeneration = 0.0f;
 	CrewCapacity = 0;
+	Thrust = 0.0f;
+	bRoutesFuel = true;
+
+	ParentModule = nullptr;
+	ParentConnectionIndex = INDEX_NONE;
+	ChildSlot = INDEX_NONE;
 }
 
 void AAstroShipModule::BeginPlay()
 {
 	Super::BeginPlay();
+
+	if (UAstroModuleStatStore* Store = GetWorld()->GetSubsystem<UAstroModuleStatStore>())
+	{
+		StatHandle = Store->Register(*this);
+	}
 }
 
-void AAstroShipModule::Tick(float DeltaTime)
+void AAstroShipModule::EndPlay(const EEndPlayReason::Type EndPlayReason)
 {
-	Super::Tick(DeltaTime);
+	if (UAstroModuleStatStore* Store = GetStatStore())
+	{
+		Store->Release(StatHandle);
+	}
+
+	Super::EndPlay(EndPlayReason);
 }
 
 bool AAstroShipModule::AttachModule(AAstroShipModule* Module, int32 ConnectionIndex)
 {
-	if (!Module || ConnectionIndex < 0 || ConnectionIndex >= ConnectionPoints.Num())
+	if (!Module || Module == this || Module->ParentModule || ConnectionIndex < 0 || ConnectionIndex >= ConnectionPoints.Num())
+		return false;
+
+	// A root attached below one of its own descendants would close a parent cycle
+	if (GetRootModule() == Module)
 		return false;
 
 	FModuleConnectionPoint& ConnectionPoint = ConnectionPoints[ConnectionIndex];
@@ -41,7 +63,7 @@ bool AAstroShipModule::AttachModule(AAstroShipModule* Module, int32 ConnectionIn
 		return false;
 
 	// Check if module type is compatible
-	if (Module->ModuleType != ConnectionPoint.AcceptedModuleType && 
+	if (Module->GetModuleType() != ConnectionPoint.AcceptedModuleType && 
 		ConnectionPoint.AcceptedModuleType != EShipModuleType::Hull)
 		return false;
 
@@ -53,31 +75,216 @@ bool AAstroShipModule::AttachModule(AAstroShipModule* Module, int32 ConnectionIn
 	Module->SetActorRelativeLocation(ConnectionPoint.RelativeLocation);
 	Module->SetActorRelativeRotation(ConnectionPoint.RelativeRotation);
 
-	// Mark connection as occupied
+	// Record the edge on both ends
+	ConnectionOccupants.SetNum(ConnectionPoints.Num());
+	ConnectionOccupants[ConnectionIndex] = Module;
 	ConnectionPoint.bIsOccupied = true;
-	AttachedModules.Add(Module);
+	Module->ParentModule = this;
+	Module->ParentConnectionIndex = ConnectionIndex;
+	Module->ChildSlot = AttachedModules.Add(Module);
+
+	if (AAstroShipAssembly* Assembly = Cast<AAstroShipAssembly>(GetOwner()))
+	{
+		Assembly->InvalidateValidation(FAstroShipValidator::ConnectionRules);
+	}
 
 	return true;
 }
 
+void AAstroShipModule::ForEachFreeConnectionPoint(TFunctionRef<void(int32, const FModuleConnectionPoint&)> Visitor) const
+{
+	for (int32 Index = 0; Index < ConnectionPoints.Num(); ++Index)
+	{
+		if (!ConnectionPoints[Index].bIsOccupied)
+		{
+			Visitor(Index, ConnectionPoints[Index]);
+		}
+	}
+}
+
 void AAstroShipModule::DetachModule(AAstroShipModule* Module)
 {
-	if (!Module)
+	if (!Module || Module->ParentModule != this)
 		return;
 
-	// Find and free the connection point
-	for (FModuleConnectionPoint& ConnectionPoint : ConnectionPoints)
+	// Free exactly the connection point the child occupies
+	const int32 ConnectionIndex = Module->ParentConnectionIndex;
+	if (ConnectionPoints.IsValidIndex(ConnectionIndex))
 	{
-		if (ConnectionPoint.bIsOccupied)
-		{
-			// Check if this is the right module (simplified)
-			ConnectionPoint.bIsOccupied = false;
-		}
+		ConnectionPoints[ConnectionIndex].bIsOccupied = false;
+	}
+	if (ConnectionOccupants.IsValidIndex(ConnectionIndex))
+	{
+		ConnectionOccupants[ConnectionIndex] = nullptr;
+	}
+
+	// Swap-remove from the child list and patch the child that moved
+	const int32 Slot = Module->ChildSlot;
+	AttachedModules.RemoveAtSwap(Slot, EAllowShrinking::No);
+	if (AttachedModules.IsValidIndex(Slot))
+	{
+		AttachedModules[Slot]->ChildSlot = Slot;
+	}
+
+	Module->ParentModule = nullptr;
+	Module->ParentConnectionIndex = INDEX_NONE;
+	Module->ChildSlot = INDEX_NONE;
+
+	if (AAstroShipAssembly* Assembly = Cast<AAstroShipAssembly>(GetOwner()))
+	{
+		Assembly->InvalidateValidation(FAstroShipValidator::ConnectionRules);
 	}
 
 	// Detach the module
 	FDetachmentTransformRules DetachRules(EDetachmentRule::KeepWorld, false);
 	Module->DetachFromActor(DetachRules);
-	
-	AttachedModules.Remove(Module);
+}
+
+AAstroShipModule* AAstroShipModule::GetConnectionOccupant(int32 ConnectionIndex) const
+{
+	return ConnectionOccupants.IsValidIndex(ConnectionIndex) ? ConnectionOccupants[ConnectionIndex] : nullptr;
+}
+
+AAstroShipModule* AAstroShipModule::GetRootModule() const
+{
+	const AAstroShipModule* Module = this;
+	while (Module->ParentModule)
+	{
+		Module = Module->ParentModule;
+	}
+	return const_cast<AAstroShipModule*>(Module);
+}
+
+void AAstroShipModule::GatherSubtree(TArray<AAstroShipModule*>& OutModules) const
+{
+	// Breadth-first over the child lists, using the output array as the queue
+	int32 Cursor = OutModules.Add(const_cast<AAstroShipModule*>(this));
+	for (; Cursor < OutModules.Num(); ++Cursor)
+	{
+		for (AAstroShipModule* Child : OutModules[Cursor]->AttachedModules)
+		{
+			if (Child)
+			{
+				OutModules.Add(Child);
+			}
+		}
+	}
+}
+
+UAstroModuleStatStore* AAstroShipModule::GetStatStore() const
+{
+	if (!StatHandle.IsValid())
+		return nullptr;
+
+	UWorld* World = GetWorld();
+	return World ? World->GetSubsystem<UAstroModuleStatStore>() : nullptr;
+}
+
+EShipModuleType AAstroShipModule::GetModuleType() const
+{
+	const UAstroModuleStatStore* Store = GetStatStore();
+	return Store ? Store->GetModuleType(StatHandle) : ModuleType;
+}
+
+float AAstroShipModule::GetMass() const
+{
+	const UAstroModuleStatStore* Store = GetStatStore();
+	return Store ? Store->GetMass(StatHandle) : Mass;
+}
+
+float AAstroShipModule::GetPowerConsumption() const
+{
+	const UAstroModuleStatStore* Store = GetStatStore();
+	return Store ? Store->GetPowerConsumption(StatHandle) : PowerConsumption;
+}
+
+float AAstroShipModule::GetPowerGeneration() const
+{
+	const UAstroModuleStatStore* Store = GetStatStore();
+	return Store ? Store->GetPowerGeneration(StatHandle) : PowerGeneration;
+}
+
+int32 AAstroShipModule::GetCrewCapacity() const
+{
+	const UAstroModuleStatStore* Store = GetStatStore();
+	return Store ? Store->GetCrewCapacity(StatHandle) : CrewCapacity;
+}
+
+float AAstroShipModule::GetThrust() const
+{
+	const UAstroModuleStatStore* Store = GetStatStore();
+	return Store ? Store->GetThrust(StatHandle) : Thrust;
+}
+
+void AAstroShipModule::SetMass(float NewMass)
+{
+	if (UAstroModuleStatStore* Store = GetStatStore())
+	{
+		Store->SetMass(StatHandle, NewMass);
+	}
+	else
+	{
+		Mass = NewMass;
+	}
+	NotifyStatsChanged();
+}
+
+void AAstroShipModule::SetPowerConsumption(float NewPowerConsumption)
+{
+	if (UAstroModuleStatStore* Store = GetStatStore())
+	{
+		Store->SetPowerConsumption(StatHandle, NewPowerConsumption);
+	}
+	else
+	{
+		PowerConsumption = NewPowerConsumption;
+	}
+	NotifyStatsChanged();
+}
+
+void AAstroShipModule::SetPowerGeneration(float NewPowerGeneration)
+{
+	if (UAstroModuleStatStore* Store = GetStatStore())
+	{
+		Store->SetPowerGeneration(StatHandle, NewPowerGeneration);
+	}
+	else
+	{
+		PowerGeneration = NewPowerGeneration;
+	}
+	NotifyStatsChanged();
+}
+
+void AAstroShipModule::SetCrewCapacity(int32 NewCrewCapacity)
+{
+	if (UAstroModuleStatStore* Store = GetStatStore())
+	{
+		Store->SetCrewCapacity(StatHandle, NewCrewCapacity);
+	}
+	else
+	{
+		CrewCapacity = NewCrewCapacity;
+	}
+	NotifyStatsChanged();
+}
+
+void AAstroShipModule::SetThrust(float NewThrust)
+{
+	if (UAstroModuleStatStore* Store = GetStatStore())
+	{
+		Store->SetThrust(StatHandle, NewThrust);
+	}
+	else
+	{
+		Thrust = NewThrust;
+	}
+	NotifyStatsChanged();
+}
+
+void AAstroShipModule::NotifyStatsChanged()
+{
+	if (AAstroShipAssembly* Assembly = Cast<AAstroShipAssembly>(GetOwner()))
+	{
+		Assembly->RefreshModuleStats(this);
+	}
 }
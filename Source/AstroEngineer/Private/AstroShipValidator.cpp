@@ -0,0 +1,246 @@
+// Copyright Astro Engineer Team. All Rights Reserved.
+
+#include "AstroShipValidator.h"
+#include "AstroShipAssembly.h"
+#include "AstroShipModule.h"
+#include "AstroEngineer.h"
+
+#define LOCTEXT_NAMESPACE "AstroShipValidator"
+
+DECLARE_CYCLE_STAT(TEXT("Evaluate Ship Rules"), STAT_AstroEvaluateShipRules, STATGROUP_AstroEngineer);
+
+namespace AstroShipValidator
+{
+	static uint32 HashSettings(const AAstroShipAssembly& Ship)
+	{
+		uint32 Hash = GetTypeHash(Ship.bRequiresCockpit);
+		Hash = HashCombineFast(Hash, GetTypeHash(Ship.bRequiresEngine));
+		Hash = HashCombineFast(Hash, GetTypeHash(Ship.bRequiresFuelTank));
+		Hash = HashCombineFast(Hash, GetTypeHash(Ship.MinThrustToWeight));
+		return HashCombineFast(Hash, GetTypeHash(Ship.ReferenceGravity));
+	}
+
+	static void AddFailure(TArray<FShipValidationFailure>& OutFailures, EShipValidationRule Rule, AAstroShipModule* Module, FText Message)
+	{
+		FShipValidationFailure& Failure = OutFailures.AddDefaulted_GetRef();
+		Failure.Rule = Rule;
+		Failure.Module = Module;
+		Failure.Message = MoveTemp(Message);
+	}
+
+	/** Visit a module's neighbours in the connection tree: its parent and its children */
+	template <typename VisitorType>
+	static void ForEachNeighbour(const AAstroShipModule* Module, VisitorType&& Visitor)
+	{
+		if (AAstroShipModule* Parent = Module->GetParentModule())
+		{
+			Visitor(Parent);
+		}
+		for (AAstroShipModule* Child : Module->AttachedModules)
+		{
+			if (Child)
+			{
+				Visitor(Child);
+			}
+		}
+	}
+}
+
+bool FAstroShipValidator::IsValid(const AAstroShipAssembly& Ship)
+{
+	Refresh(Ship);
+
+	for (const TArray<FShipValidationFailure>& Failures : RuleFailures)
+	{
+		if (Failures.Num() > 0)
+			return false;
+	}
+	return true;
+}
+
+void FAstroShipValidator::GatherFailures(const AAstroShipAssembly& Ship, TArray<FShipValidationFailure>& OutFailures)
+{
+	Refresh(Ship);
+
+	for (const TArray<FShipValidationFailure>& Failures : RuleFailures)
+	{
+		OutFailures.Append(Failures);
+	}
+}
+
+void FAstroShipValidator::Refresh(const AAstroShipAssembly& Ship)
+{
+	const uint32 SettingsHash = AstroShipValidator::HashSettings(Ship);
+	if (SettingsHash != EvaluatedSettingsHash)
+	{
+		EvaluatedSettingsHash = SettingsHash;
+		DirtyRules |= RuleBit(EShipValidationRule::RequiredModules) | RuleBit(EShipValidationRule::ThrustToWeight);
+	}
+
+	if (DirtyRules == 0)
+		return;
+
+	SCOPE_CYCLE_COUNTER(STAT_AstroEvaluateShipRules);
+
+	for (int32 RuleIndex = 0; RuleIndex < static_cast<int32>(EShipValidationRule::Count); ++RuleIndex)
+	{
+		const EShipValidationRule Rule = static_cast<EShipValidationRule>(RuleIndex);
+		if (DirtyRules & RuleBit(Rule))
+		{
+			RuleFailures[RuleIndex].Reset();
+			EvaluateRule(Rule, Ship, RuleFailures[RuleIndex]);
+			++NumEvaluations;
+		}
+	}
+	DirtyRules = 0;
+}
+
+void FAstroShipValidator::EvaluateRule(EShipValidationRule Rule, const AAstroShipAssembly& Ship, TArray<FShipValidationFailure>& OutFailures) const
+{
+	switch (Rule)
+	{
+	case EShipValidationRule::RequiredModules:
+		EvaluateRequiredModules(Ship, OutFailures);
+		break;
+	case EShipValidationRule::PowerBalance:
+		EvaluatePowerBalance(Ship, OutFailures);
+		break;
+	case EShipValidationRule::Connectivity:
+		EvaluateConnectivity(Ship, OutFailures);
+		break;
+	case EShipValidationRule::FuelRouting:
+		EvaluateFuelRouting(Ship, OutFailures);
+		break;
+	case EShipValidationRule::ThrustToWeight:
+		EvaluateThrustToWeight(Ship, OutFailures);
+		break;
+	default:
+		break;
+	}
+}
+
+void FAstroShipValidator::EvaluateRequiredModules(const AAstroShipAssembly& Ship, TArray<FShipValidationFailure>& OutFailures) const
+{
+	const FAstroShipAggregates& Aggregates = Ship.GetAggregates();
+	if (Ship.bRequiresCockpit && Aggregates.GetModuleCount(EShipModuleType::Cockpit) == 0)
+	{
+		AstroShipValidator::AddFailure(OutFailures, EShipValidationRule::RequiredModules, nullptr, LOCTEXT("MissingCockpit", "The ship needs a cockpit."));
+	}
+	if (Ship.bRequiresEngine && Aggregates.GetModuleCount(EShipModuleType::Engine) == 0)
+	{
+		AstroShipValidator::AddFailure(OutFailures, EShipValidationRule::RequiredModules, nullptr, LOCTEXT("MissingEngine", "The ship needs an engine."));
+	}
+	if (Ship.bRequiresFuelTank && Aggregates.GetModuleCount(EShipModuleType::FuelTank) == 0)
+	{
+		AstroShipValidator::AddFailure(OutFailures, EShipValidationRule::RequiredModules, nullptr, LOCTEXT("MissingFuelTank", "The ship needs a fuel tank."));
+	}
+}
+
+void FAstroShipValidator::EvaluatePowerBalance(const AAstroShipAssembly& Ship, TArray<FShipValidationFailure>& OutFailures) const
+{
+	const FAstroShipAggregates& Aggregates = Ship.GetAggregates();
+	if (Aggregates.GetPowerBalance() < 0.0)
+	{
+		AstroShipValidator::AddFailure(OutFailures, EShipValidationRule::PowerBalance, nullptr,
+			FText::Format(LOCTEXT("PowerDeficit", "Power consumption exceeds generation by {0}."), FText::AsNumber(-Aggregates.GetPowerBalance())));
+	}
+}
+
+void FAstroShipValidator::EvaluateConnectivity(const AAstroShipAssembly& Ship, TArray<FShipValidationFailure>& OutFailures) const
+{
+	// Walk down from the root; anything in the ship the walk never reaches is floating free
+	TSet<const AAstroShipModule*> Reached;
+	TArray<const AAstroShipModule*> Stack;
+	if (Ship.RootModule)
+	{
+		Stack.Add(Ship.RootModule);
+		Reached.Add(Ship.RootModule);
+	}
+	while (Stack.Num() > 0)
+	{
+		const AAstroShipModule* Module = Stack.Pop(EAllowShrinking::No);
+		for (const AAstroShipModule* Child : Module->AttachedModules)
+		{
+			bool bAlreadyReached = false;
+			if (Child && (Reached.Add(Child, &bAlreadyReached), !bAlreadyReached))
+			{
+				Stack.Add(Child);
+			}
+		}
+	}
+
+	for (AAstroShipModule* Module : Ship.GetModulesView())
+	{
+		if (Module && !Reached.Contains(Module))
+		{
+			AstroShipValidator::AddFailure(OutFailures, EShipValidationRule::Connectivity, Module,
+				FText::Format(LOCTEXT("Disconnected", "{0} is not connected to the rest of the ship."), Module->ModuleName));
+		}
+	}
+}
+
+void FAstroShipValidator::EvaluateFuelRouting(const AAstroShipAssembly& Ship, TArray<FShipValidationFailure>& OutFailures) const
+{
+	// Flood outward from every tank through modules that carry fuel; engines are reached but need not pass fuel on
+	TSet<const AAstroShipModule*> Reached;
+	TArray<const AAstroShipModule*> Frontier;
+	for (const AAstroShipModule* Module : Ship.GetModulesView())
+	{
+		if (Module && Module->GetModuleType() == EShipModuleType::FuelTank)
+		{
+			Reached.Add(Module);
+			Frontier.Add(Module);
+		}
+	}
+
+	while (Frontier.Num() > 0)
+	{
+		const AAstroShipModule* Module = Frontier.Pop(EAllowShrinking::No);
+		AstroShipValidator::ForEachNeighbour(Module, [&Reached, &Frontier](const AAstroShipModule* Neighbour)
+		{
+			const bool bEndpoint = Neighbour->GetModuleType() == EShipModuleType::Engine || Neighbour->GetModuleType() == EShipModuleType::FuelTank;
+			if (!Neighbour->bRoutesFuel && !bEndpoint)
+				return;
+
+			bool bAlreadyReached = false;
+			Reached.Add(Neighbour, &bAlreadyReached);
+			if (!bAlreadyReached && Neighbour->bRoutesFuel)
+			{
+				Frontier.Add(Neighbour);
+			}
+		});
+	}
+
+	for (AAstroShipModule* Module : Ship.GetModulesView())
+	{
+		if (Module && Module->GetModuleType() == EShipModuleType::Engine && !Reached.Contains(Module))
+		{
+			AstroShipValidator::AddFailure(OutFailures, EShipValidationRule::FuelRouting, Module,
+				FText::Format(LOCTEXT("NoFuelRoute", "{0} has no fuel line to a tank."), Module->ModuleName));
+		}
+	}
+}
+
+void FAstroShipValidator::EvaluateThrustToWeight(const AAstroShipAssembly& Ship, TArray<FShipValidationFailure>& OutFailures) const
+{
+	const FAstroShipAggregates& Aggregates = Ship.GetAggregates();
+	if (Ship.MinThrustToWeight <= 0.0f || Aggregates.GetTotalMass() <= 0.0)
+		return;
+
+	// No gravity well, nothing to lift
+	const double Weight = Aggregates.GetTotalMass() * Ship.ReferenceGravity;
+	if (Weight <= 0.0)
+		return;
+
+	const double ThrustToWeight = Aggregates.GetTotalThrust() / Weight;
+	if (ThrustToWeight <= Ship.MinThrustToWeight)
+	{
+		FNumberFormattingOptions Format;
+		Format.MaximumFractionalDigits = 2;
+		AstroShipValidator::AddFailure(OutFailures, EShipValidationRule::ThrustToWeight, nullptr,
+			FText::Format(LOCTEXT("LowThrust", "Thrust-to-weight ratio is {0}, it must be above {1}."),
+				FText::AsNumber(ThrustToWeight, &Format), FText::AsNumber(Ship.MinThrustToWeight, &Format)));
+	}
+}
+
+#undef LOCTEXT_NAMESPACE
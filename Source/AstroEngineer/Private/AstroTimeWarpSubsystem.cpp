@@ -0,0 +1,259 @@
+// Copyright Astro Engineer Team. All Rights Reserved.
+
+#include "AstroTimeWarpSubsystem.h"
+#include "AstroOrbitalSubsystem.h"
+#include "AstroShipAssembly.h"
+#include "AstroEngineer.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+#include "Math/RandomStream.h"
+#include "Misc/App.h"
+
+DECLARE_CYCLE_STAT(TEXT("Time Warp Catch-Up"), STAT_AstroTimeWarpCatchUp, STATGROUP_AstroEngineer);
+
+namespace AstroTimeWarpSubsystem
+{
+	static void RunBenchmark(const TArray<FString>& Args, UWorld* World)
+	{
+		UAstroTimeWarpSubsystem* TimeWarp = World ? World->GetSubsystem<UAstroTimeWarpSubsystem>() : nullptr;
+		if (!TimeWarp)
+			return;
+
+		const int32 FramesPerRate = Args.Num() > 0 ? FMath::Max(1, FCString::Atoi(*Args[0])) : 120;
+		const int32 NumSyntheticJobs = Args.Num() > 1 ? FMath::Max(0, FCString::Atoi(*Args[1])) : 0;
+		TimeWarp->StartBenchmark(FramesPerRate, NumSyntheticJobs);
+	}
+
+	static FAutoConsoleCommandWithWorldAndArgs BenchmarkCommand(
+		TEXT("astro.TimeWarp.Benchmark"),
+		TEXT("Log frame time at 1x, 1000x and 100000x warp. Usage: astro.TimeWarp.Benchmark [FramesPerRate=120] [SyntheticJobs=0]"),
+		FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&RunBenchmark));
+}
+
+void UAstroTimeWarpSubsystem::Tick(float DeltaTime)
+{
+	Super::Tick(DeltaTime);
+
+	LastCatchUpSeconds = 0.0;
+	if (IsWarping())
+	{
+		SuspendShipPhysics();
+
+		// The scheduler's own tick covers the real-time part of the frame; the rest is skipped ahead in one batch
+		if (UAstroJobScheduler* Scheduler = GetWorld()->GetSubsystem<UAstroJobScheduler>())
+		{
+			SCOPE_CYCLE_COUNTER(STAT_AstroTimeWarpCatchUp);
+			const double StartTime = FPlatformTime::Seconds();
+			Scheduler->AdvanceSimulationTime(DeltaTime * (WarpRate - 1.0));
+			LastCatchUpSeconds = FPlatformTime::Seconds() - StartTime;
+		}
+	}
+
+	if (Benchmark.IsSet())
+	{
+		TickBenchmark();
+	}
+}
+
+TStatId UAstroTimeWarpSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UAstroTimeWarpSubsystem, STATGROUP_AstroEngineer);
+}
+
+void UAstroTimeWarpSubsystem::Deinitialize()
+{
+	// The world is going away with its ships and jobs, so there is nothing to hand back
+	Benchmark.Reset();
+	WarpRate = 1.0;
+
+	Super::Deinitialize();
+}
+
+void UAstroTimeWarpSubsystem::SetWarpRate(double NewWarpRate)
+{
+	NewWarpRate = FMath::Max(NewWarpRate, 1.0);
+	if (NewWarpRate == WarpRate)
+		return;
+
+	const bool bWasWarping = IsWarping();
+	WarpRate = NewWarpRate;
+	if (IsWarping() && !bWasWarping)
+	{
+		EnterWarp();
+	}
+	else if (!IsWarping() && bWasWarping)
+	{
+		ExitWarp();
+	}
+
+	UE_LOG(LogAstroEngineer, Verbose, TEXT("Time warp set to %gx"), WarpRate);
+}
+
+void UAstroTimeWarpSubsystem::IncreaseWarp()
+{
+	for (const double Rate : WarpRates)
+	{
+		if (Rate > WarpRate)
+		{
+			SetWarpRate(Rate);
+			return;
+		}
+	}
+}
+
+void UAstroTimeWarpSubsystem::DecreaseWarp()
+{
+	for (int32 Index = WarpRates.Num() - 1; Index >= 0; --Index)
+	{
+		if (WarpRates[Index] < WarpRate)
+		{
+			SetWarpRate(WarpRates[Index]);
+			return;
+		}
+	}
+	SetWarpRate(1.0);
+}
+
+void UAstroTimeWarpSubsystem::EnterWarp()
+{
+	if (UAstroOrbitalSubsystem* OrbitalSubsystem = GetWorld()->GetSubsystem<UAstroOrbitalSubsystem>())
+	{
+		OrbitalSubsystem->GetPropagator().CutAllThrust();
+	}
+	SuspendShipPhysics();
+}
+
+void UAstroTimeWarpSubsystem::ExitWarp()
+{
+	UAstroOrbitalSubsystem* OrbitalSubsystem = GetWorld() ? GetWorld()->GetSubsystem<UAstroOrbitalSubsystem>() : nullptr;
+	if (!OrbitalSubsystem)
+		return;
+
+	// Ships still in orbit stay on rails; only one whose craft went away while warping simulates again
+	for (const TWeakObjectPtr<AAstroShipAssembly>& Ship : OrbitalSubsystem->GetFloatingOrigin().GetShips())
+	{
+		if (Ship.IsValid() && !Ship->IsInOrbit())
+		{
+			Ship->SetPhysicsSuspended(false);
+		}
+	}
+}
+
+void UAstroTimeWarpSubsystem::SuspendShipPhysics()
+{
+	UAstroOrbitalSubsystem* OrbitalSubsystem = GetWorld()->GetSubsystem<UAstroOrbitalSubsystem>();
+	if (!OrbitalSubsystem)
+		return;
+
+	for (const TWeakObjectPtr<AAstroShipAssembly>& Ship : OrbitalSubsystem->GetFloatingOrigin().GetShips())
+	{
+		if (Ship.IsValid())
+		{
+			Ship->SetPhysicsSuspended(true);
+		}
+	}
+}
+
+void UAstroTimeWarpSubsystem::StartBenchmark(int32 FramesPerRate, int32 NumSyntheticJobs)
+{
+	if (Benchmark.IsSet())
+	{
+		FinishBenchmark();
+	}
+
+	FBenchmark& Run = Benchmark.Emplace();
+	Run.FramesPerRate = FramesPerRate;
+	Run.WarmUpFrames = 1;
+	Run.PreviousWarpRate = WarpRate;
+	for (const double Rate : { 1.0, 1000.0, 100000.0 })
+	{
+		Run.Stages.AddDefaulted_GetRef().WarpRate = Rate;
+	}
+
+	// Recurring jobs between a minute and an hour, like a base full of refineries and assemblers
+	if (UAstroJobScheduler* Scheduler = GetWorld()->GetSubsystem<UAstroJobScheduler>())
+	{
+		FRandomStream Random(0x0A57);
+		const double Now = Scheduler->GetSimulationTime();
+		Run.Jobs.Reserve(NumSyntheticJobs);
+		for (int32 Index = 0; Index < NumSyntheticJobs; ++Index)
+		{
+			const double Period = FMath::Lerp(60.0, 3600.0, double(Random.GetFraction()));
+			Run.Jobs.Add(Scheduler->ScheduleJob(Now + Period, FAstroJobCompleted::CreateUObject(this, &UAstroTimeWarpSubsystem::OnBenchmarkJobCompleted, Index, Period)));
+		}
+	}
+
+	SetWarpRate(Run.Stages[0].WarpRate);
+}
+
+void UAstroTimeWarpSubsystem::TickBenchmark()
+{
+	FBenchmark& Run = Benchmark.GetValue();
+	if (Run.WarmUpFrames > 0)
+	{
+		--Run.WarmUpFrames;
+		return;
+	}
+
+	// Wall-clock time of the last whole frame, not the warped or dilated one
+	FBenchmarkStage& Stage = Run.Stages[Run.StageIndex];
+	const double FrameSeconds = FApp::GetDeltaTime();
+	++Stage.NumFrames;
+	Stage.FrameSeconds += FrameSeconds;
+	Stage.WorstFrameSeconds = FMath::Max(Stage.WorstFrameSeconds, FrameSeconds);
+	Stage.CatchUpSeconds += LastCatchUpSeconds;
+	if (const UAstroOrbitalSubsystem* OrbitalSubsystem = GetWorld()->GetSubsystem<UAstroOrbitalSubsystem>())
+	{
+		Stage.AdvanceSeconds += OrbitalSubsystem->GetLastAdvanceSeconds();
+	}
+
+	if (Stage.NumFrames < Run.FramesPerRate)
+		return;
+
+	if (++Run.StageIndex < Run.Stages.Num())
+	{
+		Run.WarmUpFrames = 1;
+		SetWarpRate(Run.Stages[Run.StageIndex].WarpRate);
+		return;
+	}
+	FinishBenchmark();
+}
+
+void UAstroTimeWarpSubsystem::FinishBenchmark()
+{
+	FBenchmark Run = MoveTemp(Benchmark.GetValue());
+	Benchmark.Reset();
+
+	if (UAstroJobScheduler* Scheduler = GetWorld() ? GetWorld()->GetSubsystem<UAstroJobScheduler>() : nullptr)
+	{
+		for (FAstroJobHandle& Job : Run.Jobs)
+		{
+			Scheduler->CancelJob(Job);
+		}
+	}
+
+	const UAstroOrbitalSubsystem* OrbitalSubsystem = GetWorld() ? GetWorld()->GetSubsystem<UAstroOrbitalSubsystem>() : nullptr;
+	const int32 NumCraft = OrbitalSubsystem ? OrbitalSubsystem->GetPropagator().NumCraft() : 0;
+	for (const FBenchmarkStage& Stage : Run.Stages)
+	{
+		if (Stage.NumFrames == 0)
+			continue;
+
+		UE_LOG(LogAstroEngineer, Display, TEXT("Time warp benchmark %gx: %d frames, %.3f ms per frame (worst %.3f ms), orbits %.3f ms for %d craft, production catch-up %.3f ms for %d synthetic jobs completed"),
+			Stage.WarpRate, Stage.NumFrames, Stage.FrameSeconds * 1000.0 / Stage.NumFrames, Stage.WorstFrameSeconds * 1000.0,
+			Stage.AdvanceSeconds * 1000.0 / Stage.NumFrames, NumCraft, Stage.CatchUpSeconds * 1000.0 / Stage.NumFrames, Stage.NumJobsCompleted);
+	}
+
+	SetWarpRate(Run.PreviousWarpRate);
+}
+
+void UAstroTimeWarpSubsystem::OnBenchmarkJobCompleted(double CompletionTime, int32 JobIndex, double Period)
+{
+	if (!Benchmark.IsSet())
+		return;
+
+	FBenchmark& Run = Benchmark.GetValue();
+	++Run.Stages[Run.StageIndex].NumJobsCompleted;
+	Run.Jobs[JobIndex] = GetWorld()->GetSubsystem<UAstroJobScheduler>()->ScheduleJob(CompletionTime + Period,
+		FAstroJobCompleted::CreateUObject(this, &UAstroTimeWarpSubsystem::OnBenchmarkJobCompleted, JobIndex, Period));
+}
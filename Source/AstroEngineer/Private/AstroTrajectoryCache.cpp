@@ -0,0 +1,429 @@
+// Copyright Astro Engineer Team. All Rights Reserved.
+
+#include "AstroTrajectoryCache.h"
+#include "AstroEngineer.h"
+#include "Algo/BinarySearch.h"
+#include "RenderingThread.h"
+
+DECLARE_CYCLE_STAT(TEXT("Build Trajectory"), STAT_AstroBuildTrajectory, STATGROUP_AstroEngineer);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Trajectory Segments Built"), STAT_AstroTrajectorySegmentsBuilt, STATGROUP_AstroEngineer);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Trajectory Segments Reused"), STAT_AstroTrajectorySegmentsReused, STATGROUP_AstroEngineer);
+
+namespace AstroTrajectoryCache
+{
+	/** Cap on conservative-advancement steps when searching one segment for a sphere of influence entry */
+	static constexpr int32 MaxSphereSearchSteps = 4096;
+
+	/** Cap on midpoint subdivisions of one initial sampling interval */
+	static constexpr int32 MaxSampleDepth = 10;
+	static constexpr int32 InitialSampleIntervals = 16;
+
+	/** Everything a background build needs, copied so the task never touches game-thread state */
+	struct FBuildInput
+	{
+		TArray<FAstroCelestialBody> Bodies;
+		TArray<TSharedRef<const FAstroTrajectorySegment, ESPMode::ThreadSafe>> ReusedSegments;
+
+		/** Inputs the prediction is keyed by */
+		int32 BodyIndex = INDEX_NONE;
+		FAstroOrbitalElements Elements;
+		TArray<FAstroManeuverNode> ManeuverNodes;
+
+		/** Where building resumes after the reused segments */
+		int32 StartBodyIndex = INDEX_NONE;
+		FAstroOrbitalElements StartElements;
+		double StartTime = 0.0;
+		int32 StartManeuver = 0;
+
+		double HorizonTime = 0.0;
+		int32 MaxSegments = 0;
+		double SampleTolerance = 0.0;
+		int32 MaxPointsPerSegment = 0;
+	};
+
+	static bool IsSameConic(const FAstroOrbitalElements& A, const FAstroOrbitalElements& B)
+	{
+		return A.SemiMajorAxis == B.SemiMajorAxis && A.Eccentricity == B.Eccentricity && A.Inclination == B.Inclination
+			&& A.LongitudeOfAscendingNode == B.LongitudeOfAscendingNode && A.ArgumentOfPeriapsis == B.ArgumentOfPeriapsis
+			&& A.MeanAnomalyAtEpoch == B.MeanAnomalyAtEpoch && A.Epoch == B.Epoch;
+	}
+
+	/** First time in [StartTime, EndTime] the conic enters a child body's sphere of influence, or infinity */
+	static double FindSphereEntry(const FAstroOrbitalElements& Elements, double GravitationalParameter, const FAstroCelestialBody& Child,
+		double StartTime, double EndTime)
+	{
+		auto Gap = [&Elements, GravitationalParameter, &Child](double Time, double& OutClosingSpeed)
+		{
+			FVector CraftPosition, CraftVelocity, ChildPosition, ChildVelocity;
+			FAstroOrbitalMath::StateAtTime(Elements, GravitationalParameter, Time, CraftPosition, CraftVelocity);
+			FAstroOrbitalMath::StateAtTime(Child.Orbit, GravitationalParameter, Time, ChildPosition, ChildVelocity);
+			OutClosingSpeed = FMath::Max(CraftVelocity.Size() + ChildVelocity.Size(), UE_DOUBLE_KINDA_SMALL_NUMBER);
+			return FVector::Dist(CraftPosition, ChildPosition) - Child.SphereOfInfluence;
+		};
+
+		// Conservative advancement: the gap cannot close faster than the two speeds combined
+		const double MinStep = (EndTime - StartTime) / MaxSphereSearchSteps;
+		double ClosingSpeed;
+		double Time = StartTime;
+		double CurrentGap = Gap(Time, ClosingSpeed);
+
+		// A craft that starts inside the sphere has just left that body and must get clear before it can enter again
+		bool bArmed = CurrentGap > 0.0;
+		for (int32 Step = 0; Step <= MaxSphereSearchSteps && Time < EndTime; ++Step)
+		{
+			const double PreviousTime = Time;
+			Time = FMath::Min(EndTime, Time + FMath::Max(FMath::Abs(CurrentGap) / ClosingSpeed, MinStep));
+			CurrentGap = Gap(Time, ClosingSpeed);
+			if (CurrentGap > 0.0)
+			{
+				bArmed = true;
+			}
+			else if (bArmed)
+			{
+				// Bisect to the crossing, to within a millisecond
+				double Outside = PreviousTime;
+				double Inside = Time;
+				while (Inside - Outside > 1.0e-3)
+				{
+					const double Middle = 0.5 * (Outside + Inside);
+					if (Gap(Middle, ClosingSpeed) > 0.0)
+					{
+						Outside = Middle;
+					}
+					else
+					{
+						Inside = Middle;
+					}
+				}
+				return Inside;
+			}
+		}
+		return TNumericLimits<double>::Max();
+	}
+
+	/** Add points between two samples until the polyline stays within tolerance of the conic */
+	static void RefineSamples(const FAstroOrbitalElements& Elements, double GravitationalParameter, double Tolerance, int32 MaxPoints,
+		double StartTime, const FVector& StartPoint, double EndTime, const FVector& EndPoint, int32 Depth, FAstroTrajectorySegment& Segment)
+	{
+		const double MiddleTime = 0.5 * (StartTime + EndTime);
+		FVector MiddlePoint, MiddleVelocity;
+		FAstroOrbitalMath::StateAtTime(Elements, GravitationalParameter, MiddleTime, MiddlePoint, MiddleVelocity);
+
+		// The sagitta is large where the path bends, so curved stretches get more points than straight ones
+		const double Sagitta = FVector::Dist(MiddlePoint, 0.5 * (StartPoint + EndPoint));
+		if (Depth < MaxSampleDepth && Segment.Points.Num() < MaxPoints && Sagitta > Tolerance * MiddlePoint.Size())
+		{
+			RefineSamples(Elements, GravitationalParameter, Tolerance, MaxPoints, StartTime, StartPoint, MiddleTime, MiddlePoint, Depth + 1, Segment);
+			RefineSamples(Elements, GravitationalParameter, Tolerance, MaxPoints, MiddleTime, MiddlePoint, EndTime, EndPoint, Depth + 1, Segment);
+			return;
+		}
+
+		Segment.Points.Add(EndPoint);
+		Segment.PointTimes.Add(EndTime);
+	}
+
+	static void SampleSegment(FAstroTrajectorySegment& Segment, double GravitationalParameter, double Tolerance, int32 MaxPoints)
+	{
+		FVector Point, Velocity;
+		FAstroOrbitalMath::StateAtTime(Segment.Elements, GravitationalParameter, Segment.StartTime, Point, Velocity);
+		Segment.Points.Add(Point);
+		Segment.PointTimes.Add(Segment.StartTime);
+
+		const double Interval = (Segment.EndTime - Segment.StartTime) / InitialSampleIntervals;
+		if (Interval <= 0.0)
+			return;
+
+		for (int32 IntervalIndex = 0; IntervalIndex < InitialSampleIntervals; ++IntervalIndex)
+		{
+			const double StartTime = Segment.StartTime + IntervalIndex * Interval;
+			const double EndTime = IntervalIndex + 1 == InitialSampleIntervals ? Segment.EndTime : StartTime + Interval;
+			const FVector StartPoint = Segment.Points.Last();
+			FVector EndPoint;
+			FAstroOrbitalMath::StateAtTime(Segment.Elements, GravitationalParameter, EndTime, EndPoint, Velocity);
+
+			// Leave room for the remaining initial intervals so the segment always reaches its end
+			const int32 PointBudget = MaxPoints - (InitialSampleIntervals - IntervalIndex);
+			RefineSamples(Segment.Elements, GravitationalParameter, Tolerance, PointBudget, StartTime, StartPoint, EndTime, EndPoint, 0, Segment);
+		}
+	}
+
+	static TSharedPtr<const FAstroTrajectory, ESPMode::ThreadSafe> BuildTrajectory(const FBuildInput& Input)
+	{
+		SCOPE_CYCLE_COUNTER(STAT_AstroBuildTrajectory);
+
+		TSharedRef<FAstroTrajectory, ESPMode::ThreadSafe> Trajectory = MakeShared<FAstroTrajectory, ESPMode::ThreadSafe>();
+		Trajectory->Segments = Input.ReusedSegments;
+		Trajectory->NumReusedSegments = Input.ReusedSegments.Num();
+		Trajectory->BodyIndex = Input.BodyIndex;
+		Trajectory->Elements = Input.Elements;
+		Trajectory->ManeuverNodes = Input.ManeuverNodes;
+
+		int32 BodyIndex = Input.StartBodyIndex;
+		FAstroOrbitalElements Elements = Input.StartElements;
+		double Time = Input.StartTime;
+		int32 ManeuverIndex = Input.StartManeuver;
+		while (Trajectory->Segments.Num() < Input.MaxSegments && Time < Input.HorizonTime)
+		{
+			const FAstroCelestialBody& Body = Input.Bodies[BodyIndex];
+			const double GravitationalParameter = Body.GravitationalParameter;
+
+			TSharedRef<FAstroTrajectorySegment, ESPMode::ThreadSafe> Segment = MakeShared<FAstroTrajectorySegment, ESPMode::ThreadSafe>();
+			Segment->BodyIndex = BodyIndex;
+			Segment->Elements = Elements;
+			Segment->StartTime = Time;
+			Segment->NumManeuversBefore = ManeuverIndex;
+
+			// The next maneuver ends the conic; without one a closed orbit is drawn for one revolution
+			double EndTime = Input.HorizonTime;
+			EAstroSegmentEnd EndReason = EAstroSegmentEnd::Horizon;
+			if (Input.ManeuverNodes.IsValidIndex(ManeuverIndex) && Input.ManeuverNodes[ManeuverIndex].Time < EndTime)
+			{
+				EndTime = FMath::Max(Time, Input.ManeuverNodes[ManeuverIndex].Time);
+				EndReason = EAstroSegmentEnd::Maneuver;
+			}
+			else if (!Elements.IsHyperbolic())
+			{
+				EndTime = FMath::Min(EndTime, Time + Elements.GetPeriod(GravitationalParameter));
+			}
+
+			if (Body.ParentIndex != INDEX_NONE)
+			{
+				const double EscapeTime = FAstroOrbitalMath::FindRadiusCrossing(Elements, GravitationalParameter, Body.SphereOfInfluence, Time, true);
+				if (EscapeTime < EndTime)
+				{
+					EndTime = EscapeTime;
+					EndReason = EAstroSegmentEnd::EscapeSphereOfInfluence;
+				}
+			}
+
+			const double ImpactTime = FAstroOrbitalMath::FindRadiusCrossing(Elements, GravitationalParameter, Body.Radius, Time, false);
+			if (ImpactTime < EndTime)
+			{
+				EndTime = ImpactTime;
+				EndReason = EAstroSegmentEnd::Impact;
+			}
+
+			int32 EnteredBodyIndex = INDEX_NONE;
+			for (int32 ChildIndex = BodyIndex + 1; ChildIndex < Input.Bodies.Num(); ++ChildIndex)
+			{
+				if (Input.Bodies[ChildIndex].ParentIndex != BodyIndex)
+					continue;
+
+				const double EntryTime = FindSphereEntry(Elements, GravitationalParameter, Input.Bodies[ChildIndex], Time, EndTime);
+				if (EntryTime < EndTime)
+				{
+					EndTime = EntryTime;
+					EndReason = EAstroSegmentEnd::EnterSphereOfInfluence;
+					EnteredBodyIndex = ChildIndex;
+				}
+			}
+
+			Segment->EndTime = EndTime;
+			Segment->EndReason = EndReason;
+			SampleSegment(*Segment, GravitationalParameter, Input.SampleTolerance, Input.MaxPointsPerSegment);
+			Trajectory->Segments.Add(Segment);
+			INC_DWORD_STAT(STAT_AstroTrajectorySegmentsBuilt);
+
+			if (EndReason == EAstroSegmentEnd::Horizon || EndReason == EAstroSegmentEnd::Impact)
+				break;
+
+			// Patch the next conic onto the end state
+			FVector Position, Velocity;
+			FAstroOrbitalMath::StateAtTime(Elements, GravitationalParameter, EndTime, Position, Velocity);
+			if (EndReason == EAstroSegmentEnd::Maneuver)
+			{
+				const FVector& DeltaV = Input.ManeuverNodes[ManeuverIndex++].DeltaV;
+				const FVector Prograde = Velocity.GetSafeNormal();
+				const FVector Normal = (Position ^ Velocity).GetSafeNormal();
+				Velocity += Prograde * DeltaV.X + Normal * DeltaV.Y + (Prograde ^ Normal) * DeltaV.Z;
+			}
+			else
+			{
+				const int32 ChildIndex = EndReason == EAstroSegmentEnd::EscapeSphereOfInfluence ? BodyIndex : EnteredBodyIndex;
+				const int32 ParentIndex = Input.Bodies[ChildIndex].ParentIndex;
+				FVector ChildPosition, ChildVelocity;
+				FAstroOrbitalMath::StateAtTime(Input.Bodies[ChildIndex].Orbit, Input.Bodies[ParentIndex].GravitationalParameter, EndTime, ChildPosition, ChildVelocity);
+
+				const double Sign = EndReason == EAstroSegmentEnd::EscapeSphereOfInfluence ? 1.0 : -1.0;
+				Position += ChildPosition * Sign;
+				Velocity += ChildVelocity * Sign;
+				BodyIndex = EndReason == EAstroSegmentEnd::EscapeSphereOfInfluence ? ParentIndex : ChildIndex;
+			}
+
+			Elements = FAstroOrbitalMath::ElementsFromState(Position, Velocity, Input.Bodies[BodyIndex].GravitationalParameter, EndTime);
+			Time = EndTime;
+		}
+
+		return Trajectory;
+	}
+}
+
+TSharedRef<const FAstroPublishedTrajectory, ESPMode::ThreadSafe> FAstroTrajectoryCache::Watch(const FAstroOrbitHandle& Craft)
+{
+	if (const FWatchedCraft* Watched = FindWatched(Craft))
+		return Watched->Published;
+
+	FWatchedCraft& Watched = WatchedCraft.AddDefaulted_GetRef();
+	Watched.Craft = Craft;
+	return Watched.Published;
+}
+
+void FAstroTrajectoryCache::Unwatch(const FAstroOrbitHandle& Craft)
+{
+	// A build still running owns its inputs and result, so it can simply be abandoned
+	WatchedCraft.RemoveAllSwap([&Craft](const FWatchedCraft& Watched)
+	{
+		return Watched.Craft.Index == Craft.Index && Watched.Craft.Serial == Craft.Serial;
+	});
+}
+
+void FAstroTrajectoryCache::SetManeuverNodes(const FAstroOrbitHandle& Craft, TArray<FAstroManeuverNode> Nodes)
+{
+	if (FWatchedCraft* Watched = FindWatched(Craft))
+	{
+		Nodes.StableSort([](const FAstroManeuverNode& A, const FAstroManeuverNode& B) { return A.Time < B.Time; });
+		Watched->ManeuverNodes = MoveTemp(Nodes);
+	}
+}
+
+const TArray<FAstroManeuverNode>* FAstroTrajectoryCache::GetManeuverNodes(const FAstroOrbitHandle& Craft) const
+{
+	const FWatchedCraft* Watched = FindWatched(Craft);
+	return Watched ? &Watched->ManeuverNodes : nullptr;
+}
+
+TSharedPtr<const FAstroTrajectory, ESPMode::ThreadSafe> FAstroTrajectoryCache::GetTrajectory(const FAstroOrbitHandle& Craft) const
+{
+	const FWatchedCraft* Watched = FindWatched(Craft);
+	return Watched ? Watched->Published->Owner : nullptr;
+}
+
+void FAstroTrajectoryCache::Update(const FAstroOrbitPropagator& Propagator)
+{
+	for (int32 Index = WatchedCraft.Num() - 1; Index >= 0; --Index)
+	{
+		FWatchedCraft& Watched = WatchedCraft[Index];
+		if (!Propagator.IsValid(Watched.Craft))
+		{
+			WatchedCraft.RemoveAtSwap(Index, EAllowShrinking::No);
+			continue;
+		}
+
+		// One build per craft in flight; newer edits wait for it and are picked up next frame
+		if (Watched.Pending.IsValid())
+		{
+			if (!Watched.Pending.IsCompleted())
+				continue;
+
+			Publish(*Watched.Published, Watched.Pending.GetResult());
+			Watched.Pending = UE::Tasks::TTask<TSharedPtr<const FAstroTrajectory, ESPMode::ThreadSafe>>();
+		}
+
+		const int32 BodyIndex = Propagator.GetCraftBody(Watched.Craft);
+		const FAstroOrbitalElements Elements = Propagator.GetCraftElements(Watched.Craft);
+		if (BodyIndex == Watched.LaunchedBodyIndex && AstroTrajectoryCache::IsSameConic(Elements, Watched.LaunchedElements)
+			&& Watched.ManeuverNodes == Watched.LaunchedManeuverNodes)
+			continue;
+
+		AstroTrajectoryCache::FBuildInput Input;
+		Input.Bodies = Propagator.GetBodies();
+		Input.BodyIndex = BodyIndex;
+		Input.Elements = Elements;
+		Input.ManeuverNodes = Watched.ManeuverNodes;
+		Input.MaxSegments = MaxSegments;
+		Input.SampleTolerance = SampleTolerance;
+		Input.MaxPointsPerSegment = MaxPointsPerSegment;
+
+		// With the same conic, every segment ending before the first edited node (and its transition) still holds
+		const FAstroTrajectory* Previous = Watched.Published->Owner.Get();
+		if (Previous && Previous->BodyIndex == BodyIndex && AstroTrajectoryCache::IsSameConic(Previous->Elements, Elements))
+		{
+			const TArray<FAstroManeuverNode>& PreviousNodes = Previous->ManeuverNodes;
+			int32 FirstChanged = 0;
+			while (FirstChanged < PreviousNodes.Num() && FirstChanged < Input.ManeuverNodes.Num() && PreviousNodes[FirstChanged] == Input.ManeuverNodes[FirstChanged])
+			{
+				++FirstChanged;
+			}
+
+			double ChangedTime = TNumericLimits<double>::Max();
+			if (PreviousNodes.IsValidIndex(FirstChanged))
+			{
+				ChangedTime = PreviousNodes[FirstChanged].Time;
+			}
+			if (Input.ManeuverNodes.IsValidIndex(FirstChanged))
+			{
+				ChangedTime = FMath::Min(ChangedTime, Input.ManeuverNodes[FirstChanged].Time);
+			}
+
+			for (const TSharedRef<const FAstroTrajectorySegment, ESPMode::ThreadSafe>& Segment : Previous->Segments)
+			{
+				const bool bEndStillValid = Segment->EndReason == EAstroSegmentEnd::Maneuver
+					? Segment->NumManeuversBefore < FirstChanged
+					: Segment->EndReason == EAstroSegmentEnd::EscapeSphereOfInfluence || Segment->EndReason == EAstroSegmentEnd::EnterSphereOfInfluence;
+				if (Segment->EndTime > ChangedTime || !bEndStillValid || Input.ReusedSegments.Num() + 1 >= Previous->Segments.Num())
+					break;
+
+				Input.ReusedSegments.Add(Segment);
+			}
+		}
+
+		if (Input.ReusedSegments.Num() > 0)
+		{
+			// Resume from the first stale segment, whose start is fixed by the reused ones
+			const FAstroTrajectorySegment& Resume = *Previous->Segments[Input.ReusedSegments.Num()];
+			Input.StartBodyIndex = Resume.BodyIndex;
+			Input.StartElements = Resume.Elements;
+			Input.StartTime = Resume.StartTime;
+			Input.StartManeuver = Resume.NumManeuversBefore;
+			Input.HorizonTime = Input.ReusedSegments[0]->StartTime + MaxPredictionSeconds;
+		}
+		else
+		{
+			// Nodes already behind the clock are not replayed
+			Input.StartBodyIndex = BodyIndex;
+			Input.StartElements = Elements;
+			Input.StartTime = Propagator.GetTime();
+			Input.StartManeuver = Algo::LowerBound(Input.ManeuverNodes, Input.StartTime,
+				[](const FAstroManeuverNode& Node, double Time) { return Node.Time < Time; });
+			Input.HorizonTime = Input.StartTime + MaxPredictionSeconds;
+		}
+		INC_DWORD_STAT_BY(STAT_AstroTrajectorySegmentsReused, Input.ReusedSegments.Num());
+
+		Watched.LaunchedBodyIndex = BodyIndex;
+		Watched.LaunchedElements = Elements;
+		Watched.LaunchedManeuverNodes = Watched.ManeuverNodes;
+		Watched.Pending = UE::Tasks::Launch(UE_SOURCE_LOCATION, [Input = MoveTemp(Input)]()
+		{
+			return AstroTrajectoryCache::BuildTrajectory(Input);
+		});
+	}
+}
+
+FAstroTrajectoryCache::FWatchedCraft* FAstroTrajectoryCache::FindWatched(const FAstroOrbitHandle& Craft)
+{
+	return WatchedCraft.FindByPredicate([&Craft](const FWatchedCraft& Watched)
+	{
+		return Watched.Craft.Index == Craft.Index && Watched.Craft.Serial == Craft.Serial;
+	});
+}
+
+const FAstroTrajectoryCache::FWatchedCraft* FAstroTrajectoryCache::FindWatched(const FAstroOrbitHandle& Craft) const
+{
+	return WatchedCraft.FindByPredicate([&Craft](const FWatchedCraft& Watched)
+	{
+		return Watched.Craft.Index == Craft.Index && Watched.Craft.Serial == Craft.Serial;
+	});
+}
+
+void FAstroTrajectoryCache::Publish(FAstroPublishedTrajectory& Published, TSharedPtr<const FAstroTrajectory, ESPMode::ThreadSafe> Trajectory)
+{
+	TSharedPtr<const FAstroTrajectory, ESPMode::ThreadSafe> Retired = MoveTemp(Published.Owner);
+	Published.Owner = MoveTemp(Trajectory);
+	Published.Latest.store(Published.Owner.Get(), std::memory_order_release);
+
+	// Render commands queued before the swap may still hold the old pointer; releasing it in a later command outlives them
+	if (Retired)
+	{
+		ENQUEUE_RENDER_COMMAND(RetireAstroTrajectory)([Retired = MoveTemp(Retired)](FRHICommandListImmediate&) {});
+	}
+}
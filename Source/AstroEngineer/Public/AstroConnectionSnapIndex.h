@@ -0,0 +1,57 @@
+// Copyright Astro Engineer Team. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "AstroShipModule.h"
+
+/**
+ * Uniform spatial hash over the free connection points of one ship, in assembly space.
+ * Points are added and removed per module as the ship changes, and a snap query only visits the cells
+ * overlapping its search radius, or the occupied cells when those are fewer, instead of every point on the ship.
+ */
+struct ASTROENGINEER_API FAstroConnectionSnapIndex
+{
+public:
+	/** Drop all points and set the cell edge length */
+	void Reset(float InCellSize);
+
+	/** Replace every indexed point of the module with its current free connection points */
+	void UpdateModule(const AAstroShipModule* Module, const FTransform& ModuleToAssembly);
+
+	/** Remove every indexed point of the module */
+	void RemoveModule(const AAstroShipModule* Module);
+
+	/**
+	 * Closest free point within MaxDistance of Location that accepts ModuleType.
+	 * Uses the same compatibility rule as AAstroShipModule::AttachModule.
+	 */
+	bool FindNearest(const FVector& Location, EShipModuleType ModuleType, float MaxDistance,
+		const AAstroShipModule*& OutModule, int32& OutConnectionIndex) const;
+
+	int32 NumPoints() const { return Points.Num(); }
+
+private:
+	struct FSnapPoint
+	{
+		const AAstroShipModule* Module;
+		int32 ConnectionIndex;
+		FVector Location;
+		EShipModuleType AcceptedModuleType;
+		FIntVector Cell;
+	};
+
+	FIntVector GetCell(const FVector& Location) const;
+	void RemovePoint(int32 PointIndex);
+
+	float CellSize = 200.0f;
+
+	/** Dense point storage, swap-removed */
+	TArray<FSnapPoint> Points;
+
+	/** Points falling in each occupied cell */
+	TMap<FIntVector, TArray<int32, TInlineAllocator<4>>> Cells;
+
+	/** Indexed points of each module */
+	TMap<const AAstroShipModule*, TArray<int32, TInlineAllocator<4>>> ModulePoints;
+};
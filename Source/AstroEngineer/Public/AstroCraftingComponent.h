@@ -4,6 +4,8 @@
 
 #include "CoreMinimal.h"
 #include "Components/ActorComponent.h"
+#include "AstroRecipeDatabase.h"
+#include "AstroJobScheduler.h"
 #include "AstroCraftingComponent.generated.h"
 
 class UAstroInventoryComponent;
@@ -40,8 +42,9 @@ struct FCraftingRecipe
 	UPROPERTY(EditAnywhere, BlueprintReadWrite)
 	UTexture2D* Icon;
 
+	/** Recipe starts out unlocked. Runtime unlock state lives in the component, see IsRecipeUnlocked. */
 	UPROPERTY(EditAnywhere, BlueprintReadWrite)
-	bool bIsUnlocked;
+	bool bUnlockedAtStart;
 
 	FCraftingRecipe()
 		: RecipeID(NAME_None)
@@ -51,10 +54,61 @@ struct FCraftingRecipe
 		, ResultQuantity(1)
 		, CraftingTime(1.0f)
 		, Icon(nullptr)
-		, bIsUnlocked(false)
+		, bUnlockedAtStart(false)
 	{}
 };
 
+/**
+ * Queued or running crafting job.
+ * Progress is derived from the unit timestamps, never accumulated per tick.
+ */
+USTRUCT(BlueprintType)
+struct FCraftingJob
+{
+	GENERATED_BODY()
+
+	UPROPERTY(BlueprintReadOnly)
+	int32 JobID;
+
+	UPROPERTY(BlueprintReadOnly)
+	FName RecipeID;
+
+	/** Higher priorities are dispatched to free fabricators first */
+	UPROPERTY(BlueprintReadOnly)
+	int32 Priority;
+
+	/** Units still to produce, including the one in progress */
+	UPROPERTY(BlueprintReadOnly)
+	int32 RemainingCount;
+
+	/** Fabricator running this job, INDEX_NONE while waiting */
+	UPROPERTY(BlueprintReadOnly)
+	int32 FabricatorIndex;
+
+	/** Simulation time the current unit started (see UAstroJobScheduler) */
+	UPROPERTY(BlueprintReadOnly)
+	double UnitStartTime;
+
+	/** Simulation time the current unit completes */
+	UPROPERTY(BlueprintReadOnly)
+	double UnitEndTime;
+
+	/** Scheduler entry for the current unit */
+	FAstroJobHandle CompletionHandle;
+
+	FCraftingJob()
+		: JobID(INDEX_NONE)
+		, RecipeID(NAME_None)
+		, Priority(0)
+		, RemainingCount(0)
+		, FabricatorIndex(INDEX_NONE)
+		, UnitStartTime(0.0)
+		, UnitEndTime(0.0)
+	{}
+
+	bool IsRunning() const { return FabricatorIndex != INDEX_NONE; }
+};
+
 /**
  * Crafting Component for managing recipe crafting
  */
@@ -66,40 +120,142 @@ class ASTROENGINEER_API UAstroCraftingComponent : public UActorComponent
 public:	
 	UAstroCraftingComponent();
 
-	virtual void TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
-
 	/** Check if player can craft recipe */
 	UFUNCTION(BlueprintCallable, Category = "Crafting")
 	bool CanCraftRecipe(FName RecipeID) const;
 
-	/** Start crafting a recipe */
+	/** Queue a single craft of a recipe */
 	UFUNCTION(BlueprintCallable, Category = "Crafting")
 	bool StartCrafting(FName RecipeID);
 
-	/** Cancel current crafting */
+	/**
+	 * Queue Count crafts of a recipe. Ingredients for every unit are taken up front.
+	 * Returns the new job ID, or INDEX_NONE if the recipe can't be crafted Count times.
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Crafting")
+	int32 QueueCrafting(FName RecipeID, int32 Count = 1, int32 Priority = 0);
+
+	/** Cancel one job and refund its unfinished units. Fails and keeps the job if the refund does not fit in the inventory. */
 	UFUNCTION(BlueprintCallable, Category = "Crafting")
-	void CancelCrafting();
+	bool CancelCraftingJob(int32 JobID);
+
+	/** Cancel every queued and running job. Fails and keeps them all if the refund does not fit in the inventory. */
+	UFUNCTION(BlueprintCallable, Category = "Crafting")
+	bool CancelCrafting();
+
+	/** Progress (0-1) of the current unit of a job */
+	UFUNCTION(BlueprintPure, Category = "Crafting")
+	float GetJobProgress(int32 JobID) const;
+
+	/** Progress (0-1) of the first running job */
+	UFUNCTION(BlueprintPure, Category = "Crafting")
+	float GetCraftingProgress() const;
 
 	/** Get all available recipes */
 	UFUNCTION(BlueprintCallable, Category = "Crafting")
 	TArray<FCraftingRecipe> GetAvailableRecipes() const;
 
+	/** Cached unlocked recipes, rebuilt only after unlock state changes */
+	const TArray<FCraftingRecipe>& GetAvailableRecipesRef() const;
+
+	/** Visit each unlocked recipe without copying */
+	void ForEachAvailableRecipe(TFunctionRef<void(const FCraftingRecipe&)> Visitor) const;
+
+	/** Check if recipe is currently craftable, using the cached craftable set */
+	UFUNCTION(BlueprintCallable, Category = "Crafting")
+	bool IsRecipeCraftable(FName RecipeID) const;
+
+	/** How many times a recipe could be crafted with the current inventory, from the cache */
+	UFUNCTION(BlueprintCallable, Category = "Crafting")
+	int32 GetMaxCraftableCount(FName RecipeID) const;
+
+	/** IDs of all currently craftable recipes, from the cache */
+	UFUNCTION(BlueprintCallable, Category = "Crafting")
+	TArray<FName> GetCraftableRecipeIDs() const;
+
+	/** Craft from another inventory and rebuild the craftable cache against it. BeginPlay picks the owner's inventory. */
+	void SetInventory(UAstroInventoryComponent* NewInventory);
+
+	/** Compiled recipe data, rebuilt at BeginPlay and by NotifyRecipesChanged */
+	const FAstroRecipeDatabase& GetRecipeDatabase() const { return RecipeDatabase; }
+
+	/** Call after editing CraftingRecipes directly so cached views are rebuilt */
+	UFUNCTION(BlueprintCallable, Category = "Crafting")
+	void NotifyRecipesChanged();
+
 	/** Unlock a recipe */
 	UFUNCTION(BlueprintCallable, Category = "Crafting")
 	void UnlockRecipe(FName RecipeID);
 
+	/** Unlock several recipes by database index with a single OnRecipesUnlocked broadcast */
+	void UnlockRecipes(TArrayView<const int32> RecipeIndices);
+
 	/** Check if recipe is unlocked */
 	UFUNCTION(BlueprintCallable, Category = "Crafting")
 	bool IsRecipeUnlocked(FName RecipeID) const;
 
+	/**
+	 * Read or write the unlocked recipe IDs and job queue for a progression save.
+	 * Job times are stored relative to the production clock, so they resume where they left off. On load, ElapsedSeconds
+	 * places the restored jobs as if they had kept running that long; the scheduler completes whatever fell due.
+	 */
+	void SerializeProgress(FArchive& Ar, double ElapsedSeconds = 0.0);
+
 protected:
 	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+	/** Scheduler callback: finish one unit of a job and start its next unit or the next waiting job */
+	void HandleUnitCompleted(double CompletionTime, int32 JobID);
+
+	/** Hand free fabricators to the highest-priority waiting jobs */
+	void DispatchWaitingJobs(double Now);
+
+	/** Register the current unit's completion with the job scheduler */
+	void ScheduleUnitCompletion(FCraftingJob& Job);
+
+	/** Index of a job in CraftingJobs, or INDEX_NONE */
+	int32 FindJobIndex(int32 JobID) const;
+
+	UAstroJobScheduler* GetJobScheduler() const;
+
+	/** Production clock shared with every other scheduled job */
+	double GetSimulationTime() const;
+
+	/** Refresh bIsCrafting and CurrentCraftingRecipe from the job list */
+	void UpdateCraftingState();
+
+	/** Crafting time of a recipe, or 0 if it is unknown */
+	float GetRecipeCraftingTime(FName RecipeID) const;
 
-	/** Complete the current crafting */
-	void CompleteCrafting();
+	/** Inventory delta for Units crafts of a recipe: negative to take the ingredients, positive to refund them */
+	TMap<FName, int32> MakeIngredientDelta(int32 RecipeIndex, int32 Units) const;
+
+	/** Check a recipe by its index in CraftingRecipes */
+	bool CanCraftRecipeIndex(int32 RecipeIndex) const;
+
+	/** Max craftable count of an unlocked recipe against the live inventory, 0 if locked */
+	int32 ComputeMaxCraftableCount(int32 RecipeIndex) const;
+
+	/** Recompile the recipe database, keeping recipes unlocked so far */
+	void RebuildRecipeDatabase();
+
+	/** Recompute the craftable cache for every recipe */
+	void RefreshCraftability();
+
+	/** Recompute the craftable cache for the given recipes and broadcast what changed */
+	void UpdateCraftability(TArrayView<const int32> RecipeIndices);
+
+	/** Move finished results waiting for inventory space into the inventory, if they fit now */
+	void DeliverBlockedOutputs();
+
+	/** Inventory change handler feeding UpdateCraftability */
+	UFUNCTION()
+	void HandleInventorySlotsChanged(const TArray<int32>& ChangedSlots, const TArray<FName>& ChangedItems);
 
 	/** Find recipe by ID */
 	FCraftingRecipe* FindRecipe(FName RecipeID);
+	const FCraftingRecipe* FindRecipe(FName RecipeID) const;
 
 public:	
 	/** Reference to player inventory */
@@ -110,18 +266,26 @@ public:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Crafting")
 	TArray<FCraftingRecipe> CraftingRecipes;
 
-	/** Currently crafting recipe */
+	/** Number of jobs that can run at the same time */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Crafting", meta = (ClampMin = "1"))
+	int32 NumFabricators;
+
+	/** Running and waiting jobs in dispatch order (priority, then FIFO) */
 	UPROPERTY(BlueprintReadOnly, Category = "Crafting")
-	FName CurrentCraftingRecipe;
+	TArray<FCraftingJob> CraftingJobs;
 
-	/** Crafting progress (0-1) */
+	/** Recipe of the first running job */
 	UPROPERTY(BlueprintReadOnly, Category = "Crafting")
-	float CraftingProgress;
+	FName CurrentCraftingRecipe;
 
-	/** Is currently crafting */
+	/** Is any fabricator running */
 	UPROPERTY(BlueprintReadOnly, Category = "Crafting")
 	bool bIsCrafting;
 
+	/** Finished results the inventory had no room for, delivered as soon as it changes and they fit */
+	UPROPERTY(BlueprintReadOnly, Category = "Crafting")
+	TMap<FName, int32> BlockedOutputs;
+
 	/** Delegate called when crafting starts */
 	DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnCraftingStarted, FName, RecipeID);
 	UPROPERTY(BlueprintAssignable, Category = "Crafting")
@@ -132,7 +296,40 @@ public:
 	UPROPERTY(BlueprintAssignable, Category = "Crafting")
 	FOnCraftingCompleted OnCraftingCompleted;
 
+	/** Delegate called when a finished unit's result does not fit in the inventory and joins BlockedOutputs */
+	DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnCraftingOutputBlocked, FName, RecipeID);
+	UPROPERTY(BlueprintAssignable, Category = "Crafting")
+	FOnCraftingOutputBlocked OnCraftingOutputBlocked;
+
+	/** Delegate called when recipes enter or leave the craftable set */
+	DECLARE_DYNAMIC_MULTICAST_DELEGATE_TwoParams(FOnCraftableSetChanged, const TArray<FName>&, NowCraftable, const TArray<FName>&, NoLongerCraftable);
+	UPROPERTY(BlueprintAssignable, Category = "Crafting")
+	FOnCraftableSetChanged OnCraftableSetChanged;
+
+	/** Delegate called once per unlock batch with every recipe it unlocked */
+	DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnRecipesUnlocked, const TArray<FName>&, RecipeIDs);
+	UPROPERTY(BlueprintAssignable, Category = "Crafting")
+	FOnRecipesUnlocked OnRecipesUnlocked;
+
+	/** Delegate called when jobs are queued, dispatched, finished or cancelled */
+	DECLARE_DYNAMIC_MULTICAST_DELEGATE(FOnCraftingQueueChanged);
+	UPROPERTY(BlueprintAssignable, Category = "Crafting")
+	FOnCraftingQueueChanged OnCraftingQueueChanged;
+
 private:
-	float CraftingTimer;
-	float CurrentCraftingTime;
+	int32 NextJobID;
+
+	/** Compiled, index-based view of CraftingRecipes */
+	FAstroRecipeDatabase RecipeDatabase;
+
+	/** Per-recipe unlock state */
+	TBitArray<> UnlockedRecipes;
+
+	/** Per-recipe max craftable count and craftable flag, maintained from inventory changes */
+	TArray<int32> MaxCraftableCounts;
+	TBitArray<> CraftableRecipes;
+
+	/** Unlocked recipes, valid while bAvailableRecipesDirty is false */
+	mutable TArray<FCraftingRecipe> AvailableRecipesCache;
+	mutable bool bAvailableRecipesDirty;
 };
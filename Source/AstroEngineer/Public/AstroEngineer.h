@@ -4,6 +4,11 @@
 
 #include "CoreMinimal.h"
 #include "Modules/ModuleManager.h"
+#include "Stats/Stats.h"
+
+ASTROENGINEER_API DECLARE_LOG_CATEGORY_EXTERN(LogAstroEngineer, Log, All);
+
+DECLARE_STATS_GROUP(TEXT("AstroEngineer"), STATGROUP_AstroEngineer, STATCAT_Advanced);
 
 class FAstroEngineerModule : public IModuleInterface
 {
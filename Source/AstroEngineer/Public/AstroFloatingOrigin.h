@@ -0,0 +1,141 @@
+// Copyright Astro Engineer Team. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Containers/SparseArray.h"
+#include "AstroOrbitPropagator.h"
+
+class AActor;
+class AAstroShipAssembly;
+class ULevel;
+
+/**
+ * Keeps the active vessel near world zero at interplanetary distances.
+ * Every body and craft lives in double-precision root-body (heliocentric) coordinates in the propagator; world space is a
+ * window onto them centred on Origin. Ships in orbit are placed from their root positions in one batch per frame.
+ *
+ * Only actors within LocalBubbleRadius of the active vessel stay in world space. Actors that drift out of it are parked:
+ * hidden, with collision off, and filed by root position in a coarse grid. A rebase shifts only the actors in the bubble,
+ * so its cost follows local density rather than the number of actors in the world. Parked actors catch up on the shifts
+ * they missed in one step when the vessel comes back within range, and streamed-in levels are sorted into the two sets
+ * when they are added.
+ */
+class ASTROENGINEER_API FAstroFloatingOrigin
+{
+public:
+	/** Unreal units are centimetres, the propagator works in metres */
+	static constexpr double WorldUnitsPerMetre = 100.0;
+
+	/** Root-frame position, in metres, that world zero stands for */
+	const FVector& GetOrigin() const { return Origin; }
+
+	FVector RootToWorld(const FVector& RootPosition) const { return (RootPosition - Origin) * WorldUnitsPerMetre; }
+	FVector WorldToRoot(const FVector& WorldLocation) const { return Origin + WorldLocation / WorldUnitsPerMetre; }
+
+	/** Craft the origin follows; an invalid handle freezes the origin and brings every parked actor back */
+	void SetActiveCraft(const FAstroOrbitHandle& Craft) { ActiveCraft = Craft; }
+	const FAstroOrbitHandle& GetActiveCraft() const { return ActiveCraft; }
+
+	/** Place a ship from its orbit every frame */
+	void RegisterShip(AAstroShipAssembly* Ship);
+	void UnregisterShip(AAstroShipAssembly* Ship);
+	const TArray<TWeakObjectPtr<AAstroShipAssembly>>& GetShips() const { return Ships; }
+
+	/**
+	 * Recentre on the active craft if it drifted past RebaseDistance, park and unpark actors around it, then place every
+	 * registered ship. Player pawns standing free inside the active vessel's body are moved by the same amount as the vessel.
+	 * Game thread.
+	 */
+	void Update(UWorld& World, const FAstroOrbitPropagator& Propagator);
+
+	/** Move the origin to a root-frame position, shifting the actors in the local bubble the opposite way */
+	void Rebase(const FVector& NewOrigin);
+
+	/** Park local actors outside the bubble around a root-frame position and bring back parked actors inside it */
+	void UpdateBubble(UWorld& World, const FVector& NewBubbleCenter);
+
+	/** Start tracking an actor that appeared in world space after the world was sorted, e.g. a new spawn */
+	void TrackActor(AActor& Actor);
+
+	/** Sort the actors of a level added after earlier rebases into the bubble and the parked set */
+	void TrackAddedLevel(ULevel& Level);
+
+	int32 GetNumRebases() const { return NumRebases; }
+	int32 GetNumLocalActors() const { return LocalActors.Num(); }
+	int32 GetNumParkedActors() const { return ParkedActors.Num(); }
+
+	/** How far, in metres, the active craft may drift from world zero before the origin moves */
+	double RebaseDistance = 1000.0;
+
+	/** Radius, in metres, around the active craft within which actors stay in world space */
+	double LocalBubbleRadius = 25000.0;
+
+private:
+	struct FLocalActor
+	{
+		TWeakObjectPtr<AActor> Actor;
+
+		/** Bounding sphere radius in metres, so large actors are parked by their near edge */
+		double BoundsRadius = 0.0;
+
+		bool bAlwaysLocal = false;
+	};
+
+	struct FParkedActor
+	{
+		TWeakObjectPtr<AActor> Actor;
+		FVector RootPosition = FVector::ZeroVector;
+		double BoundsRadius = 0.0;
+
+		/** TotalWorldShift when the actor was parked; it is owed the difference */
+		FVector AppliedShift = FVector::ZeroVector;
+		FIntVector Cell = FIntVector::ZeroValue;
+
+		bool bWasHidden = false;
+		bool bHadCollision = false;
+		bool bWasSimulating = false;
+	};
+
+	/** Move player pawns inside the ship's body, and not attached to anything, by the ship's own movement */
+	static void CarryPassengers(UWorld& World, const AAstroShipAssembly& Ship, const FVector& Delta);
+
+	/** File an actor under the bubble or the parked set; AppliedShift is the shift its current location already includes */
+	void SortActor(AActor& Actor, const FVector& AppliedShift);
+
+	/** Never parked: pawns, and actors too large for the parking grid */
+	bool IsAlwaysLocal(const AActor& Actor, double BoundsRadius) const;
+
+	void Park(const FLocalActor& Local, const FVector& AppliedShift);
+	void Unpark(int32 ParkedIndex);
+
+	/** Sort every actor already in the world, once, the first time there is a bubble to sort them around */
+	void TrackWorld(UWorld& World);
+
+	/** Bring every parked actor back, when there is no active craft to keep a bubble around */
+	void UnparkAll();
+
+	FIntVector GetParkingCell(const FVector& RootPosition) const;
+
+	FVector Origin = FVector::ZeroVector;
+
+	/** Sum of every rebase shift, in world units */
+	FVector TotalWorldShift = FVector::ZeroVector;
+
+	FAstroOrbitHandle ActiveCraft;
+	TArray<TWeakObjectPtr<AAstroShipAssembly>> Ships;
+	int32 NumRebases = 0;
+
+	/** Set once the actors already in the world have been sorted; spawns and added levels are tracked from then on */
+	bool bTrackingWorld = false;
+
+	/** Root-frame centre of the bubble at the last UpdateBubble */
+	FVector BubbleCenter = FVector::ZeroVector;
+
+	TArray<FLocalActor> LocalActors;
+
+	/** Parked actors, with stable indices for the grid; cells are LocalBubbleRadius wide, in root coordinates */
+	TSparseArray<FParkedActor> ParkedActors;
+	TMap<FIntVector, TArray<int32>> ParkingCells;
+	int32 ParkedSweepCursor = 0;
+};
@@ -51,8 +51,6 @@ class ASTROENGINEER_API UAstroInventoryComponent : public UActorComponent
 public:	
 	UAstroInventoryComponent();
 
-	virtual void TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
-
 	/** Add item to inventory */
 	UFUNCTION(BlueprintCallable, Category = "Inventory")
 	bool AddItem(FName ItemID, int32 Quantity = 1);
@@ -61,6 +59,13 @@ public:
 	UFUNCTION(BlueprintCallable, Category = "Inventory")
 	bool RemoveItem(FName ItemID, int32 Quantity = 1);
 
+	/**
+	 * Apply additions (positive) and removals (negative) for several items at once.
+	 * The whole delta is validated first and applied all or nothing, with a single change broadcast.
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Inventory")
+	bool ApplyInventoryDelta(const TMap<FName, int32>& Delta);
+
 	/** Check if inventory has item */
 	UFUNCTION(BlueprintCallable, Category = "Inventory")
 	bool HasItem(FName ItemID, int32 Quantity = 1) const;
@@ -73,27 +78,64 @@ public:
 	UFUNCTION(BlueprintCallable, Category = "Inventory")
 	TArray<FInventoryItem> GetInventoryItems() const { return InventoryItems; }
 
+	/** Read-only view of all inventory items without copying */
+	TArrayView<const FInventoryItem> GetInventoryItemsView() const { return InventoryItems; }
+
 	/** Clear entire inventory */
 	UFUNCTION(BlueprintCallable, Category = "Inventory")
 	void ClearInventory();
 
+	/** Read or write per-item quantities for a progression save. Loading replaces the contents in one change. */
+	void SerializeProgress(FArchive& Ar);
+
 protected:
 	virtual void BeginPlay() override;
 
 	/** Find item in inventory */
 	FInventoryItem* FindItem(FName ItemID);
 
+	/** Stack size used when ItemID overflows into a new slot */
+	int32 GetStackSizeFor(FName ItemID) const;
+
+	/** Rebuild the ItemID index from InventoryItems */
+	void RebuildItemIndex();
+
+	/** Append a new slot and index it */
+	int32 AddSlot(const FInventoryItem& NewItem);
+
+	/** Remove a slot, swapping the last slot into its place */
+	void RemoveSlot(int32 SlotIndex);
+
 public:	
 	/** Maximum inventory slots */
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Inventory")
 	int32 MaxInventorySlots;
 
-	/** Current inventory items */
-	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Inventory")
-	TArray<FInventoryItem> InventoryItems;
-
 	/** Delegate called when inventory changes */
 	DECLARE_DYNAMIC_MULTICAST_DELEGATE(FOnInventoryChanged);
 	UPROPERTY(BlueprintAssignable, Category = "Inventory")
 	FOnInventoryChanged OnInventoryChanged;
+
+	/**
+	 * Delegate called once per change with the slots and items it touched.
+	 * Slot indices at or past InventoryItems.Num() were vacated by the change.
+	 */
+	DECLARE_DYNAMIC_MULTICAST_DELEGATE_TwoParams(FOnInventorySlotsChanged, const TArray<int32>&, ChangedSlots, const TArray<FName>&, ChangedItems);
+	UPROPERTY(BlueprintAssignable, Category = "Inventory")
+	FOnInventorySlotsChanged OnInventorySlotsChanged;
+
+private:
+	/** Current inventory items; changed only through the component so the ItemID index stays in sync */
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Inventory", meta = (AllowPrivateAccess = "true"))
+	TArray<FInventoryItem> InventoryItems;
+
+	/** Slots holding one ItemID and their summed quantity */
+	struct FItemSlotIndex
+	{
+		TArray<int32, TInlineAllocator<2>> Slots;
+		int32 TotalQuantity = 0;
+	};
+
+	/** ItemID -> slots lookup, kept in sync with InventoryItems */
+	TMap<FName, FItemSlotIndex> ItemIndex;
 };
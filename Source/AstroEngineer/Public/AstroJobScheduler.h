@@ -0,0 +1,109 @@
+// Copyright Astro Engineer Team. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "AstroJobScheduler.generated.h"
+
+/** Called when a scheduled job is due, with the simulation time it was due at */
+DECLARE_DELEGATE_OneParam(FAstroJobCompleted, double /*CompletionTime*/);
+
+/**
+ * Handle to a job owned by UAstroJobScheduler.
+ * Handles go stale once their job completes or is cancelled.
+ */
+struct FAstroJobHandle
+{
+	int32 Index = INDEX_NONE;
+	uint32 Serial = 0;
+
+	bool IsValid() const { return Index != INDEX_NONE; }
+	void Invalidate() { Index = INDEX_NONE; Serial = 0; }
+};
+
+/**
+ * Owns every timed production job in the world (crafting, research, refining, manufacturing).
+ * Jobs sit in an indexed min-heap keyed by completion time, so insert, cancel and reschedule are O(log n)
+ * and each frame only pops what is due.
+ */
+UCLASS()
+class ASTROENGINEER_API UAstroJobScheduler : public UTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	virtual void Tick(float DeltaTime) override;
+	virtual TStatId GetStatId() const override;
+
+	/** Schedule a callback at an absolute simulation time */
+	FAstroJobHandle ScheduleJob(double CompletionTime, FAstroJobCompleted OnCompleted);
+
+	/** Cancel a pending job and invalidate its handle */
+	bool CancelJob(FAstroJobHandle& Handle);
+
+	/** Move a pending job to a new completion time */
+	bool RescheduleJob(const FAstroJobHandle& Handle, double NewCompletionTime);
+
+	/** Is the job still waiting to complete */
+	bool IsJobPending(const FAstroJobHandle& Handle) const;
+
+	/** Completion time of a pending job, or 0 */
+	double GetJobCompletionTime(const FAstroJobHandle& Handle) const;
+
+	/** Number of pending jobs */
+	int32 GetNumPendingJobs() const { return Heap.Num(); }
+
+	/** Production clock: world time plus any time fast-forwarded by AdvanceSimulationTime */
+	double GetSimulationTime() const;
+
+	/**
+	 * Fast-forward the production clock, completing every job that falls due in order.
+	 * Jobs scheduled by completion callbacks are processed in the same call if they are due too,
+	 * so hours of offline progress resolve in one batch.
+	 */
+	void AdvanceSimulationTime(double Seconds);
+
+	/** Run every job already due now rather than on the next tick, e.g. jobs restored with completion times in the past */
+	void RunDueJobs();
+
+private:
+	struct FJob
+	{
+		double CompletionTime = 0.0;
+		uint64 Sequence = 0;
+		int32 HeapIndex = INDEX_NONE;
+		uint32 Serial = 0;
+		FAstroJobCompleted OnCompleted;
+	};
+
+	/** Pop and run every job due at or before Now */
+	void ProcessDueJobs(double Now);
+
+	/** Resolve a handle to its live job, or null if stale */
+	FJob* FindJob(const FAstroJobHandle& Handle);
+	const FJob* FindJob(const FAstroJobHandle& Handle) const;
+
+	/** Remove a job from the heap and recycle its slot */
+	void ReleaseJob(int32 JobIndex);
+
+	/** Heap ordering: earlier completion first, FIFO on ties */
+	bool HeapLess(int32 A, int32 B) const;
+	void HeapSwap(int32 A, int32 B);
+	void SiftUp(int32 HeapIndex);
+	void SiftDown(int32 HeapIndex);
+	void HeapRemoveAt(int32 HeapIndex);
+
+	/** Job slots, recycled through FreeJobs */
+	TArray<FJob> Jobs;
+	TArray<int32> FreeJobs;
+
+	/** Binary min-heap of job slot indices */
+	TArray<int32> Heap;
+
+	uint64 NextSequence = 0;
+	uint32 NextSerial = 1;
+
+	/** Time skipped ahead of world time by catch-up */
+	double SimulationTimeOffset = 0.0;
+};
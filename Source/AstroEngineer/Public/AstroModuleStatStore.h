@@ -0,0 +1,104 @@
+// Copyright Astro Engineer Team. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "AstroModuleStatStore.generated.h"
+
+class AAstroShipModule;
+enum class EShipModuleType : uint8;
+
+/**
+ * Handle to a module's row in UAstroModuleStatStore.
+ * Handles go stale once the row is released.
+ */
+struct FAstroModuleStatHandle
+{
+	int32 Index = INDEX_NONE;
+	uint32 Serial = 0;
+
+	bool IsValid() const { return Index != INDEX_NONE; }
+	void Invalidate() { Index = INDEX_NONE; Serial = 0; }
+};
+
+/** Stat sums over a set of modules */
+struct FAstroModuleStatTotals
+{
+	double Mass = 0.0;
+	double PowerConsumption = 0.0;
+	double PowerGeneration = 0.0;
+	double Thrust = 0.0;
+	int64 CrewCapacity = 0;
+	int32 ModuleCount = 0;
+};
+
+/**
+ * Structure-of-arrays storage for the stats of every ship module in the world.
+ * Each stat is a contiguous column indexed by a dense row; rows are swap-removed on release so the columns
+ * never have holes and whole-fleet sums are straight loops over packed floats. Module actors read and write
+ * their stats through a handle instead of holding them as fields.
+ */
+UCLASS()
+class ASTROENGINEER_API UAstroModuleStatStore : public UWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	/** Add a row initialized from the module's authored stats */
+	FAstroModuleStatHandle Register(const AAstroShipModule& Module);
+
+	/** Remove a row and invalidate the handle */
+	void Release(FAstroModuleStatHandle& Handle);
+
+	bool IsValid(const FAstroModuleStatHandle& Handle) const;
+
+	EShipModuleType GetModuleType(const FAstroModuleStatHandle& Handle) const { return ModuleTypes[GetRow(Handle)]; }
+	float GetMass(const FAstroModuleStatHandle& Handle) const { return Masses[GetRow(Handle)]; }
+	float GetPowerConsumption(const FAstroModuleStatHandle& Handle) const { return PowerConsumptions[GetRow(Handle)]; }
+	float GetPowerGeneration(const FAstroModuleStatHandle& Handle) const { return PowerGenerations[GetRow(Handle)]; }
+	int32 GetCrewCapacity(const FAstroModuleStatHandle& Handle) const { return CrewCapacities[GetRow(Handle)]; }
+	float GetThrust(const FAstroModuleStatHandle& Handle) const { return Thrusts[GetRow(Handle)]; }
+
+	void SetModuleType(const FAstroModuleStatHandle& Handle, EShipModuleType Value) { ModuleTypes[GetRow(Handle)] = Value; }
+	void SetMass(const FAstroModuleStatHandle& Handle, float Value) { Masses[GetRow(Handle)] = Value; }
+	void SetPowerConsumption(const FAstroModuleStatHandle& Handle, float Value) { PowerConsumptions[GetRow(Handle)] = Value; }
+	void SetPowerGeneration(const FAstroModuleStatHandle& Handle, float Value) { PowerGenerations[GetRow(Handle)] = Value; }
+	void SetCrewCapacity(const FAstroModuleStatHandle& Handle, int32 Value) { CrewCapacities[GetRow(Handle)] = Value; }
+	void SetThrust(const FAstroModuleStatHandle& Handle, float Value) { Thrusts[GetRow(Handle)] = Value; }
+
+	/** Sum every registered module */
+	FAstroModuleStatTotals SumAllModules() const;
+
+	/** Sum a subset of modules, e.g. one ship or fleet */
+	FAstroModuleStatTotals SumModules(TArrayView<const FAstroModuleStatHandle> Handles) const;
+
+	int32 NumModules() const { return Masses.Num(); }
+
+	/** Raw columns, parallel and densely packed */
+	TArrayView<const float> GetMassColumn() const { return Masses; }
+	TArrayView<const float> GetPowerConsumptionColumn() const { return PowerConsumptions; }
+	TArrayView<const float> GetPowerGenerationColumn() const { return PowerGenerations; }
+	TArrayView<const int32> GetCrewCapacityColumn() const { return CrewCapacities; }
+	TArrayView<const float> GetThrustColumn() const { return Thrusts; }
+	TArrayView<const EShipModuleType> GetModuleTypeColumn() const { return ModuleTypes; }
+
+private:
+	int32 GetRow(const FAstroModuleStatHandle& Handle) const;
+
+	/** Dense columns */
+	TArray<float> Masses;
+	TArray<float> PowerConsumptions;
+	TArray<float> PowerGenerations;
+	TArray<int32> CrewCapacities;
+	TArray<float> Thrusts;
+	TArray<EShipModuleType> ModuleTypes;
+
+	/** Slot owning each dense row, used to patch the moved row on swap-remove */
+	TArray<int32> RowSlots;
+
+	/** Handle slot -> dense row, INDEX_NONE when free */
+	TArray<int32> SlotRows;
+	TArray<uint32> SlotSerials;
+	TArray<int32> FreeSlots;
+};
@@ -0,0 +1,210 @@
+// Copyright Astro Engineer Team. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "AstroOrbitalMath.h"
+
+/**
+ * Handle to a craft in FAstroOrbitPropagator.
+ * Handles go stale once the craft is removed.
+ */
+struct FAstroOrbitHandle
+{
+	int32 Index = INDEX_NONE;
+	uint32 Serial = 0;
+
+	bool IsValid() const { return Index != INDEX_NONE; }
+	void Invalidate() { Index = INDEX_NONE; Serial = 0; }
+	bool operator==(const FAstroOrbitHandle& Other) const { return Index == Other.Index && Serial == Other.Serial; }
+};
+
+/**
+ * A gravitating body, itself on rails around its parent
+ */
+struct ASTROENGINEER_API FAstroCelestialBody
+{
+	FName Name;
+
+	/** G * M, in m^3/s^2 */
+	double GravitationalParameter = 0.0;
+
+	/** Mean surface radius in metres */
+	double Radius = 0.0;
+
+	/** Body this one orbits, or INDEX_NONE for the root */
+	int32 ParentIndex = INDEX_NONE;
+
+	/** Orbit around the parent; unused for the root */
+	FAstroOrbitalElements Orbit;
+
+	/** Beyond this distance craft switch to the parent's conic */
+	double SphereOfInfluence = TNumericLimits<double>::Max();
+
+	/** State at the last update, relative to the parent and to the root */
+	FVector PositionInParent = FVector::ZeroVector;
+	FVector VelocityInParent = FVector::ZeroVector;
+	FVector RootPosition = FVector::ZeroVector;
+	FVector RootVelocity = FVector::ZeroVector;
+};
+
+/**
+ * Double-precision patched-conic propagator.
+ * Coasting craft sit on analytic rails: their conic lives in packed structure-of-arrays columns and each update solves
+ * Kepler's equation for the current time, so there is no numerical drift and no per-frame integration. Craft under thrust
+ * switch to a fixed-step leapfrog integrator and go back on rails from their final state when the thrust stops.
+ * Leaving a body's sphere of influence, or entering a child's, re-expresses the craft relative to the new body.
+ * Coasting craft step from event to event inside a long Advance, so a warped frame cannot carry them past a sphere of
+ * influence boundary or through a body's surface. Craft that hit a surface stay landed there until given thrust or a new state.
+ */
+struct ASTROENGINEER_API FAstroOrbitPropagator
+{
+public:
+	/** Add a body; parents must be added before their children. Returns its index. */
+	int32 AddBody(FName Name, double GravitationalParameter, double Radius, int32 ParentIndex, const FAstroOrbitalElements& Orbit);
+
+	int32 FindBody(FName Name) const;
+	int32 NumBodies() const { return Bodies.Num(); }
+	const FAstroCelestialBody& GetBody(int32 BodyIndex) const { return Bodies[BodyIndex]; }
+	const TArray<FAstroCelestialBody>& GetBodies() const { return Bodies; }
+
+	/** Add a coasting craft with a state relative to a body */
+	FAstroOrbitHandle AddCraft(int32 BodyIndex, const FVector& Position, const FVector& Velocity);
+
+	/** Remove a craft and invalidate the handle */
+	void RemoveCraft(FAstroOrbitHandle& Handle);
+
+	bool IsValid(const FAstroOrbitHandle& Handle) const;
+
+	/** Engine acceleration in m/s^2, in the root frame's axes. Zero puts the craft back on rails. */
+	void SetCraftThrust(const FAstroOrbitHandle& Handle, const FVector& Acceleration);
+
+	/** Stop every burn and put all craft back on rails */
+	void CutAllThrust();
+
+	/** Replace a craft's state, e.g. after a physics burn handled elsewhere */
+	void SetCraftState(const FAstroOrbitHandle& Handle, int32 BodyIndex, const FVector& Position, const FVector& Velocity);
+
+	bool IsCraftOnRails(const FAstroOrbitHandle& Handle) const { return !ThrustingCraft[GetRow(Handle)]; }
+	bool IsCraftLanded(const FAstroOrbitHandle& Handle) const { return LandedCraft[GetRow(Handle)]; }
+	int32 GetCraftBody(const FAstroOrbitHandle& Handle) const { return CraftBodies[GetRow(Handle)]; }
+
+	/** State relative to the craft's current body, as of the last update */
+	FVector GetCraftPosition(const FAstroOrbitHandle& Handle) const { return Positions[GetRow(Handle)]; }
+	FVector GetCraftVelocity(const FAstroOrbitHandle& Handle) const { return Velocities[GetRow(Handle)]; }
+
+	/** Position relative to the root body */
+	FVector GetCraftRootPosition(const FAstroOrbitHandle& Handle) const;
+
+	/** Conic the craft is on; osculating elements for a craft under thrust */
+	FAstroOrbitalElements GetCraftElements(const FAstroOrbitHandle& Handle) const;
+
+	int32 NumCraft() const { return Positions.Num(); }
+	int32 NumThrustingCraft() const { return NumThrusting; }
+
+	double GetTime() const { return Time; }
+
+	/** Advance by DeltaSeconds: bodies and coasting craft analytically, thrusting craft in fixed steps */
+	void Advance(double DeltaSeconds);
+
+	/** Craft that hit a body's surface during the last Advance */
+	const TArray<FAstroOrbitHandle>& GetImpacts() const { return Impacts; }
+
+	/** Evaluate every coasting craft at the current time. Part of Advance; exposed for profiling. */
+	void PropagateOnRails();
+
+	/** Integration step for craft under thrust */
+	double ThrustStepSeconds = 0.02;
+
+	/** Cap on integration steps per craft per Advance, so a long frame cannot stall the game */
+	int32 MaxThrustStepsPerAdvance = 250;
+
+	/** Shortest wait before re-checking a craft for entering a child's sphere of influence */
+	double MinEventCheckSeconds = 1.0;
+
+	/** Cap on event steps per craft per Advance; a craft still short of its events is caught up by PatchConics */
+	int32 MaxEventStepsPerAdvance = 64;
+
+private:
+	int32 GetRow(const FAstroOrbitHandle& Handle) const;
+
+	/** Update every body's state for the current time */
+	void UpdateBodies();
+
+	/** Step every thrusting craft through whole integration steps */
+	void IntegrateThrusting(double DeltaSeconds);
+
+	/** Step coasting craft through every event due before EndTime, at the time it happens */
+	void ResolveEvents(double EndTime);
+
+	/** Handle whatever is due for a coasting craft at EventTime: an impact, a sphere of influence change, or a re-check */
+	void ResolveEvent(int32 Row, double EventTime);
+
+	/** Move craft that crossed a sphere of influence boundary or hit the surface since the last update */
+	void PatchConics();
+
+	/** Derive a craft's rail columns from its current state, valid at StateTime */
+	void PutOnRails(int32 Row, double StateTime);
+
+	/** Earliest time a coasting craft could leave its body, hit it, or enter a child's sphere of influence after StateTime */
+	void UpdateNextEventTime(int32 Row, double StateTime);
+
+	/** Stop a craft on its body's surface below its current position */
+	void LandCraft(int32 Row);
+
+	/** Re-express a craft relative to another body */
+	void ChangeBody(int32 Row, int32 NewBodyIndex);
+
+	double Time = 0.0;
+	double ThrustStepRemainder = 0.0;
+
+	TArray<FAstroCelestialBody> Bodies;
+
+	/** Children of body B live in [ChildOffsets[B], ChildOffsets[B + 1]) */
+	TArray<int32> ChildOffsets;
+	TArray<int32> ChildBodies;
+
+	/** Rail columns: the conic of each coasting craft in its body's frame */
+	TArray<double> SemiMajorAxes;
+	TArray<double> Eccentricities;
+	TArray<double> MeanMotions;
+	TArray<double> MeanAnomaliesAtEpoch;
+	TArray<double> Epochs;
+	TArray<double> GravitationalParameters;
+	TArray<FVector> PerifocalPs;
+	TArray<FVector> PerifocalQs;
+
+	/** Cold copy of each craft's elements for queries */
+	TArray<FAstroOrbitalElements> CraftElements;
+
+	/** Time by which each coasting craft must be checked for events; infinity for craft under thrust or landed */
+	TArray<double> NextEventTimes;
+
+	/** Current state relative to the craft's body */
+	TArray<FVector> Positions;
+	TArray<FVector> Velocities;
+	TArray<int32> CraftBodies;
+
+	/** Engine acceleration of each craft, and which craft are off rails because of it */
+	TArray<FVector> ThrustAccelerations;
+	TBitArray<> ThrustingCraft;
+	int32 NumThrusting = 0;
+
+	/** Craft resting on their body's surface */
+	TBitArray<> LandedCraft;
+	TArray<FAstroOrbitHandle> Impacts;
+
+	/** Slot owning each dense row, used to patch the moved row on swap-remove */
+	TArray<int32> RowSlots;
+
+	/** Handle slot -> dense row, INDEX_NONE when free */
+	TArray<int32> SlotRows;
+	TArray<uint32> SlotSerials;
+	TArray<int32> FreeSlots;
+
+	/** Per-update scratch for the batched Kepler solve, kept to avoid reallocating every frame */
+	TArray<double> MeanAnomalyScratch;
+	TArray<double> AnomalyScratch;
+	TArray<double> SineScratch;
+	TArray<double> CosineScratch;
+};
@@ -0,0 +1,89 @@
+// Copyright Astro Engineer Team. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * Classical Keplerian elements of a two-body orbit, in SI units (metres, seconds, radians).
+ * Elliptic orbits have SemiMajorAxis > 0 and Eccentricity < 1; hyperbolic ones SemiMajorAxis < 0 and Eccentricity > 1.
+ */
+struct ASTROENGINEER_API FAstroOrbitalElements
+{
+	double SemiMajorAxis = 0.0;
+	double Eccentricity = 0.0;
+	double Inclination = 0.0;
+	double LongitudeOfAscendingNode = 0.0;
+	double ArgumentOfPeriapsis = 0.0;
+
+	/** Mean anomaly at Epoch */
+	double MeanAnomalyAtEpoch = 0.0;
+	double Epoch = 0.0;
+
+	bool IsHyperbolic() const { return Eccentricity >= 1.0; }
+
+	double GetPeriapsisRadius() const { return SemiMajorAxis * (1.0 - Eccentricity); }
+
+	/** Apoapsis distance, or infinity for an escape trajectory */
+	double GetApoapsisRadius() const;
+
+	/** Mean motion in rad/s around a body with the given gravitational parameter */
+	double GetMeanMotion(double GravitationalParameter) const;
+
+	/** Orbital period, or infinity for an escape trajectory */
+	double GetPeriod(double GravitationalParameter) const;
+
+	/** Unit vectors towards periapsis (P) and 90 degrees ahead of it in the orbital plane (Q) */
+	void GetPerifocalBasis(FVector& OutP, FVector& OutQ) const;
+};
+
+/**
+ * Two-body orbit math in double precision.
+ * Positions and velocities are relative to the central body, in metres and metres per second.
+ */
+struct ASTROENGINEER_API FAstroOrbitalMath
+{
+	/** Eccentric anomaly E solving M = E - e sin E, for e < 1 */
+	static double SolveKeplerElliptic(double MeanAnomaly, double Eccentricity);
+
+	/**
+	 * Solve the elliptic Kepler equation for many orbits at once, four lanes per SIMD register.
+	 * Writes E and its sine and cosine, which is all StateFromEllipticAnomaly needs. Eccentricities of 1 or more
+	 * are clamped to keep their lanes finite; solve those with SolveKeplerHyperbolic instead.
+	 */
+	static void SolveKeplerEllipticBatch(TArrayView<const double> MeanAnomalies, TArrayView<const double> Eccentricities,
+		TArrayView<double> OutAnomalies, TArrayView<double> OutSines, TArrayView<double> OutCosines);
+
+	/** One orbit at a time with the scalar solver; the reference SolveKeplerEllipticBatch is checked against */
+	static void SolveKeplerEllipticBatchReference(TArrayView<const double> MeanAnomalies, TArrayView<const double> Eccentricities,
+		TArrayView<double> OutAnomalies, TArrayView<double> OutSines, TArrayView<double> OutCosines);
+
+	/** Hyperbolic anomaly H solving M = e sinh H - H, for e > 1 */
+	static double SolveKeplerHyperbolic(double MeanAnomaly, double Eccentricity);
+
+	/** Osculating elements of a state vector at Time */
+	static FAstroOrbitalElements ElementsFromState(const FVector& Position, const FVector& Velocity, double GravitationalParameter, double Time);
+
+	/** Position and velocity on an orbit at Time */
+	static void StateAtTime(const FAstroOrbitalElements& Elements, double GravitationalParameter, double Time, FVector& OutPosition, FVector& OutVelocity);
+
+	/** Position and velocity from an anomaly (eccentric or hyperbolic) in the perifocal frame given by P and Q */
+	static void StateFromAnomaly(double Anomaly, double SemiMajorAxis, double Eccentricity, double GravitationalParameter,
+		const FVector& P, const FVector& Q, FVector& OutPosition, FVector& OutVelocity);
+
+	/** Position and velocity on an ellipse from the sine and cosine of the eccentric anomaly */
+	static void StateFromEllipticAnomaly(double SinE, double CosE, double SemiMajorAxis, double Eccentricity, double GravitationalParameter,
+		const FVector& P, const FVector& Q, FVector& OutPosition, FVector& OutVelocity);
+
+	/** Speed changes of a two-burn Hohmann transfer between circular orbits, and the coast time between them */
+	static void HohmannTransfer(double FromRadius, double ToRadius, double GravitationalParameter, double& OutDepartureDeltaV, double& OutArrivalDeltaV, double& OutTransferTime);
+
+	/** First time after After at which the conic crosses Radius going outwards or inwards, or infinity */
+	static double FindRadiusCrossing(const FAstroOrbitalElements& Elements, double GravitationalParameter, double Radius, double After, bool bOutward);
+
+	/** Sphere of influence radius of a body orbiting its parent */
+	static double SphereOfInfluence(double SemiMajorAxis, double GravitationalParameter, double ParentGravitationalParameter);
+
+	/** Map an angle to [-PI, PI) */
+	static double WrapAngle(double Angle);
+};
@@ -0,0 +1,70 @@
+// Copyright Astro Engineer Team. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "AstroOrbitPropagator.h"
+#include "AstroTrajectoryCache.h"
+#include "AstroFloatingOrigin.h"
+#include "AstroOrbitalSubsystem.generated.h"
+
+/**
+ * Owns the world's celestial bodies and every craft flying between them.
+ * Each frame the propagator advances by the frame time times the time warp rate: coasting craft are evaluated analytically from their conics
+ * and only craft under thrust are integrated. Ships in orbit are then placed in world space around the floating origin.
+ */
+UCLASS()
+class ASTROENGINEER_API UAstroOrbitalSubsystem : public UTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+	virtual void Deinitialize() override;
+	virtual void Tick(float DeltaTime) override;
+	virtual TStatId GetStatId() const override;
+
+	/** Add a body orbiting a named parent, or the root body when ParentName is None */
+	UFUNCTION(BlueprintCallable, Category = "Orbit")
+	int32 AddBody(FName Name, double GravitationalParameter, double Radius, FName ParentName, double SemiMajorAxis, double Eccentricity,
+		double Inclination = 0.0, double LongitudeOfAscendingNode = 0.0, double ArgumentOfPeriapsis = 0.0, double MeanAnomalyAtEpoch = 0.0);
+
+	UFUNCTION(BlueprintPure, Category = "Orbit")
+	int32 FindBody(FName Name) const { return Propagator.FindBody(Name); }
+
+	/** Seconds since the orbital clock started */
+	UFUNCTION(BlueprintPure, Category = "Orbit")
+	double GetUniversalTime() const { return Propagator.GetTime(); }
+
+	FAstroOrbitPropagator& GetPropagator() { return Propagator; }
+	const FAstroOrbitPropagator& GetPropagator() const { return Propagator; }
+
+	/** Predicted trajectories and maneuver nodes of the craft shown in map view */
+	FAstroTrajectoryCache& GetTrajectoryCache() { return TrajectoryCache; }
+
+	/** Maps root-body coordinates to world space around the active vessel */
+	FAstroFloatingOrigin& GetFloatingOrigin() { return FloatingOrigin; }
+	const FAstroFloatingOrigin& GetFloatingOrigin() const { return FloatingOrigin; }
+
+	/** Wall-clock seconds the last propagation step took */
+	double GetLastAdvanceSeconds() const { return LastAdvanceSeconds; }
+
+	/** World location of a body's centre, from its double-precision root position */
+	UFUNCTION(BlueprintPure, Category = "Orbit")
+	FVector GetBodyWorldLocation(int32 BodyIndex) const;
+
+private:
+	/** Streamed-in levels join the world at their authored place, so they are sorted around the bubble when added */
+	void HandleLevelAddedToWorld(ULevel* Level, UWorld* World);
+
+	/** New actors join the floating origin's local set */
+	void HandleActorSpawned(AActor* Actor);
+
+	FDelegateHandle ActorSpawnedHandle;
+
+	FAstroOrbitPropagator Propagator;
+	FAstroTrajectoryCache TrajectoryCache;
+	FAstroFloatingOrigin FloatingOrigin;
+	double LastAdvanceSeconds = 0.0;
+};
@@ -25,7 +25,6 @@ class ASTROENGINEER_API AAstroPlayerCharacter : public ACharacter
 public:
 	AAstroPlayerCharacter();
 
-	virtual void Tick(float DeltaTime) override;
 	virtual void SetupPlayerInputComponent(class UInputComponent* PlayerInputComponent) override;
 
 protected:
@@ -0,0 +1,68 @@
+// Copyright Astro Engineer Team. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/SaveGame.h"
+#include "AstroProgressionSaveGame.generated.h"
+
+/**
+ * Layout version of the progression payload.
+ * Component SerializeProgress implementations read it with Ar.CustomVer(FAstroProgressionVersion::GUID).
+ */
+struct ASTROENGINEER_API FAstroProgressionVersion
+{
+	enum Type : int32
+	{
+		// Unlock bitsets tied to the content layout; never shipped, and rejected on load
+		Initial = 1,
+
+		// Recipe and research unlocks saved as ID tables instead of bitsets tied to the content layout
+		UnlockIdTables,
+
+		// Finished crafting results waiting for inventory space
+		BlockedCraftOutputs,
+
+		VersionPlusOne,
+		Latest = VersionPlusOne - 1,
+		Oldest = UnlockIdTables
+	};
+
+	static const FGuid GUID;
+};
+
+/**
+ * Player progression (inventory quantities, recipe and research unlocks, in-flight jobs) packed into one byte payload.
+ * Each component writes only its changing state through SerializeProgress, so recipe and node definitions never reach the save.
+ */
+UCLASS()
+class ASTROENGINEER_API UAstroProgressionSaveGame : public USaveGame
+{
+	GENERATED_BODY()
+
+public:
+	/** Snapshot the progression components of an actor into Payload */
+	bool CaptureProgress(AActor* Player);
+
+	/** Restore the progression components of an actor from Payload, with their jobs run forward by OfflineSeconds */
+	bool ApplyProgress(AActor* Player, double OfflineSeconds = 0.0) const;
+
+	/** Capture on the game thread and write the slot on a worker thread, logging size and timings when done */
+	UFUNCTION(BlueprintCallable, Category = "Progression", meta = (DefaultToSelf = "Player"))
+	static bool AsyncSaveProgress(AActor* Player, const FString& SlotName, int32 UserIndex = 0);
+
+	/** Load a slot written by AsyncSaveProgress, apply it and run its jobs forward by the real time since the save */
+	UFUNCTION(BlueprintCallable, Category = "Progression", meta = (DefaultToSelf = "Player"))
+	static bool LoadProgress(AActor* Player, const FString& SlotName, int32 UserIndex = 0);
+
+	/** FAstroProgressionVersion the payload was written with */
+	UPROPERTY()
+	int32 PayloadVersion;
+
+	UPROPERTY()
+	TArray<uint8> Payload;
+
+	/** UTC time of the capture, used to catch production up on load; unset in saves from before offline progress */
+	UPROPERTY()
+	FDateTime SaveTimestamp;
+};
@@ -0,0 +1,76 @@
+// Copyright Astro Engineer Team. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+struct FCraftingRecipe;
+
+/**
+ * Immutable, compiled form of a recipe list.
+ * Recipes are stored as parallel arrays by dense recipe index (matching the source array),
+ * ingredients as flat spans of dense item indices, and each item keeps the list of recipes consuming it.
+ */
+struct ASTROENGINEER_API FAstroRecipeDatabase
+{
+public:
+	/** Compile the database from a recipe list, replacing any previous contents */
+	void Build(TArrayView<const FCraftingRecipe> Recipes);
+
+	/** Drop all compiled data */
+	void Reset();
+
+	/** Bumped by every Build, so callers holding recipe indices can tell when they went stale */
+	uint32 GetBuildSerial() const { return BuildSerial; }
+
+	int32 NumRecipes() const { return RecipeIDs.Num(); }
+	int32 NumItems() const { return ItemNames.Num(); }
+
+	/** Dense index of a recipe, or INDEX_NONE. Duplicate IDs resolve to the first entry. */
+	int32 FindRecipeIndex(FName RecipeID) const;
+
+	/** Dense index of an item referenced by any recipe, or INDEX_NONE */
+	int32 FindItemIndex(FName ItemID) const;
+
+	FName GetRecipeID(int32 RecipeIndex) const { return RecipeIDs[RecipeIndex]; }
+	FName GetItemName(int32 ItemIndex) const { return ItemNames[ItemIndex]; }
+	int32 GetResultItem(int32 RecipeIndex) const { return ResultItems[RecipeIndex]; }
+	int32 GetResultQuantity(int32 RecipeIndex) const { return ResultQuantities[RecipeIndex]; }
+	float GetCraftingTime(int32 RecipeIndex) const { return CraftingTimes[RecipeIndex]; }
+
+	/** Ingredient item indices of a recipe, parallel to GetIngredientCounts */
+	TArrayView<const int32> GetIngredientItems(int32 RecipeIndex) const;
+
+	/** Ingredient quantities of a recipe, parallel to GetIngredientItems */
+	TArrayView<const int32> GetIngredientCounts(int32 RecipeIndex) const;
+
+	/** Recipes that consume the given item */
+	TArrayView<const int32> GetRecipesUsingItem(int32 ItemIndex) const;
+
+	/** Append every recipe consuming any of the given items to OutRecipes, each at most once */
+	void GatherRecipesUsingItems(TArrayView<const FName> ItemIDs, TArray<int32>& OutRecipes) const;
+
+private:
+	int32 AddItem(FName ItemID);
+
+	uint32 BuildSerial = 0;
+
+	TMap<FName, int32> RecipeIndexByID;
+	TMap<FName, int32> ItemIndexByName;
+	TArray<FName> ItemNames;
+
+	/** Per-recipe columns */
+	TArray<FName> RecipeIDs;
+	TArray<int32> ResultItems;
+	TArray<int32> ResultQuantities;
+	TArray<float> CraftingTimes;
+
+	/** Ingredients of recipe R live in [IngredientOffsets[R], IngredientOffsets[R + 1]) */
+	TArray<int32> IngredientOffsets;
+	TArray<int32> IngredientItems;
+	TArray<int32> IngredientCounts;
+
+	/** Consumers of item I live in [ConsumerOffsets[I], ConsumerOffsets[I + 1]) */
+	TArray<int32> ConsumerOffsets;
+	TArray<int32> ConsumerRecipes;
+};
@@ -4,8 +4,13 @@
 
 #include "CoreMinimal.h"
 #include "Components/ActorComponent.h"
+#include "AstroJobScheduler.h"
+#include "AstroResearchGraph.h"
 #include "AstroResearchComponent.generated.h"
 
+class UAstroCraftingComponent;
+class UAstroInventoryComponent;
+
 /**
  * Research node structure
  */
@@ -41,8 +46,9 @@ struct FResearchNode
 	UPROPERTY(EditAnywhere, BlueprintReadWrite)
 	UTexture2D* Icon;
 
+	/** Node starts out researched. Runtime unlock state lives in the component, see IsNodeUnlocked. */
 	UPROPERTY(EditAnywhere, BlueprintReadWrite)
-	bool bIsUnlocked;
+	bool bUnlockedAtStart;
 
 	FResearchNode()
 		: NodeID(NAME_None)
@@ -50,7 +56,48 @@ struct FResearchNode
 		, Description(FText::GetEmpty())
 		, ResearchTime(10.0f)
 		, Icon(nullptr)
-		, bIsUnlocked(false)
+		, bUnlockedAtStart(false)
+	{}
+};
+
+/**
+ * A node being researched in one of the component's research slots
+ */
+USTRUCT(BlueprintType)
+struct FResearchJob
+{
+	GENERATED_BODY()
+
+	UPROPERTY(BlueprintReadOnly)
+	FName NodeID;
+
+	/** Simulation time the research started (see UAstroJobScheduler) */
+	UPROPERTY(BlueprintReadOnly)
+	double StartTime;
+
+	/** Simulation time the research completes at the current lab count */
+	UPROPERTY(BlueprintReadOnly)
+	double EndTime;
+
+	/** Base research seconds the node takes with a single lab */
+	double TotalWork;
+
+	/** Base research seconds left as of RateChangeTime */
+	double RemainingWork;
+
+	/** Simulation time of the last lab count change affecting this job */
+	double RateChangeTime;
+
+	/** Scheduler entry firing at EndTime */
+	FAstroJobHandle CompletionHandle;
+
+	FResearchJob()
+		: NodeID(NAME_None)
+		, StartTime(0.0)
+		, EndTime(0.0)
+		, TotalWork(0.0)
+		, RemainingWork(0.0)
+		, RateChangeTime(0.0)
 	{}
 };
 
@@ -65,9 +112,7 @@ class ASTROENGINEER_API UAstroResearchComponent : public UActorComponent
 public:	
 	UAstroResearchComponent();
 
-	virtual void TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
-
-	/** Check if can research node */
+	/** Check if can research node: available, not already in progress, resources in the inventory and a free slot */
 	UFUNCTION(BlueprintCallable, Category = "Research")
 	bool CanResearchNode(FName NodeID) const;
 
@@ -75,31 +120,111 @@ public:
 	UFUNCTION(BlueprintCallable, Category = "Research")
 	bool StartResearch(FName NodeID);
 
-	/** Cancel current research */
+	/** Cancel all research in progress, refunding resources */
 	UFUNCTION(BlueprintCallable, Category = "Research")
 	void CancelResearch();
 
+	/** Cancel research of one node, refunding its resources */
+	UFUNCTION(BlueprintCallable, Category = "Research")
+	bool CancelResearchNode(FName NodeID);
+
+	/** Progress (0-1) of the first research in progress */
+	UFUNCTION(BlueprintPure, Category = "Research")
+	float GetResearchProgress() const;
+
+	/** Progress (0-1) of a node being researched, computed analytically from the work left */
+	UFUNCTION(BlueprintPure, Category = "Research")
+	float GetNodeResearchProgress(FName NodeID) const;
+
+	/** Set the number of labs contributing to research; running research is retimed to the new rate */
+	UFUNCTION(BlueprintCallable, Category = "Research")
+	void SetLabCount(int32 NewLabCount);
+
+	/** Research speed multiplier for the current lab count */
+	UFUNCTION(BlueprintPure, Category = "Research")
+	float GetResearchRate() const;
+
 	/** Get all research nodes */
 	UFUNCTION(BlueprintCallable, Category = "Research")
 	TArray<FResearchNode> GetAllResearchNodes() const { return ResearchNodes; }
 
+	/** Read-only view of all research nodes without copying */
+	TArrayView<const FResearchNode> GetAllResearchNodesView() const { return ResearchNodes; }
+
 	/** Get available research nodes */
 	UFUNCTION(BlueprintCallable, Category = "Research")
 	TArray<FResearchNode> GetAvailableResearchNodes() const;
 
+	/** Cached available nodes, rebuilt only after unlock state changes */
+	const TArray<FResearchNode>& GetAvailableResearchNodesRef() const;
+
+	/** Visit each researchable node without copying */
+	void ForEachAvailableResearchNode(TFunctionRef<void(const FResearchNode&)> Visitor) const;
+
+	/** Compiled research tree, rebuilt at BeginPlay and by NotifyResearchNodesChanged */
+	const FAstroResearchGraph& GetResearchGraph() const { return ResearchGraph; }
+
+	/** Call after editing ResearchNodes directly so cached views are rebuilt */
+	UFUNCTION(BlueprintCallable, Category = "Research")
+	void NotifyResearchNodesChanged();
+
+	/** Mark a node researched without paying or waiting (cheats, tutorials, scripted rewards) and grant its recipes */
+	UFUNCTION(BlueprintCallable, Category = "Research")
+	bool UnlockNode(FName NodeID);
+
 	/** Check if node is unlocked */
 	UFUNCTION(BlueprintCallable, Category = "Research")
 	bool IsNodeUnlocked(FName NodeID) const;
 
+	/** Check if an unlocked node lists the item in UnlocksItems */
+	UFUNCTION(BlueprintPure, Category = "Research")
+	bool IsItemUnlocked(FName ItemID) const { return UnlockedItems.Contains(ItemID); }
+
+	/**
+	 * Read or write the unlocked node IDs and running research for a progression save.
+	 * Running jobs keep their remaining work and are retimed against the current lab count on load, as if they had kept
+	 * running for ElapsedSeconds; the scheduler completes whatever fell due.
+	 */
+	void SerializeProgress(FArchive& Ar, double ElapsedSeconds = 0.0);
+
 protected:
 	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+	/** Scheduler callback: complete research of a node */
+	void CompleteResearch(double CompletionTime, FName NodeID);
+
+	/** Mirror the first running job into CurrentResearchNode and friends */
+	void UpdateResearchState();
+
+	int32 FindResearchJobIndex(FName NodeID) const;
 
-	/** Complete current research */
-	void CompleteResearch();
+	UAstroJobScheduler* GetJobScheduler() const;
+
+	/** Production clock shared with every other scheduled job */
+	double GetSimulationTime() const;
 
 	/** Find research node */
 	FResearchNode* FindNode(FName NodeID);
 
+	/** Recompile the research graph, keeping nodes unlocked so far */
+	void RebuildResearchGraph();
+
+	/** Recompute locked prerequisite counts and available nodes from UnlockedNodes */
+	void RecountAvailableNodes();
+
+	/** Mark a node researched and make newly satisfied dependents available */
+	void UnlockNodeIndex(int32 NodeIndex);
+
+	/** Map each node's UnlocksRecipes to crafting database indices, if the database changed since last time */
+	void ResolveRecipeUnlocks();
+
+	/** Grant the recipes and items of unlocked nodes, with one unlock broadcast each for the whole batch */
+	void GrantNodeUnlocks(TArrayView<const int32> NodeIndices);
+
+	/** Grant the recipes and items of every unlocked node */
+	void GrantAllNodeUnlocks();
+
 public:	
 	/** All research nodes */
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Research")
@@ -109,20 +234,76 @@ public:
 	UPROPERTY(BlueprintReadOnly, Category = "Research")
 	FName CurrentResearchNode;
 
-	/** Research progress (0-1) */
-	UPROPERTY(BlueprintReadOnly, Category = "Research")
-	float ResearchProgress;
-
 	/** Is currently researching */
 	UPROPERTY(BlueprintReadOnly, Category = "Research")
 	bool bIsResearching;
 
+	/** Research in progress, one per occupied slot */
+	UPROPERTY(BlueprintReadOnly, Category = "Research")
+	TArray<FResearchJob> ResearchJobs;
+
+	/** Number of nodes that can be researched at the same time */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Research", meta = (ClampMin = "1"))
+	int32 MaxConcurrentResearch;
+
+	/** Labs contributing to research, see SetLabCount */
+	UPROPERTY(BlueprintReadOnly, Category = "Research")
+	int32 LabCount;
+
+	/** Extra research speed each lab beyond the first adds (0.5 = +50%) */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Research", meta = (ClampMin = "0.0"))
+	float SpeedBonusPerExtraLab;
+
 	/** Delegate called when research completes */
 	DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnResearchCompleted, FName, NodeID);
 	UPROPERTY(BlueprintAssignable, Category = "Research")
 	FOnResearchCompleted OnResearchCompleted;
 
+	/** Delegate called once per unlock batch with the items it unlocked */
+	DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnItemsUnlocked, const TArray<FName>&, ItemIDs);
+	UPROPERTY(BlueprintAssignable, Category = "Research")
+	FOnItemsUnlocked OnItemsUnlocked;
+
+	/** Simulation time the first research in progress started (see UAstroJobScheduler) */
+	UPROPERTY(BlueprintReadOnly, Category = "Research")
+	double ResearchStartTime;
+
+	/** Simulation time the first research in progress completes */
+	UPROPERTY(BlueprintReadOnly, Category = "Research")
+	double ResearchEndTime;
+
+	/** Inventory on the same actor that pays for research */
+	UPROPERTY()
+	UAstroInventoryComponent* PlayerInventory;
+
+	/** Crafting component on the same actor that receives recipe unlocks */
+	UPROPERTY()
+	UAstroCraftingComponent* CraftingComponent;
+
 private:
-	float ResearchTimer;
-	float CurrentResearchTime;
+	/** Compiled, index-based view of ResearchNodes */
+	FAstroResearchGraph ResearchGraph;
+
+	/** Per-node unlock state */
+	TBitArray<> UnlockedNodes;
+
+	/** Nodes whose prerequisites are all unlocked and which are not unlocked themselves */
+	TBitArray<> AvailableNodes;
+
+	/** Per-node count of prerequisites still locked */
+	TArray<int32> LockedPrerequisiteCounts;
+
+	/** Recipe indices unlocked by node N live in [RecipeUnlockOffsets[N], RecipeUnlockOffsets[N + 1]) */
+	TArray<int32> RecipeUnlockOffsets;
+	TArray<int32> RecipeUnlockIndices;
+
+	/** Recipe database build the unlock indices were resolved against */
+	uint32 ResolvedRecipeSerial;
+
+	/** Items listed in UnlocksItems by any unlocked node */
+	TSet<FName> UnlockedItems;
+
+	/** Researchable nodes, valid while bAvailableNodesDirty is false */
+	mutable TArray<FResearchNode> AvailableNodesCache;
+	mutable bool bAvailableNodesDirty;
 };
@@ -0,0 +1,56 @@
+// Copyright Astro Engineer Team. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+struct FResearchNode;
+
+/**
+ * Compiled research tree.
+ * Nodes get dense indices (matching the source array); prerequisites and dependents are stored as CSR adjacency,
+ * alongside a topological order. Nodes that sit on a cycle or reference a missing prerequisite are flagged as blocked.
+ */
+struct ASTROENGINEER_API FAstroResearchGraph
+{
+public:
+	/** Compile the graph from a node list, logging cycles and missing prerequisites. Returns false if any node is blocked. */
+	bool Build(TArrayView<const FResearchNode> Nodes);
+
+	/** Drop all compiled data */
+	void Reset();
+
+	int32 NumNodes() const { return NodeIDs.Num(); }
+
+	/** Dense index of a node, or INDEX_NONE. Duplicate IDs resolve to the first entry. */
+	int32 FindNodeIndex(FName NodeID) const;
+
+	FName GetNodeID(int32 NodeIndex) const { return NodeIDs[NodeIndex]; }
+
+	/** Nodes that must be unlocked before this one */
+	TArrayView<const int32> GetPrerequisites(int32 NodeIndex) const;
+
+	/** Nodes listing this one as a prerequisite */
+	TArrayView<const int32> GetDependents(int32 NodeIndex) const;
+
+	/** Nodes ordered so every prerequisite precedes its dependents; blocked cycle members are left out */
+	TArrayView<const int32> GetTopologicalOrder() const { return TopologicalOrder; }
+
+	/** Node is on a cycle, downstream of one, or references a missing prerequisite, so it can never be researched */
+	bool IsBlocked(int32 NodeIndex) const { return BlockedNodes[NodeIndex]; }
+
+private:
+	TMap<FName, int32> NodeIndexByID;
+	TArray<FName> NodeIDs;
+
+	/** Prerequisites of node N live in [PrerequisiteOffsets[N], PrerequisiteOffsets[N + 1]) */
+	TArray<int32> PrerequisiteOffsets;
+	TArray<int32> PrerequisiteNodes;
+
+	/** Dependents of node N live in [DependentOffsets[N], DependentOffsets[N + 1]) */
+	TArray<int32> DependentOffsets;
+	TArray<int32> DependentNodes;
+
+	TArray<int32> TopologicalOrder;
+	TBitArray<> BlockedNodes;
+};
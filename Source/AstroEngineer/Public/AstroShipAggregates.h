@@ -0,0 +1,75 @@
+// Copyright Astro Engineer Team. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "AstroShipModule.h"
+
+/** Stats one module contributes to its ship, captured when it is added so it can be subtracted exactly */
+struct ASTROENGINEER_API FAstroShipModuleContribution
+{
+	EShipModuleType ModuleType = EShipModuleType::Hull;
+	double Mass = 0.0;
+	double PowerConsumption = 0.0;
+	double PowerGeneration = 0.0;
+	int32 CrewCapacity = 0;
+	double Thrust = 0.0;
+
+	/** Module origin in ship space (the root module's frame) */
+	FVector Location = FVector::ZeroVector;
+
+	static FAstroShipModuleContribution FromModule(const AAstroShipModule& Module, const FVector& ShipSpaceLocation);
+};
+
+/**
+ * Running totals over a ship's modules.
+ * Modules are treated as point masses at their origin; the first and second mass moments are kept
+ * so center of mass and inertia can be derived at any time without walking the modules.
+ */
+struct ASTROENGINEER_API FAstroShipAggregates
+{
+public:
+	void Add(const FAstroShipModuleContribution& Contribution);
+	void Remove(const FAstroShipModuleContribution& Contribution);
+	void Reset();
+
+	double GetTotalMass() const { return TotalMass; }
+	double GetPowerGeneration() const { return PowerGeneration; }
+	double GetPowerConsumption() const { return PowerConsumption; }
+	double GetPowerBalance() const { return PowerGeneration - PowerConsumption; }
+	int32 GetCrewCapacity() const { return CrewCapacity; }
+	double GetTotalThrust() const { return TotalThrust; }
+	int32 GetModuleCount() const { return ModuleCount; }
+	int32 GetModuleCount(EShipModuleType ModuleType) const { return ModuleTypeCounts[static_cast<int32>(ModuleType)]; }
+
+	/** Center of mass in ship space, or the origin for a massless ship */
+	FVector GetCenterOfMass() const;
+
+	/** Inertia tensor about the center of mass, in ship space axes (mass units x cm^2) */
+	FMatrix GetInertiaTensor() const;
+
+	/** Diagonalized inertia: principal moments, and the rotation from principal axes to ship space */
+	void GetPrincipalInertia(FVector& OutMoments, FQuat& OutAxes) const;
+
+	/** Compare against another set of totals, allowing for floating point drift */
+	bool Equals(const FAstroShipAggregates& Other, double Tolerance) const;
+
+	FString ToString() const;
+
+private:
+	static constexpr int32 NumModuleTypes = static_cast<int32>(EShipModuleType::Hull) + 1;
+
+	double TotalMass = 0.0;
+	double PowerGeneration = 0.0;
+	double PowerConsumption = 0.0;
+	int32 CrewCapacity = 0;
+	double TotalThrust = 0.0;
+	int32 ModuleCount = 0;
+	int32 ModuleTypeCounts[NumModuleTypes] = {};
+
+	/** Sum of m * p */
+	FVector MassMoment = FVector::ZeroVector;
+
+	/** Sum of m * p * p^T, upper triangle: XX, YY, ZZ, XY, XZ, YZ */
+	double SecondMoment[6] = {};
+};
@@ -5,8 +5,17 @@
 #include "CoreMinimal.h"
 #include "GameFramework/Actor.h"
 #include "AstroShipModule.h"
+#include "AstroShipAggregates.h"
+#include "AstroConnectionSnapIndex.h"
+#include "AstroShipValidator.h"
+#include "AstroShipDesign.h"
+#include "AstroOrbitPropagator.h"
 #include "AstroShipAssembly.generated.h"
 
+class UInstancedStaticMeshComponent;
+class UAstroShipBodyComponent;
+struct FStreamableHandle;
+
 /**
  * Ship assembly manager for building modular spacecraft
  */
@@ -18,40 +27,228 @@ class ASTROENGINEER_API AAstroShipAssembly : public AActor
 public:	
 	AAstroShipAssembly();
 
-	virtual void Tick(float DeltaTime) override;
 
 	/** Add module to ship */
 	UFUNCTION(BlueprintCallable, Category = "Ship Assembly")
 	bool AddModule(TSubclassOf<AAstroShipModule> ModuleClass, AAstroShipModule* ParentModule, int32 ConnectionIndex);
 
-	/** Remove module from ship */
+	/** Remove a module and everything attached below it */
 	UFUNCTION(BlueprintCallable, Category = "Ship Assembly")
 	void RemoveModule(AAstroShipModule* Module);
 
+	/** Group several structural edits so derived ship data is refreshed once at the end. Calls nest. */
+	UFUNCTION(BlueprintCallable, Category = "Ship Assembly")
+	void BeginStructuralEdit();
+
+	UFUNCTION(BlueprintCallable, Category = "Ship Assembly")
+	void EndStructuralEdit();
+
+	/** Module is part of this ship and reachable from its root module */
+	UFUNCTION(BlueprintPure, Category = "Ship Assembly")
+	bool IsModuleConnected(const AAstroShipModule* Module) const;
+
+	/** Both modules belong to this ship and share a root */
+	UFUNCTION(BlueprintPure, Category = "Ship Assembly")
+	bool AreModulesConnected(const AAstroShipModule* ModuleA, const AAstroShipModule* ModuleB) const;
+
+	/** Closest free connection point within MaxDistance of a world location that accepts the module type */
+	UFUNCTION(BlueprintCallable, Category = "Ship Assembly")
+	bool FindSnapConnection(FVector WorldLocation, EShipModuleType ModuleType, float MaxDistance, AAstroShipModule*& OutModule, int32& OutConnectionIndex) const;
+
+	/** A module and everything attached below it, parents first */
+	UFUNCTION(BlueprintCallable, Category = "Ship Assembly")
+	TArray<AAstroShipModule*> GetSubtreeModules(AAstroShipModule* Module) const;
+
 	/** Get all ship modules */
 	UFUNCTION(BlueprintCallable, Category = "Ship Assembly")
 	TArray<AAstroShipModule*> GetAllModules() const { return ShipModules; }
 
-	/** Calculate total ship mass */
+	/** Read-only view of all ship modules without copying */
+	TArrayView<AAstroShipModule* const> GetModulesView() const { return ShipModules; }
+
+	/** Total ship mass, kept up to date as modules are added and removed */
 	UFUNCTION(BlueprintCallable, Category = "Ship Assembly")
 	float CalculateTotalMass() const;
 
-	/** Calculate total power balance */
+	/** Power generation minus consumption, kept up to date as modules are added and removed */
 	UFUNCTION(BlueprintCallable, Category = "Ship Assembly")
 	float CalculatePowerBalance() const;
 
-	/** Check if ship is flyable */
+	/** Total crew capacity */
+	UFUNCTION(BlueprintPure, Category = "Ship Assembly")
+	int32 GetCrewCapacity() const { return Aggregates.GetCrewCapacity(); }
+
+	/** Number of modules of a given type */
+	UFUNCTION(BlueprintPure, Category = "Ship Assembly")
+	int32 GetModuleCountOfType(EShipModuleType ModuleType) const { return Aggregates.GetModuleCount(ModuleType); }
+
+	/** Center of mass relative to the root module */
+	UFUNCTION(BlueprintPure, Category = "Ship Assembly")
+	FVector GetCenterOfMass() const { return Aggregates.GetCenterOfMass(); }
+
+	/** Inertia tensor about the center of mass, in the root module's axes */
+	FMatrix GetInertiaTensor() const { return Aggregates.GetInertiaTensor(); }
+
+	/** Running totals behind the stat queries above */
+	const FAstroShipAggregates& GetAggregates() const { return Aggregates; }
+
+	/** Call after changing a module's stats at runtime so the ship totals pick them up */
+	UFUNCTION(BlueprintCallable, Category = "Ship Assembly")
+	void RefreshModuleStats(AAstroShipModule* Module);
+
+	/** Recompute every total from the modules and compare with the running values. Also run after each edit when astro.Ship.ValidateAggregates is set. */
+	UFUNCTION(BlueprintCallable, Category = "Ship Assembly")
+	bool ValidateAggregates() const;
+
+	/** Check if ship is flyable. Rule results are cached and only re-evaluated after an edit touching their inputs. */
 	UFUNCTION(BlueprintCallable, Category = "Ship Assembly")
 	bool IsShipFlyable() const;
 
+	/** Every reason the ship cannot fly, empty if it can */
+	UFUNCTION(BlueprintCallable, Category = "Ship Assembly")
+	TArray<FShipValidationFailure> ValidateShip() const;
+
+	/** Mark cached validation rules as stale, see the FAstroShipValidator rule masks */
+	void InvalidateValidation(uint32 RuleMask) { Validator.Invalidate(RuleMask); }
+
 	/** Finalize ship assembly and make it controllable */
 	UFUNCTION(BlueprintCallable, Category = "Ship Assembly")
 	void FinalizeShip();
 
+	/** Undock or break off a module and everything attached below it as a new ship, keeping its motion */
+	UFUNCTION(BlueprintCallable, Category = "Ship Assembly")
+	AAstroShipAssembly* SplitOffModule(AAstroShipModule* Module);
+
+	/** Write this ship's modules, connections and stat overrides to a binary design file */
+	UFUNCTION(BlueprintCallable, Category = "Ship Assembly|Design")
+	bool SaveDesignToFile(const FString& FilePath) const;
+
+	/** Build this empty ship from a design file, either at once or streamed over several frames */
+	UFUNCTION(BlueprintCallable, Category = "Ship Assembly|Design")
+	bool LoadDesignFromFile(const FString& FilePath, bool bStreamAsync);
+
+	/** Spawn every module of a design in a single structural edit. The ship must be empty. */
+	bool BuildFromDesign(const FAstroShipDesign& Design);
+
+	/** Load the design's module classes asynchronously, then spawn DesignModulesPerFrame modules per frame. OnShipDesignLoaded fires at the end. */
+	bool StreamFromDesign(const FAstroShipDesign& Design);
+
+	UFUNCTION(BlueprintPure, Category = "Ship Assembly|Design")
+	bool IsStreamingDesign() const { return StreamingDesign.IsValid(); }
+
+	/**
+	 * Put the finalized ship on a conic around a body, from a position and velocity relative to it in metres and m/s.
+	 * The compound body stops simulating until the ship leaves orbit.
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Ship Assembly|Orbit")
+	bool EnterOrbit(FName BodyName, FVector Position, FVector Velocity);
+
+	/** Stop propagating this ship in the orbital subsystem and resume its physics */
+	UFUNCTION(BlueprintCallable, Category = "Ship Assembly|Orbit")
+	void LeaveOrbit();
+
+	UFUNCTION(BlueprintPure, Category = "Ship Assembly|Orbit")
+	bool IsInOrbit() const;
+
+	/** Stop simulating the compound body at rest, or resume it if it was simulating before. Used while the ship is on rails. */
+	void SetPhysicsSuspended(bool bSuspended);
+
+	/** Make this the vessel the floating origin follows */
+	UFUNCTION(BlueprintCallable, Category = "Ship Assembly|Orbit")
+	void MakeActiveVessel();
+
+	/** Burn at a fraction of total thrust along the ship's forward axis; zero puts it back on rails */
+	UFUNCTION(BlueprintCallable, Category = "Ship Assembly|Orbit")
+	void SetThrottle(float Throttle);
+
+	const FAstroOrbitHandle& GetOrbitHandle() const { return OrbitHandle; }
+
+	/**
+	 * Render every module as an instance of a per-mesh instanced static mesh on this actor and unregister the module
+	 * actors' components. The module actors stay alive as the ship's data, so the actor count does not change.
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Ship Assembly|Rendering")
+	void CollapseModulesToInstances();
+
+	/** Turn a collapsed module back into a live actor. Returns false if it was not collapsed. */
+	UFUNCTION(BlueprintCallable, Category = "Ship Assembly|Rendering")
+	bool ExpandModule(AAstroShipModule* Module);
+
+	/** Return a live module to its instanced group */
+	UFUNCTION(BlueprintCallable, Category = "Ship Assembly|Rendering")
+	bool CollapseModule(AAstroShipModule* Module);
+
+	/** Expand the module behind a trace hit on one of the instanced groups; returns the live module, or null */
+	UFUNCTION(BlueprintCallable, Category = "Ship Assembly|Rendering")
+	AAstroShipModule* ExpandModuleFromHit(const FHitResult& Hit);
+
+	UFUNCTION(BlueprintPure, Category = "Ship Assembly|Rendering")
+	bool IsModuleCollapsed(const AAstroShipModule* Module) const;
+
 protected:
 	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+	/** Make a freshly spawned module the root or attach it to its parent, then track it. Destroys the module on failure. */
+	bool AttachSpawnedModule(AAstroShipModule* NewModule, AAstroShipModule* ParentModule, int32 ConnectionIndex);
+
+	/** Spawn one design entry with its overrides applied. Entries whose class or parent is missing are skipped. */
+	void SpawnDesignModule(const FAstroShipDesign& Design, int32 DesignIndex, TArrayView<UClass* const> Classes, TArray<AAstroShipModule*>& SpawnedModules);
+
+	/** Module classes of the streaming design finished loading */
+	void OnDesignClassesLoaded();
+
+	/** Spawn the next batch of the streaming design */
+	void StreamDesignStep();
+
+	/** Close the streaming edit and broadcast */
+	void FinishStreamingDesign();
+
+	/** Add a module's contribution to the running totals */
+	void TrackModule(AAstroShipModule* Module);
+
+	/** Subtract a module's contribution and drop it from ShipModules */
+	void UntrackModule(AAstroShipModule* Module);
+
+	/** Module origin relative to the root module */
+	FVector GetShipSpaceLocation(const AAstroShipModule* Module) const;
+
+	/** Run ValidateAggregates if the validation cvar is set */
+	void ConditionalValidateAggregates() const;
+
+	/** Re-index the module's free connection points for snapping */
+	void UpdateSnapPoints(const AAstroShipModule* Module);
+
+	/** Record a structural change; finishes it right away unless an edit is open */
+	void MarkStructureChanged();
+
+	/** Refresh derived data and broadcast after a batch of structural changes */
+	void FinishStructuralEdit();
+
+	/** Merge module collision and mass into the ship body and start simulating if enabled */
+	void RebuildCompoundBody();
+
+	/** Build the body and instanced rendering for a finished ship */
+	void BakeFinalizedShip();
+
+	/** Instanced group drawing the given mesh, created on first use */
+	int32 FindOrAddInstanceGroup(const UStaticMeshComponent* SourceMesh);
+
+	/** Module's mesh transform relative to this actor */
+	FTransform GetModuleInstanceTransform(const AAstroShipModule* Module) const;
+
+	/** Unregister a module actor's components so it neither renders nor collides, or register them again */
+	static void SetModuleDormant(AAstroShipModule* Module, bool bDormant);
 
 public:	
+	/** Root component; becomes the single compound rigid body once the ship is finalized */
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Ship Assembly")
+	UAstroShipBodyComponent* ShipBody;
+
+	/** One instanced group per distinct module mesh, filled by CollapseModulesToInstances */
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Ship Assembly|Rendering")
+	TArray<UInstancedStaticMeshComponent*> InstancedModuleGroups;
+
 	/** Root module (usually cockpit) */
 	UPROPERTY(BlueprintReadOnly, Category = "Ship Assembly")
 	AAstroShipModule* RootModule;
@@ -78,8 +275,83 @@ public:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Ship Assembly")
 	bool bRequiresFuelTank;
 
+	/** Total thrust must exceed the ship's weight by this factor to fly; 0, the default, disables the check */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Ship Assembly", meta = (ClampMin = "0.0"))
+	float MinThrustToWeight;
+
+	/** Gravity used to weigh the ship for the thrust-to-weight check, in m/s^2; 0 means no gravity well and skips the check */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Ship Assembly", meta = (ClampMin = "0.0"))
+	float ReferenceGravity;
+
+	/** Simulate the compound body as soon as the ship is finalized */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Ship Assembly")
+	bool bSimulatePhysicsWhenFinalized;
+
+	/** Cell edge length of the connection snap index; roughly the typical snap radius works best */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Ship Assembly", meta = (ClampMin = "1.0"))
+	float SnapCellSize;
+
+	/** Modules spawned per frame when streaming a design */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Ship Assembly|Design", meta = (ClampMin = "1"))
+	int32 DesignModulesPerFrame;
+
 	/** Delegate called when ship is finalized */
 	DECLARE_DYNAMIC_MULTICAST_DELEGATE(FOnShipFinalized);
 	UPROPERTY(BlueprintAssignable, Category = "Ship Assembly")
 	FOnShipFinalized OnShipFinalized;
+
+	/** Delegate called once per structural edit (a single add or remove, or a Begin/EndStructuralEdit batch) */
+	DECLARE_DYNAMIC_MULTICAST_DELEGATE(FOnShipStructureChanged);
+	UPROPERTY(BlueprintAssignable, Category = "Ship Assembly")
+	FOnShipStructureChanged OnShipStructureChanged;
+
+	/** Delegate called when a streamed design has finished spawning */
+	DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnShipDesignLoaded, bool, bSuccess);
+	UPROPERTY(BlueprintAssignable, Category = "Ship Assembly|Design")
+	FOnShipDesignLoaded OnShipDesignLoaded;
+
+private:
+	FAstroShipAggregates Aggregates;
+
+	/** Cached flyability rules; refreshed lazily from const queries */
+	mutable FAstroShipValidator Validator;
+
+	/** What each entry of ShipModules added to Aggregates, so it can be removed exactly */
+	TArray<FAstroShipModuleContribution> ModuleContributions;
+
+	/** Free connection points of every module, for snap queries */
+	FAstroConnectionSnapIndex SnapIndex;
+
+	/** Position of each module in ShipModules */
+	TMap<AAstroShipModule*, int32> ModuleIndices;
+
+	/** Open BeginStructuralEdit calls */
+	int32 StructuralEditDepth = 0;
+
+	/** A change happened inside the open edit */
+	bool bStructureChangedInEdit = false;
+
+	/** Per instanced group, the module drawn by each instance index */
+	TArray<TArray<AAstroShipModule*>> InstanceModules;
+
+	/** Group index of every collapsed module */
+	TMap<AAstroShipModule*, int32> CollapsedModuleGroups;
+
+	/** Design being streamed in, null when idle */
+	TUniquePtr<FAstroShipDesign> StreamingDesign;
+
+	/** Keeps the streaming design's module classes loaded */
+	TSharedPtr<FStreamableHandle> DesignClassesHandle;
+
+	/** Resolved class table and spawned module per design entry of the streaming design */
+	TArray<UClass*> StreamingClasses;
+	TArray<AAstroShipModule*> StreamedModules;
+
+	double StreamStartTime = 0.0;
+
+	/** This ship's craft in the orbital subsystem, invalid when not in orbit */
+	FAstroOrbitHandle OrbitHandle;
+
+	/** The compound body was simulating when SetPhysicsSuspended stopped it */
+	bool bPhysicsSuspended = false;
 };
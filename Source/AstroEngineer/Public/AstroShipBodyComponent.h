@@ -0,0 +1,62 @@
+// Copyright Astro Engineer Team. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/PrimitiveComponent.h"
+#include "AstroShipBodyComponent.generated.h"
+
+class AAstroShipModule;
+class UBodySetup;
+struct FAstroShipAggregates;
+
+/**
+ * Single rigid body for a finalized ship.
+ * The simple collision of every module mesh is merged into one body setup in ship space, and mass,
+ * center of mass and inertia are taken from the ship's running totals instead of the collision shapes,
+ * so a ship of any size simulates as one body with no constraints.
+ */
+UCLASS(ClassGroup=(Custom), meta=(BlueprintSpawnableComponent))
+class ASTROENGINEER_API UAstroShipBodyComponent : public UPrimitiveComponent
+{
+	GENERATED_BODY()
+
+public:
+	UAstroShipBodyComponent(const FObjectInitializer& ObjectInitializer);
+
+	/** Merge the modules' collision into one body and apply the aggregated mass properties */
+	void BuildCompoundBody(TArrayView<AAstroShipModule* const> Modules, const FTransform& ShipSpaceToComponent, const FAstroShipAggregates& Aggregates);
+
+	/** Drop the compound body, leaving a collision-free scene root */
+	void ClearCompoundBody();
+
+	UFUNCTION(BlueprintPure, Category = "Ship Body")
+	bool HasCompoundBody() const { return ShipBodySetup != nullptr; }
+
+	/** Module whose collision lies closest to a world-space point on the body, e.g. a hit location */
+	UFUNCTION(BlueprintPure, Category = "Ship Body")
+	AAstroShipModule* FindModuleAt(FVector WorldLocation) const;
+
+	//~ Begin UPrimitiveComponent Interface
+	virtual UBodySetup* GetBodySetup() override { return ShipBodySetup; }
+	virtual FBoxSphereBounds CalcBounds(const FTransform& LocalToWorld) const override;
+	virtual void OnCreatePhysicsState() override;
+	//~ End UPrimitiveComponent Interface
+
+private:
+	/** Push the stored center of mass and principal inertia into the live physics body */
+	void ApplyMassProperties();
+
+	UPROPERTY(Transient, DuplicateTransient)
+	UBodySetup* ShipBodySetup;
+
+	/** Module that contributed each merged piece of collision, with that piece's bounds in ship space */
+	UPROPERTY(Transient)
+	TArray<AAstroShipModule*> PieceModules;
+	TArray<FBox> PieceBounds;
+
+	/** Mass properties from the ship totals, in component space */
+	FVector CenterOfMass;
+	FVector PrincipalInertia;
+	FQuat PrincipalAxes;
+};
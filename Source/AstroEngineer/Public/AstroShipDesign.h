@@ -0,0 +1,95 @@
+// Copyright Astro Engineer Team. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "UObject/SoftObjectPath.h"
+
+class AAstroShipAssembly;
+class AAstroShipModule;
+
+/**
+ * One module of a ship design.
+ * Modules are stored parents first, so ParentIndex is always lower than the module's own index.
+ */
+struct ASTROENGINEER_API FAstroShipDesignModule
+{
+	/** Stats that differ from the module class defaults */
+	enum EOverride : uint8
+	{
+		Override_Mass = 1 << 0,
+		Override_PowerConsumption = 1 << 1,
+		Override_PowerGeneration = 1 << 2,
+		Override_CrewCapacity = 1 << 3,
+		Override_Thrust = 1 << 4,
+	};
+
+	/** Entry in the design's class table */
+	int32 ClassIndex = 0;
+
+	/** Module this one attaches to, or INDEX_NONE for the root */
+	int32 ParentIndex = INDEX_NONE;
+
+	/** Connection point on the parent */
+	int32 ParentConnectionIndex = 0;
+
+	uint8 OverrideMask = 0;
+	float Mass = 0.0f;
+	float PowerConsumption = 0.0f;
+	float PowerGeneration = 0.0f;
+	int32 CrewCapacity = 0;
+	float Thrust = 0.0f;
+
+	/** Record every stat of a live module that differs from its class defaults */
+	void CaptureOverrides(const AAstroShipModule& Module, const AAstroShipModule& Defaults);
+
+	/** Write the overridden stats into a module's authored values; call before it begins play */
+	void ApplyOverrides(AAstroShipModule& Module) const;
+};
+
+/**
+ * Versioned binary description of a ship: a class table, the connection tree flattened parents first,
+ * and per-module stat overrides. Indices are written as packed deltas so typical designs cost a few bytes per module.
+ */
+struct ASTROENGINEER_API FAstroShipDesign
+{
+public:
+	enum EVersion : int32
+	{
+		Version_Initial = 1,
+
+		Version_Latest = Version_Initial
+	};
+
+	/** Snapshot a ship's modules and connections. Fails for an empty ship. */
+	bool Capture(const AAstroShipAssembly& Ship);
+
+	/** Read or write the design; returns false and flags the archive on a bad header or corrupt data */
+	bool Serialize(FArchive& Ar);
+
+	bool SaveToBytes(TArray<uint8>& OutBytes);
+	bool LoadFromBytes(TArrayView<const uint8> Bytes);
+
+	bool SaveToFile(const FString& FilePath);
+	bool LoadFromFile(const FString& FilePath);
+
+	void Reset();
+
+	/** Same name, class table, connection tree and overridden stats; stats a module does not override are not compared */
+	bool IsEquivalent(const FAstroShipDesign& Other) const;
+
+	int32 NumModules() const { return Modules.Num(); }
+	bool IsEmpty() const { return Modules.Num() == 0; }
+
+	FString ShipName;
+
+	/** Distinct module classes, referenced by FAstroShipDesignModule::ClassIndex */
+	TArray<FSoftClassPath> ModuleClasses;
+
+	/** Modules in parent-first order; entry 0 is the root */
+	TArray<FAstroShipDesignModule> Modules;
+
+private:
+	/** Structural checks after loading, so a bad file cannot produce out-of-range indices */
+	bool IsWellFormed() const;
+};
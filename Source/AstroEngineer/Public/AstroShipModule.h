@@ -4,6 +4,7 @@
 
 #include "CoreMinimal.h"
 #include "GameFramework/Actor.h"
+#include "AstroModuleStatStore.h"
 #include "AstroShipModule.generated.h"
 
 /**
@@ -62,7 +63,6 @@ class ASTROENGINEER_API AAstroShipModule : public AActor
 public:	
 	AAstroShipModule();
 
-	virtual void Tick(float DeltaTime) override;
 
 	/** Get module mesh */
 	UFUNCTION(BlueprintCallable, Category = "Ship Module")
@@ -72,24 +72,94 @@ public:
 	UFUNCTION(BlueprintCallable, Category = "Ship Module")
 	TArray<FModuleConnectionPoint> GetConnectionPoints() const { return ConnectionPoints; }
 
+	/** Read-only view of connection points without copying */
+	TArrayView<const FModuleConnectionPoint> GetConnectionPointsView() const { return ConnectionPoints; }
+
+	/** Visit each unoccupied connection point with its index */
+	void ForEachFreeConnectionPoint(TFunctionRef<void(int32, const FModuleConnectionPoint&)> Visitor) const;
+
 	/** Attach another module to this one */
 	UFUNCTION(BlueprintCallable, Category = "Ship Module")
 	bool AttachModule(AAstroShipModule* Module, int32 ConnectionIndex);
 
-	/** Detach a module */
+	/** Detach a directly attached child module, freeing the connection point it occupies */
 	UFUNCTION(BlueprintCallable, Category = "Ship Module")
 	void DetachModule(AAstroShipModule* Module);
 
+	/** Module occupying a connection point, or null */
+	UFUNCTION(BlueprintPure, Category = "Ship Module")
+	AAstroShipModule* GetConnectionOccupant(int32 ConnectionIndex) const;
+
+	/** Module this one is attached to, or null for a root or loose module */
+	UFUNCTION(BlueprintPure, Category = "Ship Module")
+	AAstroShipModule* GetParentModule() const { return ParentModule; }
+
+	/** Connection point on the parent this module occupies, or INDEX_NONE */
+	UFUNCTION(BlueprintPure, Category = "Ship Module")
+	int32 GetParentConnectionIndex() const { return ParentConnectionIndex; }
+
+	/** Topmost module reached by following parents */
+	UFUNCTION(BlueprintPure, Category = "Ship Module")
+	AAstroShipModule* GetRootModule() const;
+
+	/** Append this module and everything attached below it, parents before children */
+	void GatherSubtree(TArray<AAstroShipModule*>& OutModules) const;
+
+	/** Live stats, read from the world's module stat store once the module has begun play */
+	UFUNCTION(BlueprintGetter, Category = "Ship Module|Stats")
+	EShipModuleType GetModuleType() const;
+
+	UFUNCTION(BlueprintGetter, Category = "Ship Module|Stats")
+	float GetMass() const;
+
+	UFUNCTION(BlueprintGetter, Category = "Ship Module|Stats")
+	float GetPowerConsumption() const;
+
+	UFUNCTION(BlueprintGetter, Category = "Ship Module|Stats")
+	float GetPowerGeneration() const;
+
+	UFUNCTION(BlueprintGetter, Category = "Ship Module|Stats")
+	int32 GetCrewCapacity() const;
+
+	UFUNCTION(BlueprintGetter, Category = "Ship Module|Stats")
+	float GetThrust() const;
+
+	/** Change live stats; the owning assembly's totals are refreshed */
+	UFUNCTION(BlueprintCallable, Category = "Ship Module|Stats")
+	void SetMass(float NewMass);
+
+	UFUNCTION(BlueprintCallable, Category = "Ship Module|Stats")
+	void SetPowerConsumption(float NewPowerConsumption);
+
+	UFUNCTION(BlueprintCallable, Category = "Ship Module|Stats")
+	void SetPowerGeneration(float NewPowerGeneration);
+
+	UFUNCTION(BlueprintCallable, Category = "Ship Module|Stats")
+	void SetCrewCapacity(int32 NewCrewCapacity);
+
+	UFUNCTION(BlueprintCallable, Category = "Ship Module|Stats")
+	void SetThrust(float NewThrust);
+
+	/** Row of this module in the stat store, invalid outside of play */
+	const FAstroModuleStatHandle& GetStatHandle() const { return StatHandle; }
+
 protected:
 	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+	/** Store holding the live stats, or null when not registered */
+	UAstroModuleStatStore* GetStatStore() const;
+
+	/** Let the owning assembly re-capture this module's stats */
+	void NotifyStatsChanged();
 
 public:	
 	/** Module mesh */
 	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Ship Module")
 	UStaticMeshComponent* ModuleMesh;
 
-	/** Module type */
-	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Ship Module")
+	/** Module type. Authored value; copied into the stat store at BeginPlay, and read in Blueprints through GetModuleType. */
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, BlueprintGetter = GetModuleType, Category = "Ship Module")
 	EShipModuleType ModuleType;
 
 	/** Module name */
@@ -104,16 +174,41 @@ public:
 	UPROPERTY(BlueprintReadOnly, Category = "Ship Module")
 	TArray<AAstroShipModule*> AttachedModules;
 
-	/** Module stats */
-	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Ship Module|Stats")
+	/** Authored module stats; copied into the stat store at BeginPlay. Blueprint reads go through the live getters; the setters are the only write path */
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, BlueprintGetter = GetMass, Category = "Ship Module|Stats")
 	float Mass;
 
-	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Ship Module|Stats")
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, BlueprintGetter = GetPowerConsumption, Category = "Ship Module|Stats")
 	float PowerConsumption;
 
-	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Ship Module|Stats")
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, BlueprintGetter = GetPowerGeneration, Category = "Ship Module|Stats")
 	float PowerGeneration;
 
-	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Ship Module|Stats")
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, BlueprintGetter = GetCrewCapacity, Category = "Ship Module|Stats")
 	int32 CrewCapacity;
+
+	/** Maximum thrust in newtons, for engines */
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, BlueprintGetter = GetThrust, Category = "Ship Module|Stats")
+	float Thrust;
+
+	/** Fuel can flow through this module between tanks and engines */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Ship Module")
+	bool bRoutesFuel;
+
+	/** Module occupying each connection point, parallel to ConnectionPoints */
+	UPROPERTY(BlueprintReadOnly, Category = "Ship Module")
+	TArray<AAstroShipModule*> ConnectionOccupants;
+
+private:
+	FAstroModuleStatHandle StatHandle;
+
+	/** Module this one is attached to */
+	UPROPERTY()
+	AAstroShipModule* ParentModule;
+
+	/** Connection point on ParentModule this module occupies */
+	int32 ParentConnectionIndex;
+
+	/** Position of this module in ParentModule->AttachedModules, for swap-removal on detach */
+	int32 ChildSlot;
 };
@@ -0,0 +1,102 @@
+// Copyright Astro Engineer Team. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "AstroShipValidator.generated.h"
+
+class AAstroShipAssembly;
+class AAstroShipModule;
+
+/**
+ * Structural rules a ship must pass to fly
+ */
+UENUM(BlueprintType)
+enum class EShipValidationRule : uint8
+{
+	RequiredModules,
+	PowerBalance,
+	Connectivity,
+	FuelRouting,
+	ThrustToWeight,
+	Count UMETA(Hidden)
+};
+
+/**
+ * One reason a ship failed validation
+ */
+USTRUCT(BlueprintType)
+struct FShipValidationFailure
+{
+	GENERATED_BODY()
+
+	UPROPERTY(BlueprintReadOnly)
+	EShipValidationRule Rule;
+
+	/** Module at fault, if the failure is specific to one */
+	UPROPERTY(BlueprintReadOnly)
+	AAstroShipModule* Module;
+
+	UPROPERTY(BlueprintReadOnly)
+	FText Message;
+
+	FShipValidationFailure()
+		: Rule(EShipValidationRule::RequiredModules)
+		, Module(nullptr)
+		, Message(FText::GetEmpty())
+	{}
+};
+
+/**
+ * Caches the result of each validation rule for one ship.
+ * Edits invalidate only the rules whose inputs they touch, and dirty rules are re-evaluated lazily on the next query,
+ * so repeated queries between edits cost nothing.
+ */
+struct ASTROENGINEER_API FAstroShipValidator
+{
+public:
+	static constexpr uint32 RuleBit(EShipValidationRule Rule) { return 1u << static_cast<uint32>(Rule); }
+
+	static constexpr uint32 AllRules = (1u << static_cast<uint32>(EShipValidationRule::Count)) - 1;
+
+	/** Rules depending on which modules exist and how they connect */
+	static constexpr uint32 StructureRules = AllRules;
+
+	/** Rules depending on mass or thrust */
+	static constexpr uint32 MassRules = 1u << static_cast<uint32>(EShipValidationRule::ThrustToWeight);
+
+	/** Rules depending on power stats */
+	static constexpr uint32 PowerRules = 1u << static_cast<uint32>(EShipValidationRule::PowerBalance);
+
+	/** Rules depending only on connection edges */
+	static constexpr uint32 ConnectionRules = (1u << static_cast<uint32>(EShipValidationRule::Connectivity)) | (1u << static_cast<uint32>(EShipValidationRule::FuelRouting));
+
+	void Invalidate(uint32 RuleMask) { DirtyRules |= RuleMask; }
+
+	/** All rules pass */
+	bool IsValid(const AAstroShipAssembly& Ship);
+
+	/** Append every current failure */
+	void GatherFailures(const AAstroShipAssembly& Ship, TArray<FShipValidationFailure>& OutFailures);
+
+	/** Rules re-evaluated since creation, for profiling the cache */
+	int32 GetNumEvaluations() const { return NumEvaluations; }
+
+private:
+	void Refresh(const AAstroShipAssembly& Ship);
+	void EvaluateRule(EShipValidationRule Rule, const AAstroShipAssembly& Ship, TArray<FShipValidationFailure>& OutFailures) const;
+
+	void EvaluateRequiredModules(const AAstroShipAssembly& Ship, TArray<FShipValidationFailure>& OutFailures) const;
+	void EvaluatePowerBalance(const AAstroShipAssembly& Ship, TArray<FShipValidationFailure>& OutFailures) const;
+	void EvaluateConnectivity(const AAstroShipAssembly& Ship, TArray<FShipValidationFailure>& OutFailures) const;
+	void EvaluateFuelRouting(const AAstroShipAssembly& Ship, TArray<FShipValidationFailure>& OutFailures) const;
+	void EvaluateThrustToWeight(const AAstroShipAssembly& Ship, TArray<FShipValidationFailure>& OutFailures) const;
+
+	uint32 DirtyRules = AllRules;
+	TArray<FShipValidationFailure> RuleFailures[static_cast<int32>(EShipValidationRule::Count)];
+
+	/** Hash of the ship's rule settings at the last evaluation, since they can change without an edit */
+	uint32 EvaluatedSettingsHash = 0;
+
+	int32 NumEvaluations = 0;
+};
@@ -0,0 +1,100 @@
+// Copyright Astro Engineer Team. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "AstroJobScheduler.h"
+#include "AstroTimeWarpSubsystem.generated.h"
+
+/**
+ * Runs the simulation faster than real time.
+ * Entering warp cuts every burn so all craft coast on their analytic rails, and suspends the compound physics of ships in orbit.
+ * The orbital subsystem then advances by the warped frame time, and the production clock is fast-forwarded in one batch each
+ * frame, so timed jobs complete in order without anything ticking faster.
+ */
+UCLASS()
+class ASTROENGINEER_API UAstroTimeWarpSubsystem : public UTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	virtual void Tick(float DeltaTime) override;
+	virtual TStatId GetStatId() const override;
+	virtual void Deinitialize() override;
+
+	/** Simulated seconds per real second; 1 stops warping */
+	UFUNCTION(BlueprintCallable, Category = "Time Warp")
+	void SetWarpRate(double NewWarpRate);
+
+	/** Step to the next or previous rate in WarpRates */
+	UFUNCTION(BlueprintCallable, Category = "Time Warp")
+	void IncreaseWarp();
+
+	UFUNCTION(BlueprintCallable, Category = "Time Warp")
+	void DecreaseWarp();
+
+	UFUNCTION(BlueprintCallable, Category = "Time Warp")
+	void StopWarp() { SetWarpRate(1.0); }
+
+	UFUNCTION(BlueprintPure, Category = "Time Warp")
+	double GetWarpRate() const { return WarpRate; }
+
+	UFUNCTION(BlueprintPure, Category = "Time Warp")
+	bool IsWarping() const { return WarpRate > 1.0; }
+
+	/** Wall-clock seconds the last production catch-up took */
+	double GetLastCatchUpSeconds() const { return LastCatchUpSeconds; }
+
+	/**
+	 * Measure frame time at 1x, 1000x and 100000x, FramesPerRate frames each, and log one line per rate.
+	 * NumSyntheticJobs recurring production jobs are added for the run to load the catch-up.
+	 */
+	void StartBenchmark(int32 FramesPerRate, int32 NumSyntheticJobs);
+
+	/** Rates IncreaseWarp and DecreaseWarp step through */
+	TArray<double> WarpRates = { 1.0, 5.0, 10.0, 50.0, 100.0, 1000.0, 10000.0, 100000.0 };
+
+private:
+	/** Put every craft on rails and suspend ship physics */
+	void EnterWarp();
+
+	/** Give ships in orbit their physics back */
+	void ExitWarp();
+
+	/** Suspend the physics of every ship in orbit; ships that enter orbit mid-warp are caught on the next frame */
+	void SuspendShipPhysics();
+
+	void TickBenchmark();
+	void FinishBenchmark();
+	void OnBenchmarkJobCompleted(double CompletionTime, int32 JobIndex, double Period);
+
+	struct FBenchmarkStage
+	{
+		double WarpRate = 1.0;
+		int32 NumFrames = 0;
+		double FrameSeconds = 0.0;
+		double WorstFrameSeconds = 0.0;
+		double AdvanceSeconds = 0.0;
+		double CatchUpSeconds = 0.0;
+		int32 NumJobsCompleted = 0;
+	};
+
+	struct FBenchmark
+	{
+		TArray<FBenchmarkStage> Stages;
+		int32 StageIndex = 0;
+		int32 FramesPerRate = 0;
+
+		/** Frames left to skip before measuring, so the frame that changed rate is not counted */
+		int32 WarmUpFrames = 0;
+
+		double PreviousWarpRate = 1.0;
+		TArray<FAstroJobHandle> Jobs;
+	};
+
+	double WarpRate = 1.0;
+	double LastCatchUpSeconds = 0.0;
+
+	TOptional<FBenchmark> Benchmark;
+};
@@ -0,0 +1,147 @@
+// Copyright Astro Engineer Team. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "AstroOrbitPropagator.h"
+#include "Tasks/Task.h"
+#include <atomic>
+
+/**
+ * A planned burn, applied instantly at Time
+ */
+struct ASTROENGINEER_API FAstroManeuverNode
+{
+	double Time = 0.0;
+
+	/** Speed change along prograde (X), orbit normal (Y) and radial out (Z), in m/s */
+	FVector DeltaV = FVector::ZeroVector;
+
+	bool operator==(const FAstroManeuverNode& Other) const { return Time == Other.Time && DeltaV == Other.DeltaV; }
+};
+
+/** Why a predicted conic ends */
+enum class EAstroSegmentEnd : uint8
+{
+	Horizon,
+	Maneuver,
+	EscapeSphereOfInfluence,
+	EnterSphereOfInfluence,
+	Impact
+};
+
+/**
+ * One conic of a predicted trajectory
+ */
+struct ASTROENGINEER_API FAstroTrajectorySegment
+{
+	int32 BodyIndex = INDEX_NONE;
+	FAstroOrbitalElements Elements;
+	double StartTime = 0.0;
+	double EndTime = 0.0;
+	EAstroSegmentEnd EndReason = EAstroSegmentEnd::Horizon;
+
+	/** Maneuver nodes already applied when this segment starts */
+	int32 NumManeuversBefore = 0;
+
+	/** Positions relative to BodyIndex, sampled more densely where the path bends */
+	TArray<FVector> Points;
+	TArray<double> PointTimes;
+};
+
+/**
+ * Immutable prediction of one craft's path. Segments are shared with the trajectory it was patched from.
+ */
+struct ASTROENGINEER_API FAstroTrajectory
+{
+	TArray<TSharedRef<const FAstroTrajectorySegment, ESPMode::ThreadSafe>> Segments;
+
+	/** What the prediction was built from */
+	int32 BodyIndex = INDEX_NONE;
+	FAstroOrbitalElements Elements;
+	TArray<FAstroManeuverNode> ManeuverNodes;
+
+	/** Leading segments taken over unchanged from the previous prediction */
+	int32 NumReusedSegments = 0;
+};
+
+/**
+ * Latest trajectory of one watched craft, readable from the render thread without locks.
+ * Replaced trajectories are released by a render command, so a pointer read inside a render command stays valid until it ends.
+ */
+class ASTROENGINEER_API FAstroPublishedTrajectory
+{
+public:
+	const FAstroTrajectory* Get_RenderThread() const { return Latest.load(std::memory_order_acquire); }
+
+private:
+	friend class FAstroTrajectoryCache;
+
+	/** Game-thread ownership of the published trajectory */
+	TSharedPtr<const FAstroTrajectory, ESPMode::ThreadSafe> Owner;
+
+	std::atomic<const FAstroTrajectory*> Latest { nullptr };
+};
+
+/**
+ * Predicted trajectories for the craft shown in map view.
+ * A prediction is rebuilt only when the craft's conic or its maneuver nodes change, and editing a node re-patches just the
+ * conics from that node on. Sampling and sphere of influence searches run on background tasks; finished predictions are
+ * published on the game thread.
+ */
+class ASTROENGINEER_API FAstroTrajectoryCache
+{
+public:
+	/** Start predicting a craft; renderers keep the returned reference */
+	TSharedRef<const FAstroPublishedTrajectory, ESPMode::ThreadSafe> Watch(const FAstroOrbitHandle& Craft);
+
+	/** Stop predicting a craft and drop its maneuver nodes */
+	void Unwatch(const FAstroOrbitHandle& Craft);
+
+	/** Replace a watched craft's maneuver nodes; they are kept sorted by time */
+	void SetManeuverNodes(const FAstroOrbitHandle& Craft, TArray<FAstroManeuverNode> Nodes);
+
+	/** Maneuver nodes of a watched craft, or null */
+	const TArray<FAstroManeuverNode>* GetManeuverNodes(const FAstroOrbitHandle& Craft) const;
+
+	/** Latest finished prediction of a watched craft, for game-thread use */
+	TSharedPtr<const FAstroTrajectory, ESPMode::ThreadSafe> GetTrajectory(const FAstroOrbitHandle& Craft) const;
+
+	/** Publish finished predictions and start new ones for craft whose inputs changed. Call once per frame on the game thread. */
+	void Update(const FAstroOrbitPropagator& Propagator);
+
+	/** Furthest a prediction reaches past its start */
+	double MaxPredictionSeconds = 60.0 * 60.0 * 24.0 * 365.0;
+
+	/** Conics per prediction, counting each maneuver and sphere of influence change */
+	int32 MaxSegments = 12;
+
+	/** Allowed deviation of the drawn polyline from the conic, relative to the distance from the body */
+	double SampleTolerance = 1.0e-3;
+
+	int32 MaxPointsPerSegment = 512;
+
+private:
+	struct FWatchedCraft
+	{
+		FAstroOrbitHandle Craft;
+		TArray<FAstroManeuverNode> ManeuverNodes;
+		TSharedRef<FAstroPublishedTrajectory, ESPMode::ThreadSafe> Published = MakeShared<FAstroPublishedTrajectory, ESPMode::ThreadSafe>();
+
+		/** Prediction being built, if any */
+		UE::Tasks::TTask<TSharedPtr<const FAstroTrajectory, ESPMode::ThreadSafe>> Pending;
+
+		/** Inputs of the newest prediction launched; a body of INDEX_NONE means none yet */
+		int32 LaunchedBodyIndex = INDEX_NONE;
+		FAstroOrbitalElements LaunchedElements;
+		TArray<FAstroManeuverNode> LaunchedManeuverNodes;
+	};
+
+	FWatchedCraft* FindWatched(const FAstroOrbitHandle& Craft);
+	const FWatchedCraft* FindWatched(const FAstroOrbitHandle& Craft) const;
+
+	/** Swap in a new trajectory and retire the old one behind the render thread */
+	static void Publish(FAstroPublishedTrajectory& Published, TSharedPtr<const FAstroTrajectory, ESPMode::ThreadSafe> Trajectory);
+
+	TArray<FWatchedCraft> WatchedCraft;
+};